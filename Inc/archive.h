@@ -0,0 +1,98 @@
+#ifndef INC_ARCHIVE_H_
+#define INC_ARCHIVE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Temperature channel value when the sensor has no data */
+#define ARCHIVE_NO_TEMPERATURE      INT16_MIN
+
+/**
+ * @brief Telemetry archive configuration
+ */
+typedef struct
+{
+    uint32_t period_s;              /* sampling period */
+} Archive_Config_t;
+
+/**
+ * @brief Archived sample
+ */
+typedef struct
+{
+    uint32_t time;                  /* archive time, seconds */
+    uint16_t rpm;
+    uint8_t speed;                  /* target speed, % */
+    int16_t temperature;            /* 0.1 C or ARCHIVE_NO_TEMPERATURE */
+} Archive_Sample_t;
+
+/**
+ * @brief Archive state
+ */
+typedef struct
+{
+    uint16_t pages_total;
+    uint16_t pages_used;
+    uint32_t oldest_time;           /* time of the oldest archived sample */
+    uint32_t now;                   /* current archive time */
+    uint16_t pending_samples;       /* samples in RAM waiting for the block to be written */
+    uint32_t write_errors;
+    uint32_t read_errors;           /* double ECC errors, the data read was skipped */
+    uint32_t recovery_us;           /* duration of the boot scan */
+} Archive_Status_t;
+
+/**
+ * @brief Range query result
+ */
+typedef struct
+{
+    uint32_t samples;
+    uint16_t pages_visited;
+    uint16_t blocks_decoded;
+    uint16_t blocks_skipped;        /* blocks outside of the range, not decompressed */
+} Archive_QueryResult_t;
+
+typedef void (*Archive_Callback_t)(const Archive_Sample_t *sample);
+
+/**
+  * @brief Telemetry archive Initialization. Scans the page headers and the newest page to
+  *        find the append position after reset or power loss
+  * @param[in] archive_config configuration
+  * @retval true if initialized
+  */
+bool Archive_Init(const Archive_Config_t *archive_config);
+
+/**
+  * @brief Get current archive time. It counts seconds of device operation and continues
+  *        from the last archived sample after reset
+  */
+uint32_t Archive_GetTime(void);
+
+/**
+  * @brief Takes a sample if the period elapsed and writes the block when it's full. Called from the idle loop
+  */
+void Archive_Process(void);
+
+/**
+  * @brief Get samples in the time range, including the ones not written to flash yet
+  * @param[in] from first time, seconds
+  * @param[in] to last time, seconds
+  * @param[in] callback called for every sample in the range
+  * @param[out] result query statistics, may be NULL
+  */
+void Archive_Query(uint32_t from, uint32_t to, Archive_Callback_t callback, Archive_QueryResult_t *result);
+
+/**
+  * @brief Get archive state
+  */
+void Archive_GetStatus(Archive_Status_t *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_ARCHIVE_H_ */
@@ -0,0 +1,61 @@
+#ifndef INC_BOOT_H_
+#define INC_BOOT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ Boot phase timestamps. The cycle counter is started in SystemInit(), right
+ after reset, each phase end is marked with the time since then. Cycles are
+ converted with the core clock at the start of the phase, so the clock
+ configuration phase, which ends at 80 MHz, is slightly overestimated.
+*/
+
+#ifndef FAST_BOOT
+#define FAST_BOOT               1
+#endif
+
+/* MSI clock after reset */
+#define BOOT_RESET_CLOCK_MHZ    4
+
+/**
+ * @brief Boot phases in their order
+ */
+typedef enum
+{
+    Boot_Phase_Startup = 0,         /* reset to main(): SystemInit, .data and .bss initialization */
+    Boot_Phase_HAL,                 /* HAL_Init */
+    Boot_Phase_Clock,               /* SystemClock_Config */
+    Boot_Phase_Peripherals,         /* GPIO, CRC, I2C, UART */
+    Boot_Phase_Devices,             /* UserFunctions_Init, device init is deferred in fast boot */
+    Boot_Phase_Console,             /* banner printed, waiting for commands */
+    Boot_Phase_Deferred,            /* background device init finished */
+    Boot_Phase_Count
+} Boot_Phase_t;
+
+/**
+  * @brief Record the end of the phase
+  */
+void Boot_Mark(Boot_Phase_t phase);
+
+/**
+  * @brief Get end time of the phase
+  * @param[out] time_us microseconds since reset
+  * @retval false if the phase hasn't finished yet
+  */
+bool Boot_GetTime(Boot_Phase_t phase, uint32_t *time_us);
+
+/**
+  * @brief Get phase name
+  */
+const char* Boot_GetPhaseName(Boot_Phase_t phase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_BOOT_H_ */
@@ -0,0 +1,83 @@
+#ifndef INC_CRC_H_
+#define INC_CRC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ CRC service with two backends giving identical results:
+ - hardware: the CRC peripheral fed by 32-bit writes, a byte at a time only
+   for the unaligned head and tail
+ - software: table-driven, a byte per table lookup
+
+ The hardware unit has one state, a context keeps the intermediate value and
+ loads it back on every update, so computations may be interleaved. The unit
+ is not locked, so it must not be used from interrupt handlers.
+*/
+
+/**
+ * @brief CRC algorithms
+ */
+typedef enum
+{
+    Crc_Type_CCITT16 = 0,           /* CRC-16/CCITT-FALSE: poly 0x1021, init 0xFFFF, not reflected */
+    Crc_Type_CRC32,                 /* CRC-32 (IEEE 802.3): poly 0x04C11DB7 reflected, init and xorout 0xFFFFFFFF */
+    Crc_Type_Count
+} Crc_Type_t;
+
+typedef enum
+{
+    Crc_Backend_Hardware = 0,
+    Crc_Backend_Software,
+    Crc_Backend_Count
+} Crc_Backend_t;
+
+/* Backend of Crc_Compute(), the host builds have no CRC peripheral */
+#ifndef CRC_COMPUTE_BACKEND
+#define CRC_COMPUTE_BACKEND         Crc_Backend_Hardware
+#endif
+
+/**
+ * @brief Incremental computation state
+ */
+typedef struct
+{
+    Crc_Type_t type;
+    Crc_Backend_t backend;
+    uint32_t value;                 /* register value, reflected for the reflected types */
+} Crc_Context_t;
+
+/**
+  * @brief Enable the CRC peripheral clock and build the software tables
+  */
+void Crc_Init(void);
+
+/**
+  * @brief Start computation
+  */
+void Crc_Start(Crc_Context_t *ctx, Crc_Type_t type, Crc_Backend_t backend);
+
+/**
+  * @brief Add data
+  */
+void Crc_Update(Crc_Context_t *ctx, const void *data, uint32_t len);
+
+/**
+  * @brief Get CRC of the data added so far, the computation may be continued
+  */
+uint32_t Crc_Finish(const Crc_Context_t *ctx);
+
+/**
+  * @brief Compute CRC of a buffer with CRC_COMPUTE_BACKEND
+  */
+uint32_t Crc_Compute(Crc_Type_t type, const void *data, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_CRC_H_ */
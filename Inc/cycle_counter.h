@@ -0,0 +1,37 @@
+#ifndef INC_CYCLE_COUNTER_H_
+#define INC_CYCLE_COUNTER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "stm32l4xx.h"
+
+/**
+ * @brief Convert CPU cycles to microseconds at the current core clock
+ */
+#define CYCLES_TO_US(cycles)    ((uint32_t)(cycles) / (SystemCoreClock / 1000000U))
+
+/**
+ * @brief Enable DWT cycle counter
+ */
+static inline void CycleCounter_Init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+ * @brief Get current value of the free running cycle counter
+ */
+static inline uint32_t CycleCounter_Get(void)
+{
+    return DWT->CYCCNT;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_CYCLE_COUNTER_H_ */
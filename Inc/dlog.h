@@ -0,0 +1,100 @@
+#ifndef INC_DLOG_H_
+#define INC_DLOG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+/*
+ Deferred logging.
+
+ With DLOG_ENABLED=1 a log site doesn't format anything on the device. The
+ format string is placed into the ".dlog_strings" section, which the linker
+ script keeps in the ELF at address 0 but never loads to flash, so the string
+ address is its ID. A log call stores the ID, a millisecond timestamp and up to
+ 4 raw 32-bit arguments into a RAM ring; DLog_Flush() sends the records over
+ the console in binary frames and the host decoder (host/dlog_decoder) looks
+ the format up in the ELF and prints the message.
+
+ The arguments are captured as 32-bit words, so integer conversions (%d %i
+ %u %x %X %c %p, with flags/width/l) are supported and %s works only for
+ constant strings the decoder can find in the ELF (string literals, const
+ name tables). With DLOG_ENABLED=0 the macro is plain printf.
+*/
+
+#ifndef DLOG_ENABLED
+#define DLOG_ENABLED            0
+#endif
+
+#define DLOG_MAX_ARGS           4
+
+/* Frame: DLOG_SYNC0, DLOG_SYNC1, word count, then little-endian words */
+#define DLOG_SYNC0              0xDB
+#define DLOG_SYNC1              0x10
+
+/* Record header word: string ID (16 bits) | argument count << 16 */
+#define DLOG_HEADER(id, nargs)  (((uint32_t)(uintptr_t)(id) & 0xFFFF) | ((uint32_t)(nargs) << 16))
+
+/**
+ * @brief Deferred logging statistics
+ */
+typedef struct
+{
+    uint32_t records;           /* records written to the ring */
+    uint32_t dropped;           /* records lost because the ring was full */
+    uint32_t cycles_total;      /* CPU cycles spent in the log calls */
+    uint32_t cycles_max;
+} DLog_Stats_t;
+
+#if DLOG_ENABLED
+
+#define DLOG_NARGS(...)         DLOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, N, ...) N
+
+#define DLOG(fmt, ...)                                                                      \
+    do                                                                                      \
+    {                                                                                       \
+        static const char dlog_fmt[] __attribute__((section(".dlog_strings"), used)) = fmt; \
+        static_assert(DLOG_NARGS(__VA_ARGS__) <= DLOG_MAX_ARGS, "DLOG: too many args");     \
+        DLog_Write(DLOG_HEADER(dlog_fmt, DLOG_NARGS(__VA_ARGS__)), ##__VA_ARGS__);          \
+    } while(0)
+
+/**
+ * @brief Store log record into the ring. Use DLOG() instead of calling it directly
+ * @param[in] header record header, see DLOG_HEADER
+ * @param[in] ... arguments, converted to 32-bit words
+ */
+void DLog_Write(uint32_t header, ...);
+
+#else
+
+#define DLOG(fmt, ...)          printf(fmt, ##__VA_ARGS__)
+
+#endif /* DLOG_ENABLED */
+
+/**
+ * @brief Send stored records over the console in binary frames. Does nothing with DLOG_ENABLED=0
+ */
+void DLog_Flush(void);
+
+/**
+ * @brief Check if the ring is more than half full, for callers deferring DLog_Flush(). Always false with DLOG_ENABLED=0
+ */
+bool DLog_IsHalfFull(void);
+
+/**
+ * @brief Get deferred logging statistics
+ * @param[out] stats
+ */
+void DLog_GetStats(DLog_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_DLOG_H_ */
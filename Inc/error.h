@@ -1,11 +1,18 @@
 #ifndef INC_ERROR_H_
 #define INC_ERROR_H_
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
   * @brief  This function is executed in case of error occurrence.
   * @retval None
   */
 void Error_Handler(void);
 
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* INC_ERROR_H_ */
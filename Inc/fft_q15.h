@@ -0,0 +1,36 @@
+#ifndef INC_FFT_Q15_H_
+#define INC_FFT_Q15_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define FFT_Q15_MAX_LENGTH      256
+
+/**
+ * @brief Pack complex Q15 value into a word: real part in the low halfword, imaginary in the high one
+ */
+#define FFT_Q15_PACK(re, im)    (((uint32_t)(uint16_t)(re)) | ((uint32_t)(uint16_t)(im) << 16))
+#define FFT_Q15_RE(value)       ((int16_t)((value) & 0xFFFF))
+#define FFT_Q15_IM(value)       ((int16_t)((value) >> 16))
+
+/**
+  * @brief Build twiddle table for FFT_Q15_MAX_LENGTH points
+  */
+void FFT_Q15_Init(void);
+
+/**
+  * @brief In-place radix-2 complex FFT on packed Q15 data. Every stage is scaled by 1/2,
+  *        so the output is scaled by 1/length and can't overflow
+  * @param[in,out] data packed complex values, see FFT_Q15_PACK
+  * @param[in] length power of 2, up to FFT_Q15_MAX_LENGTH
+  */
+void FFT_Q15_Run(uint32_t *data, uint16_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_FFT_Q15_H_ */
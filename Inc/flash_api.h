@@ -0,0 +1,69 @@
+#ifndef INC_FLASH_API_H_
+#define INC_FLASH_API_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ Internal flash access. Addresses are always given in the current memory map:
+ the running bank is at FLASH_BASE and the other one at FLASH_BASE +
+ FLASH_BANK_SIZE, no matter which physical bank the device booted from
+ (SYSCFG FB_MODE). The page erase takes a physical bank, the mapping is
+ resolved here.
+*/
+
+/**
+  * @brief Check if the device runs from the physical bank 2
+  */
+bool FlashAPI_IsBankSwapped(void);
+
+/**
+  * @brief Erase pages
+  * @param[in] addr address of the first page
+  * @param[in] pages number of pages
+  * @retval true if erased
+  */
+bool FlashAPI_Erase(uint32_t addr, uint32_t pages);
+
+/**
+  * @brief Program double-words, the destination should be erased
+  * @param[in] addr 8-byte aligned address
+  * @param[in] data
+  * @param[in] len bytes, multiple of 8
+  * @retval true if programmed
+  */
+bool FlashAPI_Program(uint32_t addr, const void *data, uint32_t len);
+
+/**
+  * @brief Double ECC error handler, called from NMI_Handler(). A read of a double-word torn
+  *        by a reset during programming or erase raises the NMI, the failing address is
+  *        recorded and the read returns garbage
+  * @retval true if the NMI was a flash double ECC error, false for another source
+  */
+bool FlashAPI_ECC_NMIHandler(void);
+
+/**
+  * @brief Check and clear the double ECC error recorded since the last call. Called before
+  *        reading data that may be torn to drop an old error, and after to check the data
+  * @param[out] addr failing double-word in the current memory map, may be NULL
+  * @retval true if a read failed since the last call
+  */
+bool FlashAPI_ReadFailed(uint32_t *addr);
+
+/**
+  * @brief Select the bank to boot from with the BFB2 option bit and reload the option
+  *        bytes, which resets the device
+  * @param[in] bank2 true to boot from the physical bank 2
+  * @retval false if the option bytes can't be programmed, otherwise doesn't return
+  */
+bool FlashAPI_SetBootBank(bool bank2);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_FLASH_API_H_ */
@@ -0,0 +1,83 @@
+#ifndef INC_GORILLA_H_
+#define INC_GORILLA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ Gorilla-style time series compression of samples with a 32-bit timestamp
+ and GORILLA_CHANNELS 32-bit values.
+
+ The first sample is stored raw. Timestamps then go as delta-of-delta:
+   '0'                  same delta as before
+   '10'   + 7 bits      -64..63
+   '110'  + 9 bits      -256..255
+   '1110' + 12 bits     -2048..2047
+   '1111' + 32 bits     anything else
+ Values go as XOR with the previous value of the channel:
+   '0'                  unchanged
+   '10'   + bits        meaningful bits fit the previous leading/trailing zero window
+   '11'   + 5 bits leading zeros + 5 bits (length - 1) + length bits
+ Bits are written MSB first.
+*/
+
+#define GORILLA_CHANNELS        3
+
+/* Worst case sample size: timestamp '1111' + 32, every channel '11' + 5 + 5 + 32 */
+#define GORILLA_MAX_SAMPLE_BITS (4 + 32 + GORILLA_CHANNELS * (2 + 5 + 5 + 32))
+
+/**
+ * @brief Encoder/decoder state
+ */
+typedef struct
+{
+    uint8_t *buffer;
+    uint16_t size;                      /* bytes */
+    uint16_t bit_pos;
+    uint16_t count;                     /* samples */
+    uint32_t timestamp;
+    int32_t delta;
+    uint32_t values[GORILLA_CHANNELS];
+    uint8_t leading[GORILLA_CHANNELS];
+    uint8_t trailing[GORILLA_CHANNELS];
+} Gorilla_State_t;
+
+/**
+  * @brief Start encoding into an empty buffer
+  */
+void Gorilla_EncoderInit(Gorilla_State_t *state, uint8_t *buffer, uint16_t size);
+
+/**
+  * @brief Append sample
+  * @param[in] timestamp should not decrease
+  * @param[in] values GORILLA_CHANNELS values
+  * @retval false if the buffer has no room for a worst case sample, nothing is written then
+  */
+bool Gorilla_Encode(Gorilla_State_t *state, uint32_t timestamp, const uint32_t *values);
+
+/**
+  * @brief Get number of bytes used by the encoded samples
+  */
+uint16_t Gorilla_GetLength(const Gorilla_State_t *state);
+
+/**
+  * @brief Start decoding of the encoded buffer
+  */
+void Gorilla_DecoderInit(Gorilla_State_t *state, const uint8_t *buffer, uint16_t length);
+
+/**
+  * @brief Decode next sample. The padding of the last byte may look like a sample,
+  *        so the number of samples should be stored along with the buffer
+  * @retval false if the buffer is exhausted
+  */
+bool Gorilla_Decode(Gorilla_State_t *state, uint32_t *timestamp, uint32_t *values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_GORILLA_H_ */
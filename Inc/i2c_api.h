@@ -8,6 +8,56 @@ extern "C" {
 #include <stdbool.h>
 #include "main.h"
 
+/**
+ * @brief Class of a failed I2C transfer
+ */
+typedef enum
+{
+    I2C_API_Error_NACK = 0,     /* address or data not acknowledged */
+    I2C_API_Error_ARLO,         /* arbitration lost */
+    I2C_API_Error_BERR,         /* misplaced START/STOP */
+    I2C_API_Error_Timeout,      /* SCL held low, bus busy or transfer not completed in time */
+    I2C_API_Error_Other,
+    I2C_API_Error_Count
+} I2C_API_ErrorClass_t;
+
+/**
+ * @brief Error and recovery counters
+ */
+typedef struct
+{
+    uint32_t errors[I2C_API_Error_Count];
+    uint32_t retries;           /* transfers repeated after an error */
+    uint32_t failures;          /* transfers failed after all retries */
+    uint32_t resets;            /* peripheral software resets */
+    uint32_t bus_clears;        /* 9 SCL pulses + STOP sequences */
+    uint32_t reinits;           /* full peripheral re-initializations */
+} I2C_API_ErrorCounters_t;
+
+/* Bus clock rates of I2C_API_SetSpeed() */
+#define I2C_API_SPEED_STANDARD          100000U
+#define I2C_API_SPEED_FAST              400000U
+
+#define I2C_API_STATS_SLOTS             8
+/* Bucket 0: < 2 us, bucket n: [2^n, 2^(n+1)) us, the last one collects everything above */
+#define I2C_API_LATENCY_BUCKETS         16
+
+/**
+ * @brief Transfer metrics of one target address
+ */
+typedef struct
+{
+    uint8_t address;            /* 8-bit I2C address, 0 - free slot */
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t bytes;
+    uint32_t retries;
+    uint32_t failures;
+    uint32_t errors[I2C_API_Error_Count];
+    uint32_t latency_total_us;  /* including retries and recovery */
+    uint32_t latency_max_us;
+    uint32_t latency_histogram[I2C_API_LATENCY_BUCKETS];
+} I2C_API_AddressStats_t;
 
 
 /**
@@ -24,11 +74,18 @@ bool I2C_API_Init(bool fast_speed);
 void I2C_API_DeInit(void);
 
 /**
-  * @brief  Set I2C speed.
+  * @brief  Set I2C speed, kept across the re-initializations of the bus recovery.
+  * @param  i2c_speed: I2C_API_SPEED_STANDARD or I2C_API_SPEED_FAST
   * @retval None
   */
 void I2C_API_SetSpeed(uint32_t i2c_speed);
 
+/**
+  * @brief  Get I2C speed.
+  * @retval bus clock, Hz
+  */
+uint32_t I2C_API_GetSpeed(void);
+
 /**
   * @brief  I2C writes a single data.
   * @param  Addr: I2C address
@@ -69,6 +126,24 @@ bool I2C_API_ReadMultiple(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t l
   */
 
 bool I2C_API_WriteMultiple(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length);
+
+/**
+  * @brief  Same as I2C_API_ReadMultiple(), programmed through CR2/TXDR/RXDR instead of
+  *         HAL_I2C_Mem_Read(): register address write and repeated START read in one call,
+  *         without the HAL state checks and tick polling. Same retries, recovery and metrics.
+  * @param  Length: up to 255 bytes
+  * @retval true on success
+  */
+bool I2C_API_ReadDirect(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length);
+
+/**
+  * @brief  Same as I2C_API_WriteMultiple(), programmed through CR2/TXDR instead of
+  *         HAL_I2C_Mem_Write().
+  * @param  Length: up to 254 bytes
+  * @retval true on success
+  */
+bool I2C_API_WriteDirect(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length);
+
 /**
   * @brief  I2C checks if target device is ready for communication.
   * @note   This function is used with Memory devices
@@ -78,6 +153,47 @@ bool I2C_API_WriteMultiple(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t
   */
 HAL_StatusTypeDef I2C_API_IsDeviceReady(uint16_t DevAddress, uint32_t Trials);
 
+/**
+  * @brief  Fast address-only probe with a bounded sub-millisecond timeout.
+  *         Doesn't touch device registers and doesn't count NACK as an error.
+  * @param  addr: 8-bit I2C address
+  * @retval true if the address has been acknowledged
+  */
+bool I2C_API_Probe(uint8_t addr);
+
+/**
+  * @brief  Get error and recovery counters.
+  * @param  counters: copy of the counters
+  * @retval None
+  */
+void I2C_API_GetErrorCounters(I2C_API_ErrorCounters_t *counters);
+
+/**
+  * @brief  Reset error and recovery counters.
+  * @retval None
+  */
+void I2C_API_ResetErrorCounters(void);
+
+/**
+  * @brief  Get transfer metrics of a target address.
+  * @param  item: index of the address slot, 0..I2C_API_STATS_SLOTS-1
+  * @retval pointer to the metrics or NULL if the slot is free
+  */
+const I2C_API_AddressStats_t* I2C_API_GetStats(uint8_t item);
+
+/**
+  * @brief  Reset transfer metrics of all addresses.
+  * @retval None
+  */
+void I2C_API_ResetStats(void);
+
+/**
+  * @brief  Get printable name of error class.
+  * @param  error: error class
+  * @retval name
+  */
+const char* I2C_API_GetErrorName(I2C_API_ErrorClass_t error);
+
 #ifdef __cplusplus
 }
 #endif
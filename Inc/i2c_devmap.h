@@ -0,0 +1,84 @@
+#ifndef INC_I2C_DEVMAP_H_
+#define INC_I2C_DEVMAP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define I2C_DEVMAP_MAX_ENTRIES  16
+
+/**
+ * @brief Known device types
+ */
+typedef enum
+{
+    I2C_Device_Unknown = 0,
+    I2C_Device_MAX6650,
+    I2C_Device_HTS221,
+    I2C_Device_LSM6DSL,
+    I2C_Device_LPS22HB,
+    I2C_Device_Count
+} I2C_DeviceType_t;
+
+/**
+ * @brief Device found on the bus
+ */
+typedef struct
+{
+    uint8_t address;            /* 8-bit I2C address */
+    I2C_DeviceType_t type;
+} I2C_DevMap_Entry_t;
+
+/**
+  * @brief Scans addresses 0x08..0x77 with address-only probes, identifies known parts
+  *        by their register signatures and caches the result
+  * @retval number of devices found
+  */
+uint8_t I2C_DevMap_Scan(void);
+
+/**
+  * @brief Same as I2C_DevMap_Scan(), but probes only the addresses the known parts may have.
+  *        Unknown devices are not listed
+  * @retval number of devices found
+  */
+uint8_t I2C_DevMap_ScanKnown(void);
+
+/**
+  * @brief Get number of devices found by the last scan
+  */
+uint8_t I2C_DevMap_GetCount(void);
+
+/**
+  * @brief Get device found by the last scan
+  * @param[in] item index of device
+  * @retval pointer to the entry or NULL
+  */
+const I2C_DevMap_Entry_t* I2C_DevMap_GetEntry(uint8_t item);
+
+/**
+  * @brief Look up address of a known device in the cached map
+  * @param[in] type device type
+  * @param[out] address 8-bit I2C address
+  * @retval true if the device has been found by the last scan
+  */
+bool I2C_DevMap_Find(I2C_DeviceType_t type, uint8_t *address);
+
+/**
+  * @brief Get duration of the last scan
+  * @retval microseconds
+  */
+uint32_t I2C_DevMap_GetScanTime(void);
+
+/**
+  * @brief Get printable name of device type
+  */
+const char* I2C_DevMap_GetName(I2C_DeviceType_t type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_I2C_DEVMAP_H_ */
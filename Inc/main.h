@@ -12,6 +12,10 @@ extern "C" {
 #define ST_LINK_USART1_TX_GPIO_Port     GPIOB
 #define ST_LINK_USART1_RX_Pin           GPIO_PIN_7
 #define ST_LINK_USART1_RX_GPIO_Port     GPIOB
+#define I2C2_SCL_Pin                    GPIO_PIN_10
+#define I2C2_SCL_GPIO_Port              GPIOB
+#define I2C2_SDA_Pin                    GPIO_PIN_11
+#define I2C2_SDA_GPIO_Port              GPIOB
 
 
 #ifdef __cplusplus
@@ -0,0 +1,79 @@
+#ifndef INC_STREAM_H_
+#define INC_STREAM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ Streaming telemetry frame (host decoder: host/stream_decoder):
+
+   STREAM_SYNC, seq, flags, fields..., sum
+
+ seq is the 8-bit sample counter, a gap means dropped frames. flags holds
+ STREAM_FLAG_KEYFRAME and a bit per field present in the frame, fields go in
+ Stream_Field_t order as LEB128 varints. A keyframe carries all fields as
+ absolute values. Other frames carry only the fields changed since the
+ previous frame sent: the timestamp as an unsigned delta (always present),
+ the rest as zigzag-encoded signed deltas. sum is the 8-bit sum of the bytes
+ from seq to the last field.
+*/
+
+#define STREAM_SYNC                 0xA5
+#define STREAM_FLAG_KEYFRAME        0x80
+#define STREAM_KEYFRAME_INTERVAL    64
+/* Ctrl+C stops streaming */
+#define STREAM_STOP_CHAR            0x03
+
+#define STREAM_DEFAULT_RATE_HZ      100
+#define STREAM_MAX_RATE_HZ          1000
+
+/**
+ * @brief Frame fields
+ */
+typedef enum
+{
+    Stream_Field_Timestamp = 0,     /* ms since the start of streaming */
+    Stream_Field_TargetSpeed,       /* % */
+    Stream_Field_RPM,               /* from the tachometer count */
+    Stream_Field_KTach,             /* speed register */
+    Stream_Field_Alarm,             /* MAX6650_ALARM_xxx bits */
+    Stream_Field_Count
+} Stream_Field_t;
+
+/**
+ * @brief Statistics of the last streaming session
+ */
+typedef struct
+{
+    uint16_t rate_hz;
+    uint32_t samples;               /* samples taken, each gets a sequence number */
+    uint32_t frames;                /* frames queued for transmission */
+    uint32_t dropped;               /* frames dropped because the host didn't keep up */
+    uint32_t overruns;              /* sample slots skipped because sampling took too long */
+    uint32_t bytes;                 /* frame bytes sent */
+    uint32_t duration_ms;
+} Stream_Stats_t;
+
+/**
+  * @brief Sample the fan controller at fixed rate and push telemetry frames until
+  *        STREAM_STOP_CHAR is received. Frames are transmitted from a ring without
+  *        waiting for the UART, a frame that doesn't fit into the ring is dropped.
+  * @param[in] rate_hz sample rate 1..STREAM_MAX_RATE_HZ
+  * @retval false if the rate is out of range
+  */
+bool Stream_Run(uint16_t rate_hz);
+
+/**
+  * @brief Get statistics of the last streaming session
+  */
+void Stream_GetStats(Stream_Stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_STREAM_H_ */
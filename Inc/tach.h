@@ -0,0 +1,69 @@
+#ifndef INC_TACH_H_
+#define INC_TACH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ Fan speed from the tach signal on a timer input, next to the MAX6650 pulse
+ count (one 8-bit count per gate, 0.25..2 s).
+
+ The fan's open-drain tach output is wired to PA1 (TIM2_CH2, Arduino D0 on
+ the B-L475E-IOT01A) as well as to the MAX6650 TACH0 input. Channel 2 of the
+ timebase timer captures the falling edges and DMA1 channel 7 copies the
+ captured microsecond times into a circular ring, so edges cost no CPU. A
+ timebase event takes the new ones every 10 ms: the time between an edge
+ and the same pulse one revolution earlier is a revolution period, and the
+ speed is the median of the last seven, so there is a new reading per
+ revolution and the periods upset by a spurious or missed edge are voted
+ out. Once the speed is known, an edge within a quarter of a pulse interval
+ of the previous one is ringing and dropped. When no edge comes for two
+ revolutions (or 0.5 s before the speed is known) the fan is taken as
+ stalled and the measurement starts over with the next edges.
+
+ With TACH_CAPTURE=0 (the default, the line needs a wire) the functions do
+ nothing and Tach_GetRPM() fails.
+*/
+
+#ifndef TACH_CAPTURE
+#define TACH_CAPTURE            0
+#endif
+
+/* Tach pulses per revolution, as the MAX6650 driver assumes */
+#define TACH_PULSES_PER_REV     2
+
+/**
+ * @brief Tachometer state
+ */
+typedef struct
+{
+    uint32_t period_us;             /* median revolution period, 0 if stalled */
+    uint32_t age_us;                /* since the last edge */
+    uint32_t edges;                 /* captured since Tach_Init() */
+    uint32_t rejected;              /* edges taken as noise */
+    uint32_t stalls;                /* times the edges have stopped */
+    bool stalled;                   /* no edges, or not a revolution yet */
+} Tach_Info_t;
+
+/**
+ * @brief Set up the capture input, its DMA and the edge processing. Needs Timebase_Init()
+ */
+void Tach_Init(void);
+
+/**
+ * @brief Get the fan speed from the tach edges
+ * @param[out] rpm fan speed in revolutions per minute, 0 if stalled
+ * @param[out] info tachometer state, may be NULL
+ * @retval true if the speed is measured, false if the fan is stalled or TACH_CAPTURE=0
+ */
+bool Tach_GetRPM(uint16_t *rpm, Tach_Info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_TACH_H_ */
@@ -0,0 +1,84 @@
+#ifndef INC_THERMAL_H_
+#define INC_THERMAL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Point of the temperature -> fan speed curve
+ */
+typedef struct
+{
+    int16_t temperature;        /* 0.1 degC */
+    uint8_t speed;              /* 0..100% */
+} Thermal_CurvePoint_t;
+
+/**
+ * @brief Thermal control loop configuration
+ */
+typedef struct
+{
+    const Thermal_CurvePoint_t *curve;  /* sorted by ascending temperature, speeds 0 or MAX6650_GetMinSpeed()..100 */
+    uint8_t curve_points;
+    int16_t hysteresis;                 /* 0.1 degC, applied on falling temperature */
+    uint32_t update_period_ms;          /* default period used by Thermal_Enable() */
+} Thermal_Config_t;
+
+/**
+ * @brief Thermal control loop state
+ */
+typedef struct
+{
+    bool enabled;
+    bool valid;                         /* at least one measurement is available */
+    int16_t temperature;                /* 0.1 degC */
+    uint16_t humidity;                  /* 0.1 %rH */
+    uint8_t speed;                      /* last speed written to the fan controller */
+    uint32_t update_period_ms;
+} Thermal_Status_t;
+
+/**
+  * @brief Thermal control loop Initialization. Sensor and fan controller should be initialized before
+  * @param[in] thermal_config loop configuration, must stay valid while the loop is used
+  * @retval true if initialized, false also if the curve has a speed the fan controller can't set
+  */
+bool Thermal_Init(const Thermal_Config_t *thermal_config);
+
+/**
+  * @brief Enable/disable the control loop
+  * @param[in] period_ms update period, 0 disables the loop
+  */
+void Thermal_SetUpdatePeriod(uint32_t period_ms);
+
+/**
+  * @brief Enable the control loop with the configured default update period
+  */
+void Thermal_Enable(void);
+
+/**
+  * @brief Piecewise-linear lookup in the configured curve
+  * @param[in] temperature 0.1 degC
+  * @retval fan speed 0..100%
+  */
+uint8_t Thermal_CurveLookup(int16_t temperature);
+
+/**
+  * @brief Get the current state of the control loop
+  * @param[out] status
+  */
+void Thermal_GetStatus(Thermal_Status_t *status);
+
+/**
+  * @brief Runs one step of the control loop if the update period elapsed. Called from the idle loop
+  */
+void Thermal_Process(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_THERMAL_H_ */
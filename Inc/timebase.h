@@ -0,0 +1,83 @@
+#ifndef INC_TIMEBASE_H_
+#define INC_TIMEBASE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ Microsecond timebase. TIM2 counts at 1 MHz over its 32 bits and its update
+ interrupt counts the wraps (every 71.6 minutes) into the upper word of a
+ 64-bit time that doesn't wrap. Timebase_NowUs() reads both without locking
+ and accounts for a wrap whose interrupt hasn't run yet, so it can be called
+ from any interrupt and with interrupts disabled.
+
+ Timer events call a function at a given time, once or periodically. They
+ are kept in a list sorted by deadline, the first one is loaded into the
+ compare channel 1 of TIM2 and the callbacks run from its interrupt, so
+ they should be short. A periodic event keeps its phase: the next deadline
+ is the previous one plus the period, periods missed because the interrupt
+ was held up are skipped and counted.
+*/
+
+typedef void (*Timebase_Callback_t)(void *context);
+
+/**
+ * @brief Timer event, owned by the caller and left alone while it's started
+ */
+typedef struct Timebase_Event
+{
+    Timebase_Callback_t callback;
+    void *context;
+    uint64_t deadline_us;
+    uint32_t period_us;             /* 0 for a one-shot event */
+    bool active;
+    struct Timebase_Event *next;
+
+    /* Time from the deadline to the call, kept over restarts. Zero the event to clear */
+    uint32_t calls;
+    uint32_t late_min_us;
+    uint32_t late_max_us;
+    uint64_t late_total_us;
+    uint32_t overruns;              /* periods skipped */
+} Timebase_Event_t;
+
+/**
+ * @brief Start TIM2 at 1 MHz and its interrupt
+ */
+void Timebase_Init(void);
+
+/**
+ * @brief Microseconds since Timebase_Init()
+ */
+uint64_t Timebase_NowUs(void);
+
+/**
+ * @brief Start an event, restarts it if it's already started. May be called from a callback
+ * @param[in] event
+ * @param[in] delay_us time to the first call
+ * @param[in] period_us time between the calls, 0 for one call
+ * @param[in] callback called from the TIM2 interrupt
+ * @param[in] context passed to the callback
+ */
+void Timebase_Start(Timebase_Event_t *event, uint32_t delay_us, uint32_t period_us,
+                    Timebase_Callback_t callback, void *context);
+
+/**
+ * @brief Stop an event, nothing happens if it isn't started. May be called from a callback
+ */
+void Timebase_Stop(Timebase_Event_t *event);
+
+/**
+ * @brief TIM2 interrupt handler
+ */
+void Timebase_IRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_TIMEBASE_H_ */
@@ -6,8 +6,45 @@ extern "C" {
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include "termcolor.h"
 
+/**
+ * @brief Piece of console output sent by DMA without copying: constant text in flash
+ *        or a field formatted into a scratch buffer
+ */
+typedef struct
+{
+    const char *data;
+    uint16_t length;
+} UartAPI_Segment_t;
+
+/**
+ * @brief Output put together from segments, see UartAPI_OutputInit()
+ */
+typedef struct
+{
+    UartAPI_Segment_t *segments;
+    uint16_t capacity;
+    uint16_t count;
+    char *scratch;
+    uint16_t scratch_size;
+    uint16_t scratch_used;
+    bool overflow;              /* a segment or field didn't fit and was dropped */
+} UartAPI_Output_t;
+
+/**
+ * @brief Ways of sending a block, compared by the "uart_bench" command
+ */
+typedef enum
+{
+    UartAPI_TxPath_HAL = 0,         /* HAL_UART_Transmit() per character, the console before usart_ll.h */
+    UartAPI_TxPath_WaitTC,          /* UartAPI_SendChar(), waits for TC after every character */
+    UartAPI_TxPath_WaitTXE,         /* usart_ll.h, the next character is written as soon as TDR is free */
+    UartAPI_TxPath_Count
+} UartAPI_TxPath_t;
+
 
 /**
   * @brief USART1 Initialization Function
@@ -32,12 +69,110 @@ char UartAPI_GetChar(void);
 void UartAPI_SendString(char *c, int len);
 
 /**
- * @brief Print menu with information about commands
+ * @brief Send a block straight to the USART, past the batch reply buffer. Returns when the
+ *        last character is out
+ */
+void UartAPI_SendRaw(UartAPI_TxPath_t path, const char *data, uint32_t len);
+
+/**
+ * @brief Get the console baud rate
+ */
+uint32_t UartAPI_GetBaudRate(void);
+
+/**
+ * @brief Switch the console to another baud rate. The client confirms by sending the rate
+ *        in decimal and Enter at the new rate, the old rate is restored if it doesn't within 1 s.
+ *        0 arms auto baud rate detection: the next 'U' (0x55) received sets the rate
+ * @retval true if the rate has been switched or detection armed
+ */
+bool UartAPI_SwitchBaudRate(uint32_t baud);
+
+/**
+ * @brief Start interrupt driven reception into the RX ring buffer. Used for binary
+ *        transfers which can't be polled between the flash operations
+ */
+void UartAPI_RxBufferStart(void);
+
+/**
+ * @brief Stop interrupt driven reception and drop the buffered bytes
+ */
+void UartAPI_RxBufferStop(void);
+
+/**
+ * @brief Get byte from the RX ring buffer
+ * @retval true if there was a byte
+ */
+bool UartAPI_RxBufferGet(char *c);
+
+/**
+ * @brief Get number of bytes lost because the RX ring buffer was full
+ */
+uint32_t UartAPI_RxBufferOverflows(void);
+
+/**
+ * @brief USART1 interrupt handler
+ */
+void UartAPI_IRQHandler(void);
+
+/**
+ * @brief Send segments one after another by chaining DMA transfers. Returns once the first one is
+ *        started, the others are loaded from the transfer complete interrupt. Text printed before
+ *        goes first, text printed after waits for the chain. The segments and the text they point
+ *        to must stay valid until then
+ */
+void UartAPI_SendSegments(const UartAPI_Segment_t *segments, uint16_t count);
+
+/**
+ * @brief DMA1 channel 4 (USART1 TX) interrupt handler, loads the next segment
+ */
+void UartAPI_TxDMA_IRQHandler(void);
+
+/**
+ * @brief Start an output
+ * @param[out] out
+ * @param[in] segments room for capacity segments
+ * @param[in] scratch buffer for the formatted fields
+ */
+void UartAPI_OutputInit(UartAPI_Output_t *out, UartAPI_Segment_t *segments, uint16_t capacity,
+                        char *scratch, uint16_t scratch_size);
+
+/**
+ * @brief Add constant text, referenced and not copied: it must stay valid until sent
+ */
+void UartAPI_OutputText(UartAPI_Output_t *out, const char *text);
+
+/**
+ * @brief Add a field formatted into the scratch buffer, joined to the previous field if adjacent
+ */
+void UartAPI_OutputFormat(UartAPI_Output_t *out, const char *format, ...);
+
+/**
+ * @brief Send the output and wait until it is out of memory, it can be built again after
+ *        UartAPI_OutputInit()
+ */
+void UartAPI_OutputSend(const UartAPI_Output_t *out);
+
+/**
+ * @brief Send the text printed so far, the reply of a command batch and a DMA chain included,
+ *        and wait until the last character is out of the USART
+ */
+void UartAPI_FlushReply(void);
+
+/**
+ * @brief Enable/disable quiet mode for automated clients: no banner and no echo of the typed characters
+ */
+void UartAPI_SetQuiet(bool enable);
+
+/**
+ * @brief Print menu with information about commands. The segments referencing the command
+ *        names are put together on the first call and sent by DMA from then on
  */
 void UartAPI_PrintMenu(void);
 
 /**
- * @brief Waits for incoming command and execute it
+ * @brief Waits for incoming command and execute it. Arguments are parsed and checked
+ *        against the schema of the command before its handler is called. A line may hold
+ *        a batch of ';' separated commands, executed in order with one reply sent at the end
  */
 void UartAPI_WaitForCommandAndExecute(void);
 
@@ -0,0 +1,115 @@
+#ifndef INC_UPDATE_H_
+#define INC_UPDATE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ Firmware update over the console (host uploader: host/uploader).
+
+ The new image is written to the inactive bank, which is always mapped at
+ FLASH_BASE + FLASH_BANK_SIZE, then the BFB2 option bit selects it for boot.
+ The running bank is left intact for "rollback".
+
+ Host to device frames, multi-byte fields are little-endian:
+
+   UPDATE_SYNC_HOST, type, payload, crc16
+
+   UPDATE_FRAME_START  u32 image length, u32 image CRC-32
+   UPDATE_FRAME_DATA   u16 chunk number, UPDATE_CHUNK_SIZE bytes (the last one padded with 0xFF)
+   UPDATE_FRAME_DONE   no payload
+   UPDATE_FRAME_ABORT  no payload
+
+ crc16 is CRC-16/CCITT (0x1021, init 0xFFFF) of the type and the payload.
+
+ Device to host replies:
+
+   UPDATE_SYNC_DEVICE, Update_Status_t, u16 next expected chunk
+
+ The host keeps up to UPDATE_WINDOW chunks in flight. Every chunk written is
+ acknowledged with the next expected chunk number; on a NAK or a timeout the
+ host goes back to the chunk the device expects. A NAK is sent once per burst
+ of bad frames, chunks already written are acknowledged again and skipped.
+ DONE is answered after the CRC-32 (IEEE 802.3) of the written image is
+ checked. The final status of the session is sent with UPDATE_SEQ_FINAL.
+*/
+
+#define UPDATE_SYNC_HOST            0x55
+#define UPDATE_SYNC_DEVICE          0xAA
+
+#define UPDATE_FRAME_START          'S'
+#define UPDATE_FRAME_DATA           'D'
+#define UPDATE_FRAME_DONE           'E'
+#define UPDATE_FRAME_ABORT          'A'
+
+#define UPDATE_SEQ_FINAL            0xFFFF
+
+#define UPDATE_CHUNK_SIZE           256
+#define UPDATE_WINDOW               8
+/* Same as the FLASH region of the linker script */
+#define UPDATE_MAX_IMAGE_SIZE       (384 * 1024)
+/* No frames received, the session is aborted */
+#define UPDATE_TIMEOUT_MS           5000
+
+/**
+ * @brief Reply status
+ */
+typedef enum
+{
+    Update_Status_OK = 0,
+    Update_Status_BadFrame,         /* frame CRC mismatch or unknown type */
+    Update_Status_BadSeq,           /* chunk out of order, resend from the expected one */
+    Update_Status_FlashError,
+    Update_Status_BadLength,        /* image doesn't fit the bank or is incomplete */
+    Update_Status_BadCRC,           /* image CRC mismatch */
+    Update_Status_Timeout,
+    Update_Status_Aborted
+} Update_Status_t;
+
+/**
+ * @brief Statistics of the last update session
+ */
+typedef struct
+{
+    Update_Status_t status;
+    uint32_t length;                /* image bytes */
+    uint32_t chunks;                /* chunks written */
+    uint32_t duplicates;            /* chunks received again after go-back */
+    uint32_t naks;
+    uint32_t rx_overflows;          /* bytes lost by the UART RX buffer */
+    uint32_t erase_ms;
+    uint32_t duration_ms;           /* from START to DONE */
+} Update_Stats_t;
+
+/**
+  * @brief Receive the image into the inactive bank and verify it. Returns after DONE,
+  *        ABORT, an unrecoverable error or UPDATE_TIMEOUT_MS without frames
+  * @retval true if the image is written and its CRC matches
+  */
+bool Update_Run(void);
+
+/**
+  * @brief Get statistics of the last update session
+  */
+void Update_GetStats(Update_Stats_t *stats);
+
+/**
+  * @brief Check that the inactive bank holds a vector table of this device
+  */
+bool Update_IsOtherBankValid(void);
+
+/**
+  * @brief Boot from the inactive bank. Reloads the option bytes, which resets the device
+  * @retval false if the option bytes can't be programmed, otherwise doesn't return
+  */
+bool Update_SwapBank(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_UPDATE_H_ */
@@ -0,0 +1,91 @@
+#ifndef INC_USART_LL_H_
+#define INC_USART_LL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "stm32l4xx.h"
+
+/*
+ Register-level USART access for the console hot path, in place of
+ HAL_UART_Transmit()/HAL_UART_Receive(): no handle lock, state checks or
+ tick timeouts per character. TDR and the shift register are the two
+ transmit buffers: a byte is written as soon as TXE is set, while the
+ previous one is still on the line, and TC is only waited for before the
+ line must be idle (reset, baud rate change). The USART is configured by
+ HAL_UART_Init(), these functions only move data.
+*/
+
+/**
+ * @brief Queue a byte, waits while both buffers are full
+ */
+static inline void UsartLL_PutChar(USART_TypeDef *usart, uint8_t c)
+{
+    while(!(usart->ISR & USART_ISR_TXE_Msk))
+    {
+    }
+    usart->TDR = c;
+}
+
+/**
+ * @brief Queue a byte if TDR is free, never waits
+ * @retval false if both buffers are full
+ */
+static inline bool UsartLL_TryPutChar(USART_TypeDef *usart, uint8_t c)
+{
+    if(!(usart->ISR & USART_ISR_TXE_Msk))
+    {
+        return false;
+    }
+    usart->TDR = c;
+    return true;
+}
+
+/**
+ * @brief Queue bytes, returns when the last one is in TDR
+ */
+static inline void UsartLL_Write(USART_TypeDef *usart, const uint8_t *data, uint32_t len)
+{
+    for(uint32_t i = 0; i < len; i++)
+    {
+        UsartLL_PutChar(usart, data[i]);
+    }
+}
+
+/**
+ * @brief Wait until the last byte has left the shift register
+ */
+static inline void UsartLL_WaitIdle(USART_TypeDef *usart)
+{
+    while(!(usart->ISR & USART_ISR_TC_Msk))
+    {
+    }
+}
+
+/**
+ * @brief Take the received byte if there is one
+ * @retval false if nothing has been received
+ */
+static inline bool UsartLL_TryGetChar(USART_TypeDef *usart, uint8_t *c)
+{
+    /* An overrun would block further reception */
+    if(usart->ISR & USART_ISR_ORE_Msk)
+    {
+        usart->ICR = USART_ICR_ORECF;
+    }
+
+    if(!(usart->ISR & USART_ISR_RXNE_Msk))
+    {
+        return false;
+    }
+    *c = (uint8_t)usart->RDR;
+    return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_USART_LL_H_ */
@@ -6,26 +6,82 @@ extern "C" {
 #endif
 
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include "termcolor.h"
 
+/* Size of the largest argument struct of a command */
+#define COMMAND_ARGS_MAX_SIZE   16
+
+/**
+ * @brief Type of the argument struct field a command argument is stored to
+ */
+typedef enum
+{
+    Command_ArgType_U8,
+    Command_ArgType_U16,
+    Command_ArgType_U32,
+    Command_ArgType_I32
+} Command_ArgType_t;
+
+/**
+ * @brief Command argument: decimal number in the comma separated list after the command name
+ */
+typedef struct
+{
+    const char *name;
+    Command_ArgType_t type;
+    uint8_t offset;             /* of the field in the argument struct */
+    bool optional;              /* missing or empty takes the default */
+    int32_t min;
+    int32_t max;
+    int32_t def;                /* not range checked, e.g. -1 for "not given" */
+} Command_Arg_t;
+
+/**
+ * @brief Argument schema entry for a field of an argument struct
+ */
+#define COMMAND_ARG(args_type, field, type, optional, min, max, def) \
+    {#field, type, offsetof(args_type, field), optional, min, max, def}
+
+/**
+ * @brief Schema and count for a Command_t entry, COMMAND_NO_ARGS for commands without arguments
+ */
+#define COMMAND_ARGS(schema)    schema, (sizeof(schema) / sizeof(schema[0]))
+#define COMMAND_NO_ARGS         NULL, 0
+
 /**
- * @brief Typedef for user commands
+ * @brief Typedef for user commands. The handler gets the parsed arguments as its
+ *        argument struct, NULL for commands without arguments
  */
 typedef struct
 {
-    bool (*run)(int);
+    bool (*run)(const void *args);
     const char *command_name;
     const char *command_param;
+    const Command_Arg_t *args;
+    uint8_t args_count;
 } Command_t;
 
 
 /**
-  * @brief UserFunctiond Initialization
+  * @brief UserFunctiond Initialization. With FAST_BOOT device init is deferred to
+  *        UserFunctions_Process(), a task per call
   * @retval true if initialized
   */
 bool UserFunctions_Init(void);
 
+/**
+  * @brief Finish deferred device init. Called before a command is executed
+  */
+void UserFunctions_CompleteInit(void);
+
+/**
+  * @brief Background processing of user functions. Called while the console waits for input
+  */
+void UserFunctions_Process(void);
+
 /**
   * @brief Get count of user functions
   * @retval count of functions
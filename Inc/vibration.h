@@ -0,0 +1,72 @@
+#ifndef INC_VIBRATION_H_
+#define INC_VIBRATION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define VIBRATION_FFT_LENGTH    256
+
+/**
+ * @brief Accelerometer axis used for the analysis
+ */
+typedef enum
+{
+    Vibration_Axis_X = 0,
+    Vibration_Axis_Y,
+    Vibration_Axis_Z
+} Vibration_Axis_t;
+
+/**
+ * @brief Vibration analysis configuration
+ */
+typedef struct
+{
+    Vibration_Axis_t axis;
+    uint32_t block_period_ms;           /* time between the starts of two analyzed blocks */
+} Vibration_Config_t;
+
+/**
+ * @brief Result of the last analyzed block
+ */
+typedef struct
+{
+    bool valid;
+    uint32_t blocks;                    /* analyzed blocks since start */
+    uint16_t sample_rate;               /* Hz */
+    uint16_t fan_rpm;
+    uint16_t rotation_freq;             /* 0.1 Hz */
+    uint16_t rotation_amplitude;        /* mg, spectral peak around the fan rotation frequency */
+    uint16_t peak_freq;                 /* 0.1 Hz */
+    uint16_t peak_amplitude;            /* mg, highest peak of the spectrum */
+    uint16_t rms;                       /* mg, AC part of the signal */
+    uint32_t fft_cycles;                /* CPU cycles of the FFT */
+    uint32_t analysis_cycles;           /* CPU cycles of windowing + FFT + peak search */
+} Vibration_Status_t;
+
+/**
+  * @brief Vibration analysis Initialization. LSM6DSL and fan controller should be initialized before
+  * @param[in] vibration_config analysis configuration, must stay valid while the analysis is used
+  * @retval true if initialized
+  */
+bool Vibration_Init(const Vibration_Config_t *vibration_config);
+
+/**
+  * @brief Get result of the last analyzed block
+  * @param[out] status
+  */
+void Vibration_GetStatus(Vibration_Status_t *status);
+
+/**
+  * @brief Runs capture/drain/analysis state machine. Called from the idle loop
+  */
+void Vibration_Process(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_VIBRATION_H_ */
@@ -0,0 +1,507 @@
+/*
+ Telemetry archive on the host flash.
+
+ Usage: archive_test
+
+ src/archive.c, src/gorilla.c and the software CRC are built for the host
+ with the flash of host/pty_device (flash_host.cpp, in memory, the archive
+ region at the addresses of the linker script). The tick is a counter
+ advanced by the test, so a sampling period takes no time; the fan and the
+ thermal loop are stand-ins giving a scripted series with steps, noise,
+ sub-degree negative temperatures and gaps without a temperature.
+
+ The cases run on one flash in order: the Gorilla round trip on its own,
+ the archive round trip, range queries, reset recovery, a reset in the
+ middle of a block write and the wrap of the page ring. Every sample fed is
+ kept here and a query must give it back unchanged. A reset drops the
+ samples not written yet. Exits with 1 if a check fails.
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "stm32l4xx_hal.h"
+#include "archive.h"
+#include "gorilla.h"
+#include "flash_api.h"
+#include "crc.h"
+#include "max6650.h"
+#include "thermal.h"
+#include "flash_host.h"
+#include "check.h"
+
+#define PERIOD_S                    10
+
+/* Layout of src/archive.c, to find the end of the newest page */
+#define PAGE_MAGIC                  0xA4C1
+#define BLOCK_MAGIC                 0xB10C
+#define PAGE_HEADER_SIZE            8
+#define BLOCK_HEADER_SIZE           16
+#define ALIGN8(len)                 (((len) + 7) & ~7U)
+
+extern "C" uint32_t _sarchive;
+extern "C" uint32_t _earchive;
+
+static const Archive_Config_t config = {PERIOD_S};
+
+static uint32_t tick;
+static uint32_t step;
+static std::vector<Archive_Sample_t> fed;
+static std::vector<Archive_Sample_t> got;
+
+
+/* CPU and peripherals archive.c and crc.c look at, the shim is not linked */
+uint32_t SystemCoreClock = 80000000;
+CRC_TypeDef shim_crc;
+uint32_t shim_primask;
+static DWT_Type dwt;
+
+
+DWT_Type* shim_dwt(void)
+{
+    return &dwt;
+}
+
+
+uint32_t HAL_GetTick(void)
+{
+    return tick;
+}
+
+
+/* Fan and thermal loop: the scripted series of the current step */
+static uint16_t scripted_rpm(void)
+{
+    /* Ramps, a steady part and a stop */
+    if((step % 400) < 100)
+    {
+        return (uint16_t)(600 + 27 * (step % 100));
+    }
+    if((step % 400) < 350)
+    {
+        return (uint16_t)(3300 + (step * 7919) % 41);
+    }
+    return 0;
+}
+
+
+static int16_t scripted_temperature(void)
+{
+    /* Around 0 C: -1.5 .. +1.4 C */
+    return (int16_t)((int)(step % 30) - 15);
+}
+
+
+static bool scripted_temperature_valid(void)
+{
+    return (step % 97) >= 5;
+}
+
+
+bool MAX6650_GetRPM(uint16_t *rpm, uint32_t max_age_ms, MAX6650_ReadInfo_t *info)
+{
+    (void)max_age_ms;
+    (void)info;
+    *rpm = scripted_rpm();
+    return true;
+}
+
+
+uint8_t MAX6650_GetTargetSpeed(void)
+{
+    return (uint8_t)((step / 50) % 101);
+}
+
+
+void Thermal_GetStatus(Thermal_Status_t *status)
+{
+    memset(status, 0, sizeof(*status));
+    status->valid = scripted_temperature_valid();
+    status->temperature = scripted_temperature();
+}
+
+
+/**
+ * @brief Let one sampling period pass and keep the sample the archive takes
+ */
+static void feed(uint32_t count)
+{
+    Archive_Sample_t sample;
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+        tick += PERIOD_S * 1000;
+        step++;
+
+        sample.time = Archive_GetTime();
+        sample.rpm = scripted_rpm();
+        sample.speed = MAX6650_GetTargetSpeed();
+        sample.temperature = scripted_temperature_valid() ? scripted_temperature() : ARCHIVE_NO_TEMPERATURE;
+
+        Archive_Process();
+        fed.push_back(sample);
+    }
+}
+
+
+/**
+ * @brief Device reset: the samples in RAM are lost, the archive is scanned again
+ */
+static void reset(void)
+{
+    Archive_Status_t status;
+
+    Archive_GetStatus(&status);
+    fed.resize(fed.size() - status.pending_samples);
+
+    tick += 12345;
+    CHECK(Archive_Init(&config));
+}
+
+
+static void collect(const Archive_Sample_t *sample)
+{
+    got.push_back(*sample);
+}
+
+
+static Archive_QueryResult_t query(uint32_t from, uint32_t to)
+{
+    Archive_QueryResult_t result;
+
+    got.clear();
+    Archive_Query(from, to, collect, &result);
+    CHECK_EQ(result.samples, got.size());
+    return result;
+}
+
+
+/**
+ * @brief Compare the samples queried with the ones fed in the range
+ */
+static void check_range(uint32_t from, uint32_t to)
+{
+    std::vector<Archive_Sample_t> expected;
+    size_t bad = 0;
+
+    for(const Archive_Sample_t &sample : fed)
+    {
+        if((sample.time >= from) && (sample.time <= to))
+        {
+            expected.push_back(sample);
+        }
+    }
+
+    CHECK_EQ(got.size(), expected.size());
+    for(size_t i = 0; (i < got.size()) && (i < expected.size()); i++)
+    {
+        if((got[i].time != expected[i].time) || (got[i].rpm != expected[i].rpm) ||
+           (got[i].speed != expected[i].speed) || (got[i].temperature != expected[i].temperature))
+        {
+            if(bad++ == 0)
+            {
+                fprintf(stderr, "sample %zu: %u s %u rpm %u %% %d, expected %u s %u rpm %u %% %d\n", i,
+                        got[i].time, got[i].rpm, got[i].speed, got[i].temperature,
+                        expected[i].time, expected[i].rpm, expected[i].speed, expected[i].temperature);
+            }
+        }
+    }
+    CHECK_EQ(bad, 0);
+}
+
+
+/**
+ * @brief Address after the last block of the newest page, where the next block goes
+ */
+static uint32_t append_addr(void)
+{
+    uint32_t newest = 0;
+    uint16_t newest_seq = 0;
+    bool found = false;
+    uint32_t pos;
+
+    for(uint32_t page = (uintptr_t)&_sarchive; page < (uintptr_t)&_earchive; page += FLASH_PAGE_SIZE)
+    {
+        const uint16_t *header = (const uint16_t *)(uintptr_t)page;
+
+        if((header[0] == PAGE_MAGIC) && (!found || ((int16_t)(header[1] - newest_seq) > 0)))
+        {
+            newest = page;
+            newest_seq = header[1];
+            found = true;
+        }
+    }
+    CHECK(found);
+
+    for(pos = newest + PAGE_HEADER_SIZE; pos + BLOCK_HEADER_SIZE <= newest + FLASH_PAGE_SIZE;)
+    {
+        const uint16_t *header = (const uint16_t *)(uintptr_t)pos;
+
+        if(header[0] != BLOCK_MAGIC)
+        {
+            break;
+        }
+        pos += BLOCK_HEADER_SIZE + ALIGN8(header[1]);
+    }
+    return pos;
+}
+
+
+static void test_gorilla(void)
+{
+    int failures = check_failures;
+    uint8_t buffer[240];
+    Gorilla_State_t state;
+    std::vector<std::vector<uint32_t>> samples;
+    uint32_t timestamp = 1000;
+    uint32_t values[GORILLA_CHANNELS];
+    uint32_t decoded_time;
+    uint32_t decoded[GORILLA_CHANNELS];
+    uint32_t count = 0;
+
+    /* Every timestamp code: the same delta, changes of -64..63, -256..255, -2048..2047 and more; values from unchanged to any */
+    static const uint32_t deltas[] = {10, 10, 15, 12, 210, 60, 2010, 110, 100010, 10};
+
+    Gorilla_EncoderInit(&state, buffer, sizeof(buffer));
+    for(uint32_t i = 0; ; i++)
+    {
+        timestamp += deltas[i % 10];
+        values[0] = (i % 7 == 0) ? 0xFFFFFFFF : 3000 + (i * 37) % 512;
+        values[1] = (i / 4) % 101;
+        values[2] = (uint32_t)(int32_t)(((i % 3) == 0) ? ARCHIVE_NO_TEMPERATURE : (int32_t)(i % 40) - 20);
+
+        if(Gorilla_Encode(&state, timestamp, values) != true)
+        {
+            break;
+        }
+        samples.push_back({timestamp, values[0], values[1], values[2]});
+        count++;
+    }
+    CHECK(count > 10);
+    CHECK_EQ(state.count, count);
+    CHECK(Gorilla_GetLength(&state) <= sizeof(buffer));
+
+    Gorilla_DecoderInit(&state, buffer, Gorilla_GetLength(&state));
+    for(uint32_t i = 0; i < count; i++)
+    {
+        CHECK(Gorilla_Decode(&state, &decoded_time, decoded));
+        CHECK_EQ(decoded_time, samples[i][0]);
+        for(int c = 0; c < GORILLA_CHANNELS; c++)
+        {
+            CHECK_EQ(decoded[c], samples[i][c + 1]);
+        }
+    }
+
+    check_case("Gorilla round trip, every code", failures);
+}
+
+
+static void test_round_trip(void)
+{
+    int failures = check_failures;
+    Archive_Status_t status;
+    Archive_QueryResult_t result;
+
+    CHECK(Archive_Init(&config));
+    Archive_GetStatus(&status);
+    CHECK_EQ(status.pages_used, 0);
+    CHECK_EQ(status.pages_total, ((uintptr_t)&_earchive - (uintptr_t)&_sarchive) / FLASH_PAGE_SIZE);
+
+    /* Several pages, the last samples still in RAM */
+    feed(3000);
+    Archive_GetStatus(&status);
+    CHECK(status.pages_used > 1);
+    CHECK(status.pending_samples != 0);
+    CHECK_EQ(status.write_errors, 0);
+
+    result = query(0, UINT32_MAX);
+    check_range(0, UINT32_MAX);
+    CHECK_EQ(result.samples, fed.size());
+    CHECK_EQ(result.blocks_skipped, 0);
+
+    check_case("Archive round trip", failures);
+}
+
+
+static void test_range(void)
+{
+    int failures = check_failures;
+    Archive_Status_t status;
+    Archive_QueryResult_t result;
+    Archive_QueryResult_t all;
+    uint32_t from = fed[fed.size() / 2].time;
+    uint32_t to = from + 300 * PERIOD_S;
+
+    Archive_GetStatus(&status);
+    all = query(0, UINT32_MAX);
+
+    /* Middle of the archive: the pages before are passed by the search, the blocks before in the page skipped */
+    result = query(from, to);
+    check_range(from, to);
+    CHECK_EQ(result.samples, 301);
+    CHECK(result.pages_visited < status.pages_used);
+    CHECK(result.blocks_decoded < all.blocks_decoded);
+
+    /* Bounds between samples, and in the last page with the samples in RAM */
+    result = query(from + 1, from + 3 * PERIOD_S - 1);
+    check_range(from + 1, from + 3 * PERIOD_S - 1);
+    CHECK_EQ(result.samples, 2);
+
+    from = fed[fed.size() - status.pending_samples - 5].time;
+    result = query(from, UINT32_MAX);
+    check_range(from, UINT32_MAX);
+    CHECK(result.blocks_skipped != 0);
+
+    /* Before the archive and after now */
+    result = query(status.now + 1, UINT32_MAX);
+    CHECK_EQ(result.samples, 0);
+    result = query(0, fed[0].time - 1);
+    CHECK_EQ(result.samples, 0);
+
+    check_case("Range query, blocks out of the range skipped", failures);
+}
+
+
+static void test_reset(void)
+{
+    int failures = check_failures;
+    Archive_Status_t before;
+    Archive_Status_t after;
+    uint32_t last_stored;
+
+    Archive_GetStatus(&before);
+    reset();
+    last_stored = fed.back().time;
+    Archive_GetStatus(&after);
+
+    CHECK_EQ(after.pages_used, before.pages_used);
+    CHECK_EQ(after.oldest_time, before.oldest_time);
+    CHECK_EQ(after.pending_samples, 0);
+    CHECK_EQ(after.now, last_stored + 1);
+
+    query(0, UINT32_MAX);
+    check_range(0, UINT32_MAX);
+
+    /* Appending goes on in the same page */
+    feed(200);
+    query(0, UINT32_MAX);
+    check_range(0, UINT32_MAX);
+    CHECK(fed.back().time > last_stored);
+
+    check_case("Reset, the append position recovered", failures);
+}
+
+
+static void test_torn_block(void)
+{
+    int failures = check_failures;
+    Archive_Status_t status;
+    uint64_t torn[4];
+    uint16_t *header = (uint16_t *)torn;
+    uint32_t *times = (uint32_t *)&header[4];
+    uint32_t addr;
+    uint32_t last_stored;
+
+    /* Everything in RAM is written, then the next block is torn by a reset: header and one payload double-word */
+    do
+    {
+        feed(1);
+        Archive_GetStatus(&status);
+    }
+    while(status.pending_samples != 0);
+    reset();
+    last_stored = fed.back().time;
+    addr = append_addr();
+
+    memset(torn, 0xA5, sizeof(torn));
+    header[0] = BLOCK_MAGIC;
+    header[1] = 120;
+    header[2] = 30;
+    header[3] = 0x1234;
+    times[0] = last_stored + PERIOD_S;
+    times[1] = last_stored + 30 * PERIOD_S;
+    CHECK(FlashAPI_Program(addr, torn, sizeof(torn)));
+
+    CHECK(Archive_Init(&config));
+    Archive_GetStatus(&status);
+    CHECK_EQ(status.now, last_stored + 1);
+
+    query(0, UINT32_MAX);
+    check_range(0, UINT32_MAX);
+
+    /* The next block goes after the torn one, not over it */
+    feed(100);
+    query(0, UINT32_MAX);
+    check_range(0, UINT32_MAX);
+    reset();
+    CHECK(append_addr() > addr + BLOCK_HEADER_SIZE + ALIGN8(120));
+    query(0, UINT32_MAX);
+    check_range(0, UINT32_MAX);
+
+    check_case("Reset during a block write, torn block skipped", failures);
+}
+
+
+static void test_wrap(void)
+{
+    int failures = check_failures;
+    Archive_Status_t status;
+    Archive_Status_t previous;
+    uint32_t reclaimed = 0;
+
+    /* Until every page has been reclaimed once */
+    Archive_GetStatus(&previous);
+    while(reclaimed < previous.pages_total)
+    {
+        feed(50);
+        Archive_GetStatus(&status);
+        if(status.oldest_time != previous.oldest_time)
+        {
+            reclaimed++;
+        }
+        previous = status;
+    }
+
+    Archive_GetStatus(&status);
+    CHECK_EQ(status.pages_used, status.pages_total);
+    CHECK_EQ(status.write_errors, 0);
+    CHECK_EQ(status.read_errors, 0);
+
+    /* The oldest page is a sample boundary: what remains is the tail of what was fed */
+    query(0, UINT32_MAX);
+    check_range(status.oldest_time, UINT32_MAX);
+    CHECK(!got.empty() && (got.front().time == status.oldest_time));
+
+    query(status.oldest_time + 1000, status.oldest_time + 5000);
+    check_range(status.oldest_time + 1000, status.oldest_time + 5000);
+
+    reset();
+    Archive_GetStatus(&status);
+    CHECK_EQ(status.pages_used, status.pages_total);
+    query(0, UINT32_MAX);
+    check_range(status.oldest_time, UINT32_MAX);
+
+    check_case("Page ring wrap, oldest pages reclaimed", failures);
+}
+
+
+int main(void)
+{
+    Crc_Init();
+    if(!FlashHost_Map(FlashHost_Open(""), false))
+    {
+        fprintf(stderr, "Can't map the flash at 0x%08lX\n", (unsigned long)FLASH_BASE);
+        return 1;
+    }
+
+    test_gorilla();
+    test_round_trip();
+    test_range();
+    test_reset();
+    test_torn_block();
+    test_wrap();
+
+    return check_result();
+}
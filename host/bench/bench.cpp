@@ -0,0 +1,368 @@
+/*
+ Host benchmarks of the firmware hot paths (see targets.h).
+
+ Usage: bench [--benchmark_filter=<regex>] [--benchmark_min_time=<seconds>]
+              [--benchmark_format=console|json] [--benchmark_out=<file>]
+
+ The options and the JSON layout follow Google Benchmark, so its tools
+ (compare.py) can diff the results of two commits. The number of iterations
+ is grown until a benchmark runs for at least the minimum time.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "targets.h"
+
+#ifndef GIT_COMMIT
+#define GIT_COMMIT                  "unknown"
+#endif
+
+#define MAX_ITERATIONS              1000000000ULL
+#define CRC_MAX_SIZE                (256 * 1024)
+
+/* Must match Crc_Type_t in Inc/crc.h */
+#define CRC_TYPE_CCITT16            0
+#define CRC_TYPE_CRC32              1
+
+struct Benchmark
+{
+    std::string name;
+    std::function<uint32_t(uint64_t)> run;      /* runs the given number of iterations */
+    uint64_t bytes_per_iteration;
+};
+
+struct Result
+{
+    std::string name;
+    uint64_t iterations;
+    double real_ns;                             /* per iteration */
+    double cpu_ns;
+    double bytes_per_second;
+};
+
+static volatile uint32_t sink;
+
+
+static double cpu_time_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static Result run_benchmark(const Benchmark &benchmark, double min_time_s)
+{
+    uint64_t iterations = 1;
+    Result result = {benchmark.name, 0, 0, 0, 0};
+
+    while(1)
+    {
+        auto start = std::chrono::steady_clock::now();
+        double cpu_start = cpu_time_s();
+
+        sink = sink + benchmark.run(iterations);
+
+        double cpu_s = cpu_time_s() - cpu_start;
+        double real_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if((real_s >= min_time_s) || (iterations >= MAX_ITERATIONS))
+        {
+            result.iterations = iterations;
+            result.real_ns = real_s * 1e9 / iterations;
+            result.cpu_ns = cpu_s * 1e9 / iterations;
+            result.bytes_per_second = benchmark.bytes_per_iteration * iterations / (cpu_s > 0 ? cpu_s : real_s);
+            return result;
+        }
+
+        /* Aim 40% above the minimum time, grow at most 10x per step */
+        double factor = (real_s > 0) ? min_time_s * 1.4 / real_s : 10;
+        factor = factor > 10 ? 10 : factor;
+        iterations = (uint64_t)(iterations * factor) + 1;
+    }
+}
+
+
+static std::vector<Benchmark> make_benchmarks(const std::vector<uint8_t> &crc_input)
+{
+    std::vector<Benchmark> list;
+
+    static const char *dispatch_lines[] = {"set_fan_speed,50", "help", "no_such_command"};
+    for(const char *line : dispatch_lines)
+    {
+        list.push_back({std::string("dispatch/") + line, [line](uint64_t n) {
+            uint32_t res = 0;
+            for(uint64_t i = 0; i < n; i++) res += Targets_Dispatch(line);
+            return res;
+        }, 0});
+    }
+
+    static const uint8_t speeds[] = {0, 50, 100};
+    for(uint8_t speed : speeds)
+    {
+        list.push_back({"max6650/SetSpeed/" + std::to_string(speed), [speed](uint64_t n) {
+            uint32_t res = 0;
+            for(uint64_t i = 0; i < n; i++) res += Targets_Max6650SetSpeed(speed);
+            return res;
+        }, 0});
+    }
+
+    list.push_back({"max6650/GetRPM", [](uint64_t n) {
+        uint32_t res = 0;
+        for(uint64_t i = 0; i < n; i++) res += Targets_Max6650GetRPM();
+        return res;
+    }, 0});
+
+    list.push_back({"format/printf_status", [](uint64_t n) {
+        uint32_t res = 0;
+        for(uint64_t i = 0; i < n; i++) res += Targets_PrintStatus((int)(i % 101));
+        return res;
+    }, 0});
+
+    list.push_back({"format/dlog_status", [](uint64_t n) {
+        uint32_t res = 0;
+        for(uint64_t i = 0; i < n; i++) res += Targets_DLogStatus((int)(i % 101));
+        return res;
+    }, 0});
+
+    list.push_back({"format/menu_printf", [](uint64_t n) {
+        uint32_t res = 0;
+        for(uint64_t i = 0; i < n; i++) res += Targets_PrintMenuPrintf();
+        return res;
+    }, 0});
+
+    list.push_back({"format/menu_segments", [](uint64_t n) {
+        uint32_t res = 0;
+        for(uint64_t i = 0; i < n; i++) res += Targets_PrintMenu();
+        return res;
+    }, 0});
+
+    list.push_back({"ring/dlog_write", [](uint64_t n) {
+        uint32_t res = 0;
+        for(uint64_t i = 0; i < n; i++) res += Targets_DLogWrite((int)i);
+        return res;
+    }, 0});
+
+    list.push_back({"ring/uart_rx", [](uint64_t n) {
+        uint32_t res = 0;
+        for(uint64_t i = 0; i < n; i++) res += Targets_RxRing((uint8_t)i);
+        return res;
+    }, 1});
+
+    static const struct { int type; const char *name; } crc_types[] =
+    {
+        {CRC_TYPE_CCITT16, "CCITT16"},
+        {CRC_TYPE_CRC32, "CRC32"}
+    };
+    for(const auto &crc : crc_types)
+    {
+        for(uint32_t len = 64; len <= CRC_MAX_SIZE; len *= 16)
+        {
+            const uint8_t *data = crc_input.data();
+            int type = crc.type;
+            list.push_back({std::string("crc/") + crc.name + "/" + std::to_string(len), [type, data, len](uint64_t n) {
+                uint32_t res = 0;
+                for(uint64_t i = 0; i < n; i++) res += Targets_Crc(type, data, len);
+                return res;
+            }, len});
+        }
+    }
+
+    return list;
+}
+
+
+static std::string json_escape(const std::string &text)
+{
+    std::string res;
+
+    for(char c : text)
+    {
+        if(c == '"' || c == '\\')
+        {
+            res += '\\';
+        }
+        res += c;
+    }
+
+    return res;
+}
+
+
+static std::string to_json(const std::vector<Result> &results, const char *executable)
+{
+    std::ostringstream out;
+    char date[64];
+    char host[256] = "";
+    time_t now = time(nullptr);
+
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+    gethostname(host, sizeof(host) - 1);
+
+    out << "{\n  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+    out << "    \"host_name\": \"" << json_escape(host) << "\",\n";
+    out << "    \"executable\": \"" << json_escape(executable) << "\",\n";
+    out << "    \"num_cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << ",\n";
+    out << "    \"library_build_type\": \"release\",\n";
+    out << "    \"git_commit\": \"" << GIT_COMMIT << "\"\n";
+    out << "  },\n  \"benchmarks\": [\n";
+
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const Result &r = results[i];
+        out << "    {\n";
+        out << "      \"name\": \"" << json_escape(r.name) << "\",\n";
+        out << "      \"run_name\": \"" << json_escape(r.name) << "\",\n";
+        out << "      \"run_type\": \"iteration\",\n";
+        out << "      \"iterations\": " << r.iterations << ",\n";
+        out << "      \"real_time\": " << r.real_ns << ",\n";
+        out << "      \"cpu_time\": " << r.cpu_ns << ",\n";
+        if(r.bytes_per_second != 0)
+        {
+            out << "      \"bytes_per_second\": " << r.bytes_per_second << ",\n";
+        }
+        out << "      \"time_unit\": \"ns\"\n";
+        out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+
+static bool option(const char *arg, const char *name, std::string &value)
+{
+    size_t len = strlen(name);
+
+    if((strncmp(arg, name, len) != 0) || (arg[len] != '='))
+    {
+        return false;
+    }
+
+    value = arg + len + 1;
+    return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+    std::string filter = ".";
+    std::string format = "console";
+    std::string out_file;
+    double min_time_s = 0.5;
+    std::string value;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(option(argv[i], "--benchmark_filter", value))
+        {
+            filter = value;
+        }
+        else if(option(argv[i], "--benchmark_min_time", value))
+        {
+            /* Google Benchmark accepts a trailing "s" */
+            min_time_s = atof(value.c_str());
+        }
+        else if(option(argv[i], "--benchmark_format", value))
+        {
+            format = value;
+        }
+        else if(option(argv[i], "--benchmark_out", value))
+        {
+            out_file = value;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--benchmark_filter=<regex>] [--benchmark_min_time=<seconds>]\n"
+                            "          [--benchmark_format=console|json] [--benchmark_out=<file>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(((format != "console") && (format != "json")) || (min_time_s <= 0))
+    {
+        fprintf(stderr, "Bad format or minimum time\n");
+        return 1;
+    }
+
+    std::regex filter_regex;
+    try
+    {
+        filter_regex = std::regex(filter);
+    }
+    catch(const std::regex_error &)
+    {
+        fprintf(stderr, "Bad filter: %s\n", filter.c_str());
+        return 1;
+    }
+
+    std::vector<uint8_t> crc_input(CRC_MAX_SIZE);
+    for(size_t i = 0; i < crc_input.size(); i++)
+    {
+        crc_input[i] = (uint8_t)(i * 2654435761U >> 24);
+    }
+
+    /* The firmware sources print to the fake UART, the real stdout is used for the report only */
+    Targets_Init();
+
+    std::vector<Result> results;
+    if(format == "console")
+    {
+        printf("%-28s %14s %14s %12s\n", "Benchmark", "Time", "CPU", "Iterations");
+    }
+
+    for(const Benchmark &benchmark : make_benchmarks(crc_input))
+    {
+        if(!std::regex_search(benchmark.name, filter_regex))
+        {
+            continue;
+        }
+
+        Result r = run_benchmark(benchmark, min_time_s);
+        results.push_back(r);
+
+        if(format == "console")
+        {
+            printf("%-28s %11.1f ns %11.1f ns %12llu", r.name.c_str(), r.real_ns, r.cpu_ns, (unsigned long long)r.iterations);
+            if(r.bytes_per_second != 0)
+            {
+                printf(" %8.1f MB/s", r.bytes_per_second / 1e6);
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+
+    std::string json = to_json(results, argv[0]);
+    if(format == "json")
+    {
+        fputs(json.c_str(), stdout);
+    }
+
+    if(!out_file.empty())
+    {
+        std::ofstream out(out_file);
+        out << json;
+        if(!out)
+        {
+            fprintf(stderr, "Can't write %s\n", out_file.c_str());
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,293 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "stm32l4xx_hal.h"
+#include "user_functions.h"
+#include "uart_api.h"
+#include "crc.h"
+#include "dlog.h"
+#include "max6650.h"
+#include "targets.h"
+
+#define DLOG_FLUSH_PERIOD       32
+
+static uint32_t handler_calls;
+static const char *input = "";
+static uint64_t tx_bytes;
+static uint8_t max6650_registers[0x20];
+
+static MAX6650_Config_t max6650_config =
+{
+    .add_line_connection = ADD_Line_GND,
+    .rpm_max = 10500U,
+    .fan_lovtage = FanVoltage_12V,
+    .operating_mode = OperatingMode_Closed_Loop,
+    .k_scale = KScale_16
+};
+
+
+void shim_uart_write(const uint8_t *data, uint32_t len)
+{
+    (void)data;
+    tx_bytes += len;
+}
+
+
+void shim_uart_set_baud(uint32_t baud)
+{
+    (void)baud;
+}
+
+
+uint32_t shim_uart_host_baud(void)
+{
+    return 0;
+}
+
+
+uint64_t shim_tach_interval_ns(void)
+{
+    return 0;
+}
+
+
+bool shim_uart_read(uint8_t *byte, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+
+    if(*input == '\0')
+    {
+        return false;
+    }
+    *byte = (uint8_t)*input++;
+    return true;
+}
+
+
+typedef struct
+{
+    uint8_t speed;
+    uint8_t fan;
+    uint16_t ramp_ms;
+} Args_SetFanSpeed_t;
+
+static const Command_Arg_t set_fan_speed_args[] =
+{
+    COMMAND_ARG(Args_SetFanSpeed_t, speed, Command_ArgType_U8, false, 0, 100, 0),
+    COMMAND_ARG(Args_SetFanSpeed_t, ramp_ms, Command_ArgType_U16, true, 0, 60000, 0),
+    COMMAND_ARG(Args_SetFanSpeed_t, fan, Command_ArgType_U8, true, 0, 0, 0)
+};
+
+
+static bool command_stub(const void *args)
+{
+    (void)args;
+    handler_calls++;
+    return true;
+}
+
+
+static bool set_fan_speed_stub(const void *args)
+{
+    handler_calls += ((const Args_SetFanSpeed_t *)args)->speed;
+    return true;
+}
+
+
+/* Names, order and schemas of commands_list in src/user_functions.c, the dispatch cost depends on them */
+static Command_t commands[] =
+{
+    {set_fan_speed_stub, "set_fan_speed", "", COMMAND_ARGS(set_fan_speed_args)},
+    {command_stub, "get_fan_speed", "", COMMAND_NO_ARGS},
+    {command_stub, "stream", "", COMMAND_NO_ARGS},
+    {command_stub, "history", "", COMMAND_NO_ARGS},
+    {command_stub, "get_temperature", "", COMMAND_NO_ARGS},
+    {command_stub, "thermal", "", COMMAND_NO_ARGS},
+    {command_stub, "get_vibration", "", COMMAND_NO_ARGS},
+    {command_stub, "i2c_errors", "", COMMAND_NO_ARGS},
+    {command_stub, "scan", "", COMMAND_NO_ARGS},
+    {command_stub, "i2c_stats", "", COMMAND_NO_ARGS},
+    {command_stub, "i2c_reset_stats", "", COMMAND_NO_ARGS},
+    {command_stub, "dlog_stats", "", COMMAND_NO_ARGS},
+    {command_stub, "boot_times", "", COMMAND_NO_ARGS},
+    {command_stub, "crc_bench", "", COMMAND_NO_ARGS},
+    {command_stub, "uart_bench", "", COMMAND_NO_ARGS},
+    {command_stub, "i2c_bench", "", COMMAND_NO_ARGS},
+    {command_stub, "timer_bench", "", COMMAND_NO_ARGS},
+    {command_stub, "update", "", COMMAND_NO_ARGS},
+    {command_stub, "rollback", "", COMMAND_NO_ARGS},
+    {command_stub, "self_erase", "", COMMAND_NO_ARGS},
+    {command_stub, "quiet", "", COMMAND_NO_ARGS},
+    {command_stub, "baud", "", COMMAND_NO_ARGS},
+    {command_stub, "help", "", COMMAND_NO_ARGS}
+};
+
+
+uint8_t UserFunctions_GetFuncCount(void)
+{
+    return sizeof(commands) / sizeof(commands[0]);
+}
+
+
+Command_t* UserFunctions_GetFunc(uint8_t item)
+{
+    return &commands[item];
+}
+
+
+void UserFunctions_CompleteInit(void)
+{
+}
+
+
+void UserFunctions_Process(void)
+{
+}
+
+
+static bool fake_i2c_setup(bool fast_speed)
+{
+    (void)fast_speed;
+    return true;
+}
+
+
+static bool fake_i2c_read(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length)
+{
+    (void)addr;
+    memcpy(buffer, &max6650_registers[reg], length);
+    return true;
+}
+
+
+static bool fake_i2c_write(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length)
+{
+    (void)addr;
+    memcpy(&max6650_registers[reg], buffer, length);
+    return true;
+}
+
+
+static const struct MAX6650_I2C_ExtInterface fake_i2c =
+{
+    .i2c_setup = fake_i2c_setup,
+    .i2c_read = fake_i2c_read,
+    .i2c_write = fake_i2c_write
+};
+
+
+void Targets_Init(void)
+{
+    Crc_Init();
+    UartAPI_Init();
+    MAX6650_Init(&max6650_config, &fake_i2c);
+    /* Tachometer count at about half speed */
+    max6650_registers[0x0C] = 175;
+    /* Resets the ring, Targets_RxRing() calls the interrupt handler itself */
+    UartAPI_RxBufferStart();
+    UartAPI_RxBufferStop();
+}
+
+
+uint32_t Targets_Dispatch(const char *line)
+{
+    static char typed[64];
+
+    /* Typed line ends with Enter */
+    snprintf(typed, sizeof(typed), "%s\r", line);
+    input = typed;
+    UartAPI_WaitForCommandAndExecute();
+    return handler_calls;
+}
+
+
+uint32_t Targets_Max6650SetSpeed(uint8_t speed)
+{
+    uint8_t actual = 0;
+
+    MAX6650_SetSpeed(speed, &actual);
+    return actual;
+}
+
+
+uint32_t Targets_Max6650GetRPM(void)
+{
+    uint16_t rpm = 0;
+
+    MAX6650_GetRPM(&rpm, MAX6650_MAX_AGE_FRESH, NULL);
+    return rpm;
+}
+
+
+uint32_t Targets_PrintStatus(int value)
+{
+    return printf(TC_RESET"Fan speed: %d%%, RPM: %d\r\n", value, value * 105);
+}
+
+
+uint32_t Targets_DLogStatus(int value)
+{
+    DLOG(TC_RESET"Fan speed: %d%%, RPM: %d\r\n", value, value * 105);
+    DLog_Flush();
+    return (uint32_t)tx_bytes;
+}
+
+
+uint32_t Targets_PrintMenu(void)
+{
+    UartAPI_PrintMenu();
+    return (uint32_t)tx_bytes;
+}
+
+
+uint32_t Targets_PrintMenuPrintf(void)
+{
+    Command_t *func;
+
+    printf(TC_YELLOW"\r\n\r\nUse next commands to control peripheral devices:\r\n");
+    for(uint8_t i = 0; i < UserFunctions_GetFuncCount(); i++)
+    {
+        func = UserFunctions_GetFunc(i);
+        printf(TC_YELLOW"- %s%s\r\n", func->command_name, func->command_param);
+    }
+    printf("\r\n");
+    fflush(stdout);
+    return (uint32_t)tx_bytes;
+}
+
+
+uint32_t Targets_DLogWrite(int value)
+{
+    static uint32_t count;
+
+    DLOG(TC_RESET"Fan speed: %d%%, RPM: %d\r\n", value, value * 105);
+    if(++count % DLOG_FLUSH_PERIOD == 0)
+    {
+        DLog_Flush();
+    }
+    return count;
+}
+
+
+uint32_t Targets_RxRing(uint8_t value)
+{
+    char byte[2] = {(char)value, '\0'};
+    char c = 0;
+
+    /* The received byte is taken by the model of the RX data register */
+    input = byte;
+    UartAPI_IRQHandler();
+    UartAPI_RxBufferGet(&c);
+
+    return (uint8_t)c;
+}
+
+
+uint32_t Targets_Crc(int type, const void *data, uint32_t len)
+{
+    Crc_Context_t ctx;
+
+    Crc_Start(&ctx, (Crc_Type_t)type, Crc_Backend_Software);
+    Crc_Update(&ctx, data, len);
+    return Crc_Finish(&ctx);
+}
@@ -0,0 +1,65 @@
+#ifndef HOST_BENCH_TARGETS_H_
+#define HOST_BENCH_TARGETS_H_
+
+#include <stdint.h>
+
+/*
+ Benchmarked operations, built from the firmware sources with the HAL shim.
+ Each call is one iteration and returns a value to keep it from being optimized out.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void Targets_Init(void);
+
+/**
+ * @brief Execute a console command line, as if it has been typed
+ */
+uint32_t Targets_Dispatch(const char *line);
+
+uint32_t Targets_Max6650SetSpeed(uint8_t speed);
+uint32_t Targets_Max6650GetRPM(void);
+
+/**
+ * @brief Status line through printf and __io_putchar()
+ */
+uint32_t Targets_PrintStatus(int value);
+
+/**
+ * @brief Same status line as a deferred log record, flushed to the UART
+ */
+uint32_t Targets_DLogStatus(int value);
+
+/**
+ * @brief Console menu as the segment list sent by the DMA channel
+ */
+uint32_t Targets_PrintMenu(void);
+
+/**
+ * @brief Console menu through printf and __io_putchar(), as it was printed before the segment list
+ */
+uint32_t Targets_PrintMenuPrintf(void);
+
+/**
+ * @brief Deferred log record into the RAM ring, the ring is flushed every 32 records
+ */
+uint32_t Targets_DLogWrite(int value);
+
+/**
+ * @brief Byte through the UART RX interrupt handler and out of the RX ring
+ */
+uint32_t Targets_RxRing(uint8_t value);
+
+/**
+ * @brief CRC with the software backend, the hardware one needs the target
+ * @param[in] type Crc_Type_t
+ */
+uint32_t Targets_Crc(int type, const void *data, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_BENCH_TARGETS_H_ */
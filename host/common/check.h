@@ -0,0 +1,59 @@
+#ifndef HOST_COMMON_CHECK_H_
+#define HOST_COMMON_CHECK_H_
+
+#include <cmath>
+#include <cstdio>
+
+/*
+ Assertions of the host tests. A failed check is reported with its line and
+ the values, the test goes on and check_result() gives the exit code.
+*/
+
+static int check_failures;
+
+#define CHECK(condition)                                                                    \
+    do                                                                                      \
+    {                                                                                       \
+        if(!(condition))                                                                    \
+        {                                                                                   \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);  \
+            check_failures++;                                                               \
+        }                                                                                   \
+    }                                                                                       \
+    while(0)
+
+/* actual within tolerance of expected, as numbers */
+#define CHECK_NEAR(actual, expected, tolerance)                                             \
+    do                                                                                      \
+    {                                                                                       \
+        double check_a = (double)(actual);                                                  \
+        double check_e = (double)(expected);                                                \
+        if(std::abs(check_a - check_e) > (double)(tolerance))                               \
+        {                                                                                   \
+            fprintf(stderr, "%s:%d: check failed: %s = %g, expected %g +- %g\n",            \
+                    __FILE__, __LINE__, #actual, check_a, check_e, (double)(tolerance));    \
+            check_failures++;                                                               \
+        }                                                                                   \
+    }                                                                                       \
+    while(0)
+
+#define CHECK_EQ(actual, expected)      CHECK_NEAR(actual, expected, 0)
+
+/**
+ * @brief Print the outcome of a test case
+ */
+static inline void check_case(const char *name, int failures_before)
+{
+    fprintf(stderr, "%-48s %s\n", name, (check_failures == failures_before) ? "ok" : "FAILED");
+}
+
+/**
+ * @brief Exit code of the test program
+ */
+static inline int check_result(void)
+{
+    fprintf(stderr, "%s\n", (check_failures == 0) ? "All checks passed" : "Some checks failed");
+    return (check_failures == 0) ? 0 : 1;
+}
+
+#endif /* HOST_COMMON_CHECK_H_ */
@@ -0,0 +1,235 @@
+#include "dlog_frames.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+
+DLogDecoder::DLogDecoder(const ElfReader *elf, bool timestamps, Output output) :
+    elf(elf), timestamps(timestamps), output(output)
+{
+    if(elf != nullptr)
+    {
+        std::string error;
+
+        strings = FindStrings(*elf, error);
+    }
+}
+
+
+const ElfSection* DLogDecoder::FindStrings(const ElfReader &elf, std::string &error)
+{
+    const ElfSection *section = elf.FindSection(DLOG_SECTION);
+
+    if(section == nullptr)
+    {
+        error = std::string("no ") + DLOG_SECTION + " section, was the firmware built with DLOG=1?";
+    }
+    return section;
+}
+
+
+void DLogDecoder::Feed(uint8_t byte)
+{
+    switch(state)
+    {
+        case State::Text:
+            if(byte == DLOG_SYNC0)
+            {
+                state = State::Sync;
+            }
+            else
+            {
+                PutText((const char *)&byte, 1);
+            }
+            break;
+
+        case State::Sync:
+            if(byte == DLOG_SYNC1)
+            {
+                state = State::Count;
+            }
+            else
+            {
+                const char text[2] = {(char)DLOG_SYNC0, (char)byte};
+
+                PutText(text, sizeof(text));
+                state = State::Text;
+            }
+            break;
+
+        case State::Count:
+            frame_words = byte;
+            word = 0;
+            word_bytes = 0;
+            state = frame_words ? State::Words : State::Text;
+            break;
+
+        case State::Words:
+            word |= (uint32_t)byte << (8 * word_bytes);
+            if(++word_bytes == 4)
+            {
+                PutWord(word);
+                word = 0;
+                word_bytes = 0;
+                if(--frame_words == 0)
+                {
+                    state = State::Text;
+                }
+            }
+            break;
+    }
+}
+
+
+void DLogDecoder::PutWord(uint32_t value)
+{
+    words.push_back(value);
+    DecodeRecords();
+}
+
+
+/**
+ * @brief Decode complete records. Frames may split a record, so the words are queued until it's complete
+ */
+void DLogDecoder::DecodeRecords(void)
+{
+    while(!words.empty())
+    {
+        uint32_t header = words[0];
+        uint32_t nargs = DLOG_NARGS(header);
+        uint32_t id = header & DLOG_ID_MASK;
+        uint32_t args[16];
+        std::string fmt;
+
+        if(words.size() < nargs + 2)
+        {
+            return;
+        }
+
+        for(uint32_t i = 0; i < nargs; i++)
+        {
+            args[i] = words[2 + i];
+        }
+
+        records++;
+        if(strings != nullptr)
+        {
+            std::string text;
+            char buf[64];
+
+            if(timestamps)
+            {
+                snprintf(buf, sizeof(buf), "[%10.3f] ", words[1] / 1000.0);
+                text = buf;
+            }
+
+            if(id < strings->data.size())
+            {
+                fmt.assign((const char *)strings->data.data() + id, strnlen((const char *)strings->data.data() + id, strings->data.size() - id));
+                text += Format(fmt, args, nargs);
+            }
+            else
+            {
+                snprintf(buf, sizeof(buf), "<unknown log record 0x%04X>\n", id);
+                text += buf;
+            }
+            PutText(text.data(), text.size());
+        }
+
+        words.erase(words.begin(), words.begin() + nargs + 2);
+    }
+}
+
+
+/**
+ * @brief printf-like formatting of the captured argument words
+ */
+std::string DLogDecoder::Format(const std::string &fmt, const uint32_t *args, uint32_t nargs)
+{
+    std::string out;
+    uint32_t arg = 0;
+    char buf[256];
+    size_t i = 0;
+
+    while(i < fmt.size())
+    {
+        if(fmt[i] != '%')
+        {
+            out += fmt[i++];
+            continue;
+        }
+
+        /* Conversion spec: flags, width, precision, length are copied to the host printf */
+        size_t start = i++;
+        while((i < fmt.size()) && strchr("-+ #0", fmt[i])) i++;
+        while((i < fmt.size()) && (isdigit((unsigned char)fmt[i]) || (fmt[i] == '.'))) i++;
+        std::string spec = fmt.substr(start, i - start);
+        while((i < fmt.size()) && strchr("hlzjt", fmt[i])) i++;
+
+        if(i >= fmt.size())
+        {
+            out += fmt.substr(start);
+            break;
+        }
+
+        char conv = fmt[i++];
+        if(conv == '%')
+        {
+            out += '%';
+            continue;
+        }
+
+        if(arg >= nargs)
+        {
+            out += "<missing>";
+            continue;
+        }
+
+        uint32_t value = args[arg++];
+        std::string str;
+
+        switch(conv)
+        {
+            case 'd':
+            case 'i':
+                snprintf(buf, sizeof(buf), (spec + "d").c_str(), (int32_t)value);
+                break;
+
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+                snprintf(buf, sizeof(buf), (spec + conv).c_str(), value);
+                break;
+
+            case 'c':
+                snprintf(buf, sizeof(buf), (spec + "c").c_str(), (int)(value & 0xFF));
+                break;
+
+            case 'p':
+                snprintf(buf, sizeof(buf), "0x%08X", value);
+                break;
+
+            case 's':
+                /* Only strings from the loaded image can be resolved */
+                if(elf->ReadString(value, str))
+                {
+                    snprintf(buf, sizeof(buf), (spec + "s").c_str(), str.c_str());
+                }
+                else
+                {
+                    snprintf(buf, sizeof(buf), "<str@0x%08X>", value);
+                }
+                break;
+
+            default:
+                snprintf(buf, sizeof(buf), "<%%%c:0x%08X>", conv, value);
+                break;
+        }
+
+        out += buf;
+    }
+
+    return out;
+}
@@ -0,0 +1,75 @@
+#ifndef HOST_COMMON_DLOG_FRAMES_H_
+#define HOST_COMMON_DLOG_FRAMES_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+
+#include "elf_reader.h"
+
+/*
+ Decoder of the deferred logging frames (see Inc/dlog.h) in the console
+ stream. Plain text is passed through, records are formatted from the
+ ".dlog_strings" section of the firmware ELF. Without the ELF the records are
+ only counted, so the text around them stays intact.
+*/
+
+/* Must match Inc/dlog.h */
+#define DLOG_SYNC0              0xDB
+#define DLOG_SYNC1              0x10
+#define DLOG_SECTION            ".dlog_strings"
+#define DLOG_ID_MASK            0xFFFF
+#define DLOG_NARGS(header)      (((header) >> 16) & 0x0F)
+
+class DLogDecoder
+{
+public:
+    typedef std::function<void(const char *text, size_t len)> Output;
+
+    /**
+     * @param[in] elf firmware image, nullptr to skip the records
+     * @param[in] timestamps prefix every record with its device timestamp
+     * @param[in] output receives the text and the formatted records
+     */
+    DLogDecoder(const ElfReader *elf, bool timestamps, Output output);
+
+    /**
+     * @brief Find the strings section of the image
+     * @param[out] error description if there is none
+     */
+    static const ElfSection* FindStrings(const ElfReader &elf, std::string &error);
+
+    void Feed(uint8_t byte);
+
+    uint64_t Records() const { return records; }
+
+private:
+    enum class State
+    {
+        Text,
+        Sync,
+        Count,
+        Words
+    };
+
+    void PutText(const char *text, size_t len) { output(text, len); }
+    void PutWord(uint32_t word);
+    void DecodeRecords(void);
+    std::string Format(const std::string &fmt, const uint32_t *args, uint32_t nargs);
+
+    const ElfReader *elf;
+    const ElfSection *strings = nullptr;
+    bool timestamps;
+    Output output;
+
+    State state = State::Text;
+    uint32_t frame_words = 0;
+    uint32_t word = 0;
+    uint32_t word_bytes = 0;
+    std::deque<uint32_t> words;
+    uint64_t records = 0;
+};
+
+#endif /* HOST_COMMON_DLOG_FRAMES_H_ */
@@ -0,0 +1,233 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "elf_reader.h"
+
+#define EI_CLASS            4
+#define EI_DATA             5
+#define ELFCLASS32          1
+#define ELFDATA2LSB         1
+
+#define SHT_SYMTAB          2
+#define SHT_NOBITS          8
+#define SHF_ALLOC           0x2
+
+#define ELF_HEADER_SIZE     52
+#define SECTION_HEADER_SIZE 40
+#define PROGRAM_HEADER_SIZE 32
+#define SYMBOL_SIZE         16
+
+
+static uint32_t get_u32(const std::vector<uint8_t> &buf, size_t offset)
+{
+    return buf[offset] | (buf[offset + 1] << 8) | (buf[offset + 2] << 16) | ((uint32_t)buf[offset + 3] << 24);
+}
+
+
+static uint16_t get_u16(const std::vector<uint8_t> &buf, size_t offset)
+{
+    return buf[offset] | (buf[offset + 1] << 8);
+}
+
+
+bool ElfReader::Load(const std::string &path, std::string &error)
+{
+    std::ifstream file(path, std::ios::binary);
+
+    if(!file)
+    {
+        error = "can't open " + path;
+        return false;
+    }
+
+    std::vector<uint8_t> buf((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if((buf.size() < ELF_HEADER_SIZE) || (memcmp(buf.data(), "\x7F" "ELF", 4) != 0))
+    {
+        error = path + " is not an ELF file";
+        return false;
+    }
+
+    if((buf[EI_CLASS] != ELFCLASS32) || (buf[EI_DATA] != ELFDATA2LSB))
+    {
+        error = path + " is not a 32-bit little-endian ELF file";
+        return false;
+    }
+
+    entry = get_u32(buf, 24);
+    uint32_t phoff = get_u32(buf, 28);
+    uint32_t shoff = get_u32(buf, 32);
+    uint16_t phentsize = get_u16(buf, 42);
+    uint16_t phnum = get_u16(buf, 44);
+    uint16_t shentsize = get_u16(buf, 46);
+    uint16_t shnum = get_u16(buf, 48);
+    uint16_t shstrndx = get_u16(buf, 50);
+
+    if((shentsize < SECTION_HEADER_SIZE) || (shstrndx >= shnum) ||
+       ((uint64_t)shoff + (uint64_t)shnum * shentsize > buf.size()))
+    {
+        error = path + ": broken section header table";
+        return false;
+    }
+
+    std::vector<uint32_t> name_offsets;
+    sections.clear();
+
+    for(uint16_t i = 0; i < shnum; i++)
+    {
+        size_t hdr = shoff + (size_t)i * shentsize;
+        ElfSection section;
+        uint32_t offset;
+
+        name_offsets.push_back(get_u32(buf, hdr));
+        section.type = get_u32(buf, hdr + 4);
+        section.flags = get_u32(buf, hdr + 8);
+        section.addr = get_u32(buf, hdr + 12);
+        offset = get_u32(buf, hdr + 16);
+        section.size = get_u32(buf, hdr + 20);
+        section.link = get_u32(buf, hdr + 24);
+
+        if(section.type != SHT_NOBITS)
+        {
+            if((uint64_t)offset + section.size > buf.size())
+            {
+                error = path + ": section data is out of file";
+                return false;
+            }
+            section.data.assign(buf.begin() + offset, buf.begin() + offset + section.size);
+        }
+
+        sections.push_back(section);
+    }
+
+    /* Names are resolved when all sections including the string table are loaded */
+    const std::vector<uint8_t> &names = sections[shstrndx].data;
+    for(size_t i = 0; i < sections.size(); i++)
+    {
+        for(uint32_t pos = name_offsets[i]; (pos < names.size()) && (names[pos] != 0); pos++)
+        {
+            sections[i].name += (char)names[pos];
+        }
+    }
+
+    if((phnum != 0) && ((phentsize < PROGRAM_HEADER_SIZE) ||
+       ((uint64_t)phoff + (uint64_t)phnum * phentsize > buf.size())))
+    {
+        error = path + ": broken program header table";
+        return false;
+    }
+
+    segments.clear();
+
+    for(uint16_t i = 0; i < phnum; i++)
+    {
+        size_t hdr = phoff + (size_t)i * phentsize;
+        ElfSegment segment;
+        uint32_t offset = get_u32(buf, hdr + 4);
+        uint32_t filesz = get_u32(buf, hdr + 16);
+
+        segment.type = get_u32(buf, hdr);
+        segment.vaddr = get_u32(buf, hdr + 8);
+        segment.paddr = get_u32(buf, hdr + 12);
+        segment.memsz = get_u32(buf, hdr + 20);
+
+        if(((uint64_t)offset + filesz > buf.size()) || (filesz > segment.memsz))
+        {
+            error = path + ": segment data is out of file";
+            return false;
+        }
+        segment.data.assign(buf.begin() + offset, buf.begin() + offset + filesz);
+
+        segments.push_back(segment);
+    }
+
+    return true;
+}
+
+
+std::vector<ElfSymbol> ElfReader::Symbols() const
+{
+    std::vector<ElfSymbol> symbols;
+
+    for(const ElfSection &section : sections)
+    {
+        if((section.type != SHT_SYMTAB) || (section.link >= sections.size()))
+        {
+            continue;
+        }
+
+        const std::vector<uint8_t> &names = sections[section.link].data;
+        for(size_t pos = 0; pos + SYMBOL_SIZE <= section.data.size(); pos += SYMBOL_SIZE)
+        {
+            ElfSymbol symbol;
+
+            for(uint32_t i = get_u32(section.data, pos); (i < names.size()) && (names[i] != 0); i++)
+            {
+                symbol.name += (char)names[i];
+            }
+            symbol.value = get_u32(section.data, pos + 4);
+            symbol.size = get_u32(section.data, pos + 8);
+            symbol.type = section.data[pos + 12] & 0x0F;
+
+            symbols.push_back(symbol);
+        }
+    }
+
+    return symbols;
+}
+
+
+bool ElfReader::FindSymbol(const std::string &name, ElfSymbol &symbol) const
+{
+    for(const ElfSymbol &candidate : Symbols())
+    {
+        if(candidate.name == name)
+        {
+            symbol = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+const ElfSection* ElfReader::FindSection(const std::string &name) const
+{
+    for(const ElfSection &section : sections)
+    {
+        if(section.name == name)
+        {
+            return &section;
+        }
+    }
+
+    return nullptr;
+}
+
+
+bool ElfReader::ReadString(uint32_t addr, std::string &str) const
+{
+    for(const ElfSection &section : sections)
+    {
+        if(((section.flags & SHF_ALLOC) == 0) || section.data.empty() ||
+           (addr < section.addr) || (addr - section.addr >= section.size))
+        {
+            continue;
+        }
+
+        str.clear();
+        for(uint32_t pos = addr - section.addr; pos < section.size; pos++)
+        {
+            if(section.data[pos] == 0)
+            {
+                return true;
+            }
+            str += (char)section.data[pos];
+        }
+        return false;
+    }
+
+    return false;
+}
@@ -0,0 +1,88 @@
+#ifndef HOST_COMMON_ELF_READER_H_
+#define HOST_COMMON_ELF_READER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ Minimal reader for the 32-bit little-endian ELF files produced by the
+ firmware build: section headers with their contents, the symbol table and the
+ loadable segments, enough for the host tools to look up strings and code
+ by address and to load the image.
+*/
+
+struct ElfSection
+{
+    std::string name;
+    uint32_t type;
+    uint32_t flags;
+    uint32_t addr;
+    uint32_t size;
+    uint32_t link;
+    std::vector<uint8_t> data;          /* empty for SHT_NOBITS */
+};
+
+struct ElfSymbol
+{
+    std::string name;
+    uint32_t value;                     /* bit 0 is set for Thumb functions */
+    uint32_t size;
+    uint8_t type;                       /* STT_* */
+};
+
+struct ElfSegment
+{
+    uint32_t type;
+    uint32_t vaddr;
+    uint32_t paddr;                     /* load address, differs from vaddr for initialized data */
+    uint32_t memsz;
+    std::vector<uint8_t> data;          /* file contents, up to memsz */
+};
+
+class ElfReader
+{
+public:
+    /**
+     * @brief Load and parse ELF file
+     * @param[in] path file name
+     * @param[out] error description if loading has failed
+     * @retval true on success
+     */
+    bool Load(const std::string &path, std::string &error);
+
+    /**
+     * @brief Find section by name
+     * @retval pointer to the section or nullptr
+     */
+    const ElfSection* FindSection(const std::string &name) const;
+
+    /**
+     * @brief Read NUL-terminated string placed at the address of an allocated (loaded) section
+     * @retval true if the address belongs to a loaded section and the string is terminated
+     */
+    bool ReadString(uint32_t addr, std::string &str) const;
+
+    /**
+     * @brief Read the symbol table (.symtab)
+     * @retval empty if the file is stripped
+     */
+    std::vector<ElfSymbol> Symbols() const;
+
+    /**
+     * @brief Find symbol by name
+     * @retval true if found
+     */
+    bool FindSymbol(const std::string &name, ElfSymbol &symbol) const;
+
+    const std::vector<ElfSection>& Sections() const { return sections; }
+    const std::vector<ElfSegment>& Segments() const { return segments; }
+    uint32_t Entry() const { return entry; }
+
+private:
+    std::vector<ElfSection> sections;
+    std::vector<ElfSegment> segments;
+    uint32_t entry = 0;
+};
+
+#endif /* HOST_COMMON_ELF_READER_H_ */
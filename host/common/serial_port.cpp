@@ -0,0 +1,180 @@
+#include "serial_port.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+static bool baud_constant(uint32_t baud, speed_t &speed)
+{
+    switch(baud)
+    {
+        case 9600:      speed = B9600;      return true;
+        case 19200:     speed = B19200;     return true;
+        case 38400:     speed = B38400;     return true;
+        case 57600:     speed = B57600;     return true;
+        case 115200:    speed = B115200;    return true;
+        case 230400:    speed = B230400;    return true;
+        case 460800:    speed = B460800;    return true;
+        case 921600:    speed = B921600;    return true;
+        case 1000000:   speed = B1000000;   return true;
+        case 1500000:   speed = B1500000;   return true;
+        case 2000000:   speed = B2000000;   return true;
+        case 3000000:   speed = B3000000;   return true;
+        case 4000000:   speed = B4000000;   return true;
+        default:        return false;
+    }
+}
+
+
+SerialPort::~SerialPort()
+{
+    Close();
+}
+
+
+bool SerialPort::Open(const std::string &path, uint32_t baud, std::string &error, bool nonblocking)
+{
+    struct termios tio;
+    speed_t speed;
+
+    Close();
+
+    if(!baud_constant(baud, speed))
+    {
+        error = "unsupported baud rate " + std::to_string(baud);
+        return false;
+    }
+
+    fd = open(path.c_str(), O_RDWR | O_NOCTTY | (nonblocking ? O_NONBLOCK : 0));
+    if(fd < 0)
+    {
+        error = "can't open " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    if(tcgetattr(fd, &tio) != 0)
+    {
+        error = "can't configure " + path + ": " + strerror(errno);
+        Close();
+        return false;
+    }
+
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~CRTSCTS;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+
+    if(tcsetattr(fd, TCSANOW, &tio) != 0)
+    {
+        error = "can't configure " + path + ": " + strerror(errno);
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+
+bool SerialPort::SetBaud(uint32_t baud, std::string &error)
+{
+    struct termios tio;
+    speed_t speed;
+
+    if(!baud_constant(baud, speed))
+    {
+        error = "unsupported baud rate " + std::to_string(baud);
+        return false;
+    }
+
+    /* The output queued at the old rate goes first */
+    tcdrain(fd);
+    if((tcgetattr(fd, &tio) != 0) || (cfsetispeed(&tio, speed) != 0) || (cfsetospeed(&tio, speed) != 0) ||
+       (tcsetattr(fd, TCSANOW, &tio) != 0))
+    {
+        error = std::string("can't set the baud rate: ") + strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+
+void SerialPort::Close()
+{
+    if(fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+}
+
+
+bool SerialPort::Write(const void *data, size_t len)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+
+    while(len != 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if(n < 0)
+        {
+            if(errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+
+bool SerialPort::Write(const std::string &text)
+{
+    return Write(text.data(), text.size());
+}
+
+
+int SerialPort::Read(void *data, size_t len, uint32_t timeout_ms)
+{
+    fd_set fds;
+    struct timeval tv = {(time_t)(timeout_ms / 1000), (suseconds_t)(timeout_ms % 1000) * 1000};
+
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+
+    int res = select(fd + 1, &fds, nullptr, nullptr, &tv);
+    if(res <= 0)
+    {
+        return (res == 0 || errno == EINTR) ? 0 : -1;
+    }
+
+    ssize_t n = read(fd, data, len);
+    return n < 0 ? -1 : (int)n;
+}
+
+
+void SerialPort::Flush()
+{
+    tcflush(fd, TCIOFLUSH);
+}
+
+
+uint64_t SerialPort_NowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,65 @@
+#ifndef HOST_COMMON_SERIAL_PORT_H_
+#define HOST_COMMON_SERIAL_PORT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ Raw 8N1 serial port of the device console.
+*/
+
+class SerialPort
+{
+public:
+    ~SerialPort();
+
+    /**
+     * @brief Open and configure the port: raw mode, no flow control
+     * @param[in] path device name
+     * @param[in] baud rate
+     * @param[out] error description if opening has failed
+     * @param[in] nonblocking for event loops reading and writing Fd() directly
+     * @retval true on success
+     */
+    bool Open(const std::string &path, uint32_t baud, std::string &error, bool nonblocking = false);
+
+    void Close();
+
+    /**
+     * @brief Change the rate of the open port, after the queued output is sent
+     * @param[out] error description on failure
+     * @retval true on success
+     */
+    bool SetBaud(uint32_t baud, std::string &error);
+
+    /**
+     * @brief Write all bytes
+     */
+    bool Write(const void *data, size_t len);
+
+    bool Write(const std::string &text);
+
+    /**
+     * @brief Read what is available, waiting up to timeout_ms for the first byte
+     * @retval number of bytes read, 0 on timeout, -1 on error
+     */
+    int Read(void *data, size_t len, uint32_t timeout_ms);
+
+    /**
+     * @brief Drop unread input and unsent output
+     */
+    void Flush();
+
+    int Fd() const { return fd; }
+
+private:
+    int fd = -1;
+};
+
+/**
+ * @brief Monotonic time, ms
+ */
+uint64_t SerialPort_NowMs();
+
+#endif /* HOST_COMMON_SERIAL_PORT_H_ */
@@ -0,0 +1,79 @@
+/*
+ Host decoder for the deferred logging frames (see Inc/dlog.h).
+
+ Usage: dlog_decoder [-t] <firmware.elf> [input]
+
+ Reads the console stream from the input (file, serial device configured with
+ stty, or stdin), passes plain text through and replaces binary frames with
+ messages formatted from the ".dlog_strings" section of the firmware ELF.
+ -t prefixes every record with its device timestamp.
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "elf_reader.h"
+#include "dlog_frames.h"
+
+
+int main(int argc, char *argv[])
+{
+    bool timestamps = false;
+    int arg = 1;
+    ElfReader elf;
+    std::string error;
+    FILE *input = stdin;
+    int ch;
+
+    if((argc > arg) && (strcmp(argv[arg], "-t") == 0))
+    {
+        timestamps = true;
+        arg++;
+    }
+
+    if((argc - arg) < 1 || (argc - arg) > 2)
+    {
+        fprintf(stderr, "Usage: %s [-t] <firmware.elf> [input]\n", argv[0]);
+        return 1;
+    }
+
+    if(!elf.Load(argv[arg], error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    if(DLogDecoder::FindStrings(elf, error) == nullptr)
+    {
+        fprintf(stderr, "%s: %s\n", argv[arg], error.c_str());
+        return 1;
+    }
+
+    if((argc - arg) == 2)
+    {
+        input = fopen(argv[arg + 1], "rb");
+        if(input == nullptr)
+        {
+            fprintf(stderr, "Can't open %s\n", argv[arg + 1]);
+            return 1;
+        }
+    }
+
+    /* Console output is interactive, don't hold decoded text in the buffer */
+    setvbuf(stdout, nullptr, _IONBF, 0);
+
+    DLogDecoder decoder(&elf, timestamps, [](const char *text, size_t len) { fwrite(text, 1, len, stdout); });
+    while((ch = fgetc(input)) != EOF)
+    {
+        decoder.Feed((uint8_t)ch);
+    }
+
+    if(input != stdin)
+    {
+        fclose(input);
+    }
+
+    return 0;
+}
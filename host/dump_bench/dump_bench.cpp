@@ -0,0 +1,334 @@
+/*
+ Console dump throughput at several baud rates.
+
+ Usage: dump_bench [-r rates] [-c command] [-i baud] [-a] <serial device>
+
+ The console is switched to each rate in turn with "baud,<rate>" and the
+ confirmation handshake (or, with -a, with auto baud rate detection:
+ "baud,0" and a 'U' at the new rate), the dump command is run and its
+ output timed from the first to the last byte. The console is switched back
+ to the initial rate at the end.
+
+ -r  comma separated rates (default 115200,460800,921600,2000000)
+ -c  dump command (default "history,0", the whole telemetry archive)
+ -i  rate the console is at (default 115200)
+ -a  switch with auto baud rate detection instead of the handshake
+
+ Output is sustained throughput per rate: bytes, time, bytes per second and
+ the share of the 8N1 line limit (rate / 10 bytes per second).
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "serial_port.h"
+
+#define DEFAULT_BAUD                115200
+#define DEFAULT_RATES               "115200,460800,921600,2000000"
+#define DEFAULT_COMMAND             "history,0"
+
+#define REPLY_TIMEOUT_MS            2000
+/* The device waits 1 s for the confirmation */
+#define CONFIRM_TIMEOUT_MS          1000
+/* Silence that ends a dump */
+#define DUMP_QUIET_MS               300
+#define DUMP_TIMEOUT_MS             600000
+#define RX_CHUNK                    4096
+
+struct Options
+{
+    std::vector<uint32_t> rates;
+    std::string command = DEFAULT_COMMAND;
+    uint32_t baud = DEFAULT_BAUD;
+    bool autobaud = false;
+};
+
+struct Result
+{
+    uint32_t baud;
+    bool switched;
+    size_t bytes;
+    uint64_t us;
+};
+
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+/**
+ * @brief Read console text until it contains one of the markers
+ * @param[out] text everything read
+ * @retval index of the marker found, -1 on timeout
+ */
+static int wait_text(SerialPort &port, const std::vector<std::string> &markers, uint32_t timeout_ms, std::string &text)
+{
+    uint64_t deadline = SerialPort_NowMs() + timeout_ms;
+    char data[256];
+
+    text.clear();
+    while(SerialPort_NowMs() < deadline)
+    {
+        int n = port.Read(data, sizeof(data), 20);
+        if(n < 0)
+        {
+            return -1;
+        }
+        text.append(data, n);
+
+        for(size_t i = 0; i < markers.size(); i++)
+        {
+            if(text.find(markers[i]) != std::string::npos)
+            {
+                return (int)i;
+            }
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ * @brief Run a command and wait for its status line
+ */
+static bool command(SerialPort &port, const std::string &line)
+{
+    std::string text;
+
+    return port.Write(line + "\r") && (wait_text(port, {"Status: OK", "Status: ERROR"}, REPLY_TIMEOUT_MS, text) == 0);
+}
+
+
+/**
+ * @brief Switch the console rate with the confirmation handshake
+ */
+static bool switch_confirmed(SerialPort &port, uint32_t baud, std::string &error)
+{
+    std::string text;
+    std::string rate = std::to_string(baud);
+
+    if(!port.Write("baud," + rate + "\r"))
+    {
+        error = "write failed";
+        return false;
+    }
+
+    /* The device switches as soon as this line is out */
+    if(wait_text(port, {" ms\r\n", "Status: ERROR"}, REPLY_TIMEOUT_MS, text) != 0)
+    {
+        error = "rate refused: " + text;
+        return false;
+    }
+
+    if(!port.SetBaud(baud, error) || !port.Write(rate + "\r"))
+    {
+        return false;
+    }
+
+    if(wait_text(port, {"Status: OK", "Status: ERROR"}, CONFIRM_TIMEOUT_MS + REPLY_TIMEOUT_MS, text) != 0)
+    {
+        error = "not confirmed";
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Switch the console rate with auto baud rate detection
+ */
+static bool switch_detected(SerialPort &port, uint32_t baud, std::string &error)
+{
+    if(!command(port, "baud,0"))
+    {
+        error = "detection not armed";
+        return false;
+    }
+
+    if(!port.SetBaud(baud, error))
+    {
+        return false;
+    }
+
+    /* The sync character isn't taken as input, the device replies at the detected rate */
+    if(!port.Write("U") || !command(port, "quiet"))
+    {
+        error = "no reply at the detected rate";
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Time the output of the dump command, from the first to the last byte
+ */
+static bool dump(SerialPort &port, const std::string &line, Result &result)
+{
+    uint64_t deadline = SerialPort_NowMs() + DUMP_TIMEOUT_MS;
+    uint64_t first = 0;
+    uint64_t last = 0;
+    char data[RX_CHUNK];
+
+    port.Flush();
+    if(!port.Write(line + "\r"))
+    {
+        return false;
+    }
+
+    result.bytes = 0;
+    while(SerialPort_NowMs() < deadline)
+    {
+        int n = port.Read(data, sizeof(data), (first == 0) ? REPLY_TIMEOUT_MS : DUMP_QUIET_MS);
+        if(n <= 0)
+        {
+            break;
+        }
+
+        last = now_us();
+        if(first == 0)
+        {
+            first = last;
+        }
+        result.bytes += n;
+    }
+
+    result.us = last - first;
+    return result.bytes != 0;
+}
+
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: dump_bench [-r rates] [-c command] [-i baud] [-a] <serial device>\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    const char *rates = DEFAULT_RATES;
+    std::vector<Result> results;
+    std::string error;
+    uint32_t current;
+    int opt;
+
+    while((opt = getopt(argc, argv, "r:c:i:a")) != -1)
+    {
+        switch(opt)
+        {
+            case 'r': rates = optarg; break;
+            case 'c': options.command = optarg; break;
+            case 'i': options.baud = strtoul(optarg, nullptr, 0); break;
+            case 'a': options.autobaud = true; break;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    for(const char *p = rates; *p != '\0'; p += (*p == ',') ? 1 : 0)
+    {
+        char *end;
+        uint32_t rate = strtoul(p, &end, 0);
+
+        if((end == p) || (rate == 0))
+        {
+            fprintf(stderr, "Bad rate list %s\n", rates);
+            return 1;
+        }
+        options.rates.push_back(rate);
+        p = end;
+    }
+
+    if(optind != argc - 1)
+    {
+        usage();
+        return 1;
+    }
+
+    SerialPort port;
+    if(!port.Open(argv[optind], options.baud, error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    /* No echo and no banner, the dump is the command output only. A device just reset drops the
+       first character measuring its rate, the line end goes first */
+    port.Flush();
+    if(!port.Write("\r") || !command(port, "quiet"))
+    {
+        fprintf(stderr, "Device doesn't respond at %u baud\n", options.baud);
+        return 1;
+    }
+
+    current = options.baud;
+    for(uint32_t rate : options.rates)
+    {
+        Result result = {rate, true, 0, 0};
+
+        if(rate != current)
+        {
+            result.switched = options.autobaud ? switch_detected(port, rate, error) : switch_confirmed(port, rate, error);
+            if(!result.switched)
+            {
+                fprintf(stderr, "%u baud: %s\n", rate, error.c_str());
+                /* Back where the device is after a failed switch */
+                if(!options.autobaud && !port.SetBaud(current, error))
+                {
+                    break;
+                }
+                results.push_back(result);
+                continue;
+            }
+            current = rate;
+        }
+
+        if(!dump(port, options.command, result))
+        {
+            fprintf(stderr, "%u baud: no output of \"%s\"\n", rate, options.command.c_str());
+        }
+        results.push_back(result);
+    }
+
+    if(current != options.baud)
+    {
+        bool res = options.autobaud ? switch_detected(port, options.baud, error) : switch_confirmed(port, options.baud, error);
+        if(!res)
+        {
+            fprintf(stderr, "Can't switch back to %u baud: %s\n", options.baud, error.c_str());
+        }
+    }
+    command(port, "quiet,0");
+
+    printf("%10s %10s %10s %12s %8s\n", "Baud", "Bytes", "ms", "B/s", "Line %");
+    for(const Result &r : results)
+    {
+        if(!r.switched)
+        {
+            printf("%10u %10s\n", r.baud, "not switched");
+            continue;
+        }
+
+        double bps = (r.us != 0) ? r.bytes * 1e6 / r.us : 0;
+        printf("%10u %10zu %10.1f %12.0f %8.1f\n", r.baud, r.bytes, r.us / 1000.0, bps, bps * 1000.0 / r.baud);
+    }
+
+    return 0;
+}
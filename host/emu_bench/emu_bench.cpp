@@ -0,0 +1,857 @@
+/*
+ Instruction count benchmark of the ARM build, without hardware.
+
+ Usage: emu_bench [-n top] [-m max_instructions] [-v] <firmware.elf> [command ...]
+
+ The firmware ELF (src/out/max6650_test.elf) is loaded into the Unicorn
+ CPU emulator (Cortex-M4, Thumb-2) and runs from the reset vector. The
+ peripherals are register-level stubs: RCC reports every clock ready, FLASH
+ erases and programs the emulated flash, USART1 feeds the console input and
+ collects the output, written by the CPU or by the DMA1 channel 4, I2C2 serves MAX6650, HTS221 and LSM6DSL register files.
+ Interrupts are not emulated: uwTick is advanced every SystemCoreClock / 1000
+ instructions and DWT->CYCCNT returns the instruction count, so the firmware
+ runs as if every instruction took one cycle.
+
+ The firmware is stopped when it waits for a console character with no
+ input left. Boot is measured up to the first prompt, then every command
+ (default "set_fan_speed,50" and "get_fan_speed") is typed twice and the
+ second run is measured, the first one completes the deferred init. For
+ each scenario the instruction count is reported per function of the ELF
+ symbol table, along with the instructions fetched from flash and from RAM
+ (__RAM_FUNC code).
+
+ Unicorn is not cycle accurate: the counts show the Thumb-2 code generation,
+ not pipeline stalls or flash wait states.
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <unicorn/unicorn.h>
+
+#include "elf_reader.h"
+
+#define STT_FUNC                    2
+#define PT_LOAD                     1
+
+/* STM32L475VG memory map */
+#define FLASH_BASE                  0x08000000U
+#define FLASH_SIZE                  (1024 * 1024)
+#define FLASH_BANK_SIZE             (512 * 1024)
+#define FLASH_PAGE_SIZE             2048
+/* Flash size register of the factory data */
+#define SYSMEM_BASE                 0x1FFF0000U
+#define SYSMEM_SIZE                 0x00010000U
+#define FLASHSIZE_OFFSET            0x000075E0U
+#define SRAM1_BASE                  0x20000000U
+#define SRAM1_SIZE                  (96 * 1024)
+#define SRAM2_BASE                  0x10000000U
+#define SRAM2_SIZE                  (32 * 1024)
+#define PERIPH_BASE                 0x40000000U
+#define PERIPH_SIZE                 0x20000000U
+#define SCS_BASE                    0xE0000000U
+#define SCS_SIZE                    0x00100000U
+
+/* Peripheral registers, offsets from PERIPH_BASE */
+#define I2C2_OFFSET                 0x00005800U
+#define USART1_OFFSET               0x00013800U
+#define DMA1_OFFSET                 0x00020000U
+#define RCC_OFFSET                  0x00021000U
+#define FLASH_REG_OFFSET            0x00022000U
+
+#define RCC_CR                      (RCC_OFFSET + 0x00)
+#define RCC_CFGR                    (RCC_OFFSET + 0x08)
+#define RCC_BDCR                    (RCC_OFFSET + 0x90)
+#define RCC_CSR                     (RCC_OFFSET + 0x94)
+#define RCC_CRRCR                   (RCC_OFFSET + 0x98)
+
+#define FLASH_KEYR                  (FLASH_REG_OFFSET + 0x08)
+#define FLASH_SR                    (FLASH_REG_OFFSET + 0x10)
+#define FLASH_CR                    (FLASH_REG_OFFSET + 0x14)
+#define FLASH_OPTR                  (FLASH_REG_OFFSET + 0x20)
+#define FLASH_KEY2                  0xCDEF89ABU
+#define FLASH_CR_PER                (1U << 1)
+#define FLASH_CR_BKER               (1U << 11)
+#define FLASH_CR_STRT               (1U << 16)
+#define FLASH_CR_LOCK               (1U << 31)
+
+#define USART_CR3                   (USART1_OFFSET + 0x08)
+#define USART_ISR                   (USART1_OFFSET + 0x1C)
+#define USART_RDR                   (USART1_OFFSET + 0x24)
+#define USART_TDR                   (USART1_OFFSET + 0x28)
+#define USART_ISR_RXNE              (1U << 5)
+#define USART_ISR_TC                (1U << 6)
+#define USART_ISR_TXE               (1U << 7)
+#define USART_ISR_TEACK             (1U << 21)
+#define USART_ISR_REACK             (1U << 22)
+#define USART_CR3_DMAT              (1U << 7)
+
+/* DMA1 channel 4, USART1 TX */
+#define DMA_ISR                     (DMA1_OFFSET + 0x00)
+#define DMA_IFCR                    (DMA1_OFFSET + 0x04)
+#define DMA_CCR4                    (DMA1_OFFSET + 0x44)
+#define DMA_CNDTR4                  (DMA1_OFFSET + 0x48)
+#define DMA_CPAR4                   (DMA1_OFFSET + 0x4C)
+#define DMA_CMAR4                   (DMA1_OFFSET + 0x50)
+#define DMA_CCR_EN                  (1U << 0)
+#define DMA_CCR_DIR                 (1U << 4)
+/* GIF4, TCIF4 */
+#define DMA_ISR_CH4_DONE            (3U << 12)
+
+#define I2C_CR2                     (I2C2_OFFSET + 0x04)
+#define I2C_ISR                     (I2C2_OFFSET + 0x18)
+#define I2C_ICR                     (I2C2_OFFSET + 0x1C)
+#define I2C_RXDR                    (I2C2_OFFSET + 0x24)
+#define I2C_TXDR                    (I2C2_OFFSET + 0x28)
+#define I2C_ISR_TXE                 (1U << 0)
+#define I2C_ISR_TXIS                (1U << 1)
+#define I2C_ISR_RXNE                (1U << 2)
+#define I2C_ISR_NACKF               (1U << 4)
+#define I2C_ISR_STOPF               (1U << 5)
+#define I2C_ISR_TC                  (1U << 6)
+#define I2C_ISR_TCR                 (1U << 7)
+#define I2C_CR2_RD_WRN              (1U << 10)
+#define I2C_CR2_START               (1U << 13)
+#define I2C_CR2_STOP                (1U << 14)
+#define I2C_CR2_RELOAD              (1U << 24)
+#define I2C_CR2_AUTOEND             (1U << 25)
+
+/* System control space, offsets from SCS_BASE */
+#define DWT_CYCCNT                  0x00001004U
+
+/* Register reset values the HAL depends on */
+#define RCC_CR_RESET                0x00000063U
+#define FLASH_CR_RESET              0xC0000000U
+#define FLASH_OPTR_RESET            0xFFEFF8AAU
+
+#define DEFAULT_TOP                 15
+#define DEFAULT_MAX_INSTRUCTIONS    500000000ULL
+
+/**
+ * @brief Register file of an I2C slave, the first byte written selects the register
+ */
+struct I2cDevice
+{
+    uint8_t address;                /* 8-bit */
+    uint8_t pointer_mask;           /* HTS221 sets bit 7 of the register address for auto-increment */
+    uint8_t regs[256];
+};
+
+class Peripherals
+{
+public:
+    Peripherals(uint8_t *flash) : flash(flash)
+    {
+        regs[RCC_CR] = RCC_CR_RESET;
+        regs[FLASH_CR] = FLASH_CR_RESET;
+        regs[FLASH_OPTR] = FLASH_OPTR_RESET;
+
+        /* 8-bit addresses and register values as on B-L475E-IOT01A with a MAX6650 (ADD to GND) */
+        add_device(0x90, 0xFF, {{0x0C, 175}});
+        add_device(0xBE, 0x7F, {{0x0F, 0xBC}});
+        add_device(0xD4, 0xFF, {{0x0F, 0x6A}});
+    }
+
+    uint32_t Read(uint32_t offset);
+    void Write(uint32_t offset, uint32_t value);
+
+    std::deque<uint8_t> input;
+    std::string output;
+    uc_engine *memory = nullptr;    /* read by the DMA */
+
+private:
+    void add_device(uint8_t address, uint8_t pointer_mask, const std::map<uint8_t, uint8_t> &values);
+    void i2c_start(uint32_t cr2);
+    void i2c_byte_done();
+    void flash_erase(uint32_t cr);
+
+    uint8_t *flash;
+    std::map<uint32_t, uint32_t> regs;
+    std::vector<I2cDevice> devices;
+
+    I2cDevice *i2c_device = nullptr;
+    uint32_t i2c_isr = 0;
+    uint32_t i2c_cr2 = 0;
+    uint32_t i2c_remaining = 0;
+    uint8_t i2c_pointer = 0;
+    bool i2c_pointer_next = false;
+};
+
+
+void Peripherals::add_device(uint8_t address, uint8_t pointer_mask, const std::map<uint8_t, uint8_t> &values)
+{
+    I2cDevice device;
+
+    device.address = address;
+    device.pointer_mask = pointer_mask;
+    memset(device.regs, 0, sizeof(device.regs));
+    for(const auto &value : values)
+    {
+        device.regs[value.first] = value.second;
+    }
+
+    devices.push_back(device);
+}
+
+
+uint32_t Peripherals::Read(uint32_t offset)
+{
+    uint32_t value = regs[offset];
+    uint32_t ready;
+
+    switch(offset)
+    {
+        case RCC_CR:
+            /* MSIRDY, HSIRDY, HSERDY, PLLRDY, PLLSAI1RDY, PLLSAI2RDY follow their enable bits */
+            ready = ((value & 1U) << 1) | ((value & (1U << 8)) << 2) | ((value & (1U << 16)) << 1) |
+                    ((value & (1U << 24)) << 1) | ((value & (1U << 26)) << 1) | ((value & (1U << 28)) << 1);
+            return (value & ~0x2A020402U) | ready;
+
+        case RCC_CFGR:
+            /* SWS follows SW */
+            return (value & ~0x0CU) | ((value & 0x03U) << 2);
+
+        case RCC_BDCR:
+        case RCC_CSR:
+        case RCC_CRRCR:
+            /* LSERDY, LSIRDY, HSI48RDY follow their enable bits */
+            return (value & ~0x02U) | ((value & 0x01U) << 1);
+
+        case USART_ISR:
+            return USART_ISR_TXE | USART_ISR_TC | USART_ISR_TEACK | USART_ISR_REACK | (input.empty() ? 0 : USART_ISR_RXNE);
+
+        case USART_RDR:
+            if(input.empty())
+            {
+                return 0;
+            }
+            value = input.front();
+            input.pop_front();
+            return value;
+
+        case I2C_ISR:
+            return i2c_isr | I2C_ISR_TXE;
+
+        case I2C_RXDR:
+            if((i2c_device == nullptr) || (i2c_remaining == 0))
+            {
+                return 0;
+            }
+            value = i2c_device->regs[i2c_pointer & i2c_device->pointer_mask];
+            i2c_pointer++;
+            i2c_byte_done();
+            return value;
+
+        default:
+            return value;
+    }
+}
+
+
+void Peripherals::Write(uint32_t offset, uint32_t value)
+{
+    switch(offset)
+    {
+        case USART_TDR:
+            output += (char)value;
+            break;
+
+        case I2C_CR2:
+            i2c_cr2 = value & ~(I2C_CR2_START | I2C_CR2_STOP);
+            if(value & I2C_CR2_START)
+            {
+                i2c_start(value);
+            }
+            else if((i2c_isr & I2C_ISR_TCR) && (i2c_device != nullptr))
+            {
+                /* Next block of a reload transfer */
+                i2c_isr &= ~I2C_ISR_TCR;
+                i2c_remaining = (value >> 16) & 0xFF;
+                i2c_isr |= (value & I2C_CR2_RD_WRN) ? I2C_ISR_RXNE : I2C_ISR_TXIS;
+            }
+            if(value & I2C_CR2_STOP)
+            {
+                i2c_isr = (i2c_isr & ~I2C_ISR_TC) | I2C_ISR_STOPF;
+            }
+            break;
+
+        case I2C_ICR:
+            i2c_isr &= ~value;
+            break;
+
+        case DMA_IFCR:
+            regs[DMA_ISR] &= ~value;
+            break;
+
+        case DMA_CCR4:
+            /* Memory to USART1 TDR completes at once, as if the line was infinitely fast */
+            if((value & DMA_CCR_EN) && !(regs[offset] & DMA_CCR_EN) && (value & DMA_CCR_DIR) &&
+               (regs[USART_CR3] & USART_CR3_DMAT) && (regs[DMA_CPAR4] == PERIPH_BASE + USART_TDR) &&
+               (regs[DMA_CNDTR4] != 0) && (memory != nullptr))
+            {
+                std::vector<char> data(regs[DMA_CNDTR4] & 0xFFFF);
+
+                if(uc_mem_read(memory, regs[DMA_CMAR4], data.data(), data.size()) == UC_ERR_OK)
+                {
+                    output.append(data.data(), data.size());
+                    regs[DMA_CNDTR4] = 0;
+                    regs[DMA_ISR] |= DMA_ISR_CH4_DONE;
+                }
+            }
+            regs[offset] = value;
+            break;
+
+        case I2C_TXDR:
+            if((i2c_device == nullptr) || (i2c_remaining == 0))
+            {
+                break;
+            }
+            if(i2c_pointer_next)
+            {
+                i2c_pointer = value;
+                i2c_pointer_next = false;
+            }
+            else
+            {
+                i2c_device->regs[i2c_pointer & i2c_device->pointer_mask] = value;
+                i2c_pointer++;
+            }
+            i2c_byte_done();
+            break;
+
+        case FLASH_KEYR:
+            if(value == FLASH_KEY2)
+            {
+                regs[FLASH_CR] &= ~FLASH_CR_LOCK;
+            }
+            break;
+
+        case FLASH_SR:
+            /* Flags are cleared by writing 1 */
+            regs[FLASH_SR] &= ~value;
+            break;
+
+        case FLASH_CR:
+            if((value & FLASH_CR_STRT) && (value & FLASH_CR_PER))
+            {
+                flash_erase(value);
+            }
+            regs[offset] = value & ~FLASH_CR_STRT;
+            break;
+
+        default:
+            regs[offset] = value;
+            break;
+    }
+}
+
+
+void Peripherals::i2c_start(uint32_t cr2)
+{
+    uint8_t address = cr2 & 0xFE;
+
+    i2c_device = nullptr;
+    for(I2cDevice &device : devices)
+    {
+        if(device.address == address)
+        {
+            i2c_device = &device;
+        }
+    }
+
+    i2c_isr &= ~(I2C_ISR_TXIS | I2C_ISR_RXNE | I2C_ISR_TC | I2C_ISR_TCR);
+    if(i2c_device == nullptr)
+    {
+        /* The master sends STOP after a NACK */
+        i2c_isr |= I2C_ISR_NACKF | I2C_ISR_STOPF;
+        return;
+    }
+
+    i2c_remaining = (cr2 >> 16) & 0xFF;
+    if(i2c_remaining == 0)
+    {
+        i2c_remaining = 1;
+        i2c_byte_done();
+        return;
+    }
+
+    if(cr2 & I2C_CR2_RD_WRN)
+    {
+        i2c_isr |= I2C_ISR_RXNE;
+    }
+    else
+    {
+        i2c_pointer_next = true;
+        i2c_isr |= I2C_ISR_TXIS;
+    }
+}
+
+
+void Peripherals::i2c_byte_done()
+{
+    if(--i2c_remaining != 0)
+    {
+        return;
+    }
+
+    i2c_isr &= ~(I2C_ISR_TXIS | I2C_ISR_RXNE);
+    if(i2c_cr2 & I2C_CR2_RELOAD)
+    {
+        i2c_isr |= I2C_ISR_TCR;
+    }
+    else if(i2c_cr2 & I2C_CR2_AUTOEND)
+    {
+        i2c_isr |= I2C_ISR_STOPF;
+    }
+    else
+    {
+        i2c_isr |= I2C_ISR_TC;
+    }
+}
+
+
+void Peripherals::flash_erase(uint32_t cr)
+{
+    uint32_t page = (cr >> 3) & 0xFF;
+    uint32_t bank = (cr & FLASH_CR_BKER) ? 1 : 0;
+
+    /* SYSCFG_MEMRMP.FB_MODE is never set, the banks aren't swapped */
+    memset(flash + bank * FLASH_BANK_SIZE + page * FLASH_PAGE_SIZE, 0xFF, FLASH_PAGE_SIZE);
+}
+
+
+struct Function
+{
+    std::string name;
+    uint32_t start;
+    uint32_t end;
+};
+
+struct Scenario
+{
+    std::string name;
+    uint64_t instructions;
+    uint64_t ram_instructions;
+    size_t output_bytes;
+    std::vector<uint64_t> counts;           /* per function, the last entry is code without a symbol */
+    std::string error;
+};
+
+class Emulator
+{
+public:
+    ~Emulator()
+    {
+        if(uc != nullptr)
+        {
+            uc_close(uc);
+        }
+    }
+
+    bool Load(const ElfReader &elf, std::string &error);
+
+    /**
+     * @brief Run until the firmware waits for console input with none left
+     */
+    Scenario Run(const std::string &name, const std::string &input, uint64_t max_instructions);
+
+    const std::vector<Function>& Functions() const { return functions; }
+    const std::string& Output() const { return peripherals.output; }
+
+private:
+    static void hook_code(uc_engine *uc, uint64_t address, uint32_t size, void *user_data);
+    static uint64_t periph_read(uc_engine *uc, uint64_t offset, unsigned size, void *user_data);
+    static void periph_write(uc_engine *uc, uint64_t offset, unsigned size, uint64_t value, void *user_data);
+    static uint64_t scs_read(uc_engine *uc, uint64_t offset, unsigned size, void *user_data);
+    static void scs_write(uc_engine *uc, uint64_t offset, unsigned size, uint64_t value, void *user_data);
+
+    void tick();
+
+    uc_engine *uc = nullptr;
+    uc_hook code_hook;
+    std::vector<uint8_t> flash = std::vector<uint8_t>(FLASH_SIZE, 0xFF);
+    Peripherals peripherals = Peripherals(flash.data());
+    std::map<uint32_t, uint32_t> scs_regs;
+    std::vector<Function> functions;
+
+    uint32_t wait_input_addr = 0;
+    uint32_t tick_addr = 0;
+    uint32_t core_clock_addr = 0;
+    uint32_t pc = 0;
+    uint64_t total = 0;
+    uint64_t next_tick = 0;
+    Scenario *current = nullptr;
+};
+
+
+bool Emulator::Load(const ElfReader &elf, std::string &error)
+{
+    uc_err err;
+    ElfSymbol symbol;
+
+    for(const ElfSymbol &s : elf.Symbols())
+    {
+        if((s.type == STT_FUNC) && (s.size != 0))
+        {
+            functions.push_back({s.name, s.value & ~1U, (s.value & ~1U) + s.size});
+        }
+    }
+    std::sort(functions.begin(), functions.end(), [](const Function &a, const Function &b) { return a.start < b.start; });
+
+    if(functions.empty())
+    {
+        error = "no symbol table, the ELF is stripped";
+        return false;
+    }
+
+    /* The console waits for a character here, uwTick and SystemCoreClock drive the HAL time base */
+    static const char *names[] = {"__io_getchar", "uwTick", "SystemCoreClock"};
+    uint32_t *addrs[] = {&wait_input_addr, &tick_addr, &core_clock_addr};
+    for(size_t i = 0; i < 3; i++)
+    {
+        if(!elf.FindSymbol(names[i], symbol))
+        {
+            error = std::string("no ") + names[i] + " symbol";
+            return false;
+        }
+        *addrs[i] = symbol.value & ~1U;
+    }
+
+    /* Loaded by the load addresses like a flash programmer does, the startup code copies .data */
+    for(const ElfSegment &segment : elf.Segments())
+    {
+        if((segment.type != PT_LOAD) || segment.data.empty())
+        {
+            continue;
+        }
+        if((segment.paddr < FLASH_BASE) || (segment.paddr - FLASH_BASE + segment.data.size() > FLASH_SIZE))
+        {
+            error = "loadable segment out of flash";
+            return false;
+        }
+        memcpy(&flash[segment.paddr - FLASH_BASE], segment.data.data(), segment.data.size());
+    }
+
+    err = uc_open(UC_ARCH_ARM, (uc_mode)(UC_MODE_THUMB | UC_MODE_MCLASS), &uc);
+    if(err == UC_ERR_OK)
+    {
+        err = uc_ctl_set_cpu_model(uc, UC_CPU_ARM_CORTEX_M4);
+        peripherals.memory = uc;
+    }
+    if(err == UC_ERR_OK)
+    {
+        /* Flash is RAM backed, writes are done by the FLASH controller model */
+        err = uc_mem_map_ptr(uc, FLASH_BASE, FLASH_SIZE, UC_PROT_ALL, flash.data());
+    }
+    if(err == UC_ERR_OK)
+    {
+        /* FLASH_BANK_SIZE of the HAL is read from here */
+        uint16_t flash_size_kb = FLASH_SIZE / 1024;
+        err = uc_mem_map(uc, SYSMEM_BASE, SYSMEM_SIZE, UC_PROT_READ);
+        if(err == UC_ERR_OK)
+        {
+            err = uc_mem_write(uc, SYSMEM_BASE + FLASHSIZE_OFFSET, &flash_size_kb, sizeof(flash_size_kb));
+        }
+    }
+    if(err == UC_ERR_OK)
+    {
+        err = uc_mem_map(uc, SRAM1_BASE, SRAM1_SIZE, UC_PROT_ALL);
+    }
+    if(err == UC_ERR_OK)
+    {
+        err = uc_mem_map(uc, SRAM2_BASE, SRAM2_SIZE, UC_PROT_ALL);
+    }
+    if(err == UC_ERR_OK)
+    {
+        err = uc_mmio_map(uc, PERIPH_BASE, PERIPH_SIZE, periph_read, this, periph_write, this);
+    }
+    if(err == UC_ERR_OK)
+    {
+        err = uc_mmio_map(uc, SCS_BASE, SCS_SIZE, scs_read, this, scs_write, this);
+    }
+    if(err == UC_ERR_OK)
+    {
+        err = uc_hook_add(uc, &code_hook, UC_HOOK_CODE, (void *)hook_code, this, 1, 0);
+    }
+
+    if(err != UC_ERR_OK)
+    {
+        error = std::string("Unicorn: ") + uc_strerror(err);
+        return false;
+    }
+
+    /* Reset: SP and PC from the vector table at the start of flash, FPU access enabled like SystemInit() does */
+    uint32_t sp;
+    uint32_t cpacr = 0xFU << 20;
+    uint32_t fpexc = 1U << 30;
+    memcpy(&sp, &flash[0], sizeof(sp));
+    memcpy(&pc, &flash[4], sizeof(pc));
+    uc_reg_write(uc, UC_ARM_REG_SP, &sp);
+    uc_reg_write(uc, UC_ARM_REG_C1_C0_2, &cpacr);
+    uc_reg_write(uc, UC_ARM_REG_FPEXC, &fpexc);
+
+    return true;
+}
+
+
+Scenario Emulator::Run(const std::string &name, const std::string &input, uint64_t max_instructions)
+{
+    Scenario scenario;
+    size_t output_start = peripherals.output.size();
+    uint64_t start = total;
+    uc_err err;
+
+    scenario.name = name;
+    scenario.instructions = 0;
+    scenario.ram_instructions = 0;
+    scenario.counts.assign(functions.size() + 1, 0);
+    current = &scenario;
+
+    peripherals.input.insert(peripherals.input.end(), input.begin(), input.end());
+
+    /* Thumb state is bit 0 of the address */
+    err = uc_emu_start(uc, pc | 1U, 0xFFFFFFFFU, 0, max_instructions);
+    uc_reg_read(uc, UC_ARM_REG_PC, &pc);
+
+    if(err != UC_ERR_OK)
+    {
+        char text[128];
+        snprintf(text, sizeof(text), "%s at 0x%08X", uc_strerror(err), pc);
+        scenario.error = text;
+    }
+    else if((total - start) >= max_instructions)
+    {
+        scenario.error = "instruction limit reached, the firmware doesn't wait for input (Error_Handler?)";
+    }
+
+    scenario.instructions = total - start;
+    scenario.output_bytes = peripherals.output.size() - output_start;
+    current = nullptr;
+
+    return scenario;
+}
+
+
+void Emulator::hook_code(uc_engine *uc, uint64_t address, uint32_t size, void *user_data)
+{
+    Emulator *emu = (Emulator *)user_data;
+    uint32_t addr = (uint32_t)address;
+
+    if((addr == emu->wait_input_addr) && emu->peripherals.input.empty())
+    {
+        emu->pc = addr;
+        uc_emu_stop(uc);
+        return;
+    }
+
+    emu->total++;
+    if(emu->total >= emu->next_tick)
+    {
+        emu->tick();
+    }
+
+    Scenario *scenario = emu->current;
+    if(scenario == nullptr)
+    {
+        return;
+    }
+
+    if(addr >= SRAM1_BASE)
+    {
+        scenario->ram_instructions++;
+    }
+
+    auto it = std::upper_bound(emu->functions.begin(), emu->functions.end(), addr,
+                               [](uint32_t a, const Function &f) { return a < f.start; });
+    if((it != emu->functions.begin()) && (addr < (it - 1)->end))
+    {
+        scenario->counts[it - 1 - emu->functions.begin()]++;
+    }
+    else
+    {
+        scenario->counts.back()++;
+    }
+}
+
+
+void Emulator::tick()
+{
+    uint32_t value;
+
+    /* SysTick interrupt stand-in: one instruction per cycle */
+    uc_mem_read(uc, tick_addr, &value, sizeof(value));
+    value++;
+    uc_mem_write(uc, tick_addr, &value, sizeof(value));
+
+    uc_mem_read(uc, core_clock_addr, &value, sizeof(value));
+    next_tick = total + std::max<uint32_t>(value / 1000, 1);
+}
+
+
+uint64_t Emulator::periph_read(uc_engine *uc, uint64_t offset, unsigned size, void *user_data)
+{
+    Emulator *emu = (Emulator *)user_data;
+    uint32_t shift = (offset & 3) * 8;
+    uint32_t value = emu->peripherals.Read((uint32_t)offset & ~3U) >> shift;
+
+    return (size < 4) ? value & ((1U << (size * 8)) - 1) : value;
+}
+
+
+void Emulator::periph_write(uc_engine *uc, uint64_t offset, unsigned size, uint64_t value, void *user_data)
+{
+    Emulator *emu = (Emulator *)user_data;
+    uint32_t reg = (uint32_t)offset & ~3U;
+    uint32_t shift = (offset & 3) * 8;
+
+    if(size < 4)
+    {
+        /* Byte and half-word writes go to their lanes, the data registers take them as is */
+        uint32_t mask = ((1U << (size * 8)) - 1) << shift;
+        if((reg != USART_TDR) && (reg != I2C_TXDR))
+        {
+            value = (emu->peripherals.Read(reg) & ~mask) | (((uint32_t)value << shift) & mask);
+        }
+    }
+
+    emu->peripherals.Write(reg, (uint32_t)value);
+}
+
+
+uint64_t Emulator::scs_read(uc_engine *uc, uint64_t offset, unsigned size, void *user_data)
+{
+    Emulator *emu = (Emulator *)user_data;
+
+    if(offset == DWT_CYCCNT)
+    {
+        return (uint32_t)emu->total;
+    }
+
+    return emu->scs_regs[(uint32_t)offset];
+}
+
+
+void Emulator::scs_write(uc_engine *uc, uint64_t offset, unsigned size, uint64_t value, void *user_data)
+{
+    Emulator *emu = (Emulator *)user_data;
+
+    emu->scs_regs[(uint32_t)offset] = (uint32_t)value;
+}
+
+
+static void print_scenario(const Scenario &scenario, const std::vector<Function> &functions, int top)
+{
+    std::vector<size_t> order;
+
+    printf("== %s ==\n", scenario.name.c_str());
+    if(!scenario.error.empty())
+    {
+        printf("error: %s\n", scenario.error.c_str());
+    }
+    printf("instructions: %llu (flash %llu, RAM %llu), console output %zu bytes\n",
+           (unsigned long long)scenario.instructions,
+           (unsigned long long)(scenario.instructions - scenario.ram_instructions),
+           (unsigned long long)scenario.ram_instructions, scenario.output_bytes);
+
+    for(size_t i = 0; i < scenario.counts.size(); i++)
+    {
+        if(scenario.counts[i] != 0)
+        {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return scenario.counts[a] > scenario.counts[b]; });
+
+    printf("%14s %7s  %s\n", "instructions", "share", "function");
+    for(size_t i = 0; (i < order.size()) && ((int)i < top); i++)
+    {
+        size_t index = order[i];
+        printf("%14llu %6.1f%%  %s\n", (unsigned long long)scenario.counts[index],
+               100.0 * scenario.counts[index] / (scenario.instructions ? scenario.instructions : 1),
+               (index < functions.size()) ? functions[index].name.c_str() : "(no symbol)");
+    }
+    printf("\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    int top = DEFAULT_TOP;
+    uint64_t max_instructions = DEFAULT_MAX_INSTRUCTIONS;
+    bool verbose = false;
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:m:v")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': top = atoi(optarg); break;
+            case 'm': max_instructions = strtoull(optarg, nullptr, 0); break;
+            case 'v': verbose = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-n top] [-m max_instructions] [-v] <firmware.elf> [command ...]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if((optind >= argc) || (top <= 0) || (max_instructions == 0))
+    {
+        fprintf(stderr, "Usage: %s [-n top] [-m max_instructions] [-v] <firmware.elf> [command ...]\n", argv[0]);
+        return 1;
+    }
+
+    ElfReader elf;
+    std::string error;
+    if(!elf.Load(argv[optind], error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    std::vector<std::string> commands(argv + optind + 1, argv + argc);
+    if(commands.empty())
+    {
+        commands = {"set_fan_speed,50", "get_fan_speed"};
+    }
+
+    Emulator emu;
+    if(!emu.Load(elf, error))
+    {
+        fprintf(stderr, "%s: %s\n", argv[optind], error.c_str());
+        return 1;
+    }
+
+    std::vector<Scenario> scenarios;
+    scenarios.push_back(emu.Run("boot", "", max_instructions));
+
+    for(const std::string &command : commands)
+    {
+        if(!scenarios.back().error.empty())
+        {
+            break;
+        }
+        /* The first run completes the deferred init and fills the caches of the firmware */
+        Scenario warmup = emu.Run(command, command + "\r", max_instructions);
+        scenarios.push_back(warmup.error.empty() ? emu.Run(command, command + "\r", max_instructions) : warmup);
+    }
+
+    for(const Scenario &scenario : scenarios)
+    {
+        print_scenario(scenario, emu.Functions(), top);
+    }
+
+    if(verbose)
+    {
+        fprintf(stderr, "%s", emu.Output().c_str());
+    }
+
+    return scenarios.back().error.empty() ? 0 : 1;
+}
@@ -0,0 +1,546 @@
+/*
+ Metrics exporter: polls the controllers over their consoles and serves the
+ results to Prometheus-compatible scrapers.
+
+ Usage: exporter [-S count] [-b baud] [-i interval_ms] [-J jitter_pct] [-E polls]
+                 [-t timeout_ms] [-l address] [-e firmware.elf] [ports...]
+
+ The ports are kept open and polled with get_fan_speed every interval, with
+ i2c_errors every E-th poll (default 10). The devices are spread evenly over
+ the interval and every poll is moved by a random jitter of up to J % of the
+ interval (default 10), so the rack isn't polled in bursts. A device that
+ goes offline is reopened on its next slot.
+
+ Results go to per-device atomics and lock-free sample rings
+ (sample_ring.h) written by the polling thread. The HTTP thread
+ (metrics_server.h) renders them on a scrape, at most once per new result,
+ and never blocks the polling. Listens on 127.0.0.1:9650 by default, -l takes
+ "host:port" or a Unix socket path.
+
+ -S  poll a local stand-in of count devices on ptys (host/fleet/standin.h)
+ -e  firmware ELF, decodes the replies of a DLOG=1 build
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "elf_reader.h"
+#include "fleet.h"
+#include "standin.h"
+#include "metrics_server.h"
+#include "sample_ring.h"
+
+#define DEFAULT_BAUD                115200
+#define DEFAULT_INTERVAL_MS         1000
+#define DEFAULT_JITTER_PCT          10
+#define DEFAULT_ERRORS_EVERY        10
+#define DEFAULT_TIMEOUT_MS          1000
+#define DEFAULT_LISTEN              "127.0.0.1:9650"
+#define STANDIN_COMMAND_US          500
+
+/* Recent samples kept per device, the latency quantiles are taken over them */
+#define HISTORY_SAMPLES             256
+
+/* Lines of i2c_errors */
+#define I2C_COUNTERS                9
+
+struct I2cCounter
+{
+    const char *label;              /* in the i2c_errors output */
+    const char *metric;
+    const char *error_class;        /* label of fan_controller_i2c_errors, nullptr for other metrics */
+};
+
+static const I2cCounter i2c_counters[I2C_COUNTERS] =
+{
+    {"NACK",        "fan_controller_i2c_errors",        "NACK"},
+    {"ARLO",        "fan_controller_i2c_errors",        "ARLO"},
+    {"BERR",        "fan_controller_i2c_errors",        "BERR"},
+    {"Timeout",     "fan_controller_i2c_errors",        "Timeout"},
+    {"Retries",     "fan_controller_i2c_retries",       nullptr},
+    {"Failures",    "fan_controller_i2c_failures",      nullptr},
+    {"Resets",      "fan_controller_i2c_resets",        nullptr},
+    {"Bus clears",  "fan_controller_i2c_bus_clears",    nullptr},
+    {"Re-inits",    "fan_controller_i2c_reinits",       nullptr}
+};
+
+struct Sample
+{
+    uint64_t time_us;
+    uint32_t latency_us;
+    int32_t speed;
+    int32_t rpm;
+    uint32_t status;                /* CommandStatus */
+};
+
+/**
+ * @brief Written by the polling thread only, read by the HTTP thread
+ */
+struct DeviceMetrics
+{
+    std::string name;
+    std::atomic<bool> up{true};
+    std::atomic<int32_t> speed{-1};
+    std::atomic<int32_t> rpm{-1};
+    std::atomic<uint64_t> commands{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> timeouts{0};
+    std::atomic<uint64_t> skipped{0};           /* polls skipped, the previous one still in flight */
+    std::atomic<uint64_t> latency_sum_us{0};
+    std::atomic<uint64_t> latency_count{0};
+    std::atomic<bool> i2c_valid{false};
+    std::atomic<uint64_t> i2c[I2C_COUNTERS];
+    SampleRing<Sample, HISTORY_SAMPLES> history;
+};
+
+struct Options
+{
+    size_t standin = 0;
+    uint32_t baud = DEFAULT_BAUD;
+    uint32_t interval_ms = DEFAULT_INTERVAL_MS;
+    uint32_t jitter_pct = DEFAULT_JITTER_PCT;
+    uint32_t errors_every = DEFAULT_ERRORS_EVERY;
+    uint32_t timeout_ms = DEFAULT_TIMEOUT_MS;
+    std::string listen = DEFAULT_LISTEN;
+    const char *elf = nullptr;
+};
+
+struct Due
+{
+    uint64_t at_us;
+    size_t device;
+
+    bool operator>(const Due &other) const { return at_us > other.at_us; }
+};
+
+static std::atomic<bool> running;
+static std::atomic<uint64_t> generation;        /* bumped on every result and up/down change */
+static std::vector<std::unique_ptr<DeviceMetrics>> metrics;
+
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    running = false;
+}
+
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: exporter [-S count] [-b baud] [-i interval_ms] [-J jitter_pct] [-E polls]\n"
+                    "                [-t timeout_ms] [-l address] [-e firmware.elf] [ports...]\n");
+    exit(1);
+}
+
+
+static void on_result(size_t device, const CommandResult &result)
+{
+    DeviceMetrics &m = *metrics[device];
+    Sample sample = {Fleet_NowUs(), (uint32_t)result.latency_us, result.speed, result.rpm, (uint32_t)result.status};
+
+    m.commands.fetch_add(1, std::memory_order_relaxed);
+    if((result.status == CommandStatus::Error) || (result.status == CommandStatus::NotFound))
+    {
+        m.errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    if(result.status == CommandStatus::Timeout)
+    {
+        m.timeouts.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        m.latency_sum_us.fetch_add(result.latency_us, std::memory_order_relaxed);
+        m.latency_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if(result.speed >= 0)
+    {
+        m.speed.store(result.speed, std::memory_order_relaxed);
+    }
+    if(result.rpm >= 0)
+    {
+        m.rpm.store(result.rpm, std::memory_order_relaxed);
+    }
+
+    for(const std::pair<std::string, uint64_t> &counter : result.counters)
+    {
+        for(size_t i = 0; i < I2C_COUNTERS; i++)
+        {
+            if(counter.first == i2c_counters[i].label)
+            {
+                m.i2c[i].store(counter.second, std::memory_order_relaxed);
+                m.i2c_valid.store(true, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    m.history.Push(sample);
+    generation.fetch_add(1, std::memory_order_release);
+}
+
+
+/**
+ * @brief Exposition writer, counters are named the way each format wants them
+ */
+class Exposition
+{
+public:
+    explicit Exposition(bool openmetrics) : openmetrics(openmetrics) {}
+
+    void Family(const char *name, const char *type, const char *help)
+    {
+        bool counter = (strcmp(type, "counter") == 0);
+
+        out += "# HELP ";
+        out += name;
+        out += (counter && !openmetrics) ? "_total " : " ";
+        out += help;
+        out += "\n# TYPE ";
+        out += name;
+        out += (counter && !openmetrics) ? "_total " : " ";
+        out += type;
+        out += "\n";
+    }
+
+    void Value(const char *name, const char *suffix, const DeviceMetrics &m, const char *extra, double value)
+    {
+        char buf[64];
+
+        /* Counters print exactly, %g would round them past 9 digits */
+        if(value == (double)(int64_t)value)
+        {
+            snprintf(buf, sizeof(buf), "%lld", (long long)value);
+        }
+        else
+        {
+            snprintf(buf, sizeof(buf), "%.9g", value);
+        }
+        out += name;
+        out += suffix;
+        out += "{device=\"" + m.name + "\"";
+        if(extra != nullptr)
+        {
+            out += ",";
+            out += extra;
+        }
+        out += "} ";
+        out += buf;
+        out += "\n";
+    }
+
+    std::string out;
+
+private:
+    bool openmetrics;
+};
+
+
+static std::shared_ptr<const std::string> render_metrics(bool openmetrics)
+{
+    Exposition exp(openmetrics);
+    std::vector<Sample> samples(HISTORY_SAMPLES);
+    std::vector<std::vector<uint32_t>> latencies(metrics.size());
+
+    for(size_t i = 0; i < metrics.size(); i++)
+    {
+        size_t count = metrics[i]->history.Snapshot(samples.data());
+
+        for(size_t j = 0; j < count; j++)
+        {
+            if(samples[j].status != (uint32_t)CommandStatus::Timeout)
+            {
+                latencies[i].push_back(samples[j].latency_us);
+            }
+        }
+        std::sort(latencies[i].begin(), latencies[i].end());
+    }
+
+    exp.Family("fan_controller_up", "gauge", "Console of the controller is open.");
+    for(auto &m : metrics)
+    {
+        exp.Value("fan_controller_up", "", *m, nullptr, m->up.load(std::memory_order_relaxed) ? 1 : 0);
+    }
+
+    exp.Family("fan_controller_speed_percent", "gauge", "Actual fan speed, get_fan_speed.");
+    for(auto &m : metrics)
+    {
+        if(m->speed.load(std::memory_order_relaxed) >= 0)
+        {
+            exp.Value("fan_controller_speed_percent", "", *m, nullptr, m->speed.load(std::memory_order_relaxed));
+        }
+    }
+
+    exp.Family("fan_controller_rpm", "gauge", "Fan RPM from the tachometer, get_fan_speed.");
+    for(auto &m : metrics)
+    {
+        if(m->rpm.load(std::memory_order_relaxed) >= 0)
+        {
+            exp.Value("fan_controller_rpm", "", *m, nullptr, m->rpm.load(std::memory_order_relaxed));
+        }
+    }
+
+    exp.Family("fan_controller_commands", "counter", "Console commands completed, timeouts included.");
+    for(auto &m : metrics)
+    {
+        exp.Value("fan_controller_commands", "_total", *m, nullptr, m->commands.load(std::memory_order_relaxed));
+    }
+
+    exp.Family("fan_controller_command_errors", "counter", "Commands answered with an error.");
+    for(auto &m : metrics)
+    {
+        exp.Value("fan_controller_command_errors", "_total", *m, nullptr, m->errors.load(std::memory_order_relaxed));
+    }
+
+    exp.Family("fan_controller_command_timeouts", "counter", "Commands without a complete reply in time.");
+    for(auto &m : metrics)
+    {
+        exp.Value("fan_controller_command_timeouts", "_total", *m, nullptr, m->timeouts.load(std::memory_order_relaxed));
+    }
+
+    exp.Family("fan_controller_polls_skipped", "counter", "Polls skipped because the previous one was still in flight.");
+    for(auto &m : metrics)
+    {
+        exp.Value("fan_controller_polls_skipped", "_total", *m, nullptr, m->skipped.load(std::memory_order_relaxed));
+    }
+
+    exp.Family("fan_controller_command_latency_seconds", "summary", "Command round trip, quantiles over the recent samples.");
+    for(size_t i = 0; i < metrics.size(); i++)
+    {
+        const DeviceMetrics &m = *metrics[i];
+        const std::vector<uint32_t> &lat = latencies[i];
+
+        for(const char *q : {"0.5", "0.9", "0.99"})
+        {
+            if(!lat.empty())
+            {
+                size_t index = std::min(lat.size() - 1, (size_t)(atof(q) * lat.size()));
+
+                exp.Value("fan_controller_command_latency_seconds", "", m, (std::string("quantile=\"") + q + "\"").c_str(),
+                          lat[index] / 1e6);
+            }
+        }
+        exp.Value("fan_controller_command_latency_seconds", "_sum", m, nullptr, m.latency_sum_us.load(std::memory_order_relaxed) / 1e6);
+        exp.Value("fan_controller_command_latency_seconds", "_count", m, nullptr, m.latency_count.load(std::memory_order_relaxed));
+    }
+
+    /* Device counters since its reset, from i2c_errors */
+    for(size_t c = 0; c < I2C_COUNTERS; c++)
+    {
+        if((c == 0) || (strcmp(i2c_counters[c].metric, i2c_counters[c - 1].metric) != 0))
+        {
+            exp.Family(i2c_counters[c].metric, "counter", i2c_counters[c].error_class ? "I2C errors per class, i2c_errors."
+                                                                                       : "I2C recovery counter, i2c_errors.");
+        }
+        for(auto &m : metrics)
+        {
+            if(m->i2c_valid.load(std::memory_order_relaxed))
+            {
+                std::string label = i2c_counters[c].error_class ? std::string("class=\"") + i2c_counters[c].error_class + "\"" : "";
+
+                exp.Value(i2c_counters[c].metric, "_total", *m, label.empty() ? nullptr : label.c_str(),
+                          m->i2c[c].load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    return std::make_shared<const std::string>(std::move(exp.out));
+}
+
+
+/**
+ * @brief The body is rendered again only after a new result, the scrapes in between share it
+ */
+static std::shared_ptr<const std::string> render_cached(bool openmetrics)
+{
+    static std::shared_ptr<const std::string> cache[2];
+    static uint64_t cache_generation[2] = {UINT64_MAX, UINT64_MAX};
+    uint64_t now = generation.load(std::memory_order_acquire);
+
+    if(cache_generation[openmetrics] != now)
+    {
+        cache[openmetrics] = render_metrics(openmetrics);
+        cache_generation[openmetrics] = now;
+    }
+
+    return cache[openmetrics];
+}
+
+
+/**
+ * @brief Poll the devices on their slots until stopped
+ */
+static void poll_devices(Fleet &fleet, const Options &options)
+{
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> schedule;
+    uint64_t interval_us = (uint64_t)options.interval_ms * 1000;
+    int64_t jitter_max = (int64_t)(interval_us * options.jitter_pct / 100);
+    std::uniform_int_distribution<int64_t> jitter(-jitter_max, jitter_max);
+    std::mt19937 rng(1);
+    std::vector<uint64_t> slot(fleet.Size());
+    std::vector<uint32_t> polls(fleet.Size());
+    std::string error;
+    uint64_t start = Fleet_NowUs();
+
+    for(size_t i = 0; i < fleet.Size(); i++)
+    {
+        slot[i] = start + interval_us * i / fleet.Size();
+        schedule.push(Due{slot[i], i});
+    }
+
+    while(running)
+    {
+        uint64_t now = Fleet_NowUs();
+
+        while(!schedule.empty() && (schedule.top().at_us <= now))
+        {
+            size_t i = schedule.top().device;
+            DeviceMetrics &m = *metrics[i];
+
+            schedule.pop();
+
+            if(fleet.Reopen(i, error))
+            {
+                if(fleet.Pending(i) == 0)
+                {
+                    fleet.Submit(i, "get_fan_speed");
+                    if((options.errors_every != 0) && (polls[i]++ % options.errors_every == 0))
+                    {
+                        fleet.Submit(i, "i2c_errors");
+                    }
+                }
+                else
+                {
+                    m.skipped.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+
+            /* The slots stay on the grid, only the poll moves */
+            slot[i] += interval_us;
+            if(slot[i] + jitter_max < now)
+            {
+                slot[i] = now + interval_us;
+            }
+            schedule.push(Due{(uint64_t)((int64_t)slot[i] + jitter(rng)), i});
+        }
+
+        for(size_t i = 0; i < fleet.Size(); i++)
+        {
+            if(metrics[i]->up.exchange(fleet.Stats(i).online, std::memory_order_relaxed) != fleet.Stats(i).online)
+            {
+                generation.fetch_add(1, std::memory_order_release);
+            }
+        }
+
+        if(!fleet.Run(schedule.empty() ? now + 100000 : schedule.top().at_us))
+        {
+            perror("exporter: epoll");
+            running = false;
+        }
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    std::vector<std::string> ports;
+    std::string error;
+    ElfReader elf;
+    int opt;
+
+    while((opt = getopt(argc, argv, "S:b:i:J:E:t:l:e:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'S': options.standin = strtoul(optarg, nullptr, 0); break;
+            case 'b': options.baud = strtoul(optarg, nullptr, 0); break;
+            case 'i': options.interval_ms = strtoul(optarg, nullptr, 0); break;
+            case 'J': options.jitter_pct = strtoul(optarg, nullptr, 0); break;
+            case 'E': options.errors_every = strtoul(optarg, nullptr, 0); break;
+            case 't': options.timeout_ms = strtoul(optarg, nullptr, 0); break;
+            case 'l': options.listen = optarg; break;
+            case 'e': options.elf = optarg; break;
+            default: usage();
+        }
+    }
+
+    for(int i = optind; i < argc; i++)
+    {
+        ports.push_back(argv[i]);
+    }
+
+    if((ports.empty() && (options.standin == 0)) || (options.interval_ms == 0) || (options.jitter_pct > 50) ||
+       options.listen.empty())
+    {
+        usage();
+    }
+
+    if((options.elf != nullptr) && (!elf.Load(options.elf, error) || (DLogDecoder::FindStrings(elf, error) == nullptr)))
+    {
+        fprintf(stderr, "%s: %s\n", options.elf, error.c_str());
+        return 1;
+    }
+
+    StandIn standin(options.baud, STANDIN_COMMAND_US, 1);
+    if(options.standin != 0)
+    {
+        if(!standin.Start(options.standin, error))
+        {
+            fprintf(stderr, "exporter: %s\n", error.c_str());
+            return 1;
+        }
+        ports.insert(ports.end(), standin.Paths().begin(), standin.Paths().end());
+    }
+
+    Fleet fleet(1, options.timeout_ms, (options.elf != nullptr) ? &elf : nullptr);
+    for(const std::string &port : ports)
+    {
+        if(!fleet.Add(port, (options.standin != 0) ? DEFAULT_BAUD : options.baud, error))
+        {
+            fprintf(stderr, "exporter: %s\n", error.c_str());
+            return 1;
+        }
+        metrics.emplace_back(new DeviceMetrics());
+        metrics.back()->name = port;
+        for(std::atomic<uint64_t> &counter : metrics.back()->i2c)
+        {
+            counter.store(0, std::memory_order_relaxed);
+        }
+    }
+    fleet.SetResultHandler(on_result);
+
+    MetricsServer server(render_cached);
+    if(!server.Listen(options.listen, error))
+    {
+        fprintf(stderr, "exporter: %s\n", error.c_str());
+        return 1;
+    }
+    fprintf(stderr, "exporter: %zu devices, serving %s\n", fleet.Size(), options.listen.c_str());
+
+    running = true;
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::thread http([&server]() { server.Run(running); });
+    poll_devices(fleet, options);
+    http.join();
+
+    fprintf(stderr, "exporter: %llu scrapes served\n", (unsigned long long)server.Scrapes());
+    standin.Stop();
+    return 0;
+}
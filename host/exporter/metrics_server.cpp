@@ -0,0 +1,389 @@
+#include "metrics_server.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAX_EVENTS                  64
+#define RX_CHUNK                    4096
+/* Requests are a line and a few headers, anything longer is dropped */
+#define MAX_REQUEST                 16384
+/* Stop checks of the loop, ms */
+#define IDLE_WAIT_MS                100
+
+#define CONTENT_TYPE_TEXT           "text/plain; version=0.0.4; charset=utf-8"
+#define CONTENT_TYPE_OPENMETRICS    "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+
+MetricsServer::~MetricsServer()
+{
+    for(auto &conn : connections)
+    {
+        close(conn.first);
+    }
+    if(listen_fd >= 0)
+    {
+        close(listen_fd);
+    }
+    if(epoll_fd >= 0)
+    {
+        close(epoll_fd);
+    }
+    if(!unix_path.empty())
+    {
+        unlink(unix_path.c_str());
+    }
+}
+
+
+bool MetricsServer::Listen(const std::string &address, std::string &error)
+{
+    struct epoll_event ev = {};
+
+    if(address[0] == '/')
+    {
+        struct sockaddr_un addr = {};
+
+        if(address.size() >= sizeof(addr.sun_path))
+        {
+            error = "socket path too long: " + address;
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, address.c_str());
+        unlink(address.c_str());
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if((listen_fd < 0) || (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0))
+        {
+            error = "can't bind " + address + ": " + strerror(errno);
+            return false;
+        }
+        unix_path = address;
+    }
+    else
+    {
+        struct sockaddr_in addr = {};
+        size_t colon = address.rfind(':');
+        std::string host = (colon == std::string::npos || colon == 0) ? "127.0.0.1" : address.substr(0, colon);
+        int one = 1;
+
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)atoi(address.c_str() + (colon == std::string::npos ? 0 : colon + 1)));
+        if(inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+        {
+            error = "bad address " + address;
+            return false;
+        }
+
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if(listen_fd >= 0)
+        {
+            setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+        if((listen_fd < 0) || (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0))
+        {
+            error = "can't bind " + address + ": " + strerror(errno);
+            return false;
+        }
+    }
+
+    epoll_fd = epoll_create1(0);
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd;
+    if((listen(listen_fd, SOMAXCONN) != 0) || (epoll_fd < 0) || (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) != 0))
+    {
+        error = "can't listen on " + address + ": " + strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+
+void MetricsServer::Run(const std::atomic<bool> &running)
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    while(running)
+    {
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, IDLE_WAIT_MS);
+
+        for(int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            auto it = connections.find(fd);
+
+            if(fd == listen_fd)
+            {
+                Accept();
+            }
+            else if(it != connections.end())
+            {
+                if((events[i].events & EPOLLOUT) && !Transmit(it->second))
+                {
+                    continue;
+                }
+                if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                {
+                    Receive(it->second);
+                }
+            }
+        }
+    }
+}
+
+
+void MetricsServer::Accept()
+{
+    while(1)
+    {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK);
+        struct epoll_event ev = {};
+        int one = 1;
+
+        if(fd < 0)
+        {
+            return;
+        }
+
+        /* Responses go out in one writev, don't hold the last segment back */
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            close(fd);
+            continue;
+        }
+
+        Connection &conn = connections[fd];
+        conn.fd = fd;
+    }
+}
+
+
+void MetricsServer::Receive(Connection &conn)
+{
+    char buf[RX_CHUNK];
+    int fd = conn.fd;
+
+    while(1)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf));
+
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno == EAGAIN)
+            {
+                break;
+            }
+            Drop(fd);
+            return;
+        }
+        if(n == 0)
+        {
+            Drop(fd);
+            return;
+        }
+        conn.in.append(buf, n);
+    }
+
+    /* Pipelined requests are answered in order, one response in flight */
+    while(!conn.out_wait)
+    {
+        size_t end = conn.in.find("\r\n\r\n");
+
+        if(end == std::string::npos)
+        {
+            if(conn.in.size() > MAX_REQUEST)
+            {
+                Drop(fd);
+            }
+            return;
+        }
+
+        std::string request = conn.in.substr(0, end);
+        conn.in.erase(0, end + 4);
+
+        if(!Respond(conn, request) || !Transmit(conn))
+        {
+            return;
+        }
+    }
+}
+
+
+/**
+ * @brief Build the response of a request
+ * @retval false if the connection was dropped
+ */
+bool MetricsServer::Respond(Connection &conn, const std::string &request)
+{
+    std::string lower(request);
+    char method[16] = "";
+    char path[256] = "";
+    char version[16] = "";
+    bool openmetrics;
+    const char *status = "200 OK";
+    char head[256];
+
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+    if(sscanf(request.c_str(), "%15s %255s %15s", method, path, version) != 3)
+    {
+        Drop(conn.fd);
+        return false;
+    }
+
+    conn.close = (lower.find("\r\nconnection: close") != std::string::npos) ||
+                 ((strcmp(version, "HTTP/1.0") == 0) && (lower.find("\r\nconnection: keep-alive") == std::string::npos));
+    openmetrics = (lower.find("application/openmetrics-text") != std::string::npos);
+
+    conn.body.reset();
+    conn.tail.clear();
+
+    if((strcmp(method, "GET") != 0) && (strcmp(method, "HEAD") != 0))
+    {
+        status = "405 Method Not Allowed";
+    }
+    else if((strcmp(path, "/metrics") != 0) && (strcmp(path, "/") != 0))
+    {
+        status = "404 Not Found";
+    }
+    else
+    {
+        uint64_t count = scrapes.fetch_add(1, std::memory_order_relaxed) + 1;
+
+        conn.body = render(openmetrics);
+        conn.tail = openmetrics ? "# HELP fan_exporter_scrapes Scrapes served.\n# TYPE fan_exporter_scrapes counter\n"
+                                : "# HELP fan_exporter_scrapes_total Scrapes served.\n# TYPE fan_exporter_scrapes_total counter\n";
+        conn.tail += "fan_exporter_scrapes_total " + std::to_string(count) + "\n";
+        if(openmetrics)
+        {
+            conn.tail += "# EOF\n";
+        }
+    }
+
+    size_t length = (conn.body ? conn.body->size() : 0) + conn.tail.size();
+    snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s\r\n", status,
+             openmetrics ? CONTENT_TYPE_OPENMETRICS : CONTENT_TYPE_TEXT, length, conn.close ? "Connection: close\r\n" : "");
+    conn.head = head;
+
+    if(strcmp(method, "HEAD") == 0)
+    {
+        conn.body.reset();
+        conn.tail.clear();
+    }
+
+    conn.sent = 0;
+    return true;
+}
+
+
+/**
+ * @brief Write the rest of the response
+ * @retval false if the connection was dropped
+ */
+bool MetricsServer::Transmit(Connection &conn)
+{
+    const std::string empty;
+    const std::string &body = conn.body ? *conn.body : empty;
+    size_t total = conn.head.size() + body.size() + conn.tail.size();
+    struct epoll_event ev = {};
+    int fd = conn.fd;
+
+    while(conn.sent < total)
+    {
+        struct iovec iov[3];
+        int count = 0;
+        size_t skip = conn.sent;
+
+        const std::string *parts[3] = {&conn.head, &body, &conn.tail};
+
+        for(const std::string *part : parts)
+        {
+            if(skip >= part->size())
+            {
+                skip -= part->size();
+                continue;
+            }
+            iov[count].iov_base = (void *)(part->data() + skip);
+            iov[count].iov_len = part->size() - skip;
+            count++;
+            skip = 0;
+        }
+
+        ssize_t n = writev(fd, iov, count);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno != EAGAIN)
+            {
+                Drop(fd);
+                return false;
+            }
+
+            if(!conn.out_wait)
+            {
+                ev.events = EPOLLIN | EPOLLOUT;
+                ev.data.fd = fd;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+                conn.out_wait = true;
+            }
+            return true;
+        }
+        conn.sent += n;
+    }
+
+    conn.body.reset();
+
+    if(conn.close)
+    {
+        Drop(fd);
+        return false;
+    }
+
+    if(conn.out_wait)
+    {
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        conn.out_wait = false;
+
+        /* Requests that came in meanwhile */
+        Receive(conn);
+        return connections.count(fd) != 0;
+    }
+
+    return true;
+}
+
+
+void MetricsServer::Drop(int fd)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections.erase(fd);
+}
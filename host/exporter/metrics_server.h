@@ -0,0 +1,72 @@
+#ifndef HOST_EXPORTER_METRICS_SERVER_H_
+#define HOST_EXPORTER_METRICS_SERVER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+/*
+ HTTP/1.1 endpoint for the scrapers: GET /metrics on TCP or a Unix socket,
+ keep-alive and pipelined requests, one epoll thread. The body comes from the
+ render callback as a shared buffer, it's written out with writev and not
+ copied per scrape. OpenMetrics is served when the Accept header asks for it.
+*/
+
+class MetricsServer
+{
+public:
+    /**
+     * @brief Exposition body
+     * @param[in] openmetrics OpenMetrics 1.0 instead of the Prometheus text format 0.0.4
+     */
+    typedef std::function<std::shared_ptr<const std::string>(bool openmetrics)> Render;
+
+    explicit MetricsServer(Render render) : render(render) {}
+    ~MetricsServer();
+
+    /**
+     * @brief Open the listening socket
+     * @param[in] address "host:port", ":port" for localhost, or a Unix socket path starting with '/'
+     * @param[out] error description on failure
+     * @retval true on success
+     */
+    bool Listen(const std::string &address, std::string &error);
+
+    /**
+     * @brief Serve until running is cleared
+     */
+    void Run(const std::atomic<bool> &running);
+
+    uint64_t Scrapes() const { return scrapes.load(std::memory_order_relaxed); }
+
+private:
+    struct Connection
+    {
+        int fd;
+        std::string in;
+        std::string head;               /* status line and headers */
+        std::shared_ptr<const std::string> body;
+        std::string tail;               /* server metrics of this scrape */
+        size_t sent = 0;
+        bool close = false;             /* after the response */
+        bool out_wait = false;          /* EPOLLOUT armed */
+    };
+
+    void Accept();
+    void Receive(Connection &conn);
+    bool Respond(Connection &conn, const std::string &request);
+    bool Transmit(Connection &conn);
+    void Drop(int fd);
+
+    Render render;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    std::string unix_path;
+    std::map<int, Connection> connections;
+    std::atomic<uint64_t> scrapes{0};
+};
+
+#endif /* HOST_EXPORTER_METRICS_SERVER_H_ */
@@ -0,0 +1,105 @@
+#ifndef HOST_EXPORTER_SAMPLE_RING_H_
+#define HOST_EXPORTER_SAMPLE_RING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/*
+ Ring of the recent samples of a device, one writer and any number of
+ readers without locks. Every slot is a seqlock: the writer marks it odd while
+ storing, a reader keeps a copy only if the sequence was even and unchanged
+ around it. The words are atomics, so a torn read is detected, never undefined.
+ A reader racing the writer loses at most the slots overwritten meanwhile.
+*/
+
+template<typename T, size_t N>
+class SampleRing
+{
+    static_assert((N & (N - 1)) == 0, "SampleRing: N must be a power of 2");
+    static_assert(sizeof(T) % sizeof(uint64_t) == 0, "SampleRing: T must be made of 64-bit words");
+    static_assert(std::is_trivially_copyable<T>::value, "SampleRing: T must be trivially copyable");
+
+public:
+    SampleRing()
+    {
+        for(Slot &slot : slots)
+        {
+            slot.seq.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Store a sample, overwriting the oldest one. Writer thread only
+     */
+    void Push(const T &sample)
+    {
+        uint64_t n = head.load(std::memory_order_relaxed);
+        Slot &slot = slots[n & (N - 1)];
+        uint64_t words[WORDS];
+
+        memcpy(words, &sample, sizeof(words));
+
+        slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for(size_t i = 0; i < WORDS; i++)
+        {
+            slot.words[i].store(words[i], std::memory_order_relaxed);
+        }
+        slot.seq.store(2 * n + 2, std::memory_order_release);
+        head.store(n + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Copy the samples held, oldest first. Any thread
+     * @param[out] out room for N samples
+     * @retval number of samples copied
+     */
+    size_t Snapshot(T *out) const
+    {
+        uint64_t end = head.load(std::memory_order_acquire);
+        uint64_t start = (end > N) ? end - N : 0;
+        size_t count = 0;
+
+        for(uint64_t n = start; n < end; n++)
+        {
+            const Slot &slot = slots[n & (N - 1)];
+            uint64_t words[WORDS];
+            uint64_t seq = slot.seq.load(std::memory_order_acquire);
+
+            if(seq != 2 * n + 2)
+            {
+                continue;
+            }
+            for(size_t i = 0; i < WORDS; i++)
+            {
+                words[i] = slot.words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(slot.seq.load(std::memory_order_relaxed) != seq)
+            {
+                continue;
+            }
+
+            memcpy(&out[count++], words, sizeof(words));
+        }
+
+        return count;
+    }
+
+private:
+    static const size_t WORDS = sizeof(T) / sizeof(uint64_t);
+
+    struct Slot
+    {
+        std::atomic<uint64_t> seq;
+        std::atomic<uint64_t> words[WORDS];
+    };
+
+    Slot slots[N];
+    std::atomic<uint64_t> head{0};
+};
+
+#endif /* HOST_EXPORTER_SAMPLE_RING_H_ */
@@ -0,0 +1,559 @@
+#include "fleet.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define MAX_EVENTS                  64
+#define RX_CHUNK                    4096
+#define MAX_LINE                    256
+/* Timeouts are checked at least this often, ms */
+#define TIMEOUT_CHECK_MS            10
+
+#define ESC                         0x1B
+
+
+uint64_t Fleet_NowUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+/**
+ * @brief The commands that print "Actual speed:" after their status
+ */
+static bool reports_speed(const std::string &command)
+{
+    return (command.compare(0, 13, "set_fan_speed") == 0) || (command.compare(0, 13, "get_fan_speed") == 0);
+}
+
+
+static bool starts_with(const std::string &str, const char *prefix)
+{
+    return str.compare(0, strlen(prefix), prefix) == 0;
+}
+
+
+/**
+ * @brief Counter line of i2c_errors: name, optional colon, spaces, value
+ * @retval false if the line isn't one
+ */
+static bool parse_counter(const std::string &line, std::pair<std::string, uint64_t> &counter)
+{
+    size_t space = line.rfind(' ');
+    size_t name_end;
+    char *end;
+
+    if((space == std::string::npos) || (space + 1 == line.size()) || ((name_end = line.find_last_not_of(' ', space)) == std::string::npos))
+    {
+        return false;
+    }
+
+    counter.second = strtoull(line.c_str() + space + 1, &end, 10);
+    if(*end != '\0')
+    {
+        return false;
+    }
+
+    counter.first = line.substr(0, (line[name_end] == ':') ? name_end : name_end + 1);
+    return true;
+}
+
+
+Fleet::Device::Device(Fleet *fleet, size_t index) :
+    index(index),
+    decoder(fleet->elf, false, [fleet, this](const char *text, size_t len) { fleet->PutText(*this, text, len); })
+{
+}
+
+
+Fleet::Fleet(uint32_t depth, uint32_t timeout_ms, const ElfReader *elf) :
+    depth(depth ? depth : 1), timeout_us((uint64_t)timeout_ms * 1000), elf(elf)
+{
+    epoll_fd = epoll_create1(0);
+}
+
+
+Fleet::~Fleet()
+{
+    if(epoll_fd >= 0)
+    {
+        close(epoll_fd);
+    }
+}
+
+
+bool Fleet::Add(const std::string &path, uint32_t baud, std::string &error)
+{
+    std::unique_ptr<Device> dev(new Device(this, devices.size()));
+    struct epoll_event ev = {};
+
+    if(epoll_fd < 0)
+    {
+        error = std::string("epoll: ") + strerror(errno);
+        return false;
+    }
+
+    if(!dev->port.Open(path, baud, error, true))
+    {
+        return false;
+    }
+    dev->name = path;
+    dev->baud = baud;
+    /* A device just reset drops the first character measuring its rate, an empty line goes
+       out before the first command */
+    dev->tx = "\r";
+
+    ev.events = EPOLLIN;
+    ev.data.u64 = dev->index;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, dev->port.Fd(), &ev) != 0)
+    {
+        error = "can't watch " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    devices.push_back(std::move(dev));
+    return true;
+}
+
+
+bool Fleet::Reopen(size_t device, std::string &error)
+{
+    Device &dev = *devices[device];
+    struct epoll_event ev = {};
+
+    if(dev.stats.online)
+    {
+        return true;
+    }
+
+    if(!dev.port.Open(dev.name, dev.baud, error, true))
+    {
+        return false;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.u64 = dev.index;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, dev.port.Fd(), &ev) != 0)
+    {
+        error = "can't watch " + dev.name + ": " + strerror(errno);
+        dev.port.Close();
+        return false;
+    }
+
+    dev.line.clear();
+    dev.escape = false;
+    dev.tx = "\r";
+    dev.tx_wait = false;
+    dev.stats.online = true;
+    return true;
+}
+
+
+void Fleet::Submit(size_t device, const std::string &command)
+{
+    Device &dev = *devices[device];
+
+    if(!dev.stats.online)
+    {
+        return;
+    }
+    dev.queue.push_back(command);
+
+    /* Batches are put together once the caller is done submitting, in Run() or after a reply */
+    if(batch == 1)
+    {
+        Dispatch(dev);
+    }
+}
+
+
+size_t Fleet::Pending(size_t device) const
+{
+    return devices[device]->queue.size() + devices[device]->in_flight.size();
+}
+
+
+/**
+ * @brief Move queued commands to the output while the pipeline has room
+ */
+void Fleet::Dispatch(Device &dev)
+{
+    uint64_t now = Fleet_NowUs();
+    uint32_t line_commands = 0;
+    bool added = false;
+
+    while((dev.in_flight.size() < depth) && !dev.queue.empty())
+    {
+        InFlight cmd;
+
+        cmd.command = dev.queue.front();
+        cmd.sent_us = now;
+        dev.queue.pop_front();
+
+        if(dev.in_flight.empty())
+        {
+            dev.head_since_us = now;
+        }
+
+        /* The console reads a word up to the line end, a batch is one word */
+        if(added && (++line_commands < batch))
+        {
+            dev.tx += ';';
+        }
+        else
+        {
+            if(added)
+            {
+                dev.tx += '\r';
+            }
+            line_commands = 0;
+        }
+        dev.tx += cmd.command;
+        dev.in_flight.push_back(cmd);
+        added = true;
+    }
+
+    if(added)
+    {
+        dev.tx += '\r';
+    }
+
+    if(added && !dev.tx_wait)
+    {
+        Transmit(dev);
+    }
+}
+
+
+void Fleet::Transmit(Device &dev)
+{
+    struct epoll_event ev = {};
+
+    while(dev.tx_pos < dev.tx.size())
+    {
+        ssize_t n = write(dev.port.Fd(), dev.tx.data() + dev.tx_pos, dev.tx.size() - dev.tx_pos);
+
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno != EAGAIN)
+            {
+                Disconnect(dev);
+                return;
+            }
+
+            /* Driver buffer full, continue when it drains */
+            if(!dev.tx_wait)
+            {
+                ev.events = EPOLLIN | EPOLLOUT;
+                ev.data.u64 = dev.index;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, dev.port.Fd(), &ev);
+                dev.tx_wait = true;
+            }
+            return;
+        }
+
+        dev.tx_pos += n;
+        dev.stats.tx_bytes += n;
+    }
+
+    dev.tx.clear();
+    dev.tx_pos = 0;
+
+    if(dev.tx_wait)
+    {
+        ev.events = EPOLLIN;
+        ev.data.u64 = dev.index;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, dev.port.Fd(), &ev);
+        dev.tx_wait = false;
+    }
+}
+
+
+void Fleet::Receive(Device &dev)
+{
+    uint8_t buf[RX_CHUNK];
+
+    while(dev.stats.online)
+    {
+        ssize_t n = read(dev.port.Fd(), buf, sizeof(buf));
+
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno != EAGAIN)
+            {
+                /* EIO: the other side of a pty has gone */
+                Disconnect(dev);
+            }
+            return;
+        }
+        if(n == 0)
+        {
+            Disconnect(dev);
+            return;
+        }
+
+        dev.stats.rx_bytes += n;
+        for(ssize_t i = 0; i < n; i++)
+        {
+            dev.decoder.Feed(buf[i]);
+        }
+        dev.stats.records = dev.decoder.Records();
+
+        if((size_t)n < sizeof(buf))
+        {
+            return;
+        }
+    }
+}
+
+
+/**
+ * @brief Console text without the logging frames: split into lines, colors and erased characters removed
+ */
+void Fleet::PutText(Device &dev, const char *text, size_t len)
+{
+    for(size_t i = 0; i < len; i++)
+    {
+        char c = text[i];
+
+        if(dev.escape)
+        {
+            /* ESC [ parameters final, the final byte is 0x40..0x7E */
+            dev.escape = !((c >= '@') && (c <= '~') && (c != '['));
+            continue;
+        }
+
+        switch(c)
+        {
+            case ESC:
+                dev.escape = true;
+                break;
+
+            case '\r':
+            case '\n':
+                if(!dev.line.empty())
+                {
+                    ParseLine(dev, dev.line);
+                    dev.line.clear();
+                }
+                break;
+
+            case '\b':
+                if(!dev.line.empty())
+                {
+                    dev.line.pop_back();
+                }
+                break;
+
+            default:
+                if(dev.line.size() < MAX_LINE)
+                {
+                    dev.line += c;
+                }
+                break;
+        }
+    }
+}
+
+
+void Fleet::ParseLine(Device &dev, const std::string &line)
+{
+    if(dev.in_flight.empty())
+    {
+        return;
+    }
+
+    InFlight &head = dev.in_flight.front();
+    std::pair<std::string, uint64_t> counter;
+
+    if(starts_with(head.command, "i2c_errors") && parse_counter(line, counter))
+    {
+        head.result.counters.push_back(counter);
+        if(counter.first == "Re-inits")
+        {
+            Complete(dev, CommandStatus::Ok);
+        }
+    }
+    else if(starts_with(line, "Status: "))
+    {
+        if(line.compare(8, std::string::npos, "OK") != 0)
+        {
+            Complete(dev, CommandStatus::Error);
+        }
+        else if(!reports_speed(head.command))
+        {
+            Complete(dev, CommandStatus::Ok);
+        }
+    }
+    else if(starts_with(line, "Fan RPM: "))
+    {
+        head.result.rpm = atoi(line.c_str() + 9);
+    }
+    else if(starts_with(line, "Actual speed: "))
+    {
+        head.result.speed = atoi(line.c_str() + 14);
+        Complete(dev, CommandStatus::Ok);
+    }
+    else if(starts_with(line, "Command \"") && (line.find("is not found") != std::string::npos))
+    {
+        Complete(dev, CommandStatus::NotFound);
+    }
+}
+
+
+void Fleet::Complete(Device &dev, CommandStatus status)
+{
+    uint64_t now = Fleet_NowUs();
+    InFlight head = dev.in_flight.front();
+    CommandResult &result = head.result;
+
+    dev.in_flight.pop_front();
+    dev.head_since_us = now;
+
+    result.command = head.command;
+    result.status = status;
+    result.latency_us = now - head.sent_us;
+
+    dev.stats.commands++;
+    switch(status)
+    {
+        case CommandStatus::Ok:
+            if(result.speed >= 0)
+            {
+                dev.stats.speed = result.speed;
+            }
+            if(result.rpm >= 0)
+            {
+                dev.stats.rpm = result.rpm;
+            }
+            break;
+
+        case CommandStatus::Error:
+        case CommandStatus::NotFound:
+            dev.stats.errors++;
+            break;
+
+        case CommandStatus::Timeout:
+            dev.stats.timeouts++;
+            break;
+    }
+
+    if(status != CommandStatus::Timeout)
+    {
+        dev.stats.latency_total_us += result.latency_us;
+        if(result.latency_us > dev.stats.latency_max_us)
+        {
+            dev.stats.latency_max_us = result.latency_us;
+        }
+    }
+
+    if(result_handler)
+    {
+        result_handler(dev.index, result);
+    }
+
+    Dispatch(dev);
+}
+
+
+/**
+ * @brief A pipelined command waits for the ones before it, its time runs from their completion
+ */
+void Fleet::CheckTimeouts(uint64_t now_us)
+{
+    for(std::unique_ptr<Device> &dev : devices)
+    {
+        while(!dev->in_flight.empty() && (now_us - dev->head_since_us > timeout_us))
+        {
+            Complete(*dev, CommandStatus::Timeout);
+        }
+    }
+}
+
+
+void Fleet::Disconnect(Device &dev)
+{
+    if(!dev.stats.online)
+    {
+        return;
+    }
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, dev.port.Fd(), nullptr);
+    dev.port.Close();
+    dev.stats.online = false;
+
+    dev.stats.timeouts += dev.queue.size() + dev.in_flight.size();
+    dev.stats.commands += dev.queue.size() + dev.in_flight.size();
+    dev.queue.clear();
+    dev.in_flight.clear();
+    dev.tx.clear();
+    dev.tx_pos = 0;
+}
+
+
+bool Fleet::Run(uint64_t until_us)
+{
+    struct epoll_event events[MAX_EVENTS];
+    uint64_t next_check = 0;
+
+    for(std::unique_ptr<Device> &dev : devices)
+    {
+        Dispatch(*dev);
+    }
+
+    while(1)
+    {
+        uint64_t now = Fleet_NowUs();
+
+        if(now >= next_check)
+        {
+            CheckTimeouts(now);
+            next_check = now + TIMEOUT_CHECK_MS * 1000;
+        }
+        if(now >= until_us)
+        {
+            return true;
+        }
+
+        uint64_t wait_us = ((until_us < next_check) ? until_us : next_check) - now;
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, (int)((wait_us + 999) / 1000));
+
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        for(int i = 0; i < n; i++)
+        {
+            Device &dev = *devices[events[i].data.u64];
+
+            if(events[i].events & EPOLLOUT)
+            {
+                Transmit(dev);
+            }
+            if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+                Receive(dev);
+            }
+        }
+    }
+}
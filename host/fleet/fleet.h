@@ -0,0 +1,171 @@
+#ifndef HOST_FLEET_FLEET_H_
+#define HOST_FLEET_FLEET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dlog_frames.h"
+#include "elf_reader.h"
+#include "serial_port.h"
+
+/*
+ Console client for many devices at once: one epoll loop over non-blocking
+ serial ports, commands pipelined per device.
+
+ The console has no prompt, a command is complete at a known line of its
+ reply: "Status: ERROR", the "Actual speed:" line of set_fan_speed and
+ get_fan_speed, the "Re-inits:" line of i2c_errors, the "Status:" line of
+ other commands (the lines after it are not captured) or "Command ... is not
+ found". Colors and the echo of the typed
+ command are skipped. Commands may go out as ';' separated batches, the
+ console answers them in order. Deferred logging frames are taken out of the stream;
+ replies logged with DLOG=1 are only readable with the firmware ELF.
+*/
+
+enum class CommandStatus
+{
+    Ok,
+    Error,
+    NotFound,
+    Timeout
+};
+
+struct CommandResult
+{
+    std::string command;
+    CommandStatus status = CommandStatus::Ok;
+    int speed = -1;                     /* "Actual speed:", %, -1 if none */
+    int rpm = -1;                       /* "Fan RPM:" of get_fan_speed, -1 if none */
+    std::vector<std::pair<std::string, uint64_t>> counters;    /* i2c_errors lines */
+    uint64_t latency_us = 0;            /* from the command written to the reply complete */
+};
+
+struct DeviceStats
+{
+    bool online = true;
+    int speed = -1;                     /* last reported actual speed, % */
+    int rpm = -1;                       /* last reported fan RPM */
+    uint64_t commands = 0;              /* completed, timeouts included */
+    uint64_t errors = 0;                /* "Status: ERROR" and unknown commands */
+    uint64_t timeouts = 0;
+    uint64_t latency_total_us = 0;      /* of the commands with a reply */
+    uint64_t latency_max_us = 0;
+    uint64_t tx_bytes = 0;
+    uint64_t rx_bytes = 0;
+    uint64_t records = 0;               /* deferred logging records */
+};
+
+class Fleet
+{
+public:
+    typedef std::function<void(size_t device, const CommandResult &result)> ResultHandler;
+
+    /**
+     * @param[in] depth commands in flight per device
+     * @param[in] timeout_ms reply timeout of a command
+     * @param[in] elf firmware image for the deferred logging records, may be nullptr
+     */
+    Fleet(uint32_t depth, uint32_t timeout_ms, const ElfReader *elf);
+    ~Fleet();
+
+    /**
+     * @brief Open a device
+     * @param[out] error description if opening has failed
+     * @retval true on success
+     */
+    bool Add(const std::string &path, uint32_t baud, std::string &error);
+
+    /**
+     * @brief Open a device that has gone offline again, with its path and rate
+     * @param[out] error description if opening has failed
+     * @retval true if the device is online
+     */
+    bool Reopen(size_t device, std::string &error);
+
+    size_t Size() const { return devices.size(); }
+    const std::string& Name(size_t device) const { return devices[device]->name; }
+    const DeviceStats& Stats(size_t device) const { return devices[device]->stats; }
+
+    /**
+     * @brief Queue a command, it's sent once fewer than depth commands are in flight. With
+     *        batches it's sent from Run() or after a reply, with the commands queued meanwhile
+     */
+    void Submit(size_t device, const std::string &command);
+
+    /**
+     * @brief Commands queued and in flight
+     */
+    size_t Pending(size_t device) const;
+
+    void SetResultHandler(ResultHandler handler) { result_handler = handler; }
+
+    /**
+     * @brief Send up to that many queued commands in one line, within the depth
+     */
+    void SetBatch(uint32_t commands) { batch = commands ? commands : 1; }
+
+    /**
+     * @brief Run the event loop
+     * @param[in] until_us deadline, Fleet_NowUs() time
+     * @retval false on an epoll error
+     */
+    bool Run(uint64_t until_us);
+
+private:
+    struct InFlight
+    {
+        std::string command;
+        uint64_t sent_us;
+        CommandResult result;
+    };
+
+    struct Device
+    {
+        Device(Fleet *fleet, size_t index);
+
+        size_t index;
+        SerialPort port;
+        std::string name;
+        uint32_t baud = 0;
+        std::deque<std::string> queue;
+        std::deque<InFlight> in_flight;
+        uint64_t head_since_us = 0;     /* the first command in flight is being executed since */
+        std::string tx;
+        size_t tx_pos = 0;
+        bool tx_wait = false;           /* EPOLLOUT armed */
+        std::string line;
+        bool escape = false;            /* in an ANSI escape sequence */
+        DLogDecoder decoder;
+        DeviceStats stats;
+    };
+
+    void Dispatch(Device &dev);
+    void Transmit(Device &dev);
+    void Receive(Device &dev);
+    void PutText(Device &dev, const char *text, size_t len);
+    void ParseLine(Device &dev, const std::string &line);
+    void Complete(Device &dev, CommandStatus status);
+    void CheckTimeouts(uint64_t now_us);
+    void Disconnect(Device &dev);
+
+    uint32_t depth;
+    uint32_t batch = 1;
+    uint64_t timeout_us;
+    const ElfReader *elf;
+    int epoll_fd;
+    std::vector<std::unique_ptr<Device>> devices;
+    ResultHandler result_handler;
+};
+
+/**
+ * @brief Monotonic time, us
+ */
+uint64_t Fleet_NowUs();
+
+#endif /* HOST_FLEET_FLEET_H_ */
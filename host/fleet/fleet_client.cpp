@@ -0,0 +1,351 @@
+/*
+ Polls a rack of devices over their consoles at once.
+
+ Usage: fleet_client [-S count] [-b baud] [-p depth] [-B batch] [-q] [-i interval_ms] [-r report_ms]
+                     [-d seconds] [-t timeout_ms] [-w speed] [-e firmware.elf] [-j] [ports...]
+
+ All ports are served by one epoll loop (host/fleet/fleet.h). Each device is
+ sent "set_fan_speed,<speed>" once with -w, then "get_fan_speed" every
+ interval, or back to back with -i 0. Every report period a row per device
+ goes to stdout: CSV, or JSON lines with -j. The summary goes to stderr.
+
+ -S  start a local stand-in of count devices on ptys (host/fleet/standin.h)
+     and poll those, for benchmarks without the rack
+ -b  baud rate (default 115200), the stand-in paces its output at it
+ -p  commands in flight per device (default 1). The console reads by polling,
+     on the board characters arriving while a command runs may be lost: use
+     more than 1 only where the input is buffered (the stand-in, pty_device)
+ -B  commands per line, ';' separated (default 1, at most 32). The depth is
+     raised to it, back to back polls go out as full batches
+ -q  switch the consoles to quiet mode first: no banner, no echo
+ -t  reply timeout (default 1000 ms)
+ -e  firmware ELF, decodes the replies of a DLOG=1 build
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "elf_reader.h"
+#include "fleet.h"
+#include "standin.h"
+
+#define DEFAULT_BAUD                115200
+#define DEFAULT_INTERVAL_MS         1000
+#define DEFAULT_REPORT_MS           1000
+#define DEFAULT_TIMEOUT_MS          1000
+/* Execution time of a command on the stand-in: get_fan_speed reads 2 registers */
+#define STANDIN_COMMAND_US          500
+/* get_fan_speed commands fitting the console line of 511 characters */
+#define MAX_BATCH                   32
+
+struct Options
+{
+    size_t standin = 0;
+    uint32_t baud = DEFAULT_BAUD;
+    uint32_t depth = 1;
+    uint32_t batch = 1;
+    bool quiet = false;
+    uint32_t interval_ms = DEFAULT_INTERVAL_MS;
+    uint32_t report_ms = DEFAULT_REPORT_MS;
+    uint32_t duration_s = 0;
+    uint32_t timeout_ms = DEFAULT_TIMEOUT_MS;
+    int speed = -1;
+    const char *elf = nullptr;
+    bool json = false;
+};
+
+static volatile sig_atomic_t stop;
+
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: fleet_client [-S count] [-b baud] [-p depth] [-B batch] [-q] [-i interval_ms] [-r report_ms]\n"
+                    "                    [-d seconds] [-t timeout_ms] [-w speed] [-e firmware.elf] [-j] [ports...]\n");
+    exit(1);
+}
+
+
+/**
+ * @brief One row per device with the counters of the report period
+ */
+static void report(const Fleet &fleet, std::vector<DeviceStats> &last, std::vector<uint64_t> &latency_max_us,
+                   double time_s, bool json, bool header)
+{
+    std::string out;
+    char buf[512];
+
+    if(header && !json)
+    {
+        out = "time_s,device,online,speed,commands,errors,timeouts,latency_avg_ms,latency_max_ms,rx_bytes,records\n";
+    }
+
+    if(json)
+    {
+        snprintf(buf, sizeof(buf), "{\"time_s\":%.3f,\"devices\":[", time_s);
+        out += buf;
+    }
+
+    for(size_t i = 0; i < fleet.Size(); i++)
+    {
+        const DeviceStats &now = fleet.Stats(i);
+        DeviceStats &prev = last[i];
+        uint64_t commands = now.commands - prev.commands;
+        uint64_t replied = commands - (now.timeouts - prev.timeouts);
+        double latency_avg = replied ? (now.latency_total_us - prev.latency_total_us) / 1000.0 / replied : 0;
+        double latency_max = latency_max_us[i] / 1000.0;
+
+        if(json)
+        {
+            snprintf(buf, sizeof(buf), "%s{\"device\":\"%s\",\"online\":%s,\"speed\":%d,\"commands\":%llu,\"errors\":%llu,"
+                     "\"timeouts\":%llu,\"latency_avg_ms\":%.3f,\"latency_max_ms\":%.3f,\"rx_bytes\":%llu,\"records\":%llu}",
+                     i ? "," : "", fleet.Name(i).c_str(), now.online ? "true" : "false", now.speed,
+                     (unsigned long long)commands, (unsigned long long)(now.errors - prev.errors),
+                     (unsigned long long)(now.timeouts - prev.timeouts), latency_avg, latency_max,
+                     (unsigned long long)(now.rx_bytes - prev.rx_bytes), (unsigned long long)(now.records - prev.records));
+        }
+        else
+        {
+            snprintf(buf, sizeof(buf), "%.3f,%s,%d,%d,%llu,%llu,%llu,%.3f,%.3f,%llu,%llu\n",
+                     time_s, fleet.Name(i).c_str(), now.online ? 1 : 0, now.speed,
+                     (unsigned long long)commands, (unsigned long long)(now.errors - prev.errors),
+                     (unsigned long long)(now.timeouts - prev.timeouts), latency_avg, latency_max,
+                     (unsigned long long)(now.rx_bytes - prev.rx_bytes), (unsigned long long)(now.records - prev.records));
+        }
+        out += buf;
+        prev = now;
+        latency_max_us[i] = 0;
+    }
+
+    if(json)
+    {
+        out += "]}\n";
+    }
+
+    fwrite(out.data(), 1, out.size(), stdout);
+    fflush(stdout);
+}
+
+
+static void summary(const Fleet &fleet, double elapsed_s, uint32_t baud)
+{
+    DeviceStats total;
+    size_t online = 0;
+
+    total.latency_max_us = 0;
+    for(size_t i = 0; i < fleet.Size(); i++)
+    {
+        const DeviceStats &stats = fleet.Stats(i);
+
+        online += stats.online ? 1 : 0;
+        total.commands += stats.commands;
+        total.errors += stats.errors;
+        total.timeouts += stats.timeouts;
+        total.latency_total_us += stats.latency_total_us;
+        total.tx_bytes += stats.tx_bytes;
+        total.rx_bytes += stats.rx_bytes;
+        total.records += stats.records;
+        if(stats.latency_max_us > total.latency_max_us)
+        {
+            total.latency_max_us = stats.latency_max_us;
+        }
+    }
+
+    uint64_t replied = total.commands - total.timeouts;
+    /* 8N1: 10 bits per byte, per device and direction */
+    double link_bytes = (double)baud / 10 * elapsed_s * fleet.Size();
+
+    fprintf(stderr, "Devices:    %zu, %zu online\n", fleet.Size(), online);
+    fprintf(stderr, "Commands:   %llu in %.2f s, %.0f/s\n", (unsigned long long)total.commands, elapsed_s,
+            elapsed_s > 0 ? total.commands / elapsed_s : 0);
+    fprintf(stderr, "Errors:     %llu, timeouts: %llu\n", (unsigned long long)total.errors, (unsigned long long)total.timeouts);
+    fprintf(stderr, "Latency:    avg %.3f ms, max %.3f ms\n", replied ? total.latency_total_us / 1000.0 / replied : 0,
+            total.latency_max_us / 1000.0);
+    fprintf(stderr, "Bytes:      tx %llu, rx %llu (%.0f %% of the link rate), log records %llu\n",
+            (unsigned long long)total.tx_bytes, (unsigned long long)total.rx_bytes,
+            link_bytes > 0 ? 100.0 * total.rx_bytes / link_bytes : 0, (unsigned long long)total.records);
+}
+
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    std::vector<std::string> ports;
+    std::string error;
+    ElfReader elf;
+    int opt;
+
+    while((opt = getopt(argc, argv, "S:b:p:B:qi:r:d:t:w:e:j")) != -1)
+    {
+        switch(opt)
+        {
+            case 'S': options.standin = strtoul(optarg, nullptr, 0); break;
+            case 'b': options.baud = strtoul(optarg, nullptr, 0); break;
+            case 'p': options.depth = strtoul(optarg, nullptr, 0); break;
+            case 'B': options.batch = strtoul(optarg, nullptr, 0); break;
+            case 'q': options.quiet = true; break;
+            case 'i': options.interval_ms = strtoul(optarg, nullptr, 0); break;
+            case 'r': options.report_ms = strtoul(optarg, nullptr, 0); break;
+            case 'd': options.duration_s = strtoul(optarg, nullptr, 0); break;
+            case 't': options.timeout_ms = strtoul(optarg, nullptr, 0); break;
+            case 'w': options.speed = atoi(optarg); break;
+            case 'e': options.elf = optarg; break;
+            case 'j': options.json = true; break;
+            default: usage();
+        }
+    }
+
+    for(int i = optind; i < argc; i++)
+    {
+        ports.push_back(argv[i]);
+    }
+
+    if((ports.empty() && (options.standin == 0)) || (options.depth == 0) || (options.report_ms == 0) ||
+       (options.batch == 0) || (options.batch > MAX_BATCH))
+    {
+        usage();
+    }
+    options.depth = (options.depth > options.batch) ? options.depth : options.batch;
+
+    if((options.elf != nullptr) && (!elf.Load(options.elf, error) || (DLogDecoder::FindStrings(elf, error) == nullptr)))
+    {
+        fprintf(stderr, "%s: %s\n", options.elf, error.c_str());
+        return 1;
+    }
+
+    /* The stand-in ptys are set to 115200, the pacing uses the rate asked for */
+    StandIn standin(options.baud, STANDIN_COMMAND_US, 1);
+    if(options.standin != 0)
+    {
+        if(!standin.Start(options.standin, error))
+        {
+            fprintf(stderr, "fleet_client: %s\n", error.c_str());
+            return 1;
+        }
+        ports.insert(ports.end(), standin.Paths().begin(), standin.Paths().end());
+    }
+
+    Fleet fleet(options.depth, options.timeout_ms, (options.elf != nullptr) ? &elf : nullptr);
+    fleet.SetBatch(options.batch);
+    for(const std::string &port : ports)
+    {
+        /* termios takes the standard rates only, a pty ignores it anyway */
+        if(!fleet.Add(port, (options.standin != 0) ? DEFAULT_BAUD : options.baud, error))
+        {
+            fprintf(stderr, "fleet_client: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    std::vector<DeviceStats> last(fleet.Size());
+    std::vector<uint64_t> latency_max_us(fleet.Size());
+
+    fleet.SetResultHandler([&](size_t device, const CommandResult &result)
+    {
+        if((result.status != CommandStatus::Timeout) && (result.latency_us > latency_max_us[device]))
+        {
+            latency_max_us[device] = result.latency_us;
+        }
+
+        /* Back to back: the next poll goes out with the reply, or the next batch once there's room for it */
+        if((options.interval_ms == 0) && !stop && (fleet.Pending(device) + options.batch <= options.depth))
+        {
+            for(uint32_t i = 0; i < options.batch; i++)
+            {
+                fleet.Submit(device, "get_fan_speed");
+            }
+        }
+    });
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    uint64_t start = Fleet_NowUs();
+    uint64_t end = options.duration_s ? start + (uint64_t)options.duration_s * 1000000 : UINT64_MAX;
+    uint64_t next_poll = start;
+    uint64_t next_report = start + (uint64_t)options.report_ms * 1000;
+    bool header = true;
+
+    if(options.quiet)
+    {
+        for(size_t i = 0; i < fleet.Size(); i++)
+        {
+            fleet.Submit(i, "quiet");
+        }
+    }
+
+    if(options.speed >= 0)
+    {
+        for(size_t i = 0; i < fleet.Size(); i++)
+        {
+            fleet.Submit(i, "set_fan_speed," + std::to_string(options.speed));
+        }
+    }
+
+    while(!stop)
+    {
+        uint64_t now = Fleet_NowUs();
+
+        if(now >= end)
+        {
+            break;
+        }
+
+        if(options.interval_ms == 0)
+        {
+            /* Back to back: fill the pipelines, the result handler keeps them full */
+            for(size_t i = 0; i < fleet.Size(); i++)
+            {
+                while(fleet.Stats(i).online && (fleet.Pending(i) < options.depth))
+                {
+                    fleet.Submit(i, "get_fan_speed");
+                }
+            }
+        }
+        else if(now >= next_poll)
+        {
+            /* A device still busy with the previous poll is skipped */
+            for(size_t i = 0; i < fleet.Size(); i++)
+            {
+                if(fleet.Pending(i) == 0)
+                {
+                    fleet.Submit(i, "get_fan_speed");
+                }
+            }
+            next_poll += (uint64_t)options.interval_ms * 1000;
+        }
+
+        if(now >= next_report)
+        {
+            report(fleet, last, latency_max_us, (now - start) / 1e6, options.json, header);
+            header = false;
+            next_report += (uint64_t)options.report_ms * 1000;
+        }
+
+        uint64_t until = (options.interval_ms == 0) ? UINT64_MAX : next_poll;
+        until = (until < next_report) ? until : next_report;
+        until = (until < end) ? until : end;
+        if(!fleet.Run(until))
+        {
+            perror("fleet_client: epoll");
+            return 1;
+        }
+    }
+
+    summary(fleet, (Fleet_NowUs() - start) / 1e6, options.baud);
+    standin.Stop();
+    return 0;
+}
@@ -0,0 +1,322 @@
+#include "standin.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "fleet.h"
+
+#define MAX_EVENTS                  64
+#define RX_CHUNK                    256
+/* INCOMING_BUFF_LENGTH of src/uart_api.c, a batch of 32 commands */
+#define MAX_INPUT                   511
+/* Idle wake-up of the loop, ms */
+#define IDLE_WAIT_MS                10
+
+/* rpm_max of the MAX6650 configuration in src/user_functions.c */
+#define FAN_RPM_MAX                 10500
+
+/* Inc/termcolor.h */
+#define TC_RED                      "\x1b[31m"
+#define TC_YELLOW                   "\x1b[33m"
+#define TC_RESET                    "\x1b[0m"
+
+
+StandIn::StandIn(uint32_t baud, uint32_t command_us, uint32_t seed) :
+    baud(baud), command_us(command_us), rng(seed), running(false)
+{
+}
+
+
+StandIn::~StandIn()
+{
+    Stop();
+}
+
+
+static bool open_pty(int &master, int &slave, std::string &path)
+{
+    struct termios tio;
+    const char *name;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0) || ((name = ptsname(master)) == nullptr))
+    {
+        return false;
+    }
+    path = name;
+
+    slave = open(name, O_RDWR | O_NOCTTY);
+    if((slave < 0) || (tcgetattr(slave, &tio) != 0))
+    {
+        return false;
+    }
+
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B115200);
+    cfsetospeed(&tio, B115200);
+    return tcsetattr(slave, TCSANOW, &tio) == 0;
+}
+
+
+bool StandIn::Start(size_t count, std::string &error)
+{
+    devices.resize(count);
+    paths.resize(count);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        if(!open_pty(devices[i].master, devices[i].slave, paths[i]))
+        {
+            error = std::string("can't create a pty: ") + strerror(errno);
+            Stop();
+            return false;
+        }
+    }
+
+    running = true;
+    thread = std::thread(&StandIn::Loop, this);
+    return true;
+}
+
+
+void StandIn::Stop()
+{
+    if(running)
+    {
+        running = false;
+        thread.join();
+    }
+
+    for(Device &dev : devices)
+    {
+        if(dev.master >= 0)
+        {
+            close(dev.master);
+        }
+        if(dev.slave >= 0)
+        {
+            close(dev.slave);
+        }
+    }
+    devices.clear();
+    paths.clear();
+}
+
+
+void StandIn::Loop()
+{
+    struct epoll_event events[MAX_EVENTS];
+    int epoll_fd = epoll_create1(0);
+
+    for(size_t i = 0; i < devices.size(); i++)
+    {
+        struct epoll_event ev = {};
+
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, devices[i].master, &ev);
+    }
+
+    while(running)
+    {
+        uint64_t now = Fleet_NowUs();
+        uint64_t next = now + IDLE_WAIT_MS * 1000;
+
+        for(Device &dev : devices)
+        {
+            Transmit(dev, now);
+            if(!dev.output.empty() && (dev.output.front().ready_us < next))
+            {
+                next = dev.output.front().ready_us;
+            }
+        }
+
+        /* Output still due after Transmit() is blocked by a full pty, retry in 1 ms */
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, (next > now) ? (int)((next - now + 999) / 1000) : 1);
+
+        now = Fleet_NowUs();
+        for(int i = 0; i < n; i++)
+        {
+            Receive(devices[events[i].data.u64], now);
+        }
+    }
+
+    close(epoll_fd);
+}
+
+
+/**
+ * @brief Console input: echo, words end at whitespace like with scanf("%s")
+ */
+void StandIn::Receive(Device &dev, uint64_t now)
+{
+    char buf[RX_CHUNK];
+    ssize_t n = read(dev.master, buf, sizeof(buf));
+
+    for(ssize_t i = 0; i < n; i++)
+    {
+        char c = buf[i];
+
+        if((c == '\r') || (c == '\n') || (c == ' '))
+        {
+            if(!dev.quiet)
+            {
+                Send(dev, "\r\n", now);
+            }
+            if(!dev.input.empty())
+            {
+                Batch(dev, dev.input, now);
+                dev.input.clear();
+            }
+        }
+        else if(dev.input.size() < MAX_INPUT)
+        {
+            if(!dev.quiet)
+            {
+                Send(dev, std::string(1, c), now);
+            }
+            dev.input += c;
+        }
+    }
+}
+
+
+/**
+ * @brief Run the ';' separated commands of a line, a batch is answered at once when its last command is done
+ */
+void StandIn::Batch(Device &dev, const std::string &line, uint64_t now)
+{
+    std::string reply;
+    size_t start = 0;
+
+    while(1)
+    {
+        size_t end = line.find(';', start);
+        std::string command = line.substr(start, (end == std::string::npos) ? end : end - start);
+
+        if(!command.empty())
+        {
+            reply += Execute(dev, command, now);
+        }
+        if(end == std::string::npos)
+        {
+            break;
+        }
+        start = end + 1;
+    }
+
+    Send(dev, reply, dev.busy_us);
+}
+
+
+std::string StandIn::Execute(Device &dev, const std::string &command, uint64_t now)
+{
+    std::uniform_int_distribution<int> noise(-1, 1);
+    size_t comma = command.find(',');
+    std::string reply;
+    char line[64];
+    int actual;
+
+    if(command.compare(0, comma, "quiet") == 0)
+    {
+        dev.quiet = (comma == std::string::npos) || (atoi(command.c_str() + comma + 1) != 0);
+        reply = TC_RESET "Status: OK\r\n";
+    }
+    else if(command.find("i2c_errors") != std::string::npos)
+    {
+        /* The stand-in bus never fails */
+        for(const char *name : {"NACK", "ARLO", "BERR", "Timeout"})
+        {
+            snprintf(line, sizeof(line), TC_RESET "%-12s 0\r\n", name);
+            reply += line;
+        }
+        reply += TC_RESET "Retries:     0\r\n" TC_RESET "Failures:    0\r\n" TC_RESET "Resets:      0\r\n"
+                 TC_RESET "Bus clears:  0\r\n" TC_RESET "Re-inits:    0\r\n";
+    }
+    else if((command.find("set_fan_speed") == std::string::npos) && (command.find("get_fan_speed") == std::string::npos))
+    {
+        reply = TC_YELLOW "\r\nCommand \"" + command + "\" is not found..\r\n";
+    }
+    else
+    {
+        if(command.find("set_fan_speed") != std::string::npos)
+        {
+            /* The console checks the argument against its schema */
+            int speed = (comma != std::string::npos) ? atoi(command.c_str() + comma + 1) : -1;
+            if((speed < 0) || (speed > 100))
+            {
+                return TC_RED "Argument \"speed\" should be in range: 0..100\r\n" TC_RESET "Status: ERROR\r\n";
+            }
+            dev.target = speed;
+        }
+
+        actual = dev.target + noise(rng);
+        actual = (actual < 0) ? 0 : (actual > 100) ? 100 : actual;
+
+        reply += TC_RESET "Status: OK\r\n";
+        if(command.find("set_fan_speed") != std::string::npos)
+        {
+            reply += TC_RESET "Set    speed: " + std::to_string(dev.target) + "%\r\n";
+        }
+        else
+        {
+            reply += TC_RESET "Fan RPM:      " + std::to_string(actual * FAN_RPM_MAX / 100) + "\r\n";
+        }
+        reply += TC_RESET "Actual speed: " + std::to_string(actual) + "%\r\n";
+    }
+
+    /* Commands run one after another */
+    dev.busy_us = ((dev.busy_us > now) ? dev.busy_us : now) + command_us;
+    return reply;
+}
+
+
+/**
+ * @brief Queue output, it's delivered when its last character is off the line
+ */
+void StandIn::Send(Device &dev, const std::string &text, uint64_t at_us)
+{
+    uint64_t start = (dev.tx_free_us > at_us) ? dev.tx_free_us : at_us;
+
+    /* 8N1: 10 bits per character */
+    dev.tx_free_us = start + ((baud != 0) ? (uint64_t)text.size() * 10 * 1000000 / baud : 0);
+
+    if(!dev.output.empty() && (dev.output.back().ready_us >= start))
+    {
+        dev.output.back().data += text;
+        dev.output.back().ready_us = dev.tx_free_us;
+    }
+    else
+    {
+        dev.output.push_back(Output{dev.tx_free_us, text});
+    }
+}
+
+
+void StandIn::Transmit(Device &dev, uint64_t now)
+{
+    while(!dev.output.empty() && (dev.output.front().ready_us <= now))
+    {
+        Output &out = dev.output.front();
+        ssize_t n = write(dev.master, out.data.data(), out.data.size());
+
+        if(n < 0)
+        {
+            /* EAGAIN: the client doesn't read, retried on the next pass */
+            return;
+        }
+        if((size_t)n < out.data.size())
+        {
+            out.data.erase(0, n);
+            return;
+        }
+        dev.output.pop_front();
+    }
+}
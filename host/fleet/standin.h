@@ -0,0 +1,83 @@
+#ifndef HOST_FLEET_STANDIN_H_
+#define HOST_FLEET_STANDIN_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ Local stand-in for a rack of devices: pty pairs answered by a thread that
+ speaks the console of set_fan_speed, get_fan_speed, i2c_errors and quiet
+ (echo, colors, the reply lines, "Command ... is not found", ';' separated
+ batches answered at once). Output is
+ paced at the baud rate and every command takes command_us, so the client
+ sees roughly the timing of the board without the I2C bus. For the real
+ firmware behind a pty, see host/pty_device.
+*/
+
+class StandIn
+{
+public:
+    /**
+     * @param[in] baud rate the output is paced at, 0 for no pacing
+     * @param[in] command_us execution time of a command
+     * @param[in] seed of the speed readout noise
+     */
+    StandIn(uint32_t baud, uint32_t command_us, uint32_t seed);
+    ~StandIn();
+
+    /**
+     * @brief Create the ptys and start answering
+     * @param[out] error description on failure
+     * @retval true on success
+     */
+    bool Start(size_t count, std::string &error);
+
+    void Stop();
+
+    /**
+     * @brief Paths of the device sides, to be opened like /dev/ttyACM0
+     */
+    const std::vector<std::string>& Paths() const { return paths; }
+
+private:
+    struct Output
+    {
+        uint64_t ready_us;
+        std::string data;
+    };
+
+    struct Device
+    {
+        int master = -1;
+        int slave = -1;                 /* kept open, the master survives clients going away */
+        std::string input;
+        std::deque<Output> output;
+        uint64_t tx_free_us = 0;        /* the line is busy until */
+        uint64_t busy_us = 0;           /* the command being executed ends at */
+        int target = 0;                 /* set speed, % */
+        bool quiet = false;             /* no echo */
+    };
+
+    void Loop();
+    void Receive(Device &dev, uint64_t now);
+    void Batch(Device &dev, const std::string &line, uint64_t now);
+    std::string Execute(Device &dev, const std::string &command, uint64_t now);
+    void Send(Device &dev, const std::string &text, uint64_t at_us);
+    void Transmit(Device &dev, uint64_t now);
+
+    uint32_t baud;
+    uint32_t command_us;
+    std::mt19937 rng;
+    std::vector<Device> devices;
+    std::vector<std::string> paths;
+    std::thread thread;
+    std::atomic<bool> running;
+};
+
+#endif /* HOST_FLEET_STANDIN_H_ */
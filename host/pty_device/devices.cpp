@@ -0,0 +1,433 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "devices.h"
+
+/* Fan of the firmware configuration: 10500 rpm at 12 V */
+#define FAN_MAX_RPS                 175.0
+#define FAN_TIME_CONSTANT_S         1.5
+/* Tach: the pulses of a revolution are 6 % off even spacing, the edges jitter and
+   now and then a noise edge splits an interval. No edges below the stall speed */
+#define FAN_TACH_ASYMMETRY          0.06
+#define FAN_TACH_JITTER             0.003
+#define FAN_TACH_GLITCH_RATE        0.002
+#define FAN_STALL_RPS               2.0
+/* Board: 45 degC still air, 25 degC at full airflow */
+#define BOARD_HOT_DEGC              45.0
+#define BOARD_COOLING_DEGC          20.0
+#define BOARD_START_DEGC            35.0
+#define BOARD_TIME_CONSTANT_S       20.0
+
+#define MAX6650_SPEED_REG           0x00
+#define MAX6650_CONFIG_REG          0x02
+#define MAX6650_GPIODEF_REG         0x04
+#define MAX6650_DAC_REG             0x06
+#define MAX6650_ALARM_REG           0x0A
+#define MAX6650_TACH0_REG           0x0C
+#define MAX6650_COUNT_REG           0x16
+#define MAX6650_MODE_FULL_ON        0
+#define MAX6650_MODE_FULL_OFF       1
+#define MAX6650_MODE_CLOSED_LOOP    2
+/* Fan clock / 256: rps = MAX6650_TACH_CLOCK * KSCALE / (KTACH + 1), the firmware formula */
+#define MAX6650_TACH_CLOCK          992.0
+
+#define HTS221_WHO_AM_I_REG         0x0F
+#define HTS221_AV_CONF_REG          0x10
+#define HTS221_CTRL_REG1            0x20
+#define HTS221_CTRL_REG2            0x21
+#define HTS221_STATUS_REG           0x27
+#define HTS221_HUMIDITY_OUT_L_REG   0x28
+#define HTS221_HUMIDITY_OUT_H_REG   0x29
+#define HTS221_TEMP_OUT_L_REG       0x2A
+#define HTS221_TEMP_OUT_H_REG       0x2B
+#define HTS221_CALIB_REG            0x30
+#define HTS221_AUTO_INCREMENT       0x80
+#define HTS221_CTRL_REG1_PD         0x80
+#define HTS221_CTRL_REG1_ODR        0x03
+#define HTS221_CTRL_REG2_ONE_SHOT   0x01
+#define HTS221_STATUS_T_DA          0x01
+#define HTS221_STATUS_H_DA          0x02
+/* Calibration: 20 and 30 degC at 0 and 1000 LSB, 20 and 80 %rH at 0 and 6000 LSB */
+#define HTS221_T0_DEGC              20.0
+#define HTS221_T1_DEGC              30.0
+#define HTS221_T1_OUT               1000
+#define HTS221_H0_RH                20.0
+#define HTS221_H1_RH                80.0
+#define HTS221_H1_OUT               6000
+
+#define LSM6DSL_FIFO_CTRL5_REG      0x0A
+#define LSM6DSL_WHO_AM_I_REG        0x0F
+#define LSM6DSL_CTRL3_C_REG         0x12
+#define LSM6DSL_FIFO_STATUS1_REG    0x3A
+#define LSM6DSL_FIFO_STATUS2_REG    0x3B
+#define LSM6DSL_FIFO_DATA_OUT_L_REG 0x3E
+#define LSM6DSL_FIFO_DATA_OUT_H_REG 0x3F
+#define LSM6DSL_CTRL3_C_IF_INC      0x04
+#define LSM6DSL_FIFO_MODE_MASK      0x07
+#define LSM6DSL_FIFO_MODE_BYPASS    0x00
+#define LSM6DSL_FIFO_STATUS2_FULL   0x20
+#define LSM6DSL_FIFO_WORDS          2048
+/* +-2 g full scale, 0.061 mg/LSB */
+#define LSM6DSL_LSB_PER_G           16393.0
+#define LSM6DSL_NOISE_LSB           8.0
+/* Imbalance of the fan, grows with the square of the speed */
+#define FAN_IMBALANCE_G             0.02
+#define FAN_IMBALANCE_FULL_G        0.08
+
+static double now_s(void)
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+
+Plant::Plant(uint32_t seed) : temperature(BOARD_START_DEGC), rng(seed), last(now_s())
+{
+}
+
+
+void Plant::Update(void)
+{
+    double now = now_s();
+    double dt = now - last;
+
+    last = now;
+    time += dt;
+    fan_rps += (target_rps - fan_rps) * (1.0 - std::exp(-dt / FAN_TIME_CONSTANT_S));
+
+    double steady = BOARD_HOT_DEGC - BOARD_COOLING_DEGC * fan_rps / FAN_MAX_RPS;
+    temperature += (steady - temperature) * (1.0 - std::exp(-dt / BOARD_TIME_CONSTANT_S));
+}
+
+
+uint64_t Plant::TachIntervalNs(void)
+{
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double> jitter(0, FAN_TACH_JITTER);
+    double interval;
+
+    if(tach_rest > 0)
+    {
+        interval = tach_rest;
+        tach_rest = 0;
+        return (uint64_t)(interval * 1e9);
+    }
+
+    Update();
+    if(fan_rps < FAN_STALL_RPS)
+    {
+        return 0;
+    }
+
+    tach_pulse = !tach_pulse;
+    interval = (0.5 + (tach_pulse ? FAN_TACH_ASYMMETRY : -FAN_TACH_ASYMMETRY) / 2) * (1 + jitter(rng)) / fan_rps;
+    if(uniform(rng) < FAN_TACH_GLITCH_RATE)
+    {
+        double split = uniform(rng);
+
+        tach_rest = interval * (1 - split);
+        interval *= split;
+    }
+
+    return (uint64_t)(interval * 1e9);
+}
+
+
+Max6650Model::Max6650Model(Plant *plant) : plant(plant)
+{
+    /* Power-on values: full-on mode, 12 V, KSCALE 4, 1 s count time */
+    regs[MAX6650_SPEED_REG] = 0xFF;
+    regs[MAX6650_CONFIG_REG] = 0x0A;
+    regs[MAX6650_GPIODEF_REG] = 0xFF;
+    regs[MAX6650_COUNT_REG] = 0x02;
+    Drive();
+}
+
+
+void Max6650Model::Drive(void)
+{
+    uint8_t config = regs[MAX6650_CONFIG_REG];
+    double k_scale = 1 << std::min(config & 0x07, 4);
+
+    switch((config >> 4) & 0x03)
+    {
+        case MAX6650_MODE_FULL_ON:
+            plant->SetTarget(FAN_MAX_RPS);
+            break;
+
+        case MAX6650_MODE_FULL_OFF:
+            plant->SetTarget(0);
+            break;
+
+        case MAX6650_MODE_CLOSED_LOOP:
+            plant->SetTarget(std::min(FAN_MAX_RPS, MAX6650_TACH_CLOCK * k_scale / (regs[MAX6650_SPEED_REG] + 1)));
+            break;
+
+        default:
+            /* Open loop: the DAC output lowers the fan voltage */
+            plant->SetTarget(FAN_MAX_RPS * (255 - regs[MAX6650_DAC_REG]) / 255.0);
+            break;
+    }
+}
+
+
+uint8_t Max6650Model::Read(uint8_t reg)
+{
+    if(reg >= sizeof(regs))
+    {
+        return 0;
+    }
+
+    if(reg == MAX6650_TACH0_REG)
+    {
+        /* Tach edges over the count time 0.25 s x 2^COUNT, two per revolution */
+        double count_time = 0.25 * (1 << (regs[MAX6650_COUNT_REG] & 0x03));
+
+        plant->Update();
+        return (uint8_t)std::min(255.0, std::round(plant->fan_rps * 2 * count_time));
+    }
+
+    return regs[reg];
+}
+
+
+void Max6650Model::Write(uint8_t reg, uint8_t value)
+{
+    if((reg >= sizeof(regs)) || (reg == MAX6650_ALARM_REG) || (reg == MAX6650_TACH0_REG))
+    {
+        return;
+    }
+
+    regs[reg] = value;
+    if((reg == MAX6650_SPEED_REG) || (reg == MAX6650_CONFIG_REG) || (reg == MAX6650_DAC_REG))
+    {
+        plant->Update();
+        Drive();
+    }
+}
+
+
+static void put_int16(uint8_t *regs, int16_t value)
+{
+    regs[0] = (uint8_t)value;
+    regs[1] = (uint8_t)((uint16_t)value >> 8);
+}
+
+
+Hts221Model::Hts221Model(Plant *plant) : plant(plant)
+{
+    uint8_t *calib = &regs[HTS221_CALIB_REG];
+
+    regs[HTS221_WHO_AM_I_REG] = 0xBC;
+    regs[HTS221_AV_CONF_REG] = 0x1B;
+
+    calib[0] = (uint8_t)(HTS221_H0_RH * 2);
+    calib[1] = (uint8_t)(HTS221_H1_RH * 2);
+    calib[2] = (uint8_t)(HTS221_T0_DEGC * 8);
+    calib[3] = (uint8_t)(HTS221_T1_DEGC * 8);
+    put_int16(&calib[6], 0);
+    put_int16(&calib[10], HTS221_H1_OUT);
+    put_int16(&calib[12], 0);
+    put_int16(&calib[14], HTS221_T1_OUT);
+}
+
+
+void Hts221Model::Convert(void)
+{
+    std::normal_distribution<double> noise(0, 0.02);
+    double t_out, h_out;
+
+    plant->Update();
+    t_out = (plant->temperature + noise(plant->rng) - HTS221_T0_DEGC) * HTS221_T1_OUT / (HTS221_T1_DEGC - HTS221_T0_DEGC);
+    h_out = (plant->humidity + noise(plant->rng) - HTS221_H0_RH) * HTS221_H1_OUT / (HTS221_H1_RH - HTS221_H0_RH);
+
+    put_int16(&regs[HTS221_HUMIDITY_OUT_L_REG], (int16_t)std::round(h_out));
+    put_int16(&regs[HTS221_TEMP_OUT_L_REG], (int16_t)std::round(t_out));
+    regs[HTS221_STATUS_REG] |= HTS221_STATUS_T_DA | HTS221_STATUS_H_DA;
+}
+
+
+uint8_t Hts221Model::Read(uint8_t reg)
+{
+    uint8_t value;
+
+    reg &= ~HTS221_AUTO_INCREMENT;
+    if(reg >= sizeof(regs))
+    {
+        return 0;
+    }
+
+    /* Continuous mode, a new sample is always ready */
+    if((reg == HTS221_STATUS_REG) && (regs[HTS221_CTRL_REG1] & HTS221_CTRL_REG1_PD) && (regs[HTS221_CTRL_REG1] & HTS221_CTRL_REG1_ODR))
+    {
+        Convert();
+    }
+
+    value = regs[reg];
+    if(reg == HTS221_HUMIDITY_OUT_H_REG)
+    {
+        regs[HTS221_STATUS_REG] &= ~HTS221_STATUS_H_DA;
+    }
+    else if(reg == HTS221_TEMP_OUT_H_REG)
+    {
+        regs[HTS221_STATUS_REG] &= ~HTS221_STATUS_T_DA;
+    }
+    return value;
+}
+
+
+void Hts221Model::Write(uint8_t reg, uint8_t value)
+{
+    reg &= ~HTS221_AUTO_INCREMENT;
+
+    switch(reg)
+    {
+        case HTS221_AV_CONF_REG:
+        case HTS221_CTRL_REG1:
+            regs[reg] = value;
+            break;
+
+        case HTS221_CTRL_REG2:
+            /* The conversion is done by the time the firmware polls the status */
+            if((value & HTS221_CTRL_REG2_ONE_SHOT) && (regs[HTS221_CTRL_REG1] & HTS221_CTRL_REG1_PD))
+            {
+                Convert();
+            }
+            regs[reg] = value & ~HTS221_CTRL_REG2_ONE_SHOT;
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+uint8_t Hts221Model::Next(uint8_t reg)
+{
+    return (reg & HTS221_AUTO_INCREMENT) ? reg + 1 : reg;
+}
+
+
+Lsm6dslModel::Lsm6dslModel(Plant *plant) : plant(plant)
+{
+    regs[LSM6DSL_WHO_AM_I_REG] = 0x6A;
+    regs[LSM6DSL_CTRL3_C_REG] = LSM6DSL_CTRL3_C_IF_INC;
+}
+
+
+static double fifo_odr_hz(uint8_t fifo_ctrl5)
+{
+    /* Rates of the firmware for 416..3330 Hz, the datasheet ones below */
+    static const double rates[] = {0, 12.5, 26, 52, 104, 208, 416, 833, 1660, 3330, 6660};
+    uint8_t code = (fifo_ctrl5 >> 3) & 0x0F;
+
+    return code < sizeof(rates) / sizeof(rates[0]) ? rates[code] : 0;
+}
+
+
+void Lsm6dslModel::Fill(void)
+{
+    uint8_t ctrl5 = regs[LSM6DSL_FIFO_CTRL5_REG];
+    double odr = fifo_odr_hz(ctrl5);
+    std::normal_distribution<double> noise(0, LSM6DSL_NOISE_LSB);
+
+    plant->Update();
+
+    if(((ctrl5 & LSM6DSL_FIFO_MODE_MASK) == LSM6DSL_FIFO_MODE_BYPASS) || (odr == 0))
+    {
+        next_sample = plant->time;
+        return;
+    }
+
+    while(next_sample <= plant->time)
+    {
+        /* FIFO mode stops collecting when full */
+        if(fifo.size() + 3 > LSM6DSL_FIFO_WORDS)
+        {
+            next_sample = plant->time;
+            break;
+        }
+
+        double load = plant->fan_rps / FAN_MAX_RPS;
+        double amplitude = (FAN_IMBALANCE_G + FAN_IMBALANCE_FULL_G * load * load) * LSM6DSL_LSB_PER_G;
+        double angle = 2 * M_PI * phase;
+
+        fifo.push_back((int16_t)std::round(0.5 * amplitude * std::cos(angle) + noise(plant->rng)));
+        fifo.push_back((int16_t)std::round(noise(plant->rng)));
+        fifo.push_back((int16_t)std::round(LSM6DSL_LSB_PER_G + amplitude * std::sin(angle) + noise(plant->rng)));
+
+        phase = std::fmod(phase + plant->fan_rps / odr, 1.0);
+        next_sample += 1.0 / odr;
+    }
+}
+
+
+uint8_t Lsm6dslModel::Read(uint8_t reg)
+{
+    uint8_t value;
+
+    if(reg >= sizeof(regs))
+    {
+        return 0;
+    }
+
+    switch(reg)
+    {
+        case LSM6DSL_FIFO_STATUS1_REG:
+            /* Both status bytes are latched, they are read in one burst */
+            Fill();
+            regs[LSM6DSL_FIFO_STATUS1_REG] = (uint8_t)fifo.size();
+            regs[LSM6DSL_FIFO_STATUS2_REG] = (uint8_t)((fifo.size() >> 8) & 0x07) |
+                                              ((fifo.size() + 3 > LSM6DSL_FIFO_WORDS) ? LSM6DSL_FIFO_STATUS2_FULL : 0);
+            return regs[reg];
+
+        case LSM6DSL_FIFO_DATA_OUT_L_REG:
+            return fifo.empty() ? 0 : (uint8_t)fifo.front();
+
+        case LSM6DSL_FIFO_DATA_OUT_H_REG:
+            if(fifo.empty())
+            {
+                return 0;
+            }
+            value = (uint8_t)((uint16_t)fifo.front() >> 8);
+            fifo.pop_front();
+            return value;
+
+        default:
+            return regs[reg];
+    }
+}
+
+
+void Lsm6dslModel::Write(uint8_t reg, uint8_t value)
+{
+    if((reg >= sizeof(regs)) || (reg == LSM6DSL_WHO_AM_I_REG))
+    {
+        return;
+    }
+
+    if(reg == LSM6DSL_FIFO_CTRL5_REG)
+    {
+        Fill();
+        /* Bypass mode flushes the FIFO, collection starts from now */
+        if((value & LSM6DSL_FIFO_MODE_MASK) == LSM6DSL_FIFO_MODE_BYPASS)
+        {
+            fifo.clear();
+        }
+        next_sample = plant->time;
+    }
+
+    regs[reg] = value;
+}
+
+
+uint8_t Lsm6dslModel::Next(uint8_t reg)
+{
+    /* FIFO output rolls over to the next word */
+    if(reg == LSM6DSL_FIFO_DATA_OUT_H_REG)
+    {
+        return LSM6DSL_FIFO_DATA_OUT_L_REG;
+    }
+    return (regs[LSM6DSL_CTRL3_C_REG] & LSM6DSL_CTRL3_C_IF_INC) ? reg + 1 : reg;
+}
@@ -0,0 +1,111 @@
+#ifndef HOST_PTY_DEVICE_DEVICES_H_
+#define HOST_PTY_DEVICE_DEVICES_H_
+
+#include <cstdint>
+#include <deque>
+#include <random>
+
+#include "shim_i2c.h"
+
+/*
+ Simulated parts of the board, register maps as in the datasheets. They share
+ the plant: the fan follows the MAX6650 setting with a first-order lag, the
+ board temperature seen by the HTS221 falls with the airflow and the LSM6DSL
+ picks up the fan imbalance at the rotation frequency. The fan's tach edges
+ also go to the TIM2 capture input.
+*/
+
+/**
+ * @brief Fan and board, advanced on every access from the host clock
+ */
+class Plant
+{
+public:
+    explicit Plant(uint32_t seed);
+
+    void Update(void);
+
+    /**
+     * @brief Speed the fan is driven to, revolutions per second
+     */
+    void SetTarget(double rps) { target_rps = rps; }
+
+    /**
+     * @brief Time to the next tach edge, 2 pulses per revolution
+     * @retval 0 below the stall speed
+     */
+    uint64_t TachIntervalNs(void);
+
+    double fan_rps = 0;
+    double temperature = 0;         /* degC */
+    double humidity = 45;           /* %rH */
+    double time = 0;                /* s since start */
+    std::mt19937 rng;
+
+private:
+    double target_rps = 0;
+    double last = 0;
+    bool tach_pulse = false;        /* second pulse of the revolution */
+    double tach_rest = 0;           /* s, interval left after a noise edge */
+};
+
+/**
+ * @brief MAX6650 fan controller with a 2-pulse per revolution fan
+ */
+class Max6650Model : public ShimI2cDevice
+{
+public:
+    explicit Max6650Model(Plant *plant);
+
+    uint8_t Read(uint8_t reg) override;
+    void Write(uint8_t reg, uint8_t value) override;
+
+private:
+    void Drive(void);
+
+    Plant *plant;
+    uint8_t regs[0x20] = {};
+};
+
+/**
+ * @brief HTS221 humidity and temperature sensor, one-shot and continuous modes
+ */
+class Hts221Model : public ShimI2cDevice
+{
+public:
+    explicit Hts221Model(Plant *plant);
+
+    uint8_t Read(uint8_t reg) override;
+    void Write(uint8_t reg, uint8_t value) override;
+    uint8_t Next(uint8_t reg) override;
+
+private:
+    void Convert(void);
+
+    Plant *plant;
+    uint8_t regs[0x40] = {};
+};
+
+/**
+ * @brief LSM6DSL accelerometer with the FIFO, gyroscope off
+ */
+class Lsm6dslModel : public ShimI2cDevice
+{
+public:
+    explicit Lsm6dslModel(Plant *plant);
+
+    uint8_t Read(uint8_t reg) override;
+    void Write(uint8_t reg, uint8_t value) override;
+    uint8_t Next(uint8_t reg) override;
+
+private:
+    void Fill(void);
+
+    Plant *plant;
+    uint8_t regs[0x80] = {};
+    std::deque<int16_t> fifo;       /* X, Y, Z words */
+    double next_sample = 0;         /* s */
+    double phase = 0;               /* fan rotation, revolutions */
+};
+
+#endif /* HOST_PTY_DEVICE_DEVICES_H_ */
@@ -0,0 +1,50 @@
+#include "stm32l4xx_hal.h"
+#include "i2c_api.h"
+#include "uart_api.h"
+#include "user_functions.h"
+#include "crc.h"
+#include "boot.h"
+#include "timebase.h"
+#include "tach.h"
+#include "firmware_main.h"
+
+/* Same sequence as main() of src/main.c, without the clock and GPIO setup */
+void Firmware_Main(void)
+{
+    bool i2c_fast_speed = false;
+
+    Boot_Mark(Boot_Phase_Startup);
+    Boot_Mark(Boot_Phase_HAL);
+    Boot_Mark(Boot_Phase_Clock);
+
+    Crc_Init();
+    Timebase_Init();
+    Tach_Init();
+
+    I2C_API_Init(i2c_fast_speed);
+    UartAPI_Init();
+    Boot_Mark(Boot_Phase_Peripherals);
+
+    /* Clear terminal window */
+    printf(TC_CLS);
+    printf(TC_HOME);
+
+    if(UserFunctions_Init() != true)
+    {
+        printf(TC_RED"ERROR: Can't initialize..\r\n");
+    }
+    Boot_Mark(Boot_Phase_Devices);
+
+#if FAST_BOOT
+    printf(TC_MAGENTA"UART<->I2C Controller, type \"help\" for commands\r\n");
+#else
+    printf(TC_MAGENTA"---------------- UART<->I2C Controller ---------------");
+    UartAPI_PrintMenu();
+#endif
+    Boot_Mark(Boot_Phase_Console);
+
+    while(1)
+    {
+        UartAPI_WaitForCommandAndExecute();
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef HOST_PTY_DEVICE_FIRMWARE_MAIN_H_
+#define HOST_PTY_DEVICE_FIRMWARE_MAIN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Boot the firmware and run the console, doesn't return
+ */
+void Firmware_Main(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_PTY_DEVICE_FIRMWARE_MAIN_H_ */
@@ -0,0 +1,172 @@
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stm32l4xx.h"
+#include "flash_api.h"
+#include "flash_host.h"
+
+/* STM32L4 datasheet, typical */
+#define FLASH_PAGE_ERASE_NS         22000000ULL
+#define FLASH_DOUBLEWORD_NS         82000ULL
+
+static int flash_fd = -1;
+static bool boot_bank2;
+static void (*reset_handler)(bool bank2);
+
+static void wait_ns(uint64_t ns)
+{
+    struct timespec ts = {(time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL)};
+
+    nanosleep(&ts, NULL);
+}
+
+
+/**
+ * @brief File offset of an address of the current memory map
+ */
+static off_t physical_offset(uint32_t addr)
+{
+    return (addr - FLASH_BASE) ^ (boot_bank2 ? FLASH_BANK_SIZE : 0);
+}
+
+
+static bool in_flash(uint32_t addr, uint32_t len)
+{
+    return (addr >= FLASH_BASE) && (len <= FLASH_SIZE) && (addr - FLASH_BASE <= FLASH_SIZE - len);
+}
+
+
+int FlashHost_Open(const char *path)
+{
+    int fd = (*path == '\0') ? memfd_create("pty_device_flash", 0) : open(path, O_RDWR | O_CREAT, 0644);
+    std::vector<uint8_t> erased(FLASH_SIZE, 0xFF);
+    off_t size;
+
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    size = lseek(fd, 0, SEEK_END);
+    if((size < (off_t)FLASH_SIZE) && (pwrite(fd, erased.data() + size, FLASH_SIZE - size, size) != (ssize_t)(FLASH_SIZE - size)))
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+bool FlashHost_Map(int fd, bool bank2)
+{
+    for(uint32_t bank = 0; bank < 2; bank++)
+    {
+        void *addr = (void *)(uintptr_t)(FLASH_BASE + bank * FLASH_BANK_SIZE);
+
+        if(mmap(addr, FLASH_BANK_SIZE, PROT_READ, MAP_SHARED | MAP_FIXED_NOREPLACE, fd,
+                (bank ^ (bank2 ? 1 : 0)) * FLASH_BANK_SIZE) != addr)
+        {
+            return false;
+        }
+    }
+
+    flash_fd = fd;
+    boot_bank2 = bank2;
+    return true;
+}
+
+
+void FlashHost_SetResetHandler(void (*handler)(bool bank2))
+{
+    reset_handler = handler;
+}
+
+
+bool FlashAPI_IsBankSwapped(void)
+{
+    return boot_bank2;
+}
+
+
+bool FlashAPI_Erase(uint32_t addr, uint32_t pages)
+{
+    std::vector<uint8_t> erased(FLASH_PAGE_SIZE, 0xFF);
+
+    if(((addr - FLASH_BASE) % FLASH_PAGE_SIZE != 0) || (pages > FLASH_SIZE / FLASH_PAGE_SIZE) ||
+       !in_flash(addr, pages * FLASH_PAGE_SIZE))
+    {
+        return false;
+    }
+
+    /* Page by page, the range may cross the bank boundary */
+    for(uint32_t i = 0; i < pages; i++)
+    {
+        wait_ns(FLASH_PAGE_ERASE_NS);
+        if(pwrite(flash_fd, erased.data(), FLASH_PAGE_SIZE, physical_offset(addr + i * FLASH_PAGE_SIZE)) != FLASH_PAGE_SIZE)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool FlashAPI_Program(uint32_t addr, const void *data, uint32_t len)
+{
+    const uint8_t *src = (const uint8_t *)data;
+    uint64_t current;
+
+    if((addr % sizeof(uint64_t) != 0) || (len % sizeof(uint64_t) != 0) || !in_flash(addr, len))
+    {
+        return false;
+    }
+
+    for(uint32_t i = 0; i < len; i += sizeof(uint64_t))
+    {
+        memcpy(&current, (const void *)(uintptr_t)(addr + i), sizeof(current));
+        if(current != UINT64_MAX)
+        {
+            return false;
+        }
+
+        wait_ns(FLASH_DOUBLEWORD_NS);
+        if(pwrite(flash_fd, src + i, sizeof(uint64_t), physical_offset(addr + i)) != sizeof(uint64_t))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/* The file has no ECC, reads never fail */
+bool FlashAPI_ECC_NMIHandler(void)
+{
+    return false;
+}
+
+
+bool FlashAPI_ReadFailed(uint32_t *addr)
+{
+    (void)addr;
+    return false;
+}
+
+
+bool FlashAPI_SetBootBank(bool bank2)
+{
+    /* The option bytes are loaded by a system reset */
+    if(reset_handler != NULL)
+    {
+        reset_handler(bank2);
+    }
+    return false;
+}
@@ -0,0 +1,34 @@
+#ifndef HOST_PTY_DEVICE_FLASH_HOST_H_
+#define HOST_PTY_DEVICE_FLASH_HOST_H_
+
+#include <stdbool.h>
+
+/*
+ Flash of the emulated device for src/flash_api.h. Both banks are kept in a
+ file, physical bank 1 first, and mapped read-only at FLASH_BASE in the order
+ of the boot bank, so the firmware reads them in place. Erase and program go
+ through the file with the datasheet timing; programming a double-word that
+ is not erased fails like PROGERR does on the target.
+*/
+
+/**
+ * @brief Open the flash file, a new one is erased
+ * @param[in] path empty for a flash in memory
+ * @retval file descriptor, -1 on error
+ */
+int FlashHost_Open(const char *path);
+
+/**
+ * @brief Map the flash file
+ * @param[in] fd file of FLASH_SIZE bytes
+ * @param[in] bank2 booted from the physical bank 2
+ * @retval false if the address range is taken
+ */
+bool FlashHost_Map(int fd, bool bank2);
+
+/**
+ * @brief Device reset, FlashAPI_SetBootBank() calls it with the new boot bank
+ */
+void FlashHost_SetResetHandler(void (*handler)(bool bank2));
+
+#endif /* HOST_PTY_DEVICE_FLASH_HOST_H_ */
@@ -0,0 +1,390 @@
+/*
+ Emulated device behind a pseudo-terminal, for end-to-end tests of the
+ console without the board.
+
+ Usage: pty_device [-n devices] [-b baud] [-e i2c_error_rate] [-s seed] [-f flash_file]
+
+ The firmware sources (console, command handlers, I2C driver with its retry
+ and recovery policy, device libraries) are built for the host against the
+ HAL shim (host/shim) and run here unchanged. Each device gets a pty, its
+ path is printed on start; any serial client (host/uploader, picocom,
+ pyserial) opens it like /dev/ttyACM0. The I2C bus carries simulated
+ MAX6650, HTS221 and LSM6DSL parts sharing a fan and board model (devices.h).
+ The fan's tach edges go to the TIM2 capture input, the firmware is built
+ with TACH_CAPTURE=1.
+
+ -n  number of devices, each one runs in its own process
+ -b  UART rate the input and output are paced at, 0 for no pacing
+     (default 115200). The pacing follows the rate set by the firmware
+     ("baud"), auto baud rate detection measures the rate the client has
+     set on its side of the pty
+ -e  probability of an injected NACK, ARLO, BERR or clock timeout per I2C
+     transfer, 0..1 (default 0)
+ -s  seed of the random sequences, device i uses seed + i (default 1)
+ -f  flash file, kept between runs: the archive and uploaded images survive.
+     Device i of several uses flash_file.i. Without it the flash is in memory
+
+ Output the client doesn't read is dropped once the pty buffer is full, like
+ a UART with nobody listening. A bank swap ("update", "rollback") resets the
+ device: the process is executed again on the same pty and flash, the
+ running bank is mapped as selected, the firmware is still the host build.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shim.h"
+#include "devices.h"
+#include "flash_host.h"
+#include "firmware_main.h"
+
+#define DEFAULT_BAUD                115200
+/* Output paced at the baud rate may run ahead by this much, like a TX FIFO */
+#define TX_AHEAD_NS                 1000000ULL
+#define RX_CHUNK                    256
+
+struct Options
+{
+    int devices = 1;
+    uint32_t baud = DEFAULT_BAUD;
+    double error_rate = 0;
+    uint32_t seed = 1;
+    std::string flash_file;
+};
+
+/* State passed over a reset */
+struct Resume
+{
+    int pty = -1;
+    int slave = -1;
+    int flash = -1;
+    bool bank2 = false;
+    int index = 0;
+};
+
+static std::vector<std::string> arguments;
+static Resume device;
+static uint32_t baud;
+static uint64_t tx_free_ns;
+static uint64_t rx_next_ns;
+static uint8_t rx_buffer[RX_CHUNK];
+static ssize_t rx_len;
+static ssize_t rx_pos;
+static Plant *tach_plant;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void sleep_ns(uint64_t ns)
+{
+    struct timespec ts = {(time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL)};
+
+    nanosleep(&ts, NULL);
+}
+
+
+/**
+ * @brief Line time of the characters, 10 bits each with 8N1
+ */
+static uint64_t line_ns(uint32_t len)
+{
+    return (baud != 0) ? (uint64_t)len * 10 * 1000000000ULL / baud : 0;
+}
+
+
+void shim_uart_write(const uint8_t *data, uint32_t len)
+{
+    uint64_t now = now_ns();
+
+    if(tx_free_ns < now)
+    {
+        tx_free_ns = now;
+    }
+    tx_free_ns += line_ns(len);
+
+    if(tx_free_ns > now + TX_AHEAD_NS)
+    {
+        sleep_ns(tx_free_ns - now - TX_AHEAD_NS);
+    }
+
+    /* The master is non-blocking, output nobody reads is lost */
+    if(write(device.pty, data, len) < 0)
+    {
+        return;
+    }
+}
+
+
+void shim_uart_set_baud(uint32_t rate)
+{
+    if(baud != 0)
+    {
+        baud = rate;
+    }
+}
+
+
+uint32_t shim_uart_host_baud(void)
+{
+    static const struct
+    {
+        speed_t speed;
+        uint32_t baud;
+    } rates[] = {
+        {B9600, 9600}, {B19200, 19200}, {B38400, 38400}, {B57600, 57600}, {B115200, 115200},
+        {B230400, 230400}, {B460800, 460800}, {B921600, 921600}, {B1000000, 1000000},
+        {B1500000, 1500000}, {B2000000, 2000000}, {B3000000, 3000000}, {B4000000, 4000000}
+    };
+    struct termios tio;
+
+    /* The pty sides share the settings */
+    if(tcgetattr(device.pty, &tio) != 0)
+    {
+        return 0;
+    }
+    for(const auto &rate : rates)
+    {
+        if(cfgetospeed(&tio) == rate.speed)
+        {
+            return rate.baud;
+        }
+    }
+    return 0;
+}
+
+
+
+uint64_t shim_tach_interval_ns(void)
+{
+    return (tach_plant != NULL) ? tach_plant->TachIntervalNs() : 0;
+}
+
+bool shim_uart_read(uint8_t *byte, uint32_t timeout_ms)
+{
+    uint64_t now = now_ns();
+
+    /* The next character is still on the line */
+    if(rx_next_ns > now)
+    {
+        if(rx_next_ns - now > (uint64_t)timeout_ms * 1000000ULL)
+        {
+            return false;
+        }
+        sleep_ns(rx_next_ns - now);
+        now = rx_next_ns;
+    }
+
+    if(rx_pos >= rx_len)
+    {
+        struct pollfd pfd = {device.pty, POLLIN, 0};
+
+        if((poll(&pfd, 1, (int)timeout_ms) <= 0) || !(pfd.revents & POLLIN))
+        {
+            return false;
+        }
+
+        rx_len = read(device.pty, rx_buffer, sizeof(rx_buffer));
+        rx_pos = 0;
+        if(rx_len <= 0)
+        {
+            return false;
+        }
+    }
+
+    *byte = rx_buffer[rx_pos++];
+    rx_next_ns = ((rx_next_ns > now) ? rx_next_ns : now) + line_ns(1);
+    return true;
+}
+
+
+/**
+ * @brief System reset: the same program on the same pty and flash
+ */
+static void reset(bool bank2)
+{
+    std::vector<char *> argv;
+    char resume[64];
+
+    snprintf(resume, sizeof(resume), "%d,%d,%d,%d,%d", device.pty, device.slave, device.flash, bank2 ? 1 : 0, device.index);
+
+    for(std::string &arg : arguments)
+    {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back((char *)"-r");
+    argv.push_back(resume);
+    argv.push_back(NULL);
+
+    execv("/proc/self/exe", argv.data());
+    perror("pty_device: reset");
+    exit(1);
+}
+
+
+/**
+ * @brief Create the pty, the slave is kept open so the master survives clients going away
+ */
+static bool open_pty(Resume *res)
+{
+    struct termios tio;
+    const char *name;
+
+    res->pty = posix_openpt(O_RDWR | O_NOCTTY);
+    if((res->pty < 0) || (grantpt(res->pty) != 0) || (unlockpt(res->pty) != 0) || ((name = ptsname(res->pty)) == NULL))
+    {
+        return false;
+    }
+
+    res->slave = open(name, O_RDWR | O_NOCTTY);
+    if((res->slave < 0) || (tcgetattr(res->slave, &tio) != 0))
+    {
+        return false;
+    }
+
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B115200);
+    cfsetospeed(&tio, B115200);
+    return tcsetattr(res->slave, TCSANOW, &tio) == 0;
+}
+
+
+static void run_device(const Options &options, int index)
+{
+    uint32_t seed = options.seed + index;
+
+    device.index = index;
+    FlashHost_SetResetHandler(reset);
+    if(FlashHost_Map(device.flash, device.bank2) != true)
+    {
+        fprintf(stderr, "pty_device: can't map the flash\n");
+        exit(1);
+    }
+
+    fcntl(device.pty, F_SETFL, fcntl(device.pty, F_GETFL) | O_NONBLOCK);
+    baud = options.baud;
+
+    static Plant plant(seed);
+    tach_plant = &plant;
+    static Max6650Model max6650(&plant);
+    static Hts221Model hts221(&plant);
+    static Lsm6dslModel lsm6dsl(&plant);
+
+    shim_i2c_attach(0x90, &max6650);
+    shim_i2c_attach(0xBE, &hts221);
+    shim_i2c_attach(0xD4, &lsm6dsl);
+    shim_i2c_set_faults(options.error_rate, seed);
+
+    Firmware_Main();
+}
+
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: pty_device [-n devices] [-b baud] [-e i2c_error_rate] [-s seed] [-f flash_file]\n");
+    exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    const char *resume = NULL;
+    int opt;
+
+    for(int i = 0; i < argc; i++)
+    {
+        arguments.push_back(argv[i]);
+    }
+
+    while((opt = getopt(argc, argv, "n:b:e:s:f:r:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': options.devices = atoi(optarg); break;
+            case 'b': options.baud = strtoul(optarg, NULL, 0); break;
+            case 'e': options.error_rate = atof(optarg); break;
+            case 's': options.seed = strtoul(optarg, NULL, 0); break;
+            case 'f': options.flash_file = optarg; break;
+            case 'r': resume = optarg; break;
+            default: usage();
+        }
+    }
+
+    if((optind != argc) || (options.devices < 1) || (options.error_rate < 0) || (options.error_rate > 1))
+    {
+        usage();
+    }
+
+    if(resume != NULL)
+    {
+        int bank2 = 0;
+        int index = 0;
+
+        if(sscanf(resume, "%d,%d,%d,%d,%d", &device.pty, &device.slave, &device.flash, &bank2, &index) != 5)
+        {
+            usage();
+        }
+        /* The reset arguments are appended again on the next one */
+        arguments.resize(arguments.size() - 2);
+        device.bank2 = (bank2 != 0);
+        run_device(options, index);
+    }
+
+    /* All devices go down with Ctrl+C on the terminal */
+    for(int i = 0; i < options.devices; i++)
+    {
+        std::string flash_file = options.flash_file;
+        pid_t pid;
+
+        if(!flash_file.empty() && (options.devices > 1))
+        {
+            flash_file += "." + std::to_string(i);
+        }
+
+        if((open_pty(&device) != true) || ((device.flash = FlashHost_Open(flash_file.c_str())) < 0))
+        {
+            fprintf(stderr, "pty_device: can't create device %d: %s\n", i, strerror(errno));
+            return 1;
+        }
+        fprintf(stdout, "%s\n", ptsname(device.pty));
+        fflush(stdout);
+
+        pid = (options.devices == 1) ? 0 : fork();
+        if(pid == 0)
+        {
+            run_device(options, i);
+        }
+        if(pid < 0)
+        {
+            perror("pty_device: fork");
+            return 1;
+        }
+
+        close(device.pty);
+        close(device.slave);
+        close(device.flash);
+    }
+
+    while(wait(NULL) > 0)
+    {
+    }
+
+    return 0;
+}
@@ -0,0 +1,1182 @@
+#include <cctype>
+#include <cstdarg>
+#include <cstring>
+#include <map>
+#include <random>
+
+#include <time.h>
+
+#include "stm32l4xx_hal.h"
+#include "shim_i2c.h"
+#include "uart_api.h"
+#include "timebase.h"
+#include "error.h"
+
+/* Longer output is cut, the console lines are short */
+#define SHIM_PRINTF_BUFFER      1024
+/* Command line of scanf("%s") without a width, the console buffer is 512 bytes */
+#define SHIM_SCANF_MAX          511
+/* Bytes taken by the RX interrupt per tick */
+#define SHIM_IRQ_BURST          64
+/* Empty RX polls in a row before the next one waits up to 1 ms for the host */
+#define SHIM_USART_IDLE_POLLS   1000
+
+/* Register indexes, as laid out in stm32l4xx.h */
+#define USART_REG_CR1           0
+#define USART_REG_CR2           1
+#define USART_REG_BRR           3
+#define USART_REG_RQR           6
+#define USART_REG_ISR           7
+#define USART_REG_ICR           8
+#define USART_REG_RDR           9
+#define USART_REG_TDR           10
+
+#define DMA_REG_ISR             0
+#define DMA_REG_IFCR            1
+#define DMA_CHANNEL_REG_CCR     0
+
+#define TIM_REG_CR1             0
+#define TIM_REG_SR              4
+#define TIM_REG_EGR             5
+#define TIM_REG_CNT             9
+
+#define I2C_REG_CR1             0
+#define I2C_REG_CR2             1
+#define I2C_REG_TIMINGR         4
+#define I2C_REG_ISR             6
+#define I2C_REG_ICR             7
+#define I2C_REG_RXDR            9
+#define I2C_REG_TXDR            10
+
+/* Standard mode, Fast-mode Plus once enabled */
+#define I2C_BUS_HZ              100000U
+#define I2C_BUS_FMP_HZ          1000000U
+/* SCL low timeout programmed by i2c_api.c */
+#define I2C_SCL_TIMEOUT_NS      10000000ULL
+
+uint32_t SystemCoreClock = 80000000;
+CRC_TypeDef shim_crc;
+FLASH_TypeDef shim_flash;
+CoreDebug_Type shim_core_debug;
+RCC_TypeDef shim_rcc;
+uint32_t shim_primask;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_ns(uint64_t ns)
+{
+    struct timespec ts = {(time_t)(ns / 1000000000ULL), (long)(ns % 1000000000ULL)};
+
+    nanosleep(&ts, NULL);
+}
+
+static const uint64_t start_ns = now_ns();
+
+
+/**
+ * @brief USART1: the transmitter is always ready, a byte is received when the host has one.
+ *        A firmware polling for input with nothing else to do waits on the host instead of spinning.
+ *        Auto baud rate detection takes the rate of the host side when the measured byte is 0x55.
+ *        A BRR change is passed to the host tool, which paces the line at the new rate
+ */
+class UsartModel : public ShimPeripheral
+{
+public:
+    /**
+     * @brief Registers set up by HAL_UART_Init(), the host tool keeps its rate
+     */
+    void Configure(uint32_t init_brr, uint32_t init_cr2)
+    {
+        brr = init_brr;
+        cr2 = init_cr2;
+    }
+
+    uint32_t Read(int index, uint32_t value) override
+    {
+        switch(index)
+        {
+            case USART_REG_BRR:
+                return brr;
+
+            case USART_REG_ISR:
+                Fetch((idle_polls < SHIM_USART_IDLE_POLLS) ? 0 : 1);
+                idle_polls = rx_full ? 0 : idle_polls + 1;
+                return value | abr_flags | USART_ISR_TXE_Msk | USART_ISR_TC_Msk | (rx_full ? USART_ISR_RXNE_Msk : 0);
+
+            case USART_REG_RDR:
+                Fetch(0);
+                rx_full = false;
+                return rx_data;
+
+            default:
+                return value;
+        }
+    }
+
+    uint32_t Write(int index, uint32_t value) override
+    {
+        uint8_t data = (uint8_t)value;
+
+        switch(index)
+        {
+            case USART_REG_TDR:
+                shim_uart_write(&data, 1);
+                idle_polls = 0;
+                return value;
+
+            case USART_REG_CR1:
+                /* Detection is armed when the USART is enabled */
+                if((value & USART_CR1_UE) && !enabled && (cr2 & USART_CR2_ABREN))
+                {
+                    abr_armed = true;
+                }
+                if(!(value & USART_CR1_UE))
+                {
+                    abr_flags = 0;
+                }
+                enabled = (value & USART_CR1_UE) != 0;
+                return value;
+
+            case USART_REG_CR2:
+                cr2 = value;
+                return value;
+
+            case USART_REG_BRR:
+                if((value != 0) && (value != brr))
+                {
+                    shim_uart_set_baud(SystemCoreClock / value);
+                }
+                brr = value;
+                return value;
+
+            case USART_REG_RQR:
+                if((value & USART_RQR_ABRRQ) && (cr2 & USART_CR2_ABREN))
+                {
+                    abr_armed = true;
+                    abr_flags = 0;
+                }
+                return 0;
+
+            case USART_REG_ISR:
+            case USART_REG_ICR:
+                /* Flags are computed on read, overruns don't happen: the host keeps the bytes */
+                return 0;
+
+            default:
+                return value;
+        }
+    }
+
+    bool Pending(void)
+    {
+        Fetch(0);
+        return rx_full;
+    }
+
+    bool Take(uint8_t *data, uint32_t timeout_ms)
+    {
+        Fetch(timeout_ms);
+        if(!rx_full)
+        {
+            return false;
+        }
+        rx_full = false;
+        *data = rx_data;
+        return true;
+    }
+
+private:
+    void Fetch(uint32_t timeout_ms)
+    {
+        if(!rx_full)
+        {
+            rx_full = shim_uart_read(&rx_data, timeout_ms);
+            if(rx_full && abr_armed)
+            {
+                Detect();
+            }
+        }
+    }
+
+    /**
+     * @brief Auto baud rate detection on the byte just received
+     */
+    void Detect(void)
+    {
+        uint32_t host_baud = shim_uart_host_baud();
+
+        abr_armed = false;
+        abr_flags = USART_ISR_ABRF;
+        if((rx_data != 0x55) || (host_baud == 0))
+        {
+            abr_flags |= USART_ISR_ABRE;
+            return;
+        }
+
+        /* Measured to the nearest BRR step, like the hardware */
+        if((SystemCoreClock + host_baud / 2) / host_baud != brr)
+        {
+            brr = (SystemCoreClock + host_baud / 2) / host_baud;
+            shim_uart_set_baud(SystemCoreClock / brr);
+        }
+    }
+
+    bool rx_full = false;
+    uint8_t rx_data = 0;
+    uint32_t idle_polls = 0;            /* ISR reads with nothing received or sent */
+    uint32_t brr = 0;
+    uint32_t cr2 = 0;
+    bool enabled = false;
+    bool abr_armed = false;
+    uint32_t abr_flags = 0;             /* ABRF, ABRE */
+};
+
+
+/**
+ * @brief I2C2: the HAL transfers are served at transaction level. The registers
+ *        model the flags, the address-only write of the bus probe and the
+ *        register-level transfers (CR2 START, TXIS/TXDR, RXNE/RXDR, TC, STOPF)
+ *        without reload
+ */
+class I2cModel : public ShimPeripheral
+{
+public:
+    uint32_t Read(int index, uint32_t value) override
+    {
+        switch(index)
+        {
+            case I2C_REG_ISR:
+                return isr | I2C_ISR_TXE;
+
+            case I2C_REG_RXDR:
+                if((device == NULL) || (remaining == 0) || !(cr2 & I2C_CR2_RD_WRN))
+                {
+                    return 0;
+                }
+                value = device->Read(pointer);
+                pointer = device->Next(pointer);
+                ByteDone();
+                return value;
+
+            default:
+                return value;
+        }
+    }
+
+    uint32_t Write(int index, uint32_t value) override
+    {
+        switch(index)
+        {
+            case I2C_REG_CR2:
+                if(value & I2C_CR2_START)
+                {
+                    Start(value);
+                }
+                return value & ~(I2C_CR2_START | I2C_CR2_STOP);
+
+            case I2C_REG_ICR:
+                isr &= ~value;
+                return 0;
+
+            case I2C_REG_CR1:
+                /* Software reset: clearing PE clears the flags and ends the transfer */
+                if(!(value & I2C_CR1_PE))
+                {
+                    isr = 0;
+                    device = NULL;
+                    remaining = 0;
+                }
+                return value;
+
+            case I2C_REG_TIMINGR:
+                /* SCL period: (SCLH + 1 + SCLL + 1) x (PRESC + 1) PCLK1 cycles */
+                bus_hz = SystemCoreClock / ((((value >> 8) & 0xFF) + 1 + (value & 0xFF) + 1) * ((value >> 28) + 1));
+                return value;
+
+            case I2C_REG_TXDR:
+                if((device == NULL) || (remaining == 0) || (cr2 & I2C_CR2_RD_WRN))
+                {
+                    return value;
+                }
+                if(pointer_next)
+                {
+                    pointer = (uint8_t)value;
+                    pointer_next = false;
+                }
+                else
+                {
+                    device->Write(pointer, (uint8_t)value);
+                    pointer = device->Next(pointer);
+                }
+                ByteDone();
+                return value;
+
+            default:
+                return value;
+        }
+    }
+
+    /**
+     * @brief Bus time of the bytes, address and register bytes included
+     */
+    void Wait(uint32_t bytes)
+    {
+        sleep_ns((uint64_t)bytes * 9 * 1000000000ULL / (fast_mode_plus ? I2C_BUS_FMP_HZ : bus_hz));
+    }
+
+    /**
+     * @brief Injected error of the next transfer
+     * @retval HAL error code, HAL_I2C_ERROR_NONE for none
+     */
+    uint32_t NextFault(void)
+    {
+        static const uint32_t faults[] =
+        {
+            HAL_I2C_ERROR_AF,
+            HAL_I2C_ERROR_ARLO,
+            HAL_I2C_ERROR_BERR,
+            HAL_I2C_ERROR_TIMEOUT
+        };
+
+        if((fault_rate <= 0) || (std::uniform_real_distribution<double>(0, 1)(rng) >= fault_rate))
+        {
+            return HAL_I2C_ERROR_NONE;
+        }
+        return faults[std::uniform_int_distribution<int>(0, 3)(rng)];
+    }
+
+    std::map<uint8_t, ShimI2cDevice*> devices;
+    uint32_t isr = 0;
+    bool fast_mode_plus = false;
+    uint32_t bus_hz = I2C_BUS_HZ;
+    double fault_rate = 0;
+    std::mt19937 rng;
+
+private:
+    /**
+     * @brief START written to CR2: a new transfer after STOP, or a repeated START after TC
+     */
+    void Start(uint32_t value)
+    {
+        uint32_t nbytes = (value >> I2C_CR2_NBYTES_Pos) & 0xFF;
+        std::map<uint8_t, ShimI2cDevice*>::iterator it = devices.find(value & 0xFE);
+        uint32_t fault = HAL_I2C_ERROR_NONE;
+        bool repeated = (isr & I2C_ISR_TC) != 0;
+
+        isr &= ~(I2C_ISR_TXIS | I2C_ISR_RXNE | I2C_ISR_TC);
+        cr2 = value;
+        device = NULL;
+        remaining = 0;
+
+        /* Address phase and the bytes, the register pointer write included */
+        Wait(1 + nbytes);
+
+        if(!repeated && (nbytes != 0))
+        {
+            fault = NextFault();
+        }
+        if((it == devices.end()) || (fault == HAL_I2C_ERROR_AF))
+        {
+            /* The master sends STOP after a NACK */
+            isr |= I2C_ISR_NACKF | I2C_ISR_STOPF;
+            return;
+        }
+        if(fault == HAL_I2C_ERROR_ARLO)
+        {
+            isr |= I2C_ISR_ARLO;
+            return;
+        }
+        if(fault == HAL_I2C_ERROR_BERR)
+        {
+            isr |= I2C_ISR_BERR;
+            return;
+        }
+        if(fault == HAL_I2C_ERROR_TIMEOUT)
+        {
+            /* SCL held low until the clock timeout of TIMEOUTR */
+            sleep_ns(I2C_SCL_TIMEOUT_NS);
+            isr |= I2C_ISR_TIMEOUT;
+            return;
+        }
+
+        device = it->second;
+        remaining = nbytes;
+        if(nbytes == 0)
+        {
+            isr |= I2C_ISR_STOPF;
+        }
+        else if(value & I2C_CR2_RD_WRN)
+        {
+            isr |= I2C_ISR_RXNE;
+        }
+        else
+        {
+            /* The first byte of a write is the register pointer */
+            pointer_next = true;
+            isr |= I2C_ISR_TXIS;
+        }
+    }
+
+    void ByteDone(void)
+    {
+        if(--remaining != 0)
+        {
+            return;
+        }
+        isr &= ~(I2C_ISR_TXIS | I2C_ISR_RXNE);
+        isr |= (cr2 & I2C_CR2_AUTOEND) ? I2C_ISR_STOPF : I2C_ISR_TC;
+    }
+
+    ShimI2cDevice *device = NULL;
+    uint32_t cr2 = 0;
+    uint32_t remaining = 0;
+    uint8_t pointer = 0;
+    bool pointer_next = false;
+};
+
+/**
+ * @brief DMA1 flags: set by the channels, cleared through IFCR
+ */
+class DmaModel : public ShimPeripheral
+{
+public:
+    uint32_t Read(int index, uint32_t value) override
+    {
+        return (index == DMA_REG_ISR) ? isr : value;
+    }
+
+    uint32_t Write(int index, uint32_t value) override
+    {
+        if(index == DMA_REG_IFCR)
+        {
+            isr &= ~value;
+            return 0;
+        }
+        return isr;
+    }
+
+    uint32_t isr = 0;
+};
+
+
+/**
+ * @brief DMA1 channel. Memory to USART1 TDR: the block goes out at once when the channel is enabled.
+ *        Peripheral to memory: a word per request of the peripheral, circular mode reloads the count
+ */
+class DmaChannelModel : public ShimPeripheral
+{
+public:
+    DmaChannelModel(DmaModel *dma, DMA_Channel_TypeDef *channel, int number) : dma(dma), channel(channel), number(number) {}
+
+    uint32_t Write(int index, uint32_t value) override;
+
+    /**
+     * @brief Request of the peripheral at source
+     * @retval true if the channel has taken the word
+     */
+    bool Request(uintptr_t source, uint32_t data);
+
+private:
+    DmaModel *dma;
+    DMA_Channel_TypeDef *channel;
+    int number;
+    uint32_t reload = 0;
+};
+
+static void tim2_irq(void);
+
+/**
+ * @brief TIM2 upcounting from the host clock at SystemCoreClock / (PSC + 1), the prescaler
+ *        is loaded by UG. The counter is taken as free-running over 32 bits (ARR is ignored):
+ *        UIF is set on a wrap, CC1IF when the counter passes CCR1 or on CC1G. Channel 2 as
+ *        an input captures the tach edges of the host tool, with its DMA request. The
+ *        interrupt is delivered after a read of CNT and when the firmware looks at the tick
+ */
+class TimModel : public ShimPeripheral
+{
+public:
+    TimModel(TIM_TypeDef *tim, DmaChannelModel *cc2_dma) : tim(tim), cc2_dma(cc2_dma) {}
+
+    uint32_t Read(int index, uint32_t value) override
+    {
+        Update();
+        if(index == TIM_REG_SR)
+        {
+            return sr;
+        }
+        if(index == TIM_REG_CNT)
+        {
+            value = (uint32_t)count;
+            tim2_irq();
+        }
+        return value;
+    }
+
+    uint32_t Write(int index, uint32_t value) override
+    {
+        Update();
+        switch(index)
+        {
+            case TIM_REG_CR1:
+                if(((value & TIM_CR1_CEN) != 0) != running)
+                {
+                    running = !running;
+                    Restart(count);
+                }
+                break;
+
+            case TIM_REG_SR:
+                /* rc_w0 */
+                sr &= value;
+                value = sr;
+                break;
+
+            case TIM_REG_EGR:
+                if(value & TIM_EGR_UG)
+                {
+                    prescaler = tim->PSC.value;
+                    Restart(0);
+                }
+                if(value & TIM_EGR_CC1G)
+                {
+                    sr |= TIM_SR_CC1IF;
+                }
+                value = 0;
+                break;
+
+            case TIM_REG_CNT:
+                Restart(value);
+                break;
+        }
+        return value;
+    }
+
+    /**
+     * @brief An enabled flag is set, after advancing to the host time
+     */
+    bool Pending()
+    {
+        Update();
+        return (sr & tim->DIER.value & (TIM_SR_UIF | TIM_SR_CC1IF)) != 0;
+    }
+
+private:
+    uint64_t CountAt(uint64_t ns)
+    {
+        uint64_t hz = SystemCoreClock / (prescaler + 1);
+
+        ns = (ns > origin_ns) ? ns : origin_ns;
+        return origin_count + (uint64_t)((unsigned __int128)(ns - origin_ns) * hz / 1000000000ULL);
+    }
+
+    /**
+     * @brief Capture the tach edges up to ns, when channel 2 is an enabled input
+     */
+    void Capture(uint64_t ns)
+    {
+        uint64_t interval;
+
+        if(!(tim->CCER.value & TIM_CCER_CC2E) || ((tim->CCMR1.value & TIM_CCMR1_CC2S) != TIM_CCMR1_CC2S_0))
+        {
+            next_edge_ns = 0;
+            return;
+        }
+
+        if(next_edge_ns == 0)
+        {
+            interval = shim_tach_interval_ns();
+            next_edge_ns = (interval != 0) ? ns + interval : 0;
+            return;
+        }
+
+        while((next_edge_ns != 0) && (next_edge_ns <= ns))
+        {
+            tim->CCR2.value = (uint32_t)CountAt(next_edge_ns);
+            sr |= ((sr & TIM_SR_CC2IF) ? TIM_SR_CC2OF : 0) | TIM_SR_CC2IF;
+            /* The DMA reading CCR2 clears the flag */
+            if((tim->DIER.value & TIM_DIER_CC2DE) && cc2_dma->Request((uintptr_t)&tim->CCR2, tim->CCR2.value))
+            {
+                sr &= ~TIM_SR_CC2IF;
+            }
+
+            interval = shim_tach_interval_ns();
+            next_edge_ns = (interval != 0) ? next_edge_ns + interval : 0;
+        }
+    }
+
+    void Restart(uint64_t value)
+    {
+        count = value;
+        origin_count = value;
+        origin_ns = now_ns();
+    }
+
+    /**
+     * @brief Advance the counter to the host time and raise the flags passed on the way
+     */
+    void Update()
+    {
+        if(!running)
+        {
+            return;
+        }
+
+        uint64_t ns = now_ns();
+        uint64_t now = CountAt(ns);
+        /* First value after the last update that matches CCR1 */
+        uint64_t match = count + 1 + (uint32_t)(tim->CCR1.value - (uint32_t)(count + 1));
+
+        if((now >> 32) != (count >> 32))
+        {
+            sr |= TIM_SR_UIF;
+        }
+        if(match <= now)
+        {
+            sr |= TIM_SR_CC1IF;
+        }
+        count = now;
+        Capture(ns);
+    }
+
+    TIM_TypeDef *tim;
+    DmaChannelModel *cc2_dma;
+    bool running = false;
+    uint32_t prescaler = 0;
+    uint32_t sr = 0;
+    uint64_t count = 0;             /* counter with its wraps, CNT is the low word */
+    uint64_t origin_count = 0;
+    uint64_t origin_ns = 0;
+    uint64_t next_edge_ns = 0;      /* 0 if no edge is coming */
+};
+
+static UsartModel usart1_model;
+static I2cModel i2c2_model;
+static DmaModel dma1_model;
+static DmaChannelModel dma1_channel4_model(&dma1_model, &shim_dma1_channel4, 4);
+static DmaChannelModel dma1_channel7_model(&dma1_model, &shim_dma1_channel7, 7);
+static TimModel tim2_model(&shim_tim2, &dma1_channel7_model);
+static bool dma1_channel4_irq_enabled;
+static bool usart1_irq_enabled;
+static bool tim2_irq_enabled;
+static DWT_Type dwt;
+
+USART_TypeDef shim_usart1(&usart1_model);
+TIM_TypeDef shim_tim2(&tim2_model);
+I2C_TypeDef shim_i2c2(&i2c2_model);
+DMA_TypeDef shim_dma1(&dma1_model);
+DMA_Channel_TypeDef shim_dma1_channel4(&dma1_channel4_model);
+DMA_Channel_TypeDef shim_dma1_channel7(&dma1_channel7_model);
+DMA_Request_TypeDef shim_dma1_cselr;
+
+
+uint32_t DmaChannelModel::Write(int index, uint32_t value)
+{
+    if((index == DMA_CHANNEL_REG_CCR) && (value & DMA_CCR_EN) && !(channel->CCR.value & DMA_CCR_EN) &&
+       (channel->CNDTR.value != 0) && (value & DMA_CCR_DIR) &&
+       (channel->CPAR == (uintptr_t)&shim_usart1.TDR) && (shim_usart1.CR3.value & USART_CR3_DMAT))
+    {
+        shim_uart_write((const uint8_t *)channel->CMAR, channel->CNDTR.value);
+        channel->CNDTR.value = 0;
+        /* GIF and TCIF of the channel */
+        dma->isr |= 3U << (4 * (number - 1));
+    }
+
+    if((index == DMA_CHANNEL_REG_CCR) && (value & DMA_CCR_EN) && !(channel->CCR.value & DMA_CCR_EN))
+    {
+        reload = channel->CNDTR.value;
+    }
+
+    return value;
+}
+
+
+bool DmaChannelModel::Request(uintptr_t source, uint32_t data)
+{
+    volatile uint32_t *memory = (volatile uint32_t *)channel->CMAR;
+    uint32_t index;
+
+    if(!(channel->CCR.value & DMA_CCR_EN) || (channel->CCR.value & DMA_CCR_DIR) ||
+       (channel->CPAR != source) || (channel->CNDTR.value == 0))
+    {
+        return false;
+    }
+
+    index = (channel->CCR.value & DMA_CCR_MINC) ? reload - channel->CNDTR.value : 0;
+    memory[index] = data;
+    channel->CNDTR.value--;
+
+    if(channel->CNDTR.value == reload / 2)
+    {
+        /* GIF and HTIF */
+        dma->isr |= 5U << (4 * (number - 1));
+    }
+    if(channel->CNDTR.value == 0)
+    {
+        dma->isr |= 3U << (4 * (number - 1));
+        if(channel->CCR.value & DMA_CCR_CIRC)
+        {
+            channel->CNDTR.value = reload;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief USART1 RX interrupt, taken when the firmware looks at the tick
+ */
+static void usart1_irq(void)
+{
+    static bool active;
+
+    if(active || !usart1_irq_enabled || !(shim_usart1.CR1 & USART_CR1_RXNEIE))
+    {
+        return;
+    }
+
+    active = true;
+    for(int i = 0; (i < SHIM_IRQ_BURST) && usart1_model.Pending(); i++)
+    {
+        UartAPI_IRQHandler();
+    }
+    active = false;
+}
+
+
+/**
+ * @brief DMA1 channel 4 transfer complete interrupt, taken when the firmware looks at the tick
+ */
+static void dma1_channel4_irq(void)
+{
+    static bool active;
+
+    if(active || !dma1_channel4_irq_enabled || (shim_primask != 0) ||
+       !(shim_dma1_channel4.CCR & DMA_CCR_TCIE) || !(shim_dma1.ISR & DMA_ISR_TCIF4))
+    {
+        return;
+    }
+
+    active = true;
+    UartAPI_TxDMA_IRQHandler();
+    active = false;
+}
+
+
+/**
+ * @brief TIM2 interrupt, taken when the firmware reads the counter or looks at the tick
+ */
+static void tim2_irq(void)
+{
+    static bool active;
+
+    if(active || !tim2_irq_enabled || (shim_primask != 0) || !tim2_model.Pending())
+    {
+        return;
+    }
+
+    active = true;
+    Timebase_IRQHandler();
+    active = false;
+}
+
+
+uint32_t HAL_GetTick(void)
+{
+    dma1_channel4_irq();
+    usart1_irq();
+    tim2_irq();
+    return (uint32_t)((now_ns() - start_ns) / 1000000ULL);
+}
+
+
+void HAL_Delay(uint32_t delay)
+{
+    uint32_t start = HAL_GetTick();
+
+    while((HAL_GetTick() - start) < delay)
+    {
+        sleep_ns(100000);
+    }
+}
+
+
+DWT_Type* shim_dwt(void)
+{
+    dwt.CYCCNT = (uint32_t)((now_ns() - start_ns) * (SystemCoreClock / 1000000U) / 1000U);
+    return &dwt;
+}
+
+
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+    return SystemCoreClock;
+}
+
+
+uint32_t HAL_RCC_GetPCLK2Freq(void)
+{
+    return SystemCoreClock;
+}
+
+
+void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t preempt_priority, uint32_t sub_priority)
+{
+    (void)irq;
+    (void)preempt_priority;
+    (void)sub_priority;
+}
+
+
+void HAL_NVIC_EnableIRQ(IRQn_Type irq)
+{
+    if(irq == DMA1_Channel4_IRQn)
+    {
+        dma1_channel4_irq_enabled = true;
+    }
+    else if(irq == USART1_IRQn)
+    {
+        usart1_irq_enabled = true;
+    }
+    else if(irq == TIM2_IRQn)
+    {
+        tim2_irq_enabled = true;
+    }
+}
+
+
+void HAL_NVIC_DisableIRQ(IRQn_Type irq)
+{
+    if(irq == DMA1_Channel4_IRQn)
+    {
+        dma1_channel4_irq_enabled = false;
+    }
+    else if(irq == USART1_IRQn)
+    {
+        usart1_irq_enabled = false;
+    }
+    else if(irq == TIM2_IRQn)
+    {
+        tim2_irq_enabled = false;
+    }
+}
+
+
+void Error_Handler(void)
+{
+}
+
+
+/* UART */
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart)
+{
+    uint32_t cr2 = 0;
+
+    if(huart->AdvancedInit.AdvFeatureInit & UART_ADVFEATURE_AUTOBAUDRATE_INIT)
+    {
+        cr2 = huart->AdvancedInit.AutoBaudRateEnable | huart->AdvancedInit.AutoBaudRateMode;
+    }
+
+    /* Like the HAL: the USART is disabled, configured and enabled */
+    huart->Instance->CR1 = 0;
+    usart1_model.Configure(HAL_RCC_GetPCLK2Freq() / huart->Init.BaudRate, cr2);
+    huart->Instance->CR2 = cr2;
+    huart->Instance->CR1 = USART_CR1_UE;
+    return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    (void)huart;
+    (void)timeout;
+
+    shim_uart_write(data, size);
+    return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_UART_Receive(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    (void)huart;
+
+    for(uint16_t i = 0; i < size; i++)
+    {
+        if(!usart1_model.Take(&data[i], timeout))
+        {
+            return HAL_TIMEOUT;
+        }
+    }
+    return HAL_OK;
+}
+
+
+/* GPIO */
+
+void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init)
+{
+    (void)port;
+    (void)init;
+}
+
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state)
+{
+    (void)port;
+    (void)pin;
+    (void)state;
+}
+
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin)
+{
+    (void)port;
+    (void)pin;
+    return GPIO_PIN_SET;
+}
+
+
+/* I2C */
+
+void shim_i2c_attach(uint8_t address, ShimI2cDevice *device)
+{
+    i2c2_model.devices[address & 0xFE] = device;
+}
+
+
+void shim_i2c_set_faults(double rate, uint32_t seed)
+{
+    i2c2_model.fault_rate = rate;
+    i2c2_model.rng.seed(seed);
+}
+
+
+/**
+ * @brief Start of a memory transfer: address phase and injected errors
+ * @retval the device or NULL with the error code set
+ */
+static ShimI2cDevice* i2c_begin(I2C_HandleTypeDef *hi2c, uint16_t dev_address, uint32_t timeout)
+{
+    std::map<uint8_t, ShimI2cDevice*>::iterator it = i2c2_model.devices.find(dev_address & 0xFE);
+    uint32_t fault = i2c2_model.NextFault();
+
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+
+    if(it == i2c2_model.devices.end())
+    {
+        fault = HAL_I2C_ERROR_AF;
+    }
+
+    if(fault == HAL_I2C_ERROR_TIMEOUT)
+    {
+        /* SCL held low: the peripheral flags the clock timeout, HAL waits out its own timeout */
+        i2c2_model.isr |= I2C_ISR_TIMEOUT;
+        sleep_ns((uint64_t)timeout * 1000000ULL);
+    }
+    else if(fault != HAL_I2C_ERROR_NONE)
+    {
+        i2c2_model.Wait(1);
+    }
+
+    hi2c->ErrorCode = fault;
+    return (fault == HAL_I2C_ERROR_NONE) ? it->second : NULL;
+}
+
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c)
+{
+    hi2c->State = HAL_I2C_STATE_READY;
+    hi2c->ErrorCode = HAL_I2C_ERROR_NONE;
+    i2c2_model.isr = 0;
+    return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c)
+{
+    hi2c->State = HAL_I2C_STATE_RESET;
+    return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t dev_address, uint16_t mem_address, uint16_t mem_add_size,
+                                   uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    ShimI2cDevice *device = i2c_begin(hi2c, dev_address, timeout);
+    uint8_t reg = (uint8_t)mem_address;
+
+    (void)mem_add_size;
+
+    if(device == NULL)
+    {
+        return HAL_ERROR;
+    }
+
+    for(uint16_t i = 0; i < size; i++)
+    {
+        data[i] = device->Read(reg);
+        reg = device->Next(reg);
+    }
+    /* Address, register, repeated start address, data */
+    i2c2_model.Wait(3 + size);
+
+    return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t dev_address, uint16_t mem_address, uint16_t mem_add_size,
+                                    uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    ShimI2cDevice *device = i2c_begin(hi2c, dev_address, timeout);
+    uint8_t reg = (uint8_t)mem_address;
+
+    (void)mem_add_size;
+
+    if(device == NULL)
+    {
+        return HAL_ERROR;
+    }
+
+    for(uint16_t i = 0; i < size; i++)
+    {
+        device->Write(reg, data[i]);
+        reg = device->Next(reg);
+    }
+    i2c2_model.Wait(2 + size);
+
+    return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef *hi2c, uint16_t dev_address, uint32_t trials, uint32_t timeout)
+{
+    (void)trials;
+    (void)timeout;
+
+    i2c2_model.Wait(1);
+    if(i2c2_model.devices.count(dev_address & 0xFE) == 0)
+    {
+        hi2c->ErrorCode = HAL_I2C_ERROR_AF;
+        return HAL_ERROR;
+    }
+    return HAL_OK;
+}
+
+
+uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c)
+{
+    return hi2c->ErrorCode;
+}
+
+
+HAL_StatusTypeDef HAL_I2CEx_ConfigAnalogFilter(I2C_HandleTypeDef *hi2c, uint32_t analog_filter)
+{
+    (void)hi2c;
+    (void)analog_filter;
+    return HAL_OK;
+}
+
+
+HAL_StatusTypeDef HAL_I2CEx_ConfigDigitalFilter(I2C_HandleTypeDef *hi2c, uint32_t digital_filter)
+{
+    (void)hi2c;
+    (void)digital_filter;
+    return HAL_OK;
+}
+
+
+void HAL_I2CEx_EnableFastModePlus(uint32_t config)
+{
+    (void)config;
+    i2c2_model.fast_mode_plus = true;
+}
+
+
+void HAL_I2CEx_DisableFastModePlus(uint32_t config)
+{
+    (void)config;
+    i2c2_model.fast_mode_plus = false;
+}
+
+
+/* stdio */
+
+int shim_printf(const char *format, ...)
+{
+    char buffer[SHIM_PRINTF_BUFFER];
+    va_list args;
+    int len;
+
+    va_start(args, format);
+    len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if(len > (int)sizeof(buffer) - 1)
+    {
+        len = sizeof(buffer) - 1;
+    }
+
+    /* As newlib's _write() in syscalls.c */
+    if(len > 0)
+    {
+        __io_write(buffer, len);
+    }
+
+    return len;
+}
+
+
+int shim_scanf(const char *format, ...)
+{
+    va_list args;
+    int res = 0;
+    int ch;
+
+    va_start(args, format);
+
+    /* The console uses scanf("%<width>s") for the command line and scanf("%c") */
+    if((format[0] == '%') && (format[strlen(format) - 1] == 's'))
+    {
+        char *str = va_arg(args, char *);
+        int width = atoi(&format[1]);
+        int len = 0;
+
+        do
+        {
+            ch = __io_getchar();
+        }
+        while(isspace(ch));
+
+        /* As newlib, the character after a full field is left for the next read. Without
+           a width newlib doesn't limit the length, the target would overflow the buffer */
+        while(!isspace(ch))
+        {
+            if(len < SHIM_SCANF_MAX)
+            {
+                str[len++] = (char)ch;
+            }
+            if(len == width)
+            {
+                break;
+            }
+            ch = __io_getchar();
+        }
+        str[len] = '\0';
+        res = 1;
+    }
+    else if(strcmp(format, "%c") == 0)
+    {
+        *va_arg(args, char *) = (char)__io_getchar();
+        res = 1;
+    }
+
+    va_end(args);
+    return res;
+}
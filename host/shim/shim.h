@@ -0,0 +1,57 @@
+#ifndef HOST_SHIM_SHIM_H_
+#define HOST_SHIM_SHIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ Host side of the HAL shim, without the register definitions.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Send bytes from the device UART, implemented by the host tool
+ */
+void shim_uart_write(const uint8_t *data, uint32_t len);
+
+/**
+ * @brief Receive a byte on the device UART, implemented by the host tool
+ * @param[in] timeout_ms 0 to poll
+ * @retval false if nothing has arrived in time
+ */
+bool shim_uart_read(uint8_t *byte, uint32_t timeout_ms);
+
+/**
+ * @brief The firmware has changed the device UART rate, implemented by the host tool
+ */
+void shim_uart_set_baud(uint32_t baud);
+
+/**
+ * @brief Rate the host side of the line is set to, for auto baud rate detection,
+ *        implemented by the host tool
+ * @retval 0 if unknown
+ */
+uint32_t shim_uart_host_baud(void);
+
+/**
+ * @brief Time from a fan tach edge to the next one, for the TIM2 channel 2 input,
+ *        implemented by the host tool
+ * @retval 0 if there are no edges (fan stopped, nothing connected)
+ */
+uint64_t shim_tach_interval_ns(void);
+
+/**
+ * @brief Inject I2C transfer errors
+ * @param[in] rate probability of an error per transfer, 0..1
+ * @param[in] seed random sequence seed
+ */
+void shim_i2c_set_faults(double rate, uint32_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_SHIM_SHIM_H_ */
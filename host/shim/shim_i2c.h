@@ -0,0 +1,32 @@
+#ifndef HOST_SHIM_SHIM_I2C_H_
+#define HOST_SHIM_SHIM_I2C_H_
+
+#include <stdint.h>
+
+/*
+ Simulated I2C slaves on the bus of the HAL shim. A memory transfer sets the
+ register pointer and reads or writes consecutive registers, the pointer
+ advances by Next() after every byte.
+*/
+
+class ShimI2cDevice
+{
+public:
+    virtual ~ShimI2cDevice() {}
+
+    virtual uint8_t Read(uint8_t reg) = 0;
+    virtual void Write(uint8_t reg, uint8_t value) = 0;
+
+    /**
+     * @brief Register pointer after an access, auto-increment by default
+     */
+    virtual uint8_t Next(uint8_t reg) { return reg + 1; }
+};
+
+/**
+ * @brief Attach a device to the bus, it acknowledges its address from now on
+ * @param[in] address 8-bit address as used by the firmware
+ */
+void shim_i2c_attach(uint8_t address, ShimI2cDevice *device);
+
+#endif /* HOST_SHIM_SHIM_I2C_H_ */
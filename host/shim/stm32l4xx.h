@@ -0,0 +1,377 @@
+#ifndef HOST_SHIM_STM32L4XX_H_
+#define HOST_SHIM_STM32L4XX_H_
+
+/*
+ Host stand-in for the CMSIS device header.
+
+ Peripherals polled by the firmware (USART1, I2C2, DMA1, TIM2) are register
+ models: reading ISR or RDR and writing TDR or CR2 have their hardware side
+ effects. A DMA channel moves its whole block when enabled, or a word per
+ peripheral request; its address registers are pointer sized, the firmware
+ stores them from uintptr_t.
+ They are C++ objects, so the sources touching them (uart_api.c, dlog.c,
+ stream.c, i2c_api.c, timebase.c, tach.c) are built as C++ by the host
+ Makefiles; in C the blocks are opaque. The other blocks are plain structs in RAM, DWT->CYCCNT follows
+ the host clock. PRIMASK is a flag the shim checks before delivering an
+ interrupt.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __IO                    volatile
+#define __RAM_FUNC
+#define __STATIC_INLINE         static inline
+
+#define SET_BIT(REG, BIT)       ((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT)     ((REG) &= ~(BIT))
+#define READ_BIT(REG, BIT)      ((REG) & (BIT))
+#define WRITE_REG(REG, VAL)     ((REG) = (VAL))
+#define READ_REG(REG)           ((REG))
+#define MODIFY_REG(REG, CLEARMASK, SETMASK)  WRITE_REG((REG), (((READ_REG(REG)) & (~(CLEARMASK))) | (SETMASK)))
+
+/* Memory map, the flash is mapped at its device address by the host tool */
+#define FLASH_BASE              0x08000000UL
+#define FLASH_SIZE              (1024UL * 1024UL)
+#define FLASH_BANK_SIZE         (FLASH_SIZE / 2)
+#define FLASH_PAGE_SIZE         2048UL
+#define SRAM1_BASE              0x20000000UL
+#define SRAM1_SIZE_MAX          0x00018000UL
+
+typedef enum
+{
+    DMA1_Channel4_IRQn = 14,
+    TIM2_IRQn = 28,
+    I2C2_EV_IRQn = 33,
+    USART1_IRQn = 37
+} IRQn_Type;
+
+#ifdef __cplusplus
+}
+
+/**
+ * @brief Register of a peripheral model, accesses go to the model
+ */
+class ShimPeripheral;
+
+class ShimRegister
+{
+public:
+    ShimRegister(ShimPeripheral *owner, int index) : owner(owner), index(index) {}
+
+    operator uint32_t();
+    ShimRegister& operator=(uint32_t value);
+    ShimRegister& operator|=(uint32_t bits) { return *this = (uint32_t)*this | bits; }
+    ShimRegister& operator&=(uint32_t bits) { return *this = (uint32_t)*this & bits; }
+
+    ShimPeripheral *owner;
+    int index;
+    uint32_t value = 0;
+};
+
+class ShimPeripheral
+{
+public:
+    virtual ~ShimPeripheral() {}
+
+    /**
+     * @brief Register read, value is the stored one
+     */
+    virtual uint32_t Read(int index, uint32_t value) { return value; }
+
+    /**
+     * @brief Register write
+     * @retval value to store
+     */
+    virtual uint32_t Write(int index, uint32_t value) { return value; }
+};
+
+inline ShimRegister::operator uint32_t()
+{
+    return owner->Read(index, value);
+}
+
+inline ShimRegister& ShimRegister::operator=(uint32_t new_value)
+{
+    value = owner->Write(index, new_value);
+    return *this;
+}
+
+struct USART_TypeDef
+{
+    explicit USART_TypeDef(ShimPeripheral *model) :
+        CR1(model, 0), CR2(model, 1), CR3(model, 2), BRR(model, 3), GTPR(model, 4), RTOR(model, 5),
+        RQR(model, 6), ISR(model, 7), ICR(model, 8), RDR(model, 9), TDR(model, 10) {}
+
+    ShimRegister CR1, CR2, CR3, BRR, GTPR, RTOR, RQR, ISR, ICR, RDR, TDR;
+};
+
+struct I2C_TypeDef
+{
+    explicit I2C_TypeDef(ShimPeripheral *model) :
+        CR1(model, 0), CR2(model, 1), OAR1(model, 2), OAR2(model, 3), TIMINGR(model, 4), TIMEOUTR(model, 5),
+        ISR(model, 6), ICR(model, 7), PECR(model, 8), RXDR(model, 9), TXDR(model, 10) {}
+
+    ShimRegister CR1, CR2, OAR1, OAR2, TIMINGR, TIMEOUTR, ISR, ICR, PECR, RXDR, TXDR;
+};
+
+struct DMA_Channel_TypeDef
+{
+    explicit DMA_Channel_TypeDef(ShimPeripheral *model) : CCR(model, 0), CNDTR(model, 1) {}
+
+    ShimRegister CCR, CNDTR;
+    __IO uintptr_t CPAR;
+    __IO uintptr_t CMAR;
+};
+
+struct DMA_TypeDef
+{
+    explicit DMA_TypeDef(ShimPeripheral *model) : ISR(model, 0), IFCR(model, 1) {}
+
+    ShimRegister ISR, IFCR;
+};
+
+struct TIM_TypeDef
+{
+    explicit TIM_TypeDef(ShimPeripheral *model) :
+        CR1(model, 0), CR2(model, 1), SMCR(model, 2), DIER(model, 3), SR(model, 4), EGR(model, 5),
+        CCMR1(model, 6), CCMR2(model, 7), CCER(model, 8), CNT(model, 9), PSC(model, 10), ARR(model, 11),
+        RCR(model, 12), CCR1(model, 13), CCR2(model, 14), CCR3(model, 15), CCR4(model, 16) {}
+
+    ShimRegister CR1, CR2, SMCR, DIER, SR, EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR, CCR1, CCR2, CCR3, CCR4;
+};
+
+extern "C" {
+#else
+typedef struct USART_TypeDef USART_TypeDef;
+typedef struct TIM_TypeDef TIM_TypeDef;
+typedef struct I2C_TypeDef I2C_TypeDef;
+typedef struct DMA_Channel_TypeDef DMA_Channel_TypeDef;
+typedef struct DMA_TypeDef DMA_TypeDef;
+#endif
+
+/* Bits are 32-bit like on the target, so ~BIT fits the register */
+#define USART_CR1_UE            (1U << 0)
+#define USART_CR1_RXNEIE        (1U << 5)
+#define USART_CR2_ABREN         (1U << 20)
+#define USART_CR2_ABRMODE       (3U << 21)
+#define USART_RQR_ABRRQ         (1U << 0)
+#define USART_ISR_ORE_Msk       (1U << 3)
+#define USART_ISR_RXNE_Msk      (1U << 5)
+#define USART_ISR_TC_Msk        (1U << 6)
+#define USART_ISR_TXE_Msk       (1U << 7)
+#define USART_ISR_ABRE          (1U << 14)
+#define USART_ISR_ABRF          (1U << 15)
+#define USART_ICR_ORECF         (1U << 3)
+#define USART_CR3_DMAT          (1U << 7)
+
+typedef struct
+{
+    __IO uint32_t CSELR;
+} DMA_Request_TypeDef;
+
+#define DMA_CCR_EN              (1U << 0)
+#define DMA_CCR_TCIE            (1U << 1)
+#define DMA_CCR_DIR             (1U << 4)
+#define DMA_CCR_CIRC            (1U << 5)
+#define DMA_CCR_MINC            (1U << 7)
+#define DMA_CCR_PSIZE_1         (1U << 9)
+#define DMA_CCR_MSIZE_1         (1U << 11)
+#define DMA_ISR_TCIF4           (1U << 13)
+#define DMA_IFCR_CGIF4          (1U << 12)
+#define DMA_CSELR_C4S_Pos       12
+#define DMA_CSELR_C4S           (0xFU << DMA_CSELR_C4S_Pos)
+#define DMA_CSELR_C7S_Pos       24
+#define DMA_CSELR_C7S           (0xFU << DMA_CSELR_C7S_Pos)
+
+#define TIM_CR1_CEN             (1U << 0)
+#define TIM_DIER_UIE            (1U << 0)
+#define TIM_DIER_CC1IE          (1U << 1)
+#define TIM_SR_UIF              (1U << 0)
+#define TIM_SR_CC1IF            (1U << 1)
+#define TIM_SR_CC2IF            (1U << 2)
+#define TIM_SR_CC2OF            (1U << 10)
+#define TIM_DIER_CC2DE          (1U << 10)
+#define TIM_CCMR1_CC2S          (3U << 8)
+#define TIM_CCMR1_CC2S_0        (1U << 8)
+#define TIM_CCMR1_IC2PSC        (3U << 10)
+#define TIM_CCMR1_IC2F_Pos      12
+#define TIM_CCMR1_IC2F          (0xFU << TIM_CCMR1_IC2F_Pos)
+#define TIM_CCER_CC2E           (1U << 4)
+#define TIM_CCER_CC2P           (1U << 5)
+#define TIM_CCER_CC2NP          (1U << 7)
+#define TIM_EGR_UG              (1U << 0)
+#define TIM_EGR_CC1G            (1U << 1)
+
+typedef struct
+{
+    __IO uint32_t CR;
+    __IO uint32_t ICSCR;
+    __IO uint32_t CFGR;
+} RCC_TypeDef;
+
+#define RCC_CFGR_PPRE1          (7U << 8)
+#define RCC_CFGR_PPRE1_2        (4U << 8)
+
+#define I2C_CR1_PE              (1U << 0)
+#define I2C_CR2_SADD            (0x3FFU << 0)
+#define I2C_CR2_RD_WRN          (1U << 10)
+#define I2C_CR2_START           (1U << 13)
+#define I2C_CR2_STOP            (1U << 14)
+#define I2C_CR2_NBYTES_Pos      16
+#define I2C_CR2_RELOAD          (1U << 24)
+#define I2C_CR2_AUTOEND         (1U << 25)
+#define I2C_TIMEOUTR_TIMEOUTA_Msk   (0xFFFU << 0)
+#define I2C_TIMEOUTR_TIMOUTEN   (1U << 15)
+#define I2C_ISR_TXE             (1U << 0)
+#define I2C_ISR_TXIS            (1U << 1)
+#define I2C_ISR_RXNE            (1U << 2)
+#define I2C_ISR_NACKF           (1U << 4)
+#define I2C_ISR_STOPF           (1U << 5)
+#define I2C_ISR_TC              (1U << 6)
+#define I2C_ISR_TCR             (1U << 7)
+#define I2C_ISR_BERR            (1U << 8)
+#define I2C_ISR_ARLO            (1U << 9)
+#define I2C_ISR_TIMEOUT         (1U << 12)
+#define I2C_ISR_BUSY            (1U << 15)
+
+typedef struct
+{
+    __IO uint32_t DR;
+    __IO uint32_t IDR;
+    __IO uint32_t CR;
+    uint32_t RESERVED;
+    __IO uint32_t INIT;
+    __IO uint32_t POL;
+} CRC_TypeDef;
+
+#define CRC_CR_RESET            (1U << 0)
+#define CRC_CR_POLYSIZE_0       (1U << 3)
+#define CRC_CR_REV_IN_0         (1U << 5)
+#define CRC_CR_REV_OUT          (1U << 7)
+
+typedef struct
+{
+    __IO uint32_t ACR;
+    __IO uint32_t PDKEYR;
+    __IO uint32_t KEYR;
+    __IO uint32_t OPTKEYR;
+    __IO uint32_t SR;
+    __IO uint32_t ECCR;
+    uint32_t RESERVED;
+    __IO uint32_t CR;
+} FLASH_TypeDef;
+
+#define FLASH_KEY1              0x45670123UL
+#define FLASH_KEY2              0xCDEF89ABUL
+#define FLASH_CR_MER1           (1U << 2)
+#define FLASH_CR_STRT           (1U << 16)
+#define FLASH_CR_MER2           (1U << 15)
+#define FLASH_CR_LOCK           (1U << 31)
+#define FLASH_SR_BSY            (1U << 16)
+
+typedef struct
+{
+    __IO uint32_t CTRL;
+    __IO uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+    __IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk          (1U << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk      (1U << 24)
+
+extern USART_TypeDef shim_usart1;
+extern TIM_TypeDef shim_tim2;
+extern I2C_TypeDef shim_i2c2;
+extern DMA_TypeDef shim_dma1;
+extern DMA_Channel_TypeDef shim_dma1_channel4;
+extern DMA_Channel_TypeDef shim_dma1_channel7;
+extern DMA_Request_TypeDef shim_dma1_cselr;
+extern CRC_TypeDef shim_crc;
+extern FLASH_TypeDef shim_flash;
+extern CoreDebug_Type shim_core_debug;
+extern RCC_TypeDef shim_rcc;
+extern uint32_t SystemCoreClock;
+extern uint32_t shim_primask;
+
+/**
+ * @brief DWT with CYCCNT updated from the host clock at SystemCoreClock
+ */
+DWT_Type* shim_dwt(void);
+
+#define USART1                  (&shim_usart1)
+#define TIM2                    (&shim_tim2)
+#define I2C2                    (&shim_i2c2)
+#define DMA1                    (&shim_dma1)
+#define DMA1_Channel4           (&shim_dma1_channel4)
+#define DMA1_Channel7           (&shim_dma1_channel7)
+#define DMA1_CSELR              (&shim_dma1_cselr)
+#define CRC                     (&shim_crc)
+#define FLASH                   (&shim_flash)
+#define DWT                     (shim_dwt())
+#define CoreDebug               (&shim_core_debug)
+#define RCC                     (&shim_rcc)
+
+static inline uint32_t __RBIT(uint32_t value)
+{
+    uint32_t res = 0;
+
+    for(int i = 0; i < 32; i++, value >>= 1)
+    {
+        res = (res << 1) | (value & 1);
+    }
+    return res;
+}
+
+#define __REV(value)            __builtin_bswap32(value)
+#define __CLZ(value)            ((uint8_t)((value) ? __builtin_clz(value) : 32))
+
+/* Cortex-M4 SIMD instructions on two signed halfwords packed into a word */
+#define SHIM_LO(x)              ((int32_t)(int16_t)((x) & 0xFFFF))
+#define SHIM_HI(x)              ((int32_t)(int16_t)((x) >> 16))
+
+static inline uint32_t __SMUAD(uint32_t x, uint32_t y)
+{
+    return (uint32_t)(SHIM_LO(x) * SHIM_LO(y) + SHIM_HI(x) * SHIM_HI(y));
+}
+
+static inline uint32_t __SMUSD(uint32_t x, uint32_t y)
+{
+    return (uint32_t)(SHIM_LO(x) * SHIM_LO(y) - SHIM_HI(x) * SHIM_HI(y));
+}
+
+static inline uint32_t __SMUADX(uint32_t x, uint32_t y)
+{
+    return (uint32_t)(SHIM_LO(x) * SHIM_HI(y) + SHIM_HI(x) * SHIM_LO(y));
+}
+
+static inline uint32_t __SHADD16(uint32_t x, uint32_t y)
+{
+    return (((uint32_t)((SHIM_HI(x) + SHIM_HI(y)) >> 1) & 0xFFFF) << 16) | ((uint32_t)((SHIM_LO(x) + SHIM_LO(y)) >> 1) & 0xFFFF);
+}
+
+static inline uint32_t __SHSUB16(uint32_t x, uint32_t y)
+{
+    return (((uint32_t)((SHIM_HI(x) - SHIM_HI(y)) >> 1) & 0xFFFF) << 16) | ((uint32_t)((SHIM_LO(x) - SHIM_LO(y)) >> 1) & 0xFFFF);
+}
+
+#define __PKHBT(x, y, shift)    (((uint32_t)(x) & 0xFFFF) | (((uint32_t)(y) << (shift)) & 0xFFFF0000))
+
+static inline uint32_t __get_PRIMASK(void) { return shim_primask; }
+static inline void __set_PRIMASK(uint32_t primask) { shim_primask = primask; }
+static inline void __disable_irq(void) { shim_primask = 1; }
+static inline void __enable_irq(void) { shim_primask = 0; }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_SHIM_STM32L4XX_H_ */
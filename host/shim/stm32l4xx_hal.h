@@ -0,0 +1,231 @@
+#ifndef HOST_SHIM_STM32L4XX_HAL_H_
+#define HOST_SHIM_STM32L4XX_HAL_H_
+
+/*
+ Host stand-in for the HAL.
+
+ The UART moves bytes through the hooks of shim.h, which the host tool
+ implements. I2C transfers go to the devices attached with
+ shim_i2c_attach() (shim_i2c.h). HAL_GetTick() is the host monotonic clock
+ in ms and delivers the pending USART1 receive interrupt, like SysTick
+ would let it in; TIM2 delivers its own when the counter is read. printf,
+ scanf and getchar go through the firmware's __io_putchar() /
+ __io_getchar() like newlib does on the target.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "stm32l4xx.h"
+#include "shim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    HAL_OK = 0,
+    HAL_ERROR,
+    HAL_BUSY,
+    HAL_TIMEOUT
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+    HAL_UNLOCKED = 0,
+    HAL_LOCKED
+} HAL_LockTypeDef;
+
+#define __HAL_UNLOCK(handle)            ((handle)->Lock = HAL_UNLOCKED)
+#define __HAL_RCC_CRC_CLK_ENABLE()      do {} while(0)
+#define __HAL_RCC_DMA1_CLK_ENABLE()     do {} while(0)
+#define __HAL_RCC_TIM2_CLK_ENABLE()     do {} while(0)
+#define __HAL_RCC_GPIOA_CLK_ENABLE()    do {} while(0)
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t delay);
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+uint32_t HAL_RCC_GetPCLK2Freq(void);
+void HAL_NVIC_SetPriority(IRQn_Type irq, uint32_t preempt_priority, uint32_t sub_priority);
+void HAL_NVIC_EnableIRQ(IRQn_Type irq);
+void HAL_NVIC_DisableIRQ(IRQn_Type irq);
+
+/* UART */
+
+#define UART_WORDLENGTH_8B              0
+#define UART_STOPBITS_1                 0
+#define UART_PARITY_NONE                0
+#define UART_MODE_TX_RX                 0
+#define UART_HWCONTROL_NONE             0
+#define UART_OVERSAMPLING_16            0
+#define UART_ONE_BIT_SAMPLE_DISABLE     0
+#define UART_ADVFEATURE_NO_INIT         0
+#define UART_ADVFEATURE_AUTOBAUDRATE_INIT           0x00000040U
+#define UART_ADVFEATURE_AUTOBAUDRATE_ENABLE         USART_CR2_ABREN
+#define UART_ADVFEATURE_AUTOBAUDRATE_ON0X55FRAME    USART_CR2_ABRMODE
+
+typedef struct
+{
+    uint32_t BaudRate;
+    uint32_t WordLength;
+    uint32_t StopBits;
+    uint32_t Parity;
+    uint32_t Mode;
+    uint32_t HwFlowCtl;
+    uint32_t OverSampling;
+    uint32_t OneBitSampling;
+} UART_InitTypeDef;
+
+typedef struct
+{
+    uint32_t AdvFeatureInit;
+    uint32_t AutoBaudRateEnable;
+    uint32_t AutoBaudRateMode;
+} UART_AdvFeatureInitTypeDef;
+
+typedef struct
+{
+    USART_TypeDef *Instance;
+    UART_InitTypeDef Init;
+    UART_AdvFeatureInitTypeDef AdvancedInit;
+} UART_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef HAL_UART_Receive(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size, uint32_t timeout);
+
+/* GPIO, the I2C lines always read released */
+
+typedef struct GPIO_TypeDef GPIO_TypeDef;
+
+#define GPIOA                           ((GPIO_TypeDef *)0x48000000UL)
+#define GPIOB                           ((GPIO_TypeDef *)0x48000400UL)
+#define GPIO_PIN_1                      (1U << 1)
+#define GPIO_PIN_6                      (1U << 6)
+#define GPIO_PIN_7                      (1U << 7)
+#define GPIO_PIN_10                     (1U << 10)
+#define GPIO_PIN_11                     (1U << 11)
+#define GPIO_MODE_OUTPUT_OD             0x11U
+#define GPIO_MODE_AF_PP                 0x02U
+#define GPIO_MODE_AF_OD                 0x12U
+#define GPIO_PULLUP                     1U
+#define GPIO_SPEED_FREQ_LOW             0U
+#define GPIO_SPEED_FREQ_VERY_HIGH       3U
+#define GPIO_AF1_TIM2                   1U
+#define GPIO_AF4_I2C2                   4U
+
+typedef enum
+{
+    GPIO_PIN_RESET = 0,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct
+{
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init);
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin);
+
+/* I2C */
+
+#define I2C_ADDRESSINGMODE_7BIT         1U
+#define I2C_DUALADDRESS_DISABLE         0U
+#define I2C_OA2_NOMASK                  0U
+#define I2C_GENERALCALL_DISABLE         0U
+#define I2C_NOSTRETCH_DISABLE           0U
+#define I2C_ANALOGFILTER_ENABLE         0U
+#define I2C_FASTMODEPLUS_I2C2           (1U << 22)
+#define I2C_MEMADD_SIZE_8BIT            1U
+
+#define HAL_I2C_ERROR_NONE              0x00U
+#define HAL_I2C_ERROR_BERR              0x01U
+#define HAL_I2C_ERROR_ARLO              0x02U
+#define HAL_I2C_ERROR_AF                0x04U
+#define HAL_I2C_ERROR_TIMEOUT           0x20U
+
+#define I2C_FLAG_AF                     I2C_ISR_NACKF
+#define I2C_FLAG_STOPF                  I2C_ISR_STOPF
+#define I2C_FLAG_TIMEOUT                I2C_ISR_TIMEOUT
+#define I2C_FLAG_BUSY                   I2C_ISR_BUSY
+#define I2C_FLAG_BERR                   I2C_ISR_BERR
+#define I2C_FLAG_ARLO                   I2C_ISR_ARLO
+
+typedef enum
+{
+    HAL_I2C_STATE_RESET = 0,
+    HAL_I2C_STATE_READY = 0x20
+} HAL_I2C_StateTypeDef;
+
+typedef struct
+{
+    uint32_t Timing;
+    uint32_t OwnAddress1;
+    uint32_t AddressingMode;
+    uint32_t DualAddressMode;
+    uint32_t OwnAddress2;
+    uint32_t OwnAddress2Masks;
+    uint32_t GeneralCallMode;
+    uint32_t NoStretchMode;
+} I2C_InitTypeDef;
+
+typedef struct
+{
+    I2C_TypeDef *Instance;
+    I2C_InitTypeDef Init;
+    HAL_LockTypeDef Lock;
+    HAL_I2C_StateTypeDef State;
+    uint32_t ErrorCode;
+} I2C_HandleTypeDef;
+
+#define __HAL_I2C_GET_FLAG(handle, flag)    ((((handle)->Instance->ISR) & (flag)) == (flag))
+#define __HAL_I2C_CLEAR_FLAG(handle, flag)  ((handle)->Instance->ICR = (flag))
+#define __HAL_I2C_ENABLE(handle)            SET_BIT((handle)->Instance->CR1, I2C_CR1_PE)
+#define __HAL_I2C_DISABLE(handle)           CLEAR_BIT((handle)->Instance->CR1, I2C_CR1_PE)
+
+HAL_StatusTypeDef HAL_I2C_Init(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_DeInit(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2C_Mem_Read(I2C_HandleTypeDef *hi2c, uint16_t dev_address, uint16_t mem_address, uint16_t mem_add_size,
+                                   uint8_t *data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef HAL_I2C_Mem_Write(I2C_HandleTypeDef *hi2c, uint16_t dev_address, uint16_t mem_address, uint16_t mem_add_size,
+                                    uint8_t *data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef HAL_I2C_IsDeviceReady(I2C_HandleTypeDef *hi2c, uint16_t dev_address, uint32_t trials, uint32_t timeout);
+uint32_t HAL_I2C_GetError(I2C_HandleTypeDef *hi2c);
+HAL_StatusTypeDef HAL_I2CEx_ConfigAnalogFilter(I2C_HandleTypeDef *hi2c, uint32_t analog_filter);
+HAL_StatusTypeDef HAL_I2CEx_ConfigDigitalFilter(I2C_HandleTypeDef *hi2c, uint32_t digital_filter);
+void HAL_I2CEx_EnableFastModePlus(uint32_t config);
+void HAL_I2CEx_DisableFastModePlus(uint32_t config);
+
+/* FLASH, the controller is idle at once */
+
+#define FLASH_FLAG_BSY                      FLASH_SR_BSY
+#define __HAL_FLASH_GET_FLAG(flag)          ((FLASH->SR & (flag)) == (flag))
+
+/* Console of the firmware (uart_api.c), C linkage when built as C++ */
+int __io_putchar(int ch);
+int __io_getchar(void);
+int __io_write(const char *ptr, int len);
+
+int shim_printf(const char *format, ...);
+int shim_scanf(const char *format, ...);
+
+/* The firmware sources print through the UART like newlib on the target */
+#define printf                          shim_printf
+#define scanf                           shim_scanf
+/* stdin is unbuffered on the target (main.c), getchar() reads the UART */
+#undef getchar
+#define getchar()                       __io_getchar()
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_SHIM_STM32L4XX_HAL_H_ */
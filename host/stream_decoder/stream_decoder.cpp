@@ -0,0 +1,422 @@
+/*
+ Host decoder for the "stream" command telemetry frames (see Inc/stream.h).
+
+ Usage: stream_decoder [-r rate_hz] [-s seconds] [-q] <serial device | capture file>
+
+ With a serial device the port is configured (115200 8N1, raw), streaming is
+ started with "stream,<rate_hz>", stopped with Ctrl+C after the given time and
+ the device summary is read back. A capture file is decoded as is.
+
+ Samples are printed to stdout as CSV (-q suppresses them), console text and
+ bandwidth statistics go to stderr.
+*/
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* Must match Inc/stream.h */
+#define STREAM_SYNC                 0xA5
+#define STREAM_FLAG_KEYFRAME        0x80
+#define STREAM_STOP_CHAR            0x03
+#define STREAM_FIELDS               5
+#define STREAM_FIELD_TIMESTAMP      0
+
+#define VARINT_MAX_BYTES            5
+/* Quiet time that ends reading of the device summary */
+#define SUMMARY_TIMEOUT_MS          500
+
+static const char *field_names[STREAM_FIELDS] = {"timestamp_ms", "target_pct", "rpm", "ktach", "alarm"};
+
+struct Stats
+{
+    uint64_t frames = 0;
+    uint64_t keyframes = 0;
+    uint64_t gaps = 0;              /* frames missing according to the sequence numbers */
+    uint64_t frame_bytes = 0;
+    uint64_t text_bytes = 0;
+    uint64_t bad_frames = 0;        /* checksum errors or deltas without a keyframe */
+    uint32_t first_ts = 0;
+    uint32_t last_ts = 0;
+};
+
+class StreamDecoder
+{
+public:
+    explicit StreamDecoder(bool print_samples) : print_samples(print_samples) {}
+
+    void Feed(const uint8_t *data, size_t len);
+    const Stats& GetStats() const { return stats; }
+
+private:
+    enum class Result { Frame, Incomplete, Invalid };
+
+    Result Parse(size_t &len);
+    void Apply(size_t len);
+
+    bool print_samples;
+    bool synced = false;
+    bool have_seq = false;
+    uint8_t last_seq = 0;
+    uint32_t values[STREAM_FIELDS] = {0};
+    std::vector<uint8_t> buf;
+    Stats stats;
+};
+
+
+static bool get_varint(const std::vector<uint8_t> &buf, size_t &pos, uint32_t &value)
+{
+    value = 0;
+    for(int i = 0; i < VARINT_MAX_BYTES; i++)
+    {
+        if(pos >= buf.size())
+        {
+            return false;
+        }
+        uint8_t byte = buf[pos++];
+        value |= (uint32_t)(byte & 0x7F) << (7 * i);
+        if((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * @brief Check the frame at the start of the buffer
+ * @param[out] len frame length if the result is Frame
+ */
+StreamDecoder::Result StreamDecoder::Parse(size_t &len)
+{
+    size_t pos = 3;
+    uint32_t value;
+    uint8_t sum = 0;
+
+    if(buf.size() < 4)
+    {
+        return Result::Incomplete;
+    }
+
+    uint8_t flags = buf[2];
+    if(flags & ~(STREAM_FLAG_KEYFRAME | ((1 << STREAM_FIELDS) - 1)))
+    {
+        return Result::Invalid;
+    }
+
+    for(int i = 0; i < STREAM_FIELDS; i++)
+    {
+        if((flags & (1 << i)) && !get_varint(buf, pos, value))
+        {
+            /* Unterminated varint with data after it is too long to be valid */
+            return (pos < buf.size()) ? Result::Invalid : Result::Incomplete;
+        }
+    }
+
+    if(pos >= buf.size())
+    {
+        return Result::Incomplete;
+    }
+
+    for(size_t i = 1; i < pos; i++)
+    {
+        sum += buf[i];
+    }
+
+    if(sum != buf[pos])
+    {
+        return Result::Invalid;
+    }
+
+    len = pos + 1;
+    return Result::Frame;
+}
+
+
+void StreamDecoder::Apply(size_t len)
+{
+    uint8_t seq = buf[1];
+    uint8_t flags = buf[2];
+    size_t pos = 3;
+    uint32_t value;
+
+    stats.frame_bytes += len;
+
+    if(flags & STREAM_FLAG_KEYFRAME)
+    {
+        synced = true;
+        stats.keyframes++;
+    }
+    else if(!synced)
+    {
+        /* Deltas are useless until the first keyframe */
+        stats.bad_frames++;
+        return;
+    }
+
+    if(have_seq)
+    {
+        stats.gaps += (uint8_t)(seq - last_seq - 1);
+    }
+    have_seq = true;
+    last_seq = seq;
+
+    for(int i = 0; i < STREAM_FIELDS; i++)
+    {
+        if((flags & (1 << i)) == 0)
+        {
+            continue;
+        }
+
+        get_varint(buf, pos, value);
+        if((flags & STREAM_FLAG_KEYFRAME) || (i == STREAM_FIELD_TIMESTAMP))
+        {
+            values[i] = (flags & STREAM_FLAG_KEYFRAME) ? value : values[i] + value;
+        }
+        else
+        {
+            /* zigzag */
+            values[i] += (value >> 1) ^ -(int32_t)(value & 1);
+        }
+    }
+
+    if(stats.frames == 0)
+    {
+        stats.first_ts = values[STREAM_FIELD_TIMESTAMP];
+    }
+    stats.last_ts = values[STREAM_FIELD_TIMESTAMP];
+    stats.frames++;
+
+    if(print_samples)
+    {
+        printf("%u", seq);
+        for(int i = 0; i < STREAM_FIELDS; i++)
+        {
+            printf(",%u", values[i]);
+        }
+        printf("\n");
+    }
+}
+
+
+void StreamDecoder::Feed(const uint8_t *data, size_t len)
+{
+    size_t frame_len;
+
+    buf.insert(buf.end(), data, data + len);
+
+    while(!buf.empty())
+    {
+        if(buf[0] != STREAM_SYNC)
+        {
+            /* Console text around the stream */
+            fputc(buf[0], stderr);
+            stats.text_bytes++;
+            buf.erase(buf.begin());
+            continue;
+        }
+
+        Result result = Parse(frame_len);
+        if(result == Result::Incomplete)
+        {
+            return;
+        }
+
+        if(result == Result::Invalid)
+        {
+            /* Following deltas refer to a lost frame */
+            synced = false;
+            stats.bad_frames++;
+            buf.erase(buf.begin());
+            continue;
+        }
+
+        Apply(frame_len);
+        buf.erase(buf.begin(), buf.begin() + frame_len);
+    }
+}
+
+
+static uint64_t now_ms(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+
+static bool setup_port(int fd)
+{
+    struct termios tio;
+
+    if(tcgetattr(fd, &tio) != 0)
+    {
+        return false;
+    }
+
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B115200);
+    cfsetospeed(&tio, B115200);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+
+/**
+ * @brief Read from the descriptor until the deadline or until it's quiet for quiet_ms
+ */
+static void read_until(int fd, StreamDecoder &decoder, uint64_t deadline, uint64_t quiet_ms)
+{
+    uint8_t data[4096];
+    uint64_t last_rx = now_ms();
+
+    while(1)
+    {
+        uint64_t now = now_ms();
+        if((now >= deadline) || (quiet_ms && (now - last_rx >= quiet_ms)))
+        {
+            return;
+        }
+
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+        struct timeval tv = {0, 50000};
+
+        if(select(fd + 1, &fds, nullptr, nullptr, &tv) <= 0)
+        {
+            continue;
+        }
+
+        ssize_t n = read(fd, data, sizeof(data));
+        if(n > 0)
+        {
+            decoder.Feed(data, n);
+            last_rx = now_ms();
+        }
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    int rate_hz = 100;
+    int seconds = 10;
+    bool print_samples = true;
+    int opt;
+
+    while((opt = getopt(argc, argv, "r:s:q")) != -1)
+    {
+        switch(opt)
+        {
+            case 'r': rate_hz = atoi(optarg); break;
+            case 's': seconds = atoi(optarg); break;
+            case 'q': print_samples = false; break;
+            default:
+                fprintf(stderr, "Usage: %s [-r rate_hz] [-s seconds] [-q] <serial device | capture file>\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if(optind != argc - 1)
+    {
+        fprintf(stderr, "Usage: %s [-r rate_hz] [-s seconds] [-q] <serial device | capture file>\n", argv[0]);
+        return 1;
+    }
+
+    int fd = open(argv[optind], O_RDWR | O_NOCTTY);
+    if(fd < 0)
+    {
+        fd = open(argv[optind], O_RDONLY);
+    }
+    if(fd < 0)
+    {
+        fprintf(stderr, "Can't open %s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    StreamDecoder decoder(print_samples);
+
+    if(print_samples)
+    {
+        printf("seq");
+        for(int i = 0; i < STREAM_FIELDS; i++)
+        {
+            printf(",%s", field_names[i]);
+        }
+        printf("\n");
+    }
+
+    if(isatty(fd))
+    {
+        if(!setup_port(fd))
+        {
+            fprintf(stderr, "Can't configure %s: %s\n", argv[optind], strerror(errno));
+            return 1;
+        }
+
+        /* A device just reset drops the first character measuring its rate, an empty line goes first */
+        std::string command = "\rstream," + std::to_string(rate_hz) + "\r";
+        char stop = STREAM_STOP_CHAR;
+
+        tcflush(fd, TCIOFLUSH);
+        if((write(fd, command.data(), command.size()) != (ssize_t)command.size()))
+        {
+            fprintf(stderr, "Can't write to %s\n", argv[optind]);
+            return 1;
+        }
+        read_until(fd, decoder, now_ms() + (uint64_t)seconds * 1000, 0);
+
+        if(write(fd, &stop, 1) != 1)
+        {
+            fprintf(stderr, "Can't write to %s\n", argv[optind]);
+            return 1;
+        }
+        read_until(fd, decoder, UINT64_MAX, SUMMARY_TIMEOUT_MS);
+    }
+    else
+    {
+        uint8_t data[4096];
+        ssize_t n;
+
+        while((n = read(fd, data, sizeof(data))) > 0)
+        {
+            decoder.Feed(data, n);
+        }
+    }
+
+    close(fd);
+
+    const Stats &stats = decoder.GetStats();
+    uint32_t span_ms = stats.last_ts - stats.first_ts;
+
+    fprintf(stderr, "\nFrames: %llu (keyframes %llu), missing: %llu, bad: %llu\n",
+            (unsigned long long)stats.frames, (unsigned long long)stats.keyframes,
+            (unsigned long long)stats.gaps, (unsigned long long)stats.bad_frames);
+    fprintf(stderr, "Frame bytes: %llu (%.2f per frame), text bytes: %llu\n",
+            (unsigned long long)stats.frame_bytes,
+            stats.frames ? (double)stats.frame_bytes / stats.frames : 0.0,
+            (unsigned long long)stats.text_bytes);
+
+    if(span_ms != 0)
+    {
+        fprintf(stderr, "Device time: %u ms, %.1f frames/s, %.1f bytes/s\n", span_ms,
+                (stats.frames - 1) * 1000.0 / span_ms, stats.frame_bytes * 1000.0 / span_ms);
+    }
+
+    return 0;
+}
@@ -0,0 +1,254 @@
+/*
+ Tach capture on scripted edge streams.
+
+ Usage: tach_test
+
+ src/tach.c and src/timebase.c are built for the host. The TIM2 model of
+ the shim (host/shim) captures the edges given by shim_tach_interval_ns()
+ into CCR2 and DMA1 channel 7 copies them into the ring, so the edges go
+ through the firmware's edge() and poll() the way they do on the board.
+ The stream is scripted here: two pulses per revolution 6 % off even
+ spacing, with ringing right after an edge, noise edges in the middle of
+ an interval, a stop and a slow restart.
+
+ Every case runs in real time for a few hundred milliseconds and checks
+ the speeds read from Tach_GetRPM() over its second half, and the stall
+ flag. Exits with 1 if a check fails.
+*/
+
+#include <cstdint>
+#include <cstdio>
+
+#include "stm32l4xx_hal.h"
+#include "shim.h"
+#include "timebase.h"
+#include "tach.h"
+#include "check.h"
+
+/* Pulses of a revolution: 53 % and 47 % of it */
+#define PULSE_ASYMMETRY             0.06
+/* Readings within 0.5 % of the scripted speed */
+#define RPM_TOLERANCE               0.005
+
+/* Edge stream: revolutions per second, 0 for none, and a spurious edge every glitch_every edges
+   that splits the interval at glitch_split */
+static double stream_rps;
+static uint32_t glitch_every;
+static double glitch_split;
+static bool second_pulse;
+static uint32_t edge_count;
+static double rest_ns;
+
+/* Readings over the second half of a run */
+static uint16_t seen_min;
+static uint16_t seen_max;
+
+
+uint64_t shim_tach_interval_ns(void)
+{
+    double interval;
+
+    if(rest_ns > 0)
+    {
+        interval = rest_ns;
+        rest_ns = 0;
+        return (uint64_t)interval;
+    }
+
+    if(stream_rps <= 0)
+    {
+        return 0;
+    }
+
+    second_pulse = !second_pulse;
+    interval = (0.5 + (second_pulse ? PULSE_ASYMMETRY : -PULSE_ASYMMETRY) / 2) / stream_rps * 1e9;
+    if((glitch_every != 0) && (++edge_count % glitch_every == 0))
+    {
+        rest_ns = interval * (1 - glitch_split);
+        interval *= glitch_split;
+    }
+
+    return (uint64_t)interval;
+}
+
+
+/* Host tool side of the shim, the console isn't used */
+void shim_uart_write(const uint8_t *data, uint32_t len)
+{
+    (void)data;
+    (void)len;
+}
+
+
+bool shim_uart_read(uint8_t *byte, uint32_t timeout_ms)
+{
+    (void)byte;
+    (void)timeout_ms;
+    return false;
+}
+
+
+void shim_uart_set_baud(uint32_t baud)
+{
+    (void)baud;
+}
+
+
+uint32_t shim_uart_host_baud(void)
+{
+    return 0;
+}
+
+
+/* Console and USART interrupt of the firmware the shim calls, neither is used here */
+int __io_write(const char *ptr, int len)
+{
+    return (int)fwrite(ptr, 1, len, stdout);
+}
+
+
+int __io_getchar(void)
+{
+    return EOF;
+}
+
+
+extern "C" void UartAPI_IRQHandler(void)
+{
+}
+
+
+extern "C" void UartAPI_TxDMA_IRQHandler(void)
+{
+}
+
+
+/**
+ * @brief Change the edge stream and let the firmware run on it, the TIM2 interrupt
+ *        is taken whenever the tick is read. The readings of the second half are kept
+ */
+static void run(double rpm, uint32_t ms, uint32_t glitch = 0, double split = 0)
+{
+    uint16_t measured;
+    uint32_t start;
+
+    stream_rps = rpm / 60;
+    glitch_every = glitch;
+    glitch_split = split;
+    seen_min = UINT16_MAX;
+    seen_max = 0;
+
+    start = HAL_GetTick();
+    while(HAL_GetTick() - start < ms)
+    {
+        if(HAL_GetTick() - start >= ms / 2)
+        {
+            Tach_GetRPM(&measured, NULL);
+            seen_min = (measured < seen_min) ? measured : seen_min;
+            seen_max = (measured > seen_max) ? measured : seen_max;
+        }
+    }
+}
+
+
+/**
+ * @brief Check the measured speed, now and over the second half of the run
+ */
+static void check_speed(double rpm)
+{
+    uint16_t measured;
+    Tach_Info_t info;
+
+    CHECK(Tach_GetRPM(&measured, &info));
+    CHECK_NEAR(measured, rpm, rpm * RPM_TOLERANCE);
+    CHECK_NEAR(seen_min, rpm, rpm * RPM_TOLERANCE);
+    CHECK_NEAR(seen_max, rpm, rpm * RPM_TOLERANCE);
+    CHECK_NEAR(info.period_us, 60e6 / rpm, 60e6 / rpm * RPM_TOLERANCE);
+    CHECK(!info.stalled);
+}
+
+
+/**
+ * @brief Check a stalled fan
+ */
+static void check_stalled(uint32_t stalls)
+{
+    uint16_t measured = 1;
+    Tach_Info_t info;
+
+    CHECK(!Tach_GetRPM(&measured, &info));
+    CHECK_EQ(measured, 0);
+    CHECK_EQ(info.period_us, 0);
+    CHECK(info.stalled);
+    CHECK_EQ(info.stalls, stalls);
+}
+
+
+int main(void)
+{
+    Tach_Info_t info;
+    uint16_t rpm;
+    uint32_t rejected;
+    int failures;
+
+    Timebase_Init();
+    Tach_Init();
+
+    failures = check_failures;
+    run(0, 200);
+    check_stalled(0);
+    Tach_GetRPM(&rpm, &info);
+    CHECK_EQ(info.edges, 0);
+    check_case("No edges", failures);
+
+    /* Seven revolutions are 140 ms */
+    failures = check_failures;
+    run(3000, 300);
+    check_speed(3000);
+    check_case("Start at 3000 rpm", failures);
+
+    failures = check_failures;
+    run(10500, 300);
+    check_speed(10500);
+    Tach_GetRPM(&rpm, &info);
+    CHECK_EQ(info.rejected, 0);
+    check_case("Step to 10500 rpm", failures);
+
+    /* An edge 5 % of an interval after every 7th one */
+    failures = check_failures;
+    rejected = info.rejected;
+    run(10500, 300, 7, 0.05);
+    check_speed(10500);
+    Tach_GetRPM(&rpm, &info);
+    CHECK(info.rejected > rejected);
+    check_case("Ringing after edges", failures);
+
+    /* A noise edge 40 % into every 20th interval: not ringing, the median votes it out */
+    failures = check_failures;
+    run(10500, 50);
+    Tach_GetRPM(&rpm, &info);
+    rejected = info.rejected;
+    run(10500, 300, 20, 0.4);
+    check_speed(10500);
+    Tach_GetRPM(&rpm, &info);
+    CHECK_EQ(info.rejected, rejected);
+    check_case("Noise edges in the middle of intervals", failures);
+
+    /* Two revolutions are 11 ms, plus a poll period */
+    failures = check_failures;
+    run(0, 40);
+    check_stalled(1);
+    run(0, 300);
+    check_stalled(1);
+    check_case("Stop detected within 40 ms", failures);
+
+    /* 200 ms per revolution, a median of seven after 1.6 s. The edges come within the 0.5 s stall time */
+    failures = check_failures;
+    run(300, 1900);
+    check_speed(300);
+    Tach_GetRPM(&rpm, &info);
+    CHECK_EQ(info.stalls, 1);
+    check_case("Restart at 300 rpm", failures);
+
+    return check_result();
+}
@@ -0,0 +1,442 @@
+/*
+ Firmware update protocol on scripted host sessions.
+
+ Usage: update_test
+
+ src/update.c is built for the host with the flash of host/pty_device
+ (flash_host.cpp, the banks mapped at FLASH_BASE) and the software CRC.
+ The console is replaced by a byte script: each case queues the frames a
+ host would send, corrupted and out of order ones included, runs
+ Update_Run() over them and compares the reply bytes and Update_Stats_t
+ with what the protocol in Inc/update.h prescribes. The frame CRC-16 and
+ the image CRC-32 are computed here independently of src/crc.c.
+
+ The timeout case waits UPDATE_TIMEOUT_MS. Exits with 1 if a check fails.
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include "stm32l4xx_hal.h"
+#include "shim.h"
+#include "update.h"
+#include "uart_api.h"
+#include "thermal.h"
+#include "crc.h"
+#include "flash_host.h"
+#include "check.h"
+
+#define UPDATE_SLOT_ADDR            (FLASH_BASE + FLASH_BANK_SIZE)
+/* Four chunks, the last one padded */
+#define IMAGE_LENGTH                (3 * UPDATE_CHUNK_SIZE + 100)
+
+typedef std::vector<uint8_t> Bytes;
+
+struct Reply
+{
+    uint8_t status;
+    uint16_t seq;
+
+    bool operator==(const Reply &other) const { return (status == other.status) && (seq == other.seq); }
+};
+
+static std::deque<uint8_t> rx;
+static Bytes tx;
+static Bytes image;
+
+
+/* Host tool side of the shim, the console isn't used */
+void shim_uart_write(const uint8_t *data, uint32_t len)
+{
+    (void)data;
+    (void)len;
+}
+
+
+bool shim_uart_read(uint8_t *byte, uint32_t timeout_ms)
+{
+    (void)byte;
+    (void)timeout_ms;
+    return false;
+}
+
+
+void shim_uart_set_baud(uint32_t baud)
+{
+    (void)baud;
+}
+
+
+uint32_t shim_uart_host_baud(void)
+{
+    return 0;
+}
+
+
+uint64_t shim_tach_interval_ns(void)
+{
+    return 0;
+}
+
+
+/* Console and interrupts of the firmware the shim calls, none is used here */
+int __io_write(const char *ptr, int len)
+{
+    return (int)fwrite(ptr, 1, len, stdout);
+}
+
+
+int __io_getchar(void)
+{
+    return EOF;
+}
+
+
+extern "C" void UartAPI_IRQHandler(void)
+{
+}
+
+
+extern "C" void UartAPI_TxDMA_IRQHandler(void)
+{
+}
+
+
+extern "C" void Timebase_IRQHandler(void)
+{
+}
+
+
+/* Console of src/update.c: the RX buffer gives the script, the replies are collected */
+void UartAPI_RxBufferStart(void)
+{
+}
+
+
+void UartAPI_RxBufferStop(void)
+{
+}
+
+
+bool UartAPI_RxBufferGet(char *c)
+{
+    if(rx.empty())
+    {
+        return false;
+    }
+    *c = (char)rx.front();
+    rx.pop_front();
+    return true;
+}
+
+
+uint32_t UartAPI_RxBufferOverflows(void)
+{
+    return 0;
+}
+
+
+void UartAPI_SendChar(char c)
+{
+    tx.push_back((uint8_t)c);
+}
+
+
+/* The fan loop runs while the console waits */
+void Thermal_Process(void)
+{
+}
+
+
+static uint16_t crc16_ccitt(const Bytes &data)
+{
+    uint16_t crc = 0xFFFF;
+
+    for(uint8_t byte : data)
+    {
+        crc ^= (uint16_t)byte << 8;
+        for(int i = 0; i < 8; i++)
+        {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+
+static uint32_t crc32_ieee(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for(size_t n = 0; n < len; n++)
+    {
+        crc ^= data[n];
+        for(int i = 0; i < 8; i++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+
+static void put_u16(Bytes &data, uint16_t value)
+{
+    data.push_back(value & 0xFF);
+    data.push_back(value >> 8);
+}
+
+
+static void put_u32(Bytes &data, uint32_t value)
+{
+    put_u16(data, value & 0xFFFF);
+    put_u16(data, value >> 16);
+}
+
+
+/**
+ * @brief Queue a frame
+ * @param[in] corrupt flip a payload bit after the CRC is computed
+ */
+static void send_frame(uint8_t type, const Bytes &payload, bool corrupt = false)
+{
+    Bytes body = {type};
+    uint16_t crc;
+
+    body.insert(body.end(), payload.begin(), payload.end());
+    crc = crc16_ccitt(body);
+    if(corrupt)
+    {
+        body.back() ^= 0x01;
+    }
+
+    rx.push_back(UPDATE_SYNC_HOST);
+    rx.insert(rx.end(), body.begin(), body.end());
+    rx.push_back(crc & 0xFF);
+    rx.push_back(crc >> 8);
+}
+
+
+static void send_start(uint32_t length, uint32_t crc)
+{
+    Bytes payload;
+
+    put_u32(payload, length);
+    put_u32(payload, crc);
+    send_frame(UPDATE_FRAME_START, payload);
+}
+
+
+static void send_start(void)
+{
+    send_start(image.size(), crc32_ieee(image.data(), image.size()));
+}
+
+
+/**
+ * @brief Queue a chunk of the image, a number past the image sends a padding chunk
+ */
+static void send_chunk(uint16_t seq, bool corrupt = false)
+{
+    Bytes payload;
+
+    put_u16(payload, seq);
+    for(size_t i = 0; i < UPDATE_CHUNK_SIZE; i++)
+    {
+        size_t pos = (size_t)seq * UPDATE_CHUNK_SIZE + i;
+        payload.push_back((pos < image.size()) ? image[pos] : 0xFF);
+    }
+    send_frame(UPDATE_FRAME_DATA, payload, corrupt);
+}
+
+
+static void send_done(void)
+{
+    send_frame(UPDATE_FRAME_DONE, {});
+}
+
+
+static std::vector<Reply> replies(void)
+{
+    std::vector<Reply> res;
+
+    CHECK_EQ(tx.size() % 4, 0);
+    for(size_t i = 0; i + 4 <= tx.size(); i += 4)
+    {
+        CHECK_EQ(tx[i], UPDATE_SYNC_DEVICE);
+        res.push_back({tx[i + 1], (uint16_t)(tx[i + 2] | tx[i + 3] << 8)});
+    }
+    return res;
+}
+
+
+/**
+ * @brief Run the session queued and compare its replies and statistics
+ */
+static void check_session(const char *name, bool result, const std::vector<Reply> &expected, Update_Status_t status,
+                          uint32_t chunks, uint32_t duplicates, uint32_t naks)
+{
+    int failures = check_failures;
+    Update_Stats_t stats;
+
+    tx.clear();
+    CHECK_EQ(Update_Run(), result);
+    Update_GetStats(&stats);
+
+    std::vector<Reply> got = replies();
+    CHECK_EQ(got.size(), expected.size());
+    for(size_t i = 0; (i < got.size()) && (i < expected.size()); i++)
+    {
+        if(!(got[i] == expected[i]))
+        {
+            fprintf(stderr, "reply %zu: status %u seq %u, expected status %u seq %u\n", i, got[i].status, got[i].seq,
+                    expected[i].status, expected[i].seq);
+            check_failures++;
+        }
+    }
+
+    CHECK_EQ(stats.status, status);
+    CHECK_EQ(stats.chunks, chunks);
+    CHECK_EQ(stats.duplicates, duplicates);
+    CHECK_EQ(stats.naks, naks);
+    CHECK(rx.empty());
+
+    if(result)
+    {
+        CHECK_EQ(stats.length, image.size());
+        CHECK(memcmp((const void *)(uintptr_t)UPDATE_SLOT_ADDR, image.data(), image.size()) == 0);
+    }
+
+    check_case(name, failures);
+}
+
+
+int main(void)
+{
+    const uint8_t OK = Update_Status_OK;
+    const uint16_t FINAL = UPDATE_SEQ_FINAL;
+
+    Crc_Init();
+    if(!FlashHost_Map(FlashHost_Open(""), false))
+    {
+        fprintf(stderr, "Can't map the flash at 0x%08lX\n", (unsigned long)FLASH_BASE);
+        return 1;
+    }
+
+    for(size_t i = 0; i < IMAGE_LENGTH; i++)
+    {
+        image.push_back((uint8_t)(i * 7 + (i >> 8)));
+    }
+
+    send_start();
+    for(uint16_t seq = 0; seq < 4; seq++)
+    {
+        send_chunk(seq);
+    }
+    send_done();
+    check_session("Clean session", true,
+                  {{OK, 0}, {OK, 1}, {OK, 2}, {OK, 3}, {OK, 4}, {OK, FINAL}},
+                  Update_Status_OK, 4, 0, 0);
+
+    /* Chunk 1 corrupted, 2 and 3 already in flight: one NAK, then the host goes back to 1 */
+    send_start();
+    send_chunk(0);
+    send_chunk(1, true);
+    send_chunk(2);
+    send_chunk(3);
+    send_chunk(1);
+    send_chunk(2);
+    send_chunk(3);
+    send_done();
+    check_session("Corrupted chunk, one NAK, go-back-N", true,
+                  {{OK, 0}, {OK, 1}, {Update_Status_BadFrame, 1}, {OK, 2}, {OK, 3}, {OK, 4}, {OK, FINAL}},
+                  Update_Status_OK, 4, 0, 1);
+
+    /* Two corrupted in a row, then one more later: one NAK per burst */
+    send_start();
+    send_chunk(0, true);
+    send_chunk(1, true);
+    send_chunk(0);
+    send_chunk(1);
+    send_chunk(2, true);
+    send_chunk(3);
+    send_chunk(2);
+    send_chunk(3);
+    send_done();
+    check_session("Bursts of bad frames", true,
+                  {{OK, 0}, {Update_Status_BadFrame, 0}, {OK, 1}, {OK, 2}, {Update_Status_BadFrame, 2}, {OK, 3}, {OK, 4},
+                   {OK, FINAL}},
+                  Update_Status_OK, 4, 0, 2);
+
+    /* The acknowledgements of 0 and 1 are lost, the host sends them again */
+    send_start();
+    send_chunk(0);
+    send_chunk(1);
+    send_chunk(0);
+    send_chunk(1);
+    send_chunk(2);
+    send_chunk(3);
+    send_done();
+    check_session("Duplicates after lost acknowledgements", true,
+                  {{OK, 0}, {OK, 1}, {OK, 2}, {OK, 2}, {OK, 2}, {OK, 3}, {OK, 4}, {OK, FINAL}},
+                  Update_Status_OK, 4, 2, 0);
+
+    /* A chunk ahead of the expected one, and one past the image */
+    send_start();
+    send_chunk(2);
+    send_chunk(0);
+    send_chunk(1);
+    send_chunk(2);
+    send_chunk(3);
+    send_chunk(4);
+    send_chunk(4);
+    send_done();
+    check_session("Out of order and out of range chunks", true,
+                  {{OK, 0}, {Update_Status_BadSeq, 0}, {OK, 1}, {OK, 2}, {OK, 3}, {OK, 4}, {Update_Status_BadSeq, 4},
+                   {OK, FINAL}},
+                  Update_Status_OK, 4, 0, 2);
+
+    send_chunk(0);
+    send_frame(UPDATE_FRAME_ABORT, {});
+    check_session("Chunk before START, then ABORT", false,
+                  {{Update_Status_BadSeq, 0}, {Update_Status_Aborted, FINAL}},
+                  Update_Status_Aborted, 0, 0, 1);
+
+    send_start();
+    send_chunk(0);
+    send_chunk(1);
+    send_done();
+    check_session("DONE before all chunks", false,
+                  {{OK, 0}, {OK, 1}, {OK, 2}, {Update_Status_BadLength, FINAL}},
+                  Update_Status_BadLength, 2, 0, 0);
+
+    send_start(image.size(), crc32_ieee(image.data(), image.size()) ^ 1);
+    for(uint16_t seq = 0; seq < 4; seq++)
+    {
+        send_chunk(seq);
+    }
+    send_done();
+    check_session("Image CRC mismatch", false,
+                  {{OK, 0}, {OK, 1}, {OK, 2}, {OK, 3}, {OK, 4}, {Update_Status_BadCRC, FINAL}},
+                  Update_Status_BadCRC, 4, 0, 0);
+
+    send_start(UPDATE_MAX_IMAGE_SIZE + 1, 0);
+    check_session("Image larger than the bank", false,
+                  {{Update_Status_BadLength, FINAL}},
+                  Update_Status_BadLength, 0, 0, 0);
+
+    /* The host is gone after two chunks: no final reply */
+    send_start();
+    send_chunk(0);
+    send_chunk(1);
+    uint32_t start = HAL_GetTick();
+    check_session("Timeout", false,
+                  {{OK, 0}, {OK, 1}, {OK, 2}},
+                  Update_Status_Timeout, 2, 0, 0);
+    CHECK(HAL_GetTick() - start >= UPDATE_TIMEOUT_MS);
+
+    return check_result();
+}
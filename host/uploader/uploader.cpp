@@ -0,0 +1,394 @@
+/*
+ Host uploader for the "update" command (protocol: Inc/update.h).
+
+ Usage: uploader [-w window] <serial device> <image.bin>
+
+ The image is the raw binary of the firmware build (out/max6650_test.bin).
+ The uploader starts "update" on the device, sends the image with up to
+ `window` chunks in flight (go-back-N on a NAK or a timeout), waits for the
+ CRC check and reports the throughput against the 115200 8N1 link rate. The
+ device boots the new image on success.
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "serial_port.h"
+
+/* Must match Inc/update.h */
+#define UPDATE_SYNC_HOST            0x55
+#define UPDATE_SYNC_DEVICE          0xAA
+#define UPDATE_FRAME_START          'S'
+#define UPDATE_FRAME_DATA           'D'
+#define UPDATE_FRAME_DONE           'E'
+#define UPDATE_FRAME_ABORT          'A'
+#define UPDATE_SEQ_FINAL            0xFFFF
+#define UPDATE_CHUNK_SIZE           256
+#define UPDATE_WINDOW               8
+#define UPDATE_MAX_IMAGE_SIZE       (384 * 1024)
+
+#define STATUS_OK                   0
+#define STATUS_BAD_FRAME            1
+#define STATUS_BAD_SEQ              2
+
+#define BAUD                        115200
+/* 8N1: 10 bits per byte */
+#define LINK_BYTES_PER_S            (BAUD / 10)
+
+/* Erase of 192 pages takes up to ~4.5 s */
+#define START_TIMEOUT_MS            10000
+#define ACK_TIMEOUT_MS              500
+#define DONE_TIMEOUT_MS             3000
+#define PROMPT_TIMEOUT_MS           2000
+#define MAX_TIMEOUTS                10
+
+static const char *status_names[] =
+{
+    "OK", "bad frame", "bad sequence", "flash error", "bad length", "bad CRC", "timeout", "aborted"
+};
+
+struct Reply
+{
+    uint8_t status;
+    uint16_t seq;
+};
+
+
+static uint16_t crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+
+    while(len--)
+    {
+        crc ^= (uint16_t)*data++ << 8;
+        for(int i = 0; i < 8; i++)
+        {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    while(len--)
+    {
+        crc ^= *data++;
+        for(int i = 0; i < 8; i++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+    }
+
+    return ~crc;
+}
+
+
+static void put_u16(std::vector<uint8_t> &buf, uint16_t value)
+{
+    buf.push_back(value & 0xFF);
+    buf.push_back(value >> 8);
+}
+
+
+static void put_u32(std::vector<uint8_t> &buf, uint32_t value)
+{
+    put_u16(buf, value & 0xFFFF);
+    put_u16(buf, value >> 16);
+}
+
+
+static std::vector<uint8_t> make_frame(uint8_t type, const std::vector<uint8_t> &payload)
+{
+    std::vector<uint8_t> frame;
+
+    frame.push_back(UPDATE_SYNC_HOST);
+    frame.push_back(type);
+    frame.insert(frame.end(), payload.begin(), payload.end());
+    put_u16(frame, crc16(&frame[1], frame.size() - 1));
+
+    return frame;
+}
+
+
+static const char* status_name(uint8_t status)
+{
+    return status < sizeof(status_names) / sizeof(status_names[0]) ? status_names[status] : "unknown";
+}
+
+
+/**
+ * @brief Device replies parser. Console text between the replies is passed to stderr
+ */
+class ReplyReader
+{
+public:
+    explicit ReplyReader(SerialPort &port) : port(port) {}
+
+    /**
+     * @brief Wait for the next reply
+     * @retval false on timeout
+     */
+    bool Get(Reply &reply, uint32_t timeout_ms)
+    {
+        uint64_t deadline = SerialPort_NowMs() + timeout_ms;
+
+        while(1)
+        {
+            while(pos < buf.size())
+            {
+                if(buf[pos] != UPDATE_SYNC_DEVICE)
+                {
+                    fputc(buf[pos++], stderr);
+                    continue;
+                }
+                if(buf.size() - pos < 4)
+                {
+                    break;
+                }
+                reply.status = buf[pos + 1];
+                reply.seq = buf[pos + 2] | buf[pos + 3] << 8;
+                pos += 4;
+                return true;
+            }
+            buf.erase(buf.begin(), buf.begin() + pos);
+            pos = 0;
+
+            uint64_t now = SerialPort_NowMs();
+            if(now >= deadline)
+            {
+                return false;
+            }
+
+            uint8_t data[256];
+            int n = port.Read(data, sizeof(data), deadline - now);
+            if(n < 0)
+            {
+                return false;
+            }
+            buf.insert(buf.end(), data, data + n);
+        }
+    }
+
+private:
+    SerialPort &port;
+    std::vector<uint8_t> buf;
+    size_t pos = 0;
+};
+
+
+/**
+ * @brief Echo console text until the prompt of the "update" command
+ */
+static bool wait_prompt(SerialPort &port)
+{
+    std::string text;
+    uint64_t deadline = SerialPort_NowMs() + PROMPT_TIMEOUT_MS;
+    char data[256];
+
+    while(SerialPort_NowMs() < deadline)
+    {
+        int n = port.Read(data, sizeof(data), 50);
+        if(n < 0)
+        {
+            return false;
+        }
+        text.append(data, n);
+        fwrite(data, 1, n, stderr);
+        if(text.find("waiting for the image") != std::string::npos)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned window = UPDATE_WINDOW;
+    int opt;
+
+    while((opt = getopt(argc, argv, "w:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'w': window = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-w window] <serial device> <image.bin>\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if((optind != argc - 2) || (window == 0))
+    {
+        fprintf(stderr, "Usage: %s [-w window] <serial device> <image.bin>\n", argv[0]);
+        return 1;
+    }
+
+    std::ifstream file(argv[optind + 1], std::ios::binary);
+    if(!file)
+    {
+        fprintf(stderr, "Can't open %s\n", argv[optind + 1]);
+        return 1;
+    }
+    std::vector<uint8_t> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if(image.empty() || (image.size() > UPDATE_MAX_IMAGE_SIZE))
+    {
+        fprintf(stderr, "Image size %zu is out of range 1..%d\n", image.size(), UPDATE_MAX_IMAGE_SIZE);
+        return 1;
+    }
+
+    uint32_t length = image.size();
+    uint32_t image_crc = crc32(image.data(), length);
+    uint16_t chunks = (length + UPDATE_CHUNK_SIZE - 1) / UPDATE_CHUNK_SIZE;
+    /* The erased flash reads 0xFF */
+    image.resize((size_t)chunks * UPDATE_CHUNK_SIZE, 0xFF);
+
+    SerialPort port;
+    std::string error;
+    if(!port.Open(argv[optind], BAUD, error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    /* A device just reset drops the first character measuring its rate, the line end goes first */
+    port.Flush();
+    if(!port.Write("\rupdate\r") || !wait_prompt(port))
+    {
+        fprintf(stderr, "\nDevice doesn't respond to \"update\"\n");
+        return 1;
+    }
+
+    ReplyReader reader(port);
+    Reply reply;
+    std::vector<uint8_t> payload;
+
+    put_u32(payload, length);
+    put_u32(payload, image_crc);
+    std::vector<uint8_t> frame = make_frame(UPDATE_FRAME_START, payload);
+
+    fprintf(stderr, "\nErasing %u bytes..\n", length);
+    uint64_t start_ms = SerialPort_NowMs();
+    bool replied = port.Write(frame.data(), frame.size()) && reader.Get(reply, START_TIMEOUT_MS);
+    if(!replied || (reply.status != STATUS_OK))
+    {
+        fprintf(stderr, "START failed: %s\n", replied ? status_name(reply.status) : "no reply");
+        return 1;
+    }
+    uint64_t data_start_ms = SerialPort_NowMs();
+
+    uint16_t base = 0;              /* first chunk not acknowledged */
+    uint16_t next = 0;              /* next chunk to send */
+    uint64_t frames_sent = 0;
+    uint64_t bytes_sent = 0;
+    unsigned naks = 0;
+    unsigned timeouts = 0;
+    unsigned consecutive_timeouts = 0;
+
+    while(base < chunks)
+    {
+        while((next < chunks) && (next < base + window))
+        {
+            payload.clear();
+            put_u16(payload, next);
+            payload.insert(payload.end(), image.begin() + (size_t)next * UPDATE_CHUNK_SIZE,
+                           image.begin() + (size_t)(next + 1) * UPDATE_CHUNK_SIZE);
+            frame = make_frame(UPDATE_FRAME_DATA, payload);
+            if(!port.Write(frame.data(), frame.size()))
+            {
+                fprintf(stderr, "Can't write to %s\n", argv[optind]);
+                return 1;
+            }
+            frames_sent++;
+            bytes_sent += frame.size();
+            next++;
+        }
+
+        if(!reader.Get(reply, ACK_TIMEOUT_MS))
+        {
+            /* Lost frames or acknowledgements: send the window again */
+            timeouts++;
+            if(++consecutive_timeouts > MAX_TIMEOUTS)
+            {
+                fprintf(stderr, "Device doesn't respond at chunk %u\n", base);
+                return 1;
+            }
+            next = base;
+            continue;
+        }
+        consecutive_timeouts = 0;
+
+        if(reply.status == STATUS_OK)
+        {
+            if(reply.seq > base)
+            {
+                base = reply.seq;
+            }
+        }
+        else if((reply.status == STATUS_BAD_FRAME) || (reply.status == STATUS_BAD_SEQ))
+        {
+            naks++;
+            base = reply.seq;
+            next = reply.seq;
+        }
+        else
+        {
+            fprintf(stderr, "Update failed at chunk %u: %s\n", base, status_name(reply.status));
+            return 1;
+        }
+
+        fprintf(stderr, "\r%u / %u chunks", base, chunks);
+    }
+    uint64_t data_ms = SerialPort_NowMs() - data_start_ms;
+
+    frame = make_frame(UPDATE_FRAME_DONE, std::vector<uint8_t>());
+    if(!port.Write(frame.data(), frame.size()))
+    {
+        fprintf(stderr, "Can't write to %s\n", argv[optind]);
+        return 1;
+    }
+
+    /* Late acknowledgements of duplicates come before the final status */
+    bool done = false;
+    while(!done && reader.Get(reply, DONE_TIMEOUT_MS))
+    {
+        done = (reply.seq == UPDATE_SEQ_FINAL);
+    }
+    uint64_t total_ms = SerialPort_NowMs() - start_ms;
+
+    fprintf(stderr, "\n");
+    if(!done || (reply.status != STATUS_OK))
+    {
+        fprintf(stderr, "Update failed: %s\n", done ? status_name(reply.status) : "no reply");
+        return 1;
+    }
+
+    fprintf(stderr, "Image: %u bytes, CRC-32 %08X, %u chunks\n", length, image_crc, chunks);
+    fprintf(stderr, "Frames sent: %llu, NAKs: %u, timeouts: %u\n", (unsigned long long)frames_sent, naks, timeouts);
+    if(data_ms != 0)
+    {
+        double rate = bytes_sent * 1000.0 / data_ms;
+        fprintf(stderr, "Data phase: %llu ms, %.0f B/s on the wire (%.0f%% of %d B/s), %.0f B/s of image\n",
+                (unsigned long long)data_ms, rate, rate * 100.0 / LINK_BYTES_PER_S, LINK_BYTES_PER_S,
+                length * 1000.0 / data_ms);
+    }
+    fprintf(stderr, "Total with erase and verification: %llu ms\n", (unsigned long long)total_ms);
+
+    return 0;
+}
@@ -0,0 +1,384 @@
+/*
+ Vibration analysis on synthetic accelerometer blocks.
+
+ Usage: vibration_test
+
+ src/vibration.c and src/fft_q15.c are built for the host, the Cortex-M4
+ SIMD intrinsics come from the shim (host/shim/stm32l4xx.h). The LSM6DSL
+ FIFO is replaced by generated blocks of sinusoids and noise, the fan
+ speed comes from the MAX6650 driver reading a simulated tach count, so
+ the rotation frequency the analysis looks at is the one of the firmware.
+
+ The FFT is checked on its own with complex tones, then whole blocks go
+ through Vibration_Process(): the peak bin and amplitude, the amplitude at
+ the fan rotation frequency and the RMS are compared with the generated
+ signal. Exits with 1 if a check fails.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "stm32l4xx_hal.h"
+#include "shim.h"
+#include "fft_q15.h"
+#include "vibration.h"
+#include "lsm6dsl.h"
+#include "max6650.h"
+#include "check.h"
+
+#define SAMPLE_RATE                 1660
+#define MAX6650_TACHO_0_REG         0x0C
+#define BLOCK_TIMEOUT_MS            2000
+
+/* One bin of the spectrum in 0.1 Hz */
+#define BIN_FREQ                    ((double)SAMPLE_RATE * 10 / VIBRATION_FFT_LENGTH)
+
+static std::vector<int16_t> block;
+static size_t block_read;
+static uint8_t tach_count;
+
+static const Vibration_Config_t vibration_config =
+{
+    .axis = Vibration_Axis_Z,
+    .block_period_ms = 0
+};
+
+static MAX6650_Config_t max6650_config =
+{
+    .add_line_connection = ADD_Line_GND,
+    .operating_mode = OperatingMode_Closed_Loop,
+    .fan_lovtage = FanVoltage_12V,
+    .k_scale = KScale_16,
+    .rpm_max = 10500U
+};
+
+
+/* Host tool side of the shim, the console isn't used */
+void shim_uart_write(const uint8_t *data, uint32_t len)
+{
+    (void)data;
+    (void)len;
+}
+
+
+bool shim_uart_read(uint8_t *byte, uint32_t timeout_ms)
+{
+    (void)byte;
+    (void)timeout_ms;
+    return false;
+}
+
+
+void shim_uart_set_baud(uint32_t baud)
+{
+    (void)baud;
+}
+
+
+uint32_t shim_uart_host_baud(void)
+{
+    return 0;
+}
+
+
+uint64_t shim_tach_interval_ns(void)
+{
+    return 0;
+}
+
+
+/* Console and interrupts of the firmware the shim calls, neither is used here */
+int __io_write(const char *ptr, int len)
+{
+    return (int)fwrite(ptr, 1, len, stdout);
+}
+
+
+int __io_getchar(void)
+{
+    return EOF;
+}
+
+
+extern "C" void UartAPI_IRQHandler(void)
+{
+}
+
+
+extern "C" void UartAPI_TxDMA_IRQHandler(void)
+{
+}
+
+
+extern "C" void Timebase_IRQHandler(void)
+{
+}
+
+
+/* LSM6DSL FIFO holding the generated block on the Z axis */
+uint16_t LSM6DSL_GetSampleRate(void)
+{
+    return SAMPLE_RATE;
+}
+
+
+bool LSM6DSL_FIFO_Restart(void)
+{
+    block_read = 0;
+    return true;
+}
+
+
+bool LSM6DSL_FIFO_GetCount(uint16_t *count)
+{
+    *count = (uint16_t)(block.size() - block_read);
+    return true;
+}
+
+
+bool LSM6DSL_FIFO_Read(LSM6DSL_Sample_t *samples, uint16_t count)
+{
+    for(uint16_t i = 0; i < count; i++)
+    {
+        samples[i].x = 0;
+        samples[i].y = 0;
+        samples[i].z = block[block_read++];
+    }
+    return true;
+}
+
+
+/* MAX6650 registers: the tach count, writes are taken */
+static bool max6650_read(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length)
+{
+    (void)addr;
+    for(uint16_t i = 0; i < length; i++)
+    {
+        buffer[i] = (reg + i == MAX6650_TACHO_0_REG) ? tach_count : 0;
+    }
+    return true;
+}
+
+
+static bool max6650_write(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length)
+{
+    (void)addr;
+    (void)reg;
+    (void)buffer;
+    (void)length;
+    return true;
+}
+
+
+static const struct MAX6650_I2C_ExtInterface max6650_i2c =
+{
+    .i2c_setup = NULL,
+    .i2c_read = max6650_read,
+    .i2c_write = max6650_write,
+    .get_tick_ms = NULL
+};
+
+
+static double mg_to_lsb(double mg)
+{
+    return mg * 1000.0 / LSM6DSL_SENSITIVITY_2G_UG;
+}
+
+
+/**
+ * @brief Add a sine of the given frequency and amplitude to a block
+ */
+static void add_tone(std::vector<double> &signal, double freq_hz, double amplitude_mg)
+{
+    for(size_t n = 0; n < signal.size(); n++)
+    {
+        signal[n] += mg_to_lsb(amplitude_mg) * sin(2 * M_PI * freq_hz * n / SAMPLE_RATE);
+    }
+}
+
+
+static std::vector<int16_t> quantize(const std::vector<double> &signal)
+{
+    std::vector<int16_t> res;
+
+    for(double value : signal)
+    {
+        res.push_back((int16_t)lrint(std::max(-32768.0, std::min(32767.0, value))));
+    }
+    return res;
+}
+
+
+/**
+ * @brief Run one block through the capture and analysis state machine
+ * @param[in] samples Z axis samples
+ * @param[in] tach MAX6650 tach count: pulses per 1 s gate, two per revolution
+ */
+static Vibration_Status_t analyze(const std::vector<int16_t> &samples, uint8_t tach)
+{
+    Vibration_Status_t status;
+    uint32_t blocks;
+
+    block = samples;
+    tach_count = tach;
+
+    Vibration_GetStatus(&status);
+    blocks = status.blocks;
+
+    CHECK(Vibration_Init(&vibration_config));
+    uint32_t start = HAL_GetTick();
+    do
+    {
+        Vibration_Process();
+        Vibration_GetStatus(&status);
+    }
+    while((status.blocks == blocks) && (HAL_GetTick() - start < BLOCK_TIMEOUT_MS));
+
+    CHECK(status.blocks == blocks + 1);
+    return status;
+}
+
+
+/**
+ * @brief Complex tone on one bin: the 1/length scaled FFT gives its amplitude there and nothing elsewhere
+ */
+static void test_fft_tone(uint16_t length, uint16_t bin)
+{
+    std::vector<uint32_t> data(length);
+    const double amplitude = 16000;
+    int failures = check_failures;
+    char name[64];
+
+    for(uint16_t n = 0; n < length; n++)
+    {
+        double angle = 2 * M_PI * bin * n / length;
+        data[n] = FFT_Q15_PACK(lrint(amplitude * cos(angle)), lrint(amplitude * sin(angle)));
+    }
+
+    FFT_Q15_Run(data.data(), length);
+
+    for(uint16_t k = 0; k < length; k++)
+    {
+        if(k == bin)
+        {
+            CHECK_NEAR(FFT_Q15_RE(data[k]), amplitude, 40);
+            CHECK_NEAR(FFT_Q15_IM(data[k]), 0, 40);
+        }
+        else
+        {
+            CHECK_NEAR(FFT_Q15_RE(data[k]), 0, 40);
+            CHECK_NEAR(FFT_Q15_IM(data[k]), 0, 40);
+        }
+    }
+
+    snprintf(name, sizeof(name), "FFT of a tone on bin %u of %u", bin, length);
+    check_case(name, failures);
+}
+
+
+int main(void)
+{
+    Vibration_Status_t status;
+    int failures;
+
+    FFT_Q15_Init();
+    test_fft_tone(256, 1);
+    test_fft_tone(256, 37);
+    test_fft_tone(64, 5);
+
+    CHECK(MAX6650_Init(&max6650_config, &max6650_i2c));
+
+    /* On bin 20 with gravity on the axis: the window has no scalloping loss there */
+    {
+        std::vector<double> signal(VIBRATION_FFT_LENGTH, mg_to_lsb(1000));
+        failures = check_failures;
+        add_tone(signal, 20 * BIN_FREQ / 10, 500);
+        status = analyze(quantize(signal), 0);
+        CHECK_NEAR(status.peak_freq, 20 * BIN_FREQ, 1);
+        CHECK_NEAR(status.peak_amplitude, 500, 15);
+        CHECK_NEAR(status.rms, 500 / sqrt(2), 10);
+        CHECK_EQ(status.fan_rpm, 0);
+        CHECK_EQ(status.rotation_amplitude, 0);
+        check_case("Tone on a bin, DC removed", failures);
+    }
+
+    /* Fan at 3000 rpm: 100 pulses per 1 s gate, 50 Hz. A stronger tone at 300 Hz is the highest peak */
+    {
+        std::vector<double> signal(VIBRATION_FFT_LENGTH, 0);
+        failures = check_failures;
+        add_tone(signal, 50, 200);
+        add_tone(signal, 300, 400);
+        status = analyze(quantize(signal), 100);
+        CHECK_EQ(status.fan_rpm, 3000);
+        CHECK_EQ(status.rotation_freq, 500);
+        CHECK_NEAR(status.rotation_amplitude, 200, 30);
+        CHECK_NEAR(status.peak_freq, 3000, BIN_FREQ);
+        CHECK_NEAR(status.peak_amplitude, 400, 60);
+        check_case("Rotation peak next to a higher one", failures);
+    }
+
+    /* Fan at 6000 rpm, the rotation peak moves to 100 Hz and the 50 Hz tone is left out */
+    {
+        std::vector<double> signal(VIBRATION_FFT_LENGTH, 0);
+        failures = check_failures;
+        add_tone(signal, 50, 100);
+        add_tone(signal, 100, 300);
+        status = analyze(quantize(signal), 200);
+        CHECK_EQ(status.fan_rpm, 6000);
+        CHECK_EQ(status.rotation_freq, 1000);
+        CHECK_NEAR(status.rotation_amplitude, 300, 45);
+        CHECK_NEAR(status.peak_freq, 1000, BIN_FREQ);
+        check_case("Rotation peak follows the fan speed", failures);
+    }
+
+    /* Tone in white noise: the peak stands out, the RMS has both */
+    {
+        std::vector<double> signal(VIBRATION_FFT_LENGTH, 0);
+        std::mt19937 rng(1);
+        std::normal_distribution<double> noise(0, mg_to_lsb(100));
+        failures = check_failures;
+        for(double &value : signal)
+        {
+            value = noise(rng);
+        }
+        add_tone(signal, 30 * BIN_FREQ / 10, 300);
+        std::vector<int16_t> samples = quantize(signal);
+
+        double mean = 0, power = 0;
+        for(int16_t value : samples) mean += value;
+        mean /= samples.size();
+        for(int16_t value : samples) power += (value - mean) * (value - mean);
+
+        status = analyze(samples, 0);
+        CHECK_NEAR(status.peak_freq, 30 * BIN_FREQ, 1);
+        CHECK_NEAR(status.peak_amplitude, 300, 40);
+        CHECK_NEAR(status.rms, sqrt(power / samples.size()) * LSM6DSL_SENSITIVITY_2G_UG / 1000, 2);
+        check_case("Tone in white noise", failures);
+    }
+
+    /* Spikes from -30000 to +30000: deviations from the mean over 46341 LSB, squares over 2^31 */
+    {
+        std::vector<int16_t> samples(VIBRATION_FFT_LENGTH, -30000);
+        failures = check_failures;
+        for(size_t n = 0; n < samples.size(); n += 32)
+        {
+            samples[n] = 30000;
+        }
+
+        int32_t mean = 0;
+        double power = 0;
+        for(int16_t value : samples) mean += value;
+        mean /= (int32_t)samples.size();
+        for(int16_t value : samples) power += (double)(value - mean) * (value - mean);
+
+        status = analyze(samples, 0);
+        CHECK_NEAR(status.rms, sqrt(power / samples.size()) * LSM6DSL_SENSITIVITY_2G_UG / 1000, 1);
+        check_case("RMS of a full-scale spread", failures);
+    }
+
+    return check_result();
+}
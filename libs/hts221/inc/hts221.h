@@ -0,0 +1,82 @@
+#ifndef __HTS221_INC_HTS221_H
+#define __HTS221_INC_HTS221_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define HTS221_I2C_ADDRESS              0xBE            /* 8-bit address on the B-L475E-IOT01A I2C2 bus */
+#define HTS221_WHO_AM_I_VALUE           0xBC
+
+/**
+ * @brief I2C External Interface
+ */
+struct HTS221_I2C_ExtInterface
+{
+    bool (*i2c_read)(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length);
+    bool (*i2c_write)(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length);
+};
+
+/**
+ * @brief HTS221 Conversion Mode
+ */
+typedef enum
+{
+    HTS221_Mode_OneShot = 0,
+    HTS221_Mode_Continuous_1Hz,
+    HTS221_Mode_Continuous_7Hz,
+    HTS221_Mode_Continuous_12_5Hz
+} HTS221_Mode_t;
+
+/**
+ * @brief HTS221 Configuration structure
+ */
+typedef struct
+{
+    uint8_t i2c_address;
+    HTS221_Mode_t mode;
+} HTS221_Config_t;
+
+/**
+ * @brief HTS221 Measurement
+ */
+typedef struct
+{
+    int16_t temperature;        /* 0.1 degC */
+    uint16_t humidity;          /* 0.1 %rH */
+} HTS221_Data_t;
+
+/**
+  * @brief HTS221 Initialization Function. Checks WHO_AM_I, reads the factory calibration and
+  *        powers the sensor up in the requested mode
+  * @param[in] HTS221 configuration
+  * @param[in] External I2C Interface
+  * @retval true if initialized, otherwise false
+  */
+bool HTS221_Init(HTS221_Config_t *hts221_config, const struct HTS221_I2C_ExtInterface *ext_i2c_interface);
+
+/**
+ * @brief HTS221 Start Conversion. Triggers a single conversion in one-shot mode, does nothing in continuous mode
+ * @retval true if the conversion has been started
+ */
+bool HTS221_StartConversion(void);
+
+/**
+ * @brief HTS221 Read. Reads status and both output registers in a single bus transaction
+ * @param[out] data converted measurement, updated only if new data is available
+ * @param[out] ready true if the sensor had a new measurement
+ * @retval true if the registers have been read
+ */
+bool HTS221_Read(HTS221_Data_t *data, bool *ready);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HTS221_INC_HTS221_H */
@@ -0,0 +1,198 @@
+/*
+ HTS221 relative humidity and temperature sensor driver.
+
+ The sensor outputs raw 16-bit ADC counts. Every part is factory calibrated
+ and the calibration points are stored in registers 0x30..0x3F:
+
+    T0_degC_x8 / T1_degC_x8 (10-bit, msb in 0x35) <-> T0_OUT / T1_OUT
+    H0_rH_x2   / H1_rH_x2                         <-> H0_T0_OUT / H1_T0_OUT
+
+ The measured value is obtained by linear interpolation between these two
+ points:
+
+    T = T0 + (T_OUT - T0_OUT) x (T1 - T0) / (T1_OUT - T0_OUT)
+
+ The calibration block is read once during initialization, so a measurement
+ costs a single 5-byte burst read (STATUS, HUMIDITY_OUT, TEMP_OUT). Register
+ auto-increment is requested by setting the MSB of the register address.
+
+ In one-shot mode the conversion is started by HTS221_StartConversion() and
+ takes ~20 ms at the default averaging; the caller is expected to do other bus
+ work meanwhile and pick the result up later with HTS221_Read().
+*/
+
+#include "hts221.h"
+#include "dlog.h"
+
+#define HTS221_WHO_AM_I_REG             0x0F
+#define HTS221_AV_CONF_REG              0x10
+#define HTS221_CTRL_REG1                0x20
+#define HTS221_CTRL_REG2                0x21
+#define HTS221_STATUS_REG               0x27
+#define HTS221_CALIB_REG                0x30
+
+#define HTS221_AUTO_INCREMENT           0x80
+
+#define HTS221_CTRL_REG1_PD             0x80
+#define HTS221_CTRL_REG1_BDU            0x04
+#define HTS221_CTRL_REG2_ONE_SHOT       0x01
+
+#define HTS221_STATUS_T_DA              0x01
+#define HTS221_STATUS_H_DA              0x02
+
+#define HTS221_CALIB_LENGTH             16
+
+typedef struct
+{
+    int16_t t0_degc_x8;
+    int16_t t1_degc_x8;
+    int16_t t0_out;
+    int16_t t1_out;
+    int16_t h0_rh_x2;
+    int16_t h1_rh_x2;
+    int16_t h0_t0_out;
+    int16_t h1_t0_out;
+} HTS221_Calibration_t;
+
+static const struct HTS221_I2C_ExtInterface *i2c_ext_if = NULL;
+static HTS221_Config_t *config = NULL;
+static HTS221_Calibration_t calib;
+
+
+static int16_t get_int16(const uint8_t *buffer)
+{
+    return (int16_t)((uint16_t)buffer[1] << 8 | buffer[0]);
+}
+
+
+static bool read_calibration(void)
+{
+    uint8_t buffer[HTS221_CALIB_LENGTH];
+
+    if(i2c_ext_if->i2c_read(config->i2c_address, HTS221_CALIB_REG | HTS221_AUTO_INCREMENT, buffer, HTS221_CALIB_LENGTH) != true)
+    {
+        return false;
+    }
+
+    calib.h0_rh_x2 = buffer[0];
+    calib.h1_rh_x2 = buffer[1];
+    calib.t0_degc_x8 = (int16_t)(((buffer[5] & 0x03) << 8) | buffer[2]);
+    calib.t1_degc_x8 = (int16_t)(((buffer[5] & 0x0C) << 6) | buffer[3]);
+    calib.h0_t0_out = get_int16(&buffer[6]);
+    calib.h1_t0_out = get_int16(&buffer[10]);
+    calib.t0_out = get_int16(&buffer[12]);
+    calib.t1_out = get_int16(&buffer[14]);
+
+    /* Protect the interpolation against a blank calibration area */
+    return (calib.t1_out != calib.t0_out) && (calib.h1_t0_out != calib.h0_t0_out);
+}
+
+
+bool HTS221_Init(HTS221_Config_t *hts221_config, const struct HTS221_I2C_ExtInterface *ext_i2c_interface)
+{
+    uint8_t value;
+    i2c_ext_if = ext_i2c_interface;
+    config = hts221_config;
+
+    if(i2c_ext_if == NULL)
+    {
+        DLOG("HTS221: External I2C interface is not initialized!\r\n");
+        return false;
+    }
+
+    if(config == NULL)
+    {
+        DLOG("HTS221: no configuration available!\r\n");
+        return false;
+    }
+
+    if(i2c_ext_if->i2c_read(config->i2c_address, HTS221_WHO_AM_I_REG, &value, 1) != true)
+    {
+        return false;
+    }
+
+    if(value != HTS221_WHO_AM_I_VALUE)
+    {
+        DLOG("HTS221: unexpected WHO_AM_I 0x%02X\r\n", value);
+        return false;
+    }
+
+    if(read_calibration() != true)
+    {
+        DLOG("HTS221: calibration data is not valid!\r\n");
+        return false;
+    }
+
+    /* Block data update keeps MSB and LSB of a sample consistent during the burst read */
+    value = HTS221_CTRL_REG1_PD | HTS221_CTRL_REG1_BDU | (config->mode & 0x03);
+
+    return i2c_ext_if->i2c_write(config->i2c_address, HTS221_CTRL_REG1, &value, 1);
+}
+
+
+bool HTS221_StartConversion(void)
+{
+    uint8_t value = HTS221_CTRL_REG2_ONE_SHOT;
+
+    if((i2c_ext_if == NULL) || (config == NULL))
+    {
+        return false;
+    }
+
+    if(config->mode != HTS221_Mode_OneShot)
+    {
+        return true;
+    }
+
+    return i2c_ext_if->i2c_write(config->i2c_address, HTS221_CTRL_REG2, &value, 1);
+}
+
+
+bool HTS221_Read(HTS221_Data_t *data, bool *ready)
+{
+    uint8_t buffer[5];
+    int32_t temp_x80;
+    int32_t hum_x20;
+    int16_t out;
+
+    if((i2c_ext_if == NULL) || (config == NULL))
+    {
+        return false;
+    }
+
+    *ready = false;
+
+    if(i2c_ext_if->i2c_read(config->i2c_address, HTS221_STATUS_REG | HTS221_AUTO_INCREMENT, buffer, sizeof(buffer)) != true)
+    {
+        return false;
+    }
+
+    if((buffer[0] & (HTS221_STATUS_T_DA | HTS221_STATUS_H_DA)) != (HTS221_STATUS_T_DA | HTS221_STATUS_H_DA))
+    {
+        return true;
+    }
+
+    /* Temperature is interpolated in 1/80 degC and scaled to 0.1 degC */
+    out = get_int16(&buffer[3]);
+    temp_x80 = (int32_t)calib.t0_degc_x8 * 10 +
+               ((int32_t)(out - calib.t0_out) * (calib.t1_degc_x8 - calib.t0_degc_x8) * 10) / (calib.t1_out - calib.t0_out);
+    data->temperature = (int16_t)(temp_x80 / 8);
+
+    /* Humidity is interpolated in 1/20 %rH, scaled to 0.1 %rH and clamped to the physical range */
+    out = get_int16(&buffer[1]);
+    hum_x20 = (int32_t)calib.h0_rh_x2 * 10 +
+              ((int32_t)(out - calib.h0_t0_out) * (calib.h1_rh_x2 - calib.h0_rh_x2) * 10) / (calib.h1_t0_out - calib.h0_t0_out);
+    hum_x20 /= 2;
+    if(hum_x20 < 0)
+    {
+        hum_x20 = 0;
+    }
+    else if(hum_x20 > 1000)
+    {
+        hum_x20 = 1000;
+    }
+    data->humidity = (uint16_t)hum_x20;
+
+    *ready = true;
+    return true;
+}
@@ -0,0 +1,100 @@
+#ifndef __LSM6DSL_INC_LSM6DSL_H
+#define __LSM6DSL_INC_LSM6DSL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define LSM6DSL_I2C_ADDRESS             0xD4            /* 8-bit address on the B-L475E-IOT01A I2C2 bus */
+#define LSM6DSL_WHO_AM_I_VALUE          0x6A
+
+/* Sensitivity at +-2g full scale, ug/LSB */
+#define LSM6DSL_SENSITIVITY_2G_UG       61
+
+/**
+ * @brief I2C External Interface
+ */
+struct LSM6DSL_I2C_ExtInterface
+{
+    bool (*i2c_read)(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length);
+    bool (*i2c_write)(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length);
+};
+
+/**
+ * @brief LSM6DSL accelerometer/FIFO output data rate
+ */
+typedef enum
+{
+    LSM6DSL_ODR_416Hz = 6,
+    LSM6DSL_ODR_833Hz = 7,
+    LSM6DSL_ODR_1660Hz = 8,
+    LSM6DSL_ODR_3330Hz = 9
+} LSM6DSL_ODR_t;
+
+/**
+ * @brief LSM6DSL Configuration structure
+ */
+typedef struct
+{
+    uint8_t i2c_address;
+    LSM6DSL_ODR_t odr;
+} LSM6DSL_Config_t;
+
+/**
+ * @brief Accelerometer sample as stored in the FIFO
+ */
+typedef struct
+{
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} LSM6DSL_Sample_t;
+
+/**
+  * @brief LSM6DSL Initialization Function. Configures the accelerometer at +-2g and
+  *        the FIFO to store accelerometer samples only. The gyroscope stays powered down
+  * @param[in] LSM6DSL configuration
+  * @param[in] External I2C Interface
+  * @retval true if initialized, otherwise false
+  */
+bool LSM6DSL_Init(LSM6DSL_Config_t *lsm6dsl_config, const struct LSM6DSL_I2C_ExtInterface *ext_i2c_interface);
+
+/**
+ * @brief Get sampling frequency of the configured output data rate
+ * @retval sampling frequency in Hz
+ */
+uint16_t LSM6DSL_GetSampleRate(void);
+
+/**
+ * @brief Restart block capture. Flushes the FIFO and fills it with new samples until it is full,
+ *        so the samples of one block are always contiguous
+ * @retval true if the FIFO has been restarted
+ */
+bool LSM6DSL_FIFO_Restart(void);
+
+/**
+ * @brief Get number of complete samples stored in the FIFO
+ * @param[out] count number of samples
+ * @retval true if the FIFO status has been read
+ */
+bool LSM6DSL_FIFO_GetCount(uint16_t *count);
+
+/**
+ * @brief Read samples from the FIFO in a single burst transaction
+ * @param[out] samples
+ * @param[in] count number of samples to read
+ * @retval true if the samples have been read
+ */
+bool LSM6DSL_FIFO_Read(LSM6DSL_Sample_t *samples, uint16_t count);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LSM6DSL_INC_LSM6DSL_H */
@@ -0,0 +1,171 @@
+/*
+ LSM6DSL accelerometer driver with FIFO block capture.
+
+ Only the accelerometer is stored in the 4 KB hardware FIFO (no decimation),
+ so the FIFO pattern is X, Y, Z words and a complete sample is 6 bytes. The
+ FIFO is used in "FIFO mode": after a restart it collects samples until it
+ is full and then stops, which guarantees that a block read from it has no
+ gaps even if the bus is too slow to follow the output data rate.
+
+ Reading FIFO_DATA_OUT_L with register auto-increment (IF_INC) rolls the
+ address back to FIFO_DATA_OUT_L after FIFO_DATA_OUT_H, so any number of
+ words can be drained in one burst transaction directly into the caller's
+ sample buffer.
+*/
+
+#include "lsm6dsl.h"
+#include "dlog.h"
+
+#define LSM6DSL_FIFO_CTRL3_REG          0x08
+#define LSM6DSL_FIFO_CTRL5_REG          0x0A
+#define LSM6DSL_WHO_AM_I_REG            0x0F
+#define LSM6DSL_CTRL1_XL_REG            0x10
+#define LSM6DSL_CTRL3_C_REG             0x12
+#define LSM6DSL_FIFO_STATUS1_REG        0x3A
+#define LSM6DSL_FIFO_DATA_OUT_L_REG     0x3E
+
+#define LSM6DSL_CTRL3_C_BDU             0x40
+#define LSM6DSL_CTRL3_C_IF_INC          0x04
+
+#define LSM6DSL_FIFO_CTRL3_XL_NO_DEC    0x01
+
+#define LSM6DSL_FIFO_MODE_BYPASS        0x00
+#define LSM6DSL_FIFO_MODE_FIFO          0x01
+
+#define LSM6DSL_FIFO_DIFF_MSB_MASK      0x07
+#define LSM6DSL_WORDS_PER_SAMPLE        3
+
+static const struct LSM6DSL_I2C_ExtInterface *i2c_ext_if = NULL;
+static LSM6DSL_Config_t *config = NULL;
+
+
+static bool write_reg(uint8_t reg, uint8_t value)
+{
+    return i2c_ext_if->i2c_write(config->i2c_address, reg, &value, 1);
+}
+
+
+bool LSM6DSL_Init(LSM6DSL_Config_t *lsm6dsl_config, const struct LSM6DSL_I2C_ExtInterface *ext_i2c_interface)
+{
+    bool res;
+    uint8_t value;
+    i2c_ext_if = ext_i2c_interface;
+    config = lsm6dsl_config;
+
+    if(i2c_ext_if == NULL)
+    {
+        DLOG("LSM6DSL: External I2C interface is not initialized!\r\n");
+        return false;
+    }
+
+    if(config == NULL)
+    {
+        DLOG("LSM6DSL: no configuration available!\r\n");
+        return false;
+    }
+
+    if(i2c_ext_if->i2c_read(config->i2c_address, LSM6DSL_WHO_AM_I_REG, &value, 1) != true)
+    {
+        return false;
+    }
+
+    if(value != LSM6DSL_WHO_AM_I_VALUE)
+    {
+        DLOG("LSM6DSL: unexpected WHO_AM_I 0x%02X\r\n", value);
+        return false;
+    }
+
+    res = write_reg(LSM6DSL_CTRL3_C_REG, LSM6DSL_CTRL3_C_BDU | LSM6DSL_CTRL3_C_IF_INC);
+
+    if(res == true)
+    {
+        /* +-2g full scale */
+        res = write_reg(LSM6DSL_CTRL1_XL_REG, (config->odr & 0x0F) << 4);
+    }
+
+    if(res == true)
+    {
+        res = write_reg(LSM6DSL_FIFO_CTRL3_REG, LSM6DSL_FIFO_CTRL3_XL_NO_DEC);
+    }
+
+    if(res == true)
+    {
+        res = write_reg(LSM6DSL_FIFO_CTRL5_REG, LSM6DSL_FIFO_MODE_BYPASS);
+    }
+
+    return res;
+}
+
+
+uint16_t LSM6DSL_GetSampleRate(void)
+{
+    uint16_t res = 0;
+
+    if(config == NULL)
+    {
+        return 0;
+    }
+
+    switch(config->odr)
+    {
+        case LSM6DSL_ODR_416Hz: res = 416; break;
+        case LSM6DSL_ODR_833Hz: res = 833; break;
+        case LSM6DSL_ODR_1660Hz: res = 1660; break;
+        case LSM6DSL_ODR_3330Hz: res = 3330; break;
+        default: break;
+    }
+    return res;
+}
+
+
+bool LSM6DSL_FIFO_Restart(void)
+{
+    uint8_t odr;
+
+    if((i2c_ext_if == NULL) || (config == NULL))
+    {
+        return false;
+    }
+
+    odr = (config->odr & 0x0F) << 3;
+
+    /* Switching to bypass mode flushes the FIFO */
+    if(write_reg(LSM6DSL_FIFO_CTRL5_REG, odr | LSM6DSL_FIFO_MODE_BYPASS) != true)
+    {
+        return false;
+    }
+
+    return write_reg(LSM6DSL_FIFO_CTRL5_REG, odr | LSM6DSL_FIFO_MODE_FIFO);
+}
+
+
+bool LSM6DSL_FIFO_GetCount(uint16_t *count)
+{
+    uint8_t status[2];
+
+    if((i2c_ext_if == NULL) || (config == NULL))
+    {
+        return false;
+    }
+
+    if(i2c_ext_if->i2c_read(config->i2c_address, LSM6DSL_FIFO_STATUS1_REG, status, sizeof(status)) != true)
+    {
+        return false;
+    }
+
+    *count = (((uint16_t)(status[1] & LSM6DSL_FIFO_DIFF_MSB_MASK) << 8) | status[0]) / LSM6DSL_WORDS_PER_SAMPLE;
+    return true;
+}
+
+
+bool LSM6DSL_FIFO_Read(LSM6DSL_Sample_t *samples, uint16_t count)
+{
+    if((i2c_ext_if == NULL) || (config == NULL))
+    {
+        return false;
+    }
+
+    /* Samples are little-endian X, Y, Z words, the same layout as LSM6DSL_Sample_t */
+    return i2c_ext_if->i2c_read(config->i2c_address, LSM6DSL_FIFO_DATA_OUT_L_REG,
+                                (uint8_t *)samples, count * sizeof(LSM6DSL_Sample_t));
+}
@@ -10,6 +10,23 @@ extern "C" {
 #include <stdint.h>
 #include <stddef.h>
 
+/* 8-bit I2C addresses selected by the ADD line */
+#define MAX6650_I2C_ADDRESS_GND             0x90
+#define MAX6650_I2C_ADDRESS_VCC             0x96
+#define MAX6650_I2C_ADDRESS_NOT_CONNECTED   0x36
+#define MAX6650_I2C_ADDRESS_RES10K          0x3E
+
+
+/* Alarm status register bits, cleared on read */
+#define MAX6650_ALARM_MAX_OUTPUT            0x01
+#define MAX6650_ALARM_MIN_OUTPUT            0x02
+#define MAX6650_ALARM_TACH_OVERFLOW         0x04
+#define MAX6650_ALARM_GPIO1                 0x08
+#define MAX6650_ALARM_GPIO2                 0x10
+
+/* max_age_ms of the register queries */
+#define MAX6650_MAX_AGE_FRESH               0U              /* always read the chip */
+#define MAX6650_MAX_AGE_GATE                UINT32_MAX      /* any value read in the current tachometer gate */
 
 /**
  * @brief I2C External Interface
@@ -19,6 +36,7 @@ struct MAX6650_I2C_ExtInterface
     bool (*i2c_setup)(bool fast_speed);
     bool (*i2c_read)(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length);
     bool (*i2c_write)(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length);
+    uint32_t (*get_tick_ms)(void);      /* time base of the read cache, NULL disables it */
 };
 
 
@@ -79,6 +97,15 @@ typedef struct
     uint16_t rpm_max;
 } MAX6650_Config_t;
 
+/**
+ * @brief Where a register query was answered from
+ */
+typedef struct
+{
+    bool cached;                        /* from RAM, no bus transfer */
+    uint32_t age_ms;                    /* since the value was read from the chip */
+} MAX6650_ReadInfo_t;
+
 /**
   * @brief MAX6650 Initialization Function
   * @param[in] MAX6650 configuration
@@ -88,8 +115,9 @@ typedef struct
 bool MAX6650_Init(MAX6650_Config_t *max6650_config, const struct MAX6650_I2C_ExtInterface *ext_i2c_interface);
 
 /**
- * @brief MAX6650 Set Speed
- * @param[in] speed_set (0..100%)
+ * @brief MAX6650 Set Speed. 0 switches the fan off (software full-off mode), speeds below
+ *        MAX6650_GetMinSpeed() can't be encoded in the speed register and are refused
+ * @param[in] speed_set (0, MAX6650_GetMinSpeed()..100%)
  * @param[out] speed_actual (0..100%)
  * @retval true if speed has been set
  */
@@ -98,9 +126,48 @@ bool MAX6650_SetSpeed(uint8_t speed_set, uint8_t *speed_actual);
 /**
  * @brief MAX6650 Get Speed
  * @param[out] speed (0..100)
+ * @param[in] max_age_ms oldest cached tachometer count accepted, MAX6650_MAX_AGE_xxx
+ * @param[out] info source of the value, may be NULL
+ * @retval true if speed has been read
+ */
+bool MAX6650_GetSpeed(uint8_t *speed, uint32_t max_age_ms, MAX6650_ReadInfo_t *info);
+
+/**
+ * @brief MAX6650 Get RPM
+ * @param[out] rpm fan speed in revolutions per minute
+ * @param[in] max_age_ms oldest cached tachometer count accepted, MAX6650_MAX_AGE_xxx
+ * @param[out] info source of the value, may be NULL
  * @retval true if speed has been read
  */
-bool MAX6650_GetSpeed(uint8_t *speed);
+bool MAX6650_GetRPM(uint16_t *rpm, uint32_t max_age_ms, MAX6650_ReadInfo_t *info);
+
+/**
+ * @brief MAX6650 Get KTACH value from the speed register
+ * @param[out] ktach
+ * @param[in] max_age_ms oldest cached value accepted, MAX6650_MAX_AGE_xxx
+ * @param[out] info source of the value, may be NULL
+ * @retval true if the register has been read
+ */
+bool MAX6650_GetKTach(uint8_t *ktach, uint32_t max_age_ms, MAX6650_ReadInfo_t *info);
+
+/**
+ * @brief MAX6650 Get alarm status, always read from the chip. Reading clears the latched alarms
+ * @param[out] alarm MAX6650_ALARM_xxx bits
+ * @retval true if the register has been read
+ */
+bool MAX6650_GetAlarm(uint8_t *alarm);
+
+/**
+ * @brief MAX6650 Get the last speed set by MAX6650_SetSpeed()
+ * @retval speed (0..100%)
+ */
+uint8_t MAX6650_GetTargetSpeed(void);
+
+/**
+ * @brief MAX6650 Get the lowest speed MAX6650_SetSpeed() regulates to, from rpm_max and k_scale
+ * @retval speed (1..100%), 0 before MAX6650_Init()
+ */
+uint8_t MAX6650_GetMinSpeed(void);
 
 
 #ifdef __cplusplus
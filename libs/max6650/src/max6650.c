@@ -31,7 +31,7 @@
 
  When reading, we need to solve for FanSpeed :
 
-      FanSpeed = (tacho / 2) x count_t
+      FanSpeed = tacho / (2 x gate), the gate being 0.25 s x 2^count_t
 
       then multiply by 60 to give fanspeed in rpm
 
@@ -53,7 +53,10 @@
  controlled.
 */
 
+#include <string.h>
+
 #include "max6650.h"
+#include "dlog.h"
 
 #define MAX6650_SPEED_REG               0b00000000     /* fan speed R/W */
 #define MAX6650_CONFIG_REG              0b00000010     /* configuration R/W */
@@ -65,16 +68,41 @@
 #define MAX6650_GPIOSTAT_REG            0b00010100     /* GPIO status R */
 #define MAX6650_COUNT_REG               0b00010110     /* tachometer count time R/W */
 
-#define I2C_ADDRESS_GND                 0x90
-#define I2C_ADDRESS_VCC                 0x96
-#define I2C_ADDRESS_NOT_CONNECTED       0x36
-#define I2C_ADDRESS_RES10K              0x3E
-
 #define COUNTT                          2               /* default count time */
+/* Tachometer gate: the count register is updated every 0.25 s x 2^COUNTT */
+#define GATE_MS                         (250U << COUNTT)
+/* Tach pulses per fan revolution */
+#define TACH_PULSES                     2
+
+/* Registers are at even addresses 0x00..0x16 */
+#define CACHE_SIZE                      12
+#define CACHE_INDEX(reg)                ((reg) >> 1)
+
+/*
+ Read cache. The tachometer count only changes at the end of a gate, the
+ other cached registers only when written by this driver (write-through), so
+ a value read in the current gate is served from RAM. Gates are counted from
+ the write of the count time register in MAX6650_Init(), the phase of the
+ chip's gate isn't observable, so a cached count may lag a fresh read by up
+ to one gate. The alarm register is cleared on read and never cached.
+*/
+typedef struct
+{
+    bool valid;
+    uint8_t value;
+    uint32_t epoch;                     /* gate number */
+    uint32_t time_ms;
+} Cache_Entry_t;
 
 static const struct MAX6650_I2C_ExtInterface *i2c_ext_if = NULL;
 static MAX6650_Config_t *config = NULL;
 static uint8_t i2c_address;
+static uint8_t speed_target;
+/* Lowest speed KTACH can encode, 0 switches the fan off */
+static uint8_t speed_min;
+static bool fan_off;
+static Cache_Entry_t cache[CACHE_SIZE];
+static uint32_t gate_origin_ms;
 
 
 static uint8_t get_scale(MAX6650_KScale_t k_scale)
@@ -92,96 +120,301 @@ static uint8_t get_scale(MAX6650_KScale_t k_scale)
     return res;
 }
 
+/**
+ * @brief Tachometer count (pulses per gate) to revolutions per minute, multiplied first so no
+ *        fraction is lost
+ */
+static uint16_t tach_to_rpm(uint8_t tach)
+{
+    return (uint16_t)((uint32_t)tach * 60 * 1000 / (TACH_PULSES * GATE_MS));
+}
+
+/**
+ * @brief Speed register value for a speed
+ * @retval false if KTACH can't encode the speed: below about a third of rpm_max it would be
+ *         over 255
+ */
+static bool speed_to_ktach(uint8_t speed, uint8_t *ktach)
+{
+    uint16_t rps = config->rpm_max / 100 * speed / 60;
+    uint32_t value;
+
+    if(rps == 0)
+    {
+        return false;
+    }
+
+    value = 992U * get_scale(config->k_scale) / rps;
+    if((value == 0) || (value - 1 > UINT8_MAX))
+    {
+        return false;
+    }
+
+    *ktach = (uint8_t)(value - 1);
+    return true;
+}
+
+/**
+ * @brief Read a register, from the cache if the value is from the current gate and young enough
+ */
+static bool read_reg(uint8_t reg, uint8_t *value, uint32_t max_age_ms, MAX6650_ReadInfo_t *info)
+{
+    Cache_Entry_t *entry = &cache[CACHE_INDEX(reg)];
+    uint32_t now = 0;
+    uint32_t epoch = 0;
+    bool res;
+
+    if(i2c_ext_if->get_tick_ms != NULL)
+    {
+        now = i2c_ext_if->get_tick_ms();
+        epoch = (now - gate_origin_ms) / GATE_MS;
+
+        /* An entry of the current gate is younger than a gate, which also rules out tick wrap-around */
+        if(entry->valid && (entry->epoch == epoch) && (now - entry->time_ms < GATE_MS) &&
+           (now - entry->time_ms <= max_age_ms))
+        {
+            *value = entry->value;
+            if(info != NULL)
+            {
+                info->cached = true;
+                info->age_ms = now - entry->time_ms;
+            }
+            return true;
+        }
+    }
+
+    res = i2c_ext_if->i2c_read(i2c_address, reg, value, 1);
+    if(res == true)
+    {
+        entry->valid = (i2c_ext_if->get_tick_ms != NULL);
+        entry->value = *value;
+        entry->epoch = epoch;
+        entry->time_ms = now;
+    }
+
+    if(info != NULL)
+    {
+        info->cached = false;
+        info->age_ms = 0;
+    }
+
+    return res;
+}
+
+
+/**
+ * @brief Write a register and keep its cached value
+ */
+static bool write_reg(uint8_t reg, uint8_t value)
+{
+    Cache_Entry_t *entry = &cache[CACHE_INDEX(reg)];
+    bool res;
+
+    res = i2c_ext_if->i2c_write(i2c_address, reg, &value, 1);
+
+    /* After a failure the chip may hold either value */
+    entry->valid = (res == true) && (i2c_ext_if->get_tick_ms != NULL);
+    if(entry->valid)
+    {
+        entry->value = value;
+        entry->time_ms = i2c_ext_if->get_tick_ms();
+        entry->epoch = (entry->time_ms - gate_origin_ms) / GATE_MS;
+    }
+
+    return res;
+}
+
+
+/**
+ * @brief Write the configuration register with an operating mode
+ */
+static bool write_config(MAX6650_OperatingMode_t mode)
+{
+    uint8_t config_byte = (mode&0x03)<<4 | (config->fan_lovtage&0x01)<<3 | (config->k_scale&0x07);
+
+    return write_reg(MAX6650_CONFIG_REG, config_byte);
+}
+
+
 bool MAX6650_Init(MAX6650_Config_t *max6650_config, const struct MAX6650_I2C_ExtInterface *ext_i2c_interface)
 {
     bool res;
-    uint8_t config_byte;
+    uint8_t ktach;
     i2c_ext_if = ext_i2c_interface;
     config = max6650_config;
 
     if(i2c_ext_if == NULL)
     {
-        printf("MAX6650: External I2C interface is not initialized!\r\n");
+        DLOG("MAX6650: External I2C interface is not initialized!\r\n");
         return false;
     }
 
     if(config == NULL)
     {
-        printf("MAX6650: no configuration available!\r\n");
+        DLOG("MAX6650: no configuration available!\r\n");
         return false;
     }
 
     switch(config->add_line_connection)
     {
         case ADD_Line_GND:
-            i2c_address = I2C_ADDRESS_GND;
+            i2c_address = MAX6650_I2C_ADDRESS_GND;
             break;
         case ADD_Line_Vcc:
-            i2c_address = I2C_ADDRESS_VCC;
+            i2c_address = MAX6650_I2C_ADDRESS_VCC;
             break;
         case ADD_Line_NotConnected:
-            i2c_address = I2C_ADDRESS_NOT_CONNECTED;
+            i2c_address = MAX6650_I2C_ADDRESS_NOT_CONNECTED;
             break;
         case ADD_Line_Res10K:
-            i2c_address = I2C_ADDRESS_RES10K;
+            i2c_address = MAX6650_I2C_ADDRESS_RES10K;
             break;
         default:
-            printf("MAX6650: I2C address configuration failed!\r\n");
+            DLOG("MAX6650: I2C address configuration failed!\r\n");
             return false;
     }
 
-    config_byte = (config->operating_mode&0x03)<<4 | (config->fan_lovtage&0x01)<<3 | (config->k_scale&0x07);
+    memset(cache, 0, sizeof(cache));
 
-    res = i2c_ext_if->i2c_write(i2c_address, MAX6650_CONFIG_REG, &config_byte, 1);
+    /* KTACH falls with the speed, the lowest one is where it first fits into 8 bits */
+    for(speed_min = 1; speed_min < 100; speed_min++)
+    {
+        if(speed_to_ktach(speed_min, &ktach) == true)
+        {
+            break;
+        }
+    }
+
+    res = write_config(config->operating_mode);
+    fan_off = false;
 
     if(res == true)
     {
-        config_byte = COUNTT;
-        res = i2c_ext_if->i2c_write(i2c_address, MAX6650_COUNT_REG, &config_byte, 1);
+        res = write_reg(MAX6650_COUNT_REG, COUNTT);
+        gate_origin_ms = (i2c_ext_if->get_tick_ms != NULL) ? i2c_ext_if->get_tick_ms() : 0;
+        cache[CACHE_INDEX(MAX6650_COUNT_REG)].epoch = 0;
     }
 
     return res;
 }
 
 
-bool MAX6650_GetSpeed(uint8_t *speed)
+bool MAX6650_GetSpeed(uint8_t *speed, uint32_t max_age_ms, MAX6650_ReadInfo_t *info)
 {
-    uint8_t rps;
+    uint8_t tach;
     bool res;
 
-    res = i2c_ext_if->i2c_read(i2c_address, MAX6650_TACHO_0_REG, &rps, 1);
+    if((i2c_ext_if == NULL) || (config == NULL))
+    {
+        return false;
+    }
+
+    res = read_reg(MAX6650_TACHO_0_REG, &tach, max_age_ms, info);
 
     if(res == true)
     {
-        rps = ((rps /2)/COUNTT);
-        *speed =  (uint32_t)rps * 60 * 100 / config->rpm_max;
+        *speed = (uint32_t)tach_to_rpm(tach) * 100 / config->rpm_max;
+    }
+
+   return res;
+}
+
+
+bool MAX6650_GetRPM(uint16_t *rpm, uint32_t max_age_ms, MAX6650_ReadInfo_t *info)
+{
+    uint8_t tach;
+    bool res;
+
+    if((i2c_ext_if == NULL) || (config == NULL))
+    {
+        return false;
+    }
+
+    res = read_reg(MAX6650_TACHO_0_REG, &tach, max_age_ms, info);
+
+    if(res == true)
+    {
+        *rpm = tach_to_rpm(tach);
+    }
+
+    return res;
+}
+
+
+bool MAX6650_GetKTach(uint8_t *ktach, uint32_t max_age_ms, MAX6650_ReadInfo_t *info)
+{
+    if((i2c_ext_if == NULL) || (config == NULL))
+    {
+        return false;
+    }
+
+    return read_reg(MAX6650_SPEED_REG, ktach, max_age_ms, info);
+}
+
+
+bool MAX6650_GetAlarm(uint8_t *alarm)
+{
+    if((i2c_ext_if == NULL) || (config == NULL))
+    {
+        return false;
     }
 
-   return true;
+    return i2c_ext_if->i2c_read(i2c_address, MAX6650_ALARM_REG, alarm, 1);
+}
+
+
+uint8_t MAX6650_GetTargetSpeed(void)
+{
+    return speed_target;
+}
+
+
+uint8_t MAX6650_GetMinSpeed(void)
+{
+    return speed_min;
 }
 
 
 bool MAX6650_SetSpeed(uint8_t speed_set, uint8_t *speed_actual)
 {
     uint8_t ktach;
-    uint16_t rpm;
     bool res;
 
+    if((i2c_ext_if == NULL) || (config == NULL))
+    {
+        return false;
+    }
+
     if(speed_set > 100)
     {
-        printf("MAX6650: Warning, speed should be in range: 0..100%%\r\n");
+        DLOG("MAX6650: Warning, speed should be in range: 0..100%%\r\n");
         speed_set = 100;
     }
 
-    rpm = config->rpm_max/100 * speed_set;
-
-    ktach=(((992 * get_scale(config->k_scale)) / (rpm/60) ) - 1);
-
-    res = i2c_ext_if->i2c_write(i2c_address, MAX6650_SPEED_REG, &ktach, 1);
+    if(speed_set == 0)
+    {
+        /* KTACH can't encode a stopped fan */
+        res = write_config(OperatingMode_Software_Off);
+    }
+    else if(speed_to_ktach(speed_set, &ktach) != true)
+    {
+        DLOG("MAX6650: %u%% can't be regulated, the lowest speed is %u%%\r\n", speed_set, speed_min);
+        return false;
+    }
+    else
+    {
+        res = write_reg(MAX6650_SPEED_REG, ktach);
+        if((res == true) && (fan_off == true))
+        {
+            res = write_config(config->operating_mode);
+        }
+    }
 
     if(res == true)
     {
-        res = MAX6650_GetSpeed(speed_actual);
+        fan_off = (speed_set == 0);
+        speed_target = speed_set;
+        res = MAX6650_GetSpeed(speed_actual, MAX6650_MAX_AGE_FRESH, NULL);
     }
 
     return res;
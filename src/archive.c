@@ -0,0 +1,644 @@
+/*
+ Log-structured telemetry archive in internal flash.
+
+ The region reserved by the linker script (_sarchive.._earchive) is used as a
+ ring of pages. A page starts with a one double-word header (magic, sequence
+ number, time of the first sample) followed by blocks appended one after
+ another. A block is a 16-byte header (magic, payload length, sample count,
+ CRC-16, time of the first and the last sample) and the Gorilla-compressed
+ samples. Samples are collected in RAM and the block is written when the
+ payload is full or ARCHIVE_BLOCK_MAX_SAMPLES are collected. When the ring is
+ full the oldest page is erased.
+
+ Page headers are ordered by time, so a range query finds the first page with
+ a binary search over the headers and skips blocks by their time range
+ without decompressing them.
+
+ Power loss recovery: the boot scan reads all page headers and walks the block
+ headers of the newest page only. A block interrupted while being written has
+ a valid length but a wrong CRC, it's skipped and appending continues after
+ it; a page interrupted while being erased has no valid header and is erased
+ again before use. A double-word torn by the reset may fail its ECC check:
+ the read raises an NMI, flash_api.c records it, and the data read is taken
+ as garbage: a page header as no header, a block header as the end of the
+ page, a payload as a torn block.
+
+ The region is at the top of the physical bank 2 and stays there after a bank
+ swap (see update.c), the firmware image is limited to fit below it.
+*/
+
+#include <string.h>
+
+#include "stm32l4xx_hal.h"
+#include "archive.h"
+#include "gorilla.h"
+#include "flash_api.h"
+#include "crc.h"
+#include "cycle_counter.h"
+#include "max6650.h"
+#include "thermal.h"
+
+#define ARCHIVE_PAGE_MAGIC          0xA4C1
+#define ARCHIVE_BLOCK_MAGIC         0xB10C
+
+/* Compressed samples of a block, a steady fan takes less than a byte per sample */
+#define ARCHIVE_BLOCK_PAYLOAD       240
+/* Samples kept in RAM at most, bounds the loss on power failure */
+#define ARCHIVE_BLOCK_MAX_SAMPLES   60
+
+#define ARCHIVE_ALIGN(len)          (((len) + 7) & ~7U)
+
+
+/**
+ * @brief Page header, programmed as a single double-word
+ */
+typedef struct
+{
+    uint16_t magic;
+    uint16_t seq;
+    uint32_t t_first;
+} Archive_PageHeader_t;
+
+/**
+ * @brief Block header
+ */
+typedef struct
+{
+    uint16_t magic;
+    uint16_t length;                /* payload bytes */
+    uint16_t count;                 /* samples */
+    uint16_t crc;                   /* CRC-16 of t_first, t_last and the payload */
+    uint32_t t_first;
+    uint32_t t_last;
+} Archive_BlockHeader_t;
+
+/* Region boundaries from the linker script */
+extern uint32_t _sarchive;
+extern uint32_t _earchive;
+
+static const Archive_Config_t *config = NULL;
+
+static uint32_t base;
+static uint16_t pages_total;
+static uint16_t oldest;             /* index of the oldest page */
+static uint16_t pages_used;
+static uint16_t next_seq;
+static uint32_t write_addr;         /* 0 if there is no page open for appending */
+static uint32_t write_end;
+
+static uint32_t time_seconds;
+static uint32_t time_ms;
+static uint32_t last_tick;
+static uint32_t next_sample_tick;
+
+static uint8_t payload[ARCHIVE_BLOCK_PAYLOAD];
+static Gorilla_State_t encoder;
+static uint32_t block_t_first;
+static uint32_t block_t_last;
+/* Block as programmed: header and padded payload */
+static uint64_t block_buffer[(sizeof(Archive_BlockHeader_t) + ARCHIVE_BLOCK_PAYLOAD + 7) / 8];
+
+static uint32_t write_errors;
+static uint32_t read_errors;
+static uint32_t recovery_us;
+
+
+/**
+ * @brief CRC of the sample times and the payload, they follow each other
+ */
+static uint16_t block_crc(const Archive_BlockHeader_t *header, uint16_t length)
+{
+    return Crc_Compute(Crc_Type_CCITT16, &header->t_first, 2 * sizeof(uint32_t) + length);
+}
+
+
+static uint32_t page_addr(uint16_t page)
+{
+    return base + (uint32_t)page * FLASH_PAGE_SIZE;
+}
+
+
+static const Archive_PageHeader_t* page_header(uint16_t page)
+{
+    return (const Archive_PageHeader_t *)page_addr(page);
+}
+
+
+/**
+ * @brief Check the reads since the last call for double ECC errors
+ * @retval true if the data read is garbage
+ */
+static bool read_failed(void)
+{
+    bool res = FlashAPI_ReadFailed(NULL);
+
+    if(res)
+    {
+        read_errors++;
+    }
+    return res;
+}
+
+
+/**
+ * @brief The header is a single double-word, seq and t_first are valid with the magic
+ */
+static bool page_valid(uint16_t page)
+{
+    bool res;
+
+    FlashAPI_ReadFailed(NULL);
+    res = (page_header(page)->magic == ARCHIVE_PAGE_MAGIC);
+
+    return (read_failed() != true) && res;
+}
+
+
+/**
+ * @brief Physical page of the logical index, 0 is the oldest page
+ */
+static uint16_t logical_page(uint16_t index)
+{
+    return (oldest + index) % pages_total;
+}
+
+
+/**
+ * @brief Read the magic and the length of a block header, they are in its first double-word
+ * @retval false if the read failed, the magic is then set to no block
+ */
+static bool block_header_read(const Archive_BlockHeader_t *header, uint16_t *magic, uint16_t *length)
+{
+    FlashAPI_ReadFailed(NULL);
+    *magic = header->magic;
+    *length = header->length;
+
+    if(read_failed())
+    {
+        *magic = 0;
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Check the CRC of a block whose magic and length were read, a failed read makes it torn
+ */
+static bool block_valid(const Archive_BlockHeader_t *header, uint32_t end)
+{
+    bool res;
+
+    if((header->magic != ARCHIVE_BLOCK_MAGIC) || (header->length > ARCHIVE_BLOCK_PAYLOAD) ||
+       ((uint32_t)header + sizeof(Archive_BlockHeader_t) + ARCHIVE_ALIGN(header->length) > end))
+    {
+        return false;
+    }
+
+    res = (block_crc(header, header->length) == header->crc);
+
+    return (read_failed() != true) && res;
+}
+
+
+static bool program(uint32_t addr, const void *data, uint32_t len)
+{
+    bool res = FlashAPI_Program(addr, data, len);
+
+    if(res != true)
+    {
+        write_errors++;
+    }
+    return res;
+}
+
+
+static bool erase(uint16_t page)
+{
+    bool res = FlashAPI_Erase(page_addr(page), 1);
+
+    if(res != true)
+    {
+        write_errors++;
+    }
+    return res;
+}
+
+
+static bool page_erased(uint16_t page)
+{
+    const uint32_t *word = (const uint32_t *)page_addr(page);
+
+    FlashAPI_ReadFailed(NULL);
+    for(uint32_t i = 0; i < FLASH_PAGE_SIZE / sizeof(uint32_t); i++)
+    {
+        if(word[i] != 0xFFFFFFFF)
+        {
+            read_failed();
+            return false;
+        }
+    }
+
+    /* A torn erase may read as erased */
+    return read_failed() != true;
+}
+
+
+/**
+ * @brief Start the next page of the ring, the oldest page is reclaimed if the ring is full
+ */
+static bool open_page(uint32_t t_first)
+{
+    Archive_PageHeader_t header;
+    uint16_t page = logical_page(pages_used);
+
+    write_addr = 0;
+
+    if(pages_used == pages_total)
+    {
+        oldest = (oldest + 1) % pages_total;
+        pages_used--;
+    }
+
+    if((page_erased(page) != true) && (erase(page) != true))
+    {
+        return false;
+    }
+
+    header.magic = ARCHIVE_PAGE_MAGIC;
+    header.seq = next_seq;
+    header.t_first = t_first;
+
+    if(program(page_addr(page), &header, sizeof(header)) != true)
+    {
+        return false;
+    }
+
+    next_seq++;
+    pages_used++;
+    write_addr = page_addr(page) + sizeof(header);
+    write_end = page_addr(page) + FLASH_PAGE_SIZE;
+
+    return true;
+}
+
+
+static void flush_block(void)
+{
+    Archive_BlockHeader_t *header = (Archive_BlockHeader_t *)block_buffer;
+    uint16_t length = Gorilla_GetLength(&encoder);
+    uint32_t size = sizeof(Archive_BlockHeader_t) + ARCHIVE_ALIGN(length);
+
+    if(encoder.count == 0)
+    {
+        return;
+    }
+
+    if(((write_addr == 0) || (write_addr + size > write_end)) && (open_page(block_t_first) != true))
+    {
+        /* The block is lost, retry with a new page next time */
+        Gorilla_EncoderInit(&encoder, payload, sizeof(payload));
+        return;
+    }
+
+    memset(block_buffer, 0, sizeof(block_buffer));
+    header->magic = ARCHIVE_BLOCK_MAGIC;
+    header->length = length;
+    header->count = encoder.count;
+    header->t_first = block_t_first;
+    header->t_last = block_t_last;
+    memcpy(header + 1, payload, length);
+    header->crc = block_crc(header, length);
+
+    if(program(write_addr, block_buffer, size) == true)
+    {
+        write_addr += size;
+    }
+    else
+    {
+        write_addr = 0;
+    }
+
+    Gorilla_EncoderInit(&encoder, payload, sizeof(payload));
+}
+
+
+/**
+ * @brief Find the append position in the newest page
+ * @retval time of the last sample stored in the page
+ */
+static uint32_t recover_page(uint16_t page)
+{
+    const Archive_BlockHeader_t *header;
+    uint32_t end = page_addr(page) + FLASH_PAGE_SIZE;
+    uint32_t pos = page_addr(page) + sizeof(Archive_PageHeader_t);
+    uint32_t last_time = page_header(page)->t_first;
+    uint16_t magic;
+    uint16_t length;
+
+    while(pos + sizeof(Archive_BlockHeader_t) <= end)
+    {
+        header = (const Archive_BlockHeader_t *)pos;
+
+        if(block_header_read(header, &magic, &length) && (magic == 0xFFFF))
+        {
+            break;
+        }
+
+        if((magic != ARCHIVE_BLOCK_MAGIC) || (length > ARCHIVE_BLOCK_PAYLOAD))
+        {
+            /* Nothing can be appended after garbage */
+            pos = end;
+            break;
+        }
+
+        /* A torn block has a valid length, the space is skipped */
+        if(block_valid(header, end))
+        {
+            last_time = header->t_last;
+        }
+        pos += sizeof(Archive_BlockHeader_t) + ARCHIVE_ALIGN(header->length);
+    }
+
+    if(pos + sizeof(Archive_BlockHeader_t) < end)
+    {
+        write_addr = pos;
+        write_end = end;
+    }
+
+    return last_time;
+}
+
+
+bool Archive_Init(const Archive_Config_t *archive_config)
+{
+    uint32_t start = CycleCounter_Get();
+    uint16_t newest = 0;
+    bool found = false;
+    uint16_t next;
+    uint16_t prev;
+
+    config = archive_config;
+    if(config == NULL)
+    {
+        return false;
+    }
+
+    /* The region is in the physical bank 2, which is mapped at FLASH_BASE after a bank swap */
+    base = (uint32_t)&_sarchive;
+    if(FlashAPI_IsBankSwapped() == true)
+    {
+        base -= FLASH_BANK_SIZE;
+    }
+    pages_total = ((uint32_t)&_earchive - (uint32_t)&_sarchive) / FLASH_PAGE_SIZE;
+    oldest = 0;
+    pages_used = 0;
+    next_seq = 0;
+    write_addr = 0;
+    time_seconds = 0;
+
+    /* The newest page is not followed by its successor in the ring */
+    for(uint16_t page = 0; page < pages_total; page++)
+    {
+        next = (page + 1) % pages_total;
+        if(page_valid(page) && (!page_valid(next) || (page_header(next)->seq != (uint16_t)(page_header(page)->seq + 1))))
+        {
+            if(!found || ((int16_t)(page_header(page)->seq - page_header(newest)->seq) > 0))
+            {
+                newest = page;
+                found = true;
+            }
+        }
+    }
+
+    if(found)
+    {
+        oldest = newest;
+        pages_used = 1;
+        while(pages_used < pages_total)
+        {
+            prev = (oldest + pages_total - 1) % pages_total;
+            if(!page_valid(prev) || (page_header(prev)->seq != (uint16_t)(page_header(oldest)->seq - 1)))
+            {
+                break;
+            }
+            oldest = prev;
+            pages_used++;
+        }
+
+        next_seq = page_header(newest)->seq + 1;
+        /* Archive time continues after the last sample */
+        time_seconds = recover_page(newest) + 1;
+    }
+
+    time_ms = 0;
+    last_tick = HAL_GetTick();
+    next_sample_tick = last_tick;
+    Gorilla_EncoderInit(&encoder, payload, sizeof(payload));
+
+    recovery_us = CYCLES_TO_US(CycleCounter_Get() - start);
+
+    return true;
+}
+
+
+uint32_t Archive_GetTime(void)
+{
+    uint32_t tick = HAL_GetTick();
+
+    /* Accumulated, so the time doesn't jump back when the tick counter wraps */
+    time_ms += tick - last_tick;
+    last_tick = tick;
+    time_seconds += time_ms / 1000;
+    time_ms %= 1000;
+
+    return time_seconds;
+}
+
+
+void Archive_Process(void)
+{
+    Thermal_Status_t thermal_status;
+    uint32_t values[GORILLA_CHANNELS];
+    uint32_t time;
+    uint16_t rpm = 0;
+
+    if(config == NULL)
+    {
+        return;
+    }
+
+    if((int32_t)(HAL_GetTick() - next_sample_tick) < 0)
+    {
+        return;
+    }
+    next_sample_tick += config->period_s * 1000;
+
+    time = Archive_GetTime();
+    MAX6650_GetRPM(&rpm, MAX6650_MAX_AGE_FRESH, NULL);
+    Thermal_GetStatus(&thermal_status);
+
+    values[0] = rpm;
+    values[1] = MAX6650_GetTargetSpeed();
+    values[2] = (uint32_t)(int32_t)(thermal_status.valid ? thermal_status.temperature : ARCHIVE_NO_TEMPERATURE);
+
+    if(Gorilla_Encode(&encoder, time, values) != true)
+    {
+        flush_block();
+        Gorilla_Encode(&encoder, time, values);
+    }
+
+    if(encoder.count == 1)
+    {
+        block_t_first = time;
+    }
+    block_t_last = time;
+
+    if(encoder.count >= ARCHIVE_BLOCK_MAX_SAMPLES)
+    {
+        flush_block();
+    }
+}
+
+
+static uint32_t decode_block(const uint8_t *data, uint16_t length, uint16_t count,
+                             uint32_t from, uint32_t to, Archive_Callback_t callback)
+{
+    Gorilla_State_t decoder;
+    Archive_Sample_t sample;
+    uint32_t values[GORILLA_CHANNELS];
+    uint32_t samples = 0;
+
+    Gorilla_DecoderInit(&decoder, data, length);
+
+    for(uint16_t i = 0; i < count; i++)
+    {
+        if(Gorilla_Decode(&decoder, &sample.time, values) != true)
+        {
+            break;
+        }
+
+        if((sample.time < from) || (sample.time > to))
+        {
+            continue;
+        }
+
+        sample.rpm = values[0];
+        sample.speed = values[1];
+        sample.temperature = (int16_t)values[2];
+        callback(&sample);
+        samples++;
+    }
+
+    return samples;
+}
+
+
+void Archive_Query(uint32_t from, uint32_t to, Archive_Callback_t callback, Archive_QueryResult_t *result)
+{
+    Archive_QueryResult_t query;
+    const Archive_BlockHeader_t *header;
+    uint16_t lo = 0;
+    uint16_t hi = pages_used;
+    uint16_t mid;
+    uint16_t page;
+    uint32_t pos;
+    uint32_t end;
+    uint16_t magic;
+    uint16_t length;
+
+    memset(&query, 0, sizeof(query));
+
+    /* The last page starting not later than "from" */
+    while(lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if(page_header(logical_page(mid))->t_first <= from)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    for(uint16_t i = (lo != 0) ? lo - 1 : 0; i < pages_used; i++)
+    {
+        page = logical_page(i);
+        if(page_header(page)->t_first > to)
+        {
+            goto done;
+        }
+        query.pages_visited++;
+
+        pos = page_addr(page) + sizeof(Archive_PageHeader_t);
+        end = page_addr(page) + FLASH_PAGE_SIZE;
+
+        while(pos + sizeof(Archive_BlockHeader_t) <= end)
+        {
+            header = (const Archive_BlockHeader_t *)pos;
+
+            if((block_header_read(header, &magic, &length) != true) ||
+               (magic != ARCHIVE_BLOCK_MAGIC) || (length > ARCHIVE_BLOCK_PAYLOAD))
+            {
+                break;
+            }
+            pos += sizeof(Archive_BlockHeader_t) + ARCHIVE_ALIGN(header->length);
+
+            if(block_valid(header, end) != true)
+            {
+                continue;
+            }
+
+            if(header->t_first > to)
+            {
+                goto done;
+            }
+
+            if(header->t_last < from)
+            {
+                query.blocks_skipped++;
+                continue;
+            }
+
+            query.blocks_decoded++;
+            query.samples += decode_block((const uint8_t *)(header + 1), header->length, header->count, from, to, callback);
+        }
+    }
+
+    /* Samples not written to flash yet */
+    if((encoder.count != 0) && (block_t_last >= from) && (block_t_first <= to))
+    {
+        query.blocks_decoded++;
+        query.samples += decode_block(payload, Gorilla_GetLength(&encoder), encoder.count, from, to, callback);
+    }
+
+done:
+    if(result != NULL)
+    {
+        *result = query;
+    }
+}
+
+
+void Archive_GetStatus(Archive_Status_t *status)
+{
+    status->pages_total = pages_total;
+    status->pages_used = pages_used;
+    status->now = Archive_GetTime();
+
+    if(pages_used != 0)
+    {
+        status->oldest_time = page_header(oldest)->t_first;
+    }
+    else
+    {
+        status->oldest_time = encoder.count ? block_t_first : status->now;
+    }
+
+    status->pending_samples = encoder.count;
+    status->write_errors = write_errors;
+    status->read_errors = read_errors;
+    status->recovery_us = recovery_us;
+}
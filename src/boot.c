@@ -0,0 +1,52 @@
+#include "boot.h"
+#include "cycle_counter.h"
+
+static const char* phase_names[Boot_Phase_Count] =
+{
+    "Startup",
+    "HAL init",
+    "Clock",
+    "Peripherals",
+    "Devices",
+    "Console",
+    "Deferred init"
+};
+
+static uint32_t marks_us[Boot_Phase_Count];
+static uint32_t marked;
+
+static uint32_t elapsed_us;
+/* The counter starts from 0 in SystemInit() */
+static uint32_t last_cycles = 0;
+static uint32_t last_clock_mhz = BOOT_RESET_CLOCK_MHZ;
+
+
+void Boot_Mark(Boot_Phase_t phase)
+{
+    uint32_t now = CycleCounter_Get();
+
+    elapsed_us += (now - last_cycles) / last_clock_mhz;
+    last_cycles = now;
+    last_clock_mhz = SystemCoreClock / 1000000U;
+
+    marks_us[phase] = elapsed_us;
+    marked |= 1U << phase;
+}
+
+
+bool Boot_GetTime(Boot_Phase_t phase, uint32_t *time_us)
+{
+    if((marked & (1U << phase)) == 0)
+    {
+        return false;
+    }
+
+    *time_us = marks_us[phase];
+    return true;
+}
+
+
+const char* Boot_GetPhaseName(Boot_Phase_t phase)
+{
+    return phase < Boot_Phase_Count ? phase_names[phase] : "";
+}
@@ -0,0 +1,135 @@
+#include "stm32l4xx_hal.h"
+#include "crc.h"
+
+#define CCITT16_POLY                0x1021
+#define CCITT16_INIT                0xFFFF
+#define CRC32_POLY                  0x04C11DB7
+#define CRC32_POLY_REFLECTED        0xEDB88320
+#define CRC32_INIT                  0xFFFFFFFF
+
+static uint16_t table_ccitt16[256];
+static uint32_t table_crc32[256];
+
+
+static void build_tables(void)
+{
+    uint16_t crc16;
+    uint32_t crc32;
+
+    for(uint32_t i = 0; i < 256; i++)
+    {
+        crc16 = i << 8;
+        crc32 = i;
+        for(uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc16 = (crc16 & 0x8000) ? (crc16 << 1) ^ CCITT16_POLY : crc16 << 1;
+            crc32 = (crc32 & 1) ? (crc32 >> 1) ^ CRC32_POLY_REFLECTED : crc32 >> 1;
+        }
+        table_ccitt16[i] = crc16;
+        table_crc32[i] = crc32;
+    }
+}
+
+
+static uint32_t update_software(Crc_Type_t type, uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    if(type == Crc_Type_CCITT16)
+    {
+        while(len--)
+        {
+            crc = (crc << 8) ^ table_ccitt16[((crc >> 8) ^ *data++) & 0xFF];
+        }
+        return crc & 0xFFFF;
+    }
+
+    while(len--)
+    {
+        crc = (crc >> 8) ^ table_crc32[(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+
+/**
+ * @brief Bytes go to the unit in memory order: 32-bit writes are byte-swapped, the unit
+ *        takes the most significant byte first. Reflected input reverses bits in every byte
+ */
+static uint32_t update_hardware(Crc_Type_t type, uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    if(type == Crc_Type_CCITT16)
+    {
+        CRC->POL = CCITT16_POLY;
+        CRC->INIT = crc;
+        CRC->CR = CRC_CR_POLYSIZE_0 | CRC_CR_RESET;
+    }
+    else
+    {
+        /* The reflected output is read back, the unit continues from the state before reflection */
+        CRC->POL = CRC32_POLY;
+        CRC->INIT = __RBIT(crc);
+        CRC->CR = CRC_CR_REV_IN_0 | CRC_CR_REV_OUT | CRC_CR_RESET;
+    }
+
+    while((len != 0) && (((uintptr_t)data & 3) != 0))
+    {
+        *(__IO uint8_t *)&CRC->DR = *data++;
+        len--;
+    }
+
+    for(; len >= 4; len -= 4, data += 4)
+    {
+        CRC->DR = __REV(*(const uint32_t *)data);
+    }
+
+    while(len--)
+    {
+        *(__IO uint8_t *)&CRC->DR = *data++;
+    }
+
+    return CRC->DR;
+}
+
+
+void Crc_Init(void)
+{
+    __HAL_RCC_CRC_CLK_ENABLE();
+    build_tables();
+}
+
+
+void Crc_Start(Crc_Context_t *ctx, Crc_Type_t type, Crc_Backend_t backend)
+{
+    ctx->type = type;
+    ctx->backend = backend;
+    ctx->value = (type == Crc_Type_CCITT16) ? CCITT16_INIT : CRC32_INIT;
+}
+
+
+void Crc_Update(Crc_Context_t *ctx, const void *data, uint32_t len)
+{
+    if(ctx->backend == Crc_Backend_Hardware)
+    {
+        ctx->value = update_hardware(ctx->type, ctx->value, data, len);
+    }
+    else
+    {
+        ctx->value = update_software(ctx->type, ctx->value, data, len);
+    }
+}
+
+
+uint32_t Crc_Finish(const Crc_Context_t *ctx)
+{
+    return (ctx->type == Crc_Type_CCITT16) ? ctx->value : ~ctx->value;
+}
+
+
+uint32_t Crc_Compute(Crc_Type_t type, const void *data, uint32_t len)
+{
+    Crc_Context_t ctx;
+
+    Crc_Start(&ctx, type, CRC_COMPUTE_BACKEND);
+    Crc_Update(&ctx, data, len);
+
+    return Crc_Finish(&ctx);
+}
@@ -0,0 +1,132 @@
+#include <stdarg.h>
+
+#include "stm32l4xx_hal.h"
+#include "dlog.h"
+#include "uart_api.h"
+#include "usart_ll.h"
+#include "cycle_counter.h"
+
+/* Ring size in words, power of 2 */
+#define DLOG_RING_WORDS         256
+#define DLOG_RING_MASK          (DLOG_RING_WORDS - 1)
+/* Words sent per frame, the count field is a single byte */
+#define DLOG_FRAME_MAX_WORDS    64
+
+static DLog_Stats_t stats;
+
+#if DLOG_ENABLED
+
+static uint32_t ring[DLOG_RING_WORDS];
+static volatile uint32_t head;          /* written by DLog_Write */
+static volatile uint32_t tail;          /* written by DLog_Flush */
+
+
+void DLog_Write(uint32_t header, ...)
+{
+    uint32_t start = CycleCounter_Get();
+    uint32_t nargs = (header >> 16) & 0x0F;
+    uint32_t words = nargs + 2;
+    uint32_t primask;
+    uint32_t pos;
+    uint32_t cycles;
+    va_list args;
+
+    /* Log sites may be called from interrupts, reserve the space atomically */
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    if((DLOG_RING_WORDS - (head - tail)) < words)
+    {
+        stats.dropped++;
+        __set_PRIMASK(primask);
+        return;
+    }
+
+    pos = head;
+    head = pos + words;
+
+    ring[pos++ & DLOG_RING_MASK] = header;
+    ring[pos++ & DLOG_RING_MASK] = HAL_GetTick();
+
+    va_start(args, header);
+    while(nargs--)
+    {
+        ring[pos++ & DLOG_RING_MASK] = va_arg(args, uint32_t);
+    }
+    va_end(args);
+
+    stats.records++;
+    cycles = CycleCounter_Get() - start;
+    stats.cycles_total += cycles;
+    if(cycles > stats.cycles_max)
+    {
+        stats.cycles_max = cycles;
+    }
+
+    __set_PRIMASK(primask);
+}
+
+
+void DLog_Flush(void)
+{
+    uint32_t words;
+    uint32_t pos;
+    uint32_t word;
+    uint8_t frame_header[3] = {DLOG_SYNC0, DLOG_SYNC1, 0};
+
+    if(tail == head)
+    {
+        return;
+    }
+
+    /* Keep the order with text already written by printf */
+    UartAPI_FlushReply();
+
+    while(tail != head)
+    {
+        words = head - tail;
+        if(words > DLOG_FRAME_MAX_WORDS)
+        {
+            words = DLOG_FRAME_MAX_WORDS;
+        }
+
+        /* Frames may split records, the decoder reassembles the word stream */
+        frame_header[2] = (uint8_t)words;
+        UsartLL_Write(USART1, frame_header, sizeof(frame_header));
+
+        pos = tail;
+        for(uint32_t i = 0; i < words; i++)
+        {
+            word = ring[pos++ & DLOG_RING_MASK];
+            UsartLL_Write(USART1, (const uint8_t *)&word, sizeof(word));
+        }
+
+        tail = pos;
+    }
+}
+
+
+bool DLog_IsHalfFull(void)
+{
+    return (head - tail) > (DLOG_RING_WORDS / 2);
+}
+
+#else
+
+void DLog_Flush(void)
+{
+}
+
+
+bool DLog_IsHalfFull(void)
+{
+    return false;
+}
+
+#endif /* DLOG_ENABLED */
+
+
+void DLog_GetStats(DLog_Stats_t *dlog_stats)
+{
+    *dlog_stats = stats;
+}
@@ -0,0 +1,70 @@
+#include <math.h>
+
+#include "stm32l4xx.h"
+#include "fft_q15.h"
+
+/* W(k) = cos(2*pi*k/N) - j*sin(2*pi*k/N), k = 0..N/2-1, packed like the data */
+static uint32_t twiddle[FFT_Q15_MAX_LENGTH / 2];
+
+
+/**
+ * @brief Complex multiply of packed Q15 values using dual 16-bit multiply-accumulate
+ */
+static inline uint32_t cmul_q15(uint32_t x, uint32_t w)
+{
+    /* re = xr*wr - xi*wi, im = xr*wi + xi*wr, both Q30 */
+    int32_t re = (int32_t)__SMUSD(x, w);
+    int32_t im = (int32_t)__SMUADX(x, w);
+
+    return __PKHBT((uint32_t)(re >> 15), (uint32_t)(im >> 15), 16);
+}
+
+
+void FFT_Q15_Init(void)
+{
+    float angle;
+
+    for(uint16_t k = 0; k < FFT_Q15_MAX_LENGTH / 2; k++)
+    {
+        angle = 2.0f * (float)M_PI * k / FFT_Q15_MAX_LENGTH;
+        twiddle[k] = FFT_Q15_PACK((int16_t)(cosf(angle) * 32767.0f), (int16_t)(-sinf(angle) * 32767.0f));
+    }
+}
+
+
+void FFT_Q15_Run(uint32_t *data, uint16_t length)
+{
+    uint32_t shift = __CLZ(length) + 1;
+    uint32_t tmp;
+    uint32_t a, t;
+    uint16_t half, step, i, j, k;
+
+    /* Bit-reversed reordering */
+    for(i = 1; i < length - 1; i++)
+    {
+        j = __RBIT(i) >> shift;
+        if(i < j)
+        {
+            tmp = data[i];
+            data[i] = data[j];
+            data[j] = tmp;
+        }
+    }
+
+    /* Decimation in time butterflies, halving add/sub keeps every stage in range */
+    for(half = 1; half < length; half <<= 1)
+    {
+        step = FFT_Q15_MAX_LENGTH / (half << 1);
+
+        for(i = 0; i < length; i += half << 1)
+        {
+            for(k = 0; k < half; k++)
+            {
+                a = data[i + k];
+                t = cmul_q15(data[i + k + half], twiddle[k * step]);
+                data[i + k] = __SHADD16(a, t);
+                data[i + k + half] = __SHSUB16(a, t);
+            }
+        }
+    }
+}
@@ -0,0 +1,129 @@
+#include <string.h>
+
+#include "stm32l4xx_hal.h"
+#include "flash_api.h"
+
+/* Recorded by the NMI, read by the code that was interrupted */
+static volatile bool ecc_failed;
+static volatile uint32_t ecc_addr;
+
+
+bool FlashAPI_IsBankSwapped(void)
+{
+    return READ_BIT(SYSCFG->MEMRMP, SYSCFG_MEMRMP_FB_MODE) != 0U;
+}
+
+
+bool FlashAPI_Erase(uint32_t addr, uint32_t pages)
+{
+    FLASH_EraseInitTypeDef erase_init;
+    uint32_t offset;
+    uint32_t page_error;
+    bool upper_bank;
+    bool res = true;
+
+    HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+
+    /* Page by page, the range may cross the bank boundary */
+    for(uint32_t i = 0; (i < pages) && (res == true); i++)
+    {
+        offset = addr - FLASH_BASE + i * FLASH_PAGE_SIZE;
+        upper_bank = offset >= FLASH_BANK_SIZE;
+
+        erase_init.TypeErase = FLASH_TYPEERASE_PAGES;
+        erase_init.Banks = (upper_bank != FlashAPI_IsBankSwapped()) ? FLASH_BANK_2 : FLASH_BANK_1;
+        erase_init.Page = (offset % FLASH_BANK_SIZE) / FLASH_PAGE_SIZE;
+        erase_init.NbPages = 1;
+
+        res = (HAL_FLASHEx_Erase(&erase_init, &page_error) == HAL_OK);
+    }
+
+    HAL_FLASH_Lock();
+
+    return res;
+}
+
+
+bool FlashAPI_Program(uint32_t addr, const void *data, uint32_t len)
+{
+    const uint8_t *src = data;
+    uint64_t value;
+    bool res = true;
+
+    HAL_FLASH_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+
+    for(uint32_t i = 0; (i < len) && (res == true); i += sizeof(uint64_t))
+    {
+        memcpy(&value, src + i, sizeof(uint64_t));
+        res = (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, addr + i, value) == HAL_OK);
+    }
+
+    HAL_FLASH_Lock();
+
+    return res;
+}
+
+
+bool FlashAPI_ECC_NMIHandler(void)
+{
+    uint32_t eccr = FLASH->ECCR;
+    bool upper_bank;
+
+    if((eccr & FLASH_ECCR_ECCD) == 0U)
+    {
+        return false;
+    }
+
+    /* The bank is the physical one, the address is the byte offset in it */
+    upper_bank = ((eccr & FLASH_ECCR_BK_ECC) != 0U) != FlashAPI_IsBankSwapped();
+    ecc_addr = FLASH_BASE + (upper_bank ? FLASH_BANK_SIZE : 0U) + ((eccr & FLASH_ECCR_ADDR_ECC) & ~7U);
+    ecc_failed = true;
+
+    /* The next error is recorded once the flag is cleared */
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ECCD);
+
+    return true;
+}
+
+
+bool FlashAPI_ReadFailed(uint32_t *addr)
+{
+    bool res = ecc_failed;
+
+    if(res && (addr != NULL))
+    {
+        *addr = ecc_addr;
+    }
+    ecc_failed = false;
+
+    return res;
+}
+
+
+bool FlashAPI_SetBootBank(bool bank2)
+{
+    FLASH_OBProgramInitTypeDef ob_init;
+
+    memset(&ob_init, 0, sizeof(ob_init));
+    ob_init.OptionType = OPTIONBYTE_USER;
+    ob_init.USERType = OB_USER_BFB2;
+    ob_init.USERConfig = bank2 ? OB_BFB2_ENABLE : OB_BFB2_DISABLE;
+
+    HAL_FLASH_Unlock();
+    HAL_FLASH_OB_Unlock();
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+
+    if(HAL_FLASHEx_OBProgram(&ob_init) != HAL_OK)
+    {
+        HAL_FLASH_OB_Lock();
+        HAL_FLASH_Lock();
+        return false;
+    }
+
+    /* Option bytes are loaded by a system reset */
+    HAL_FLASH_OB_Launch();
+
+    return false;
+}
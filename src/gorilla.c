@@ -0,0 +1,300 @@
+#include <string.h>
+
+#include "gorilla.h"
+
+
+static void put_bits(Gorilla_State_t *state, uint32_t value, uint8_t bits)
+{
+    while(bits--)
+    {
+        if((value >> bits) & 1)
+        {
+            state->buffer[state->bit_pos >> 3] |= 0x80 >> (state->bit_pos & 7);
+        }
+        state->bit_pos++;
+    }
+}
+
+
+static bool get_bits(Gorilla_State_t *state, uint8_t bits, uint32_t *value)
+{
+    uint32_t res = 0;
+
+    if(state->bit_pos + bits > state->size * 8)
+    {
+        return false;
+    }
+
+    while(bits--)
+    {
+        res = (res << 1) | ((state->buffer[state->bit_pos >> 3] >> (7 - (state->bit_pos & 7))) & 1);
+        state->bit_pos++;
+    }
+
+    *value = res;
+    return true;
+}
+
+
+static bool fits(int32_t value, uint8_t bits)
+{
+    return (value >= -(1 << (bits - 1))) && (value < (1 << (bits - 1)));
+}
+
+
+static int32_t sign_extend(uint32_t value, uint8_t bits)
+{
+    return (int32_t)(value << (32 - bits)) >> (32 - bits);
+}
+
+
+static void encode_timestamp(Gorilla_State_t *state, uint32_t timestamp)
+{
+    int32_t delta = (int32_t)(timestamp - state->timestamp);
+    int32_t dod = delta - state->delta;
+
+    if(dod == 0)
+    {
+        put_bits(state, 0x0, 1);
+    }
+    else if(fits(dod, 7))
+    {
+        put_bits(state, 0x2, 2);
+        put_bits(state, (uint32_t)dod & 0x7F, 7);
+    }
+    else if(fits(dod, 9))
+    {
+        put_bits(state, 0x6, 3);
+        put_bits(state, (uint32_t)dod & 0x1FF, 9);
+    }
+    else if(fits(dod, 12))
+    {
+        put_bits(state, 0xE, 4);
+        put_bits(state, (uint32_t)dod & 0xFFF, 12);
+    }
+    else
+    {
+        put_bits(state, 0xF, 4);
+        put_bits(state, (uint32_t)dod, 32);
+    }
+
+    state->timestamp = timestamp;
+    state->delta = delta;
+}
+
+
+static void encode_value(Gorilla_State_t *state, uint8_t channel, uint32_t value)
+{
+    uint32_t xor = value ^ state->values[channel];
+    uint8_t leading;
+    uint8_t trailing;
+
+    state->values[channel] = value;
+
+    if(xor == 0)
+    {
+        put_bits(state, 0x0, 1);
+        return;
+    }
+
+    leading = __builtin_clz(xor);
+    trailing = __builtin_ctz(xor);
+
+    /* The window of the previous value is reused if the meaningful bits fit into it */
+    if((state->leading[channel] + state->trailing[channel] != 0) &&
+       (leading >= state->leading[channel]) && (trailing >= state->trailing[channel]))
+    {
+        put_bits(state, 0x2, 2);
+        put_bits(state, xor >> state->trailing[channel], 32 - state->leading[channel] - state->trailing[channel]);
+        return;
+    }
+
+    put_bits(state, 0x3, 2);
+    put_bits(state, leading, 5);
+    put_bits(state, 32 - leading - trailing - 1, 5);
+    put_bits(state, xor >> trailing, 32 - leading - trailing);
+
+    state->leading[channel] = leading;
+    state->trailing[channel] = trailing;
+}
+
+
+void Gorilla_EncoderInit(Gorilla_State_t *state, uint8_t *buffer, uint16_t size)
+{
+    memset(state, 0, sizeof(Gorilla_State_t));
+    memset(buffer, 0, size);
+    state->buffer = buffer;
+    state->size = size;
+}
+
+
+bool Gorilla_Encode(Gorilla_State_t *state, uint32_t timestamp, const uint32_t *values)
+{
+    if(state->bit_pos + GORILLA_MAX_SAMPLE_BITS > state->size * 8)
+    {
+        return false;
+    }
+
+    if(state->count == 0)
+    {
+        put_bits(state, timestamp, 32);
+        state->timestamp = timestamp;
+
+        for(uint8_t i = 0; i < GORILLA_CHANNELS; i++)
+        {
+            put_bits(state, values[i], 32);
+            state->values[i] = values[i];
+        }
+    }
+    else
+    {
+        encode_timestamp(state, timestamp);
+
+        for(uint8_t i = 0; i < GORILLA_CHANNELS; i++)
+        {
+            encode_value(state, i, values[i]);
+        }
+    }
+
+    state->count++;
+    return true;
+}
+
+
+uint16_t Gorilla_GetLength(const Gorilla_State_t *state)
+{
+    return (state->bit_pos + 7) / 8;
+}
+
+
+void Gorilla_DecoderInit(Gorilla_State_t *state, const uint8_t *buffer, uint16_t length)
+{
+    memset(state, 0, sizeof(Gorilla_State_t));
+    /* The decoder never writes to the buffer */
+    state->buffer = (uint8_t *)buffer;
+    state->size = length;
+}
+
+
+static bool decode_timestamp(Gorilla_State_t *state)
+{
+    static const uint8_t dod_bits[] = {7, 9, 12, 32};
+    uint32_t bit;
+    uint32_t value;
+    uint8_t prefix = 0;
+    int32_t dod = 0;
+
+    /* Count leading '1's of the prefix, up to 4 */
+    while(prefix < 4)
+    {
+        if(!get_bits(state, 1, &bit))
+        {
+            return false;
+        }
+        if(bit == 0)
+        {
+            break;
+        }
+        prefix++;
+    }
+
+    if(prefix != 0)
+    {
+        if(!get_bits(state, dod_bits[prefix - 1], &value))
+        {
+            return false;
+        }
+        dod = sign_extend(value, dod_bits[prefix - 1]);
+    }
+
+    state->delta += dod;
+    state->timestamp += state->delta;
+    return true;
+}
+
+
+static bool decode_value(Gorilla_State_t *state, uint8_t channel)
+{
+    uint32_t control;
+    uint32_t leading;
+    uint32_t length;
+    uint32_t xor;
+
+    if(!get_bits(state, 1, &control))
+    {
+        return false;
+    }
+
+    if(control == 0)
+    {
+        return true;
+    }
+
+    if(!get_bits(state, 1, &control))
+    {
+        return false;
+    }
+
+    if(control == 1)
+    {
+        if(!get_bits(state, 5, &leading) || !get_bits(state, 5, &length))
+        {
+            return false;
+        }
+        length++;
+        state->leading[channel] = leading;
+        state->trailing[channel] = 32 - leading - length;
+    }
+
+    length = 32 - state->leading[channel] - state->trailing[channel];
+    if(!get_bits(state, length, &xor))
+    {
+        return false;
+    }
+
+    state->values[channel] ^= xor << state->trailing[channel];
+    return true;
+}
+
+
+bool Gorilla_Decode(Gorilla_State_t *state, uint32_t *timestamp, uint32_t *values)
+{
+    uint32_t value;
+
+    if(state->count == 0)
+    {
+        if(!get_bits(state, 32, &value))
+        {
+            return false;
+        }
+        state->timestamp = value;
+
+        for(uint8_t i = 0; i < GORILLA_CHANNELS; i++)
+        {
+            if(!get_bits(state, 32, &state->values[i]))
+            {
+                return false;
+            }
+        }
+    }
+    else
+    {
+        if(!decode_timestamp(state))
+        {
+            return false;
+        }
+
+        for(uint8_t i = 0; i < GORILLA_CHANNELS; i++)
+        {
+            if(!decode_value(state, i))
+            {
+                return false;
+            }
+        }
+    }
+
+    state->count++;
+    *timestamp = state->timestamp;
+    memcpy(values, state->values, sizeof(state->values));
+    return true;
+}
@@ -1,8 +1,46 @@
+#include <string.h>
+
 #include "i2c_api.h"
 #include "error.h"
+#include "cycle_counter.h"
+
+/* Maximum time a slave may stretch SCL before the peripheral aborts the transfer */
+#define I2C_SCL_LOW_TIMEOUT_US          10000U
+/* Software timeout of a transfer: fixed part plus ~90 us per byte at 100 kHz */
+#define I2C_TIMEOUT_BASE_MS             5U
+#define I2C_TIMEOUT_MS(length)          (I2C_TIMEOUT_BASE_MS + (length) / 8U)
+/* Transfer attempts after the first one, NACK backoff is 1, 2, 4.. ms */
+#define I2C_MAX_RETRIES                 3U
+/* Half period of the bus clear clock, 100 kHz */
+#define I2C_BUS_CLEAR_HALF_PERIOD_US    5U
+#define I2C_BUS_CLEAR_PULSES            9U
+/* Address-only probe: 9 bits + STOP take ~100 us at 100 kHz */
+#define I2C_PROBE_TIMEOUT_US            500U
+/* TIMINGR at 80 MHz PCLK1, analog filter on (CubeMX) */
+#define I2C_TIMING_100KHZ               0x10909CECU
+#define I2C_TIMING_400KHZ               0x00702991U
+/* Direct transfers: one START, NBYTES without reload */
+#define I2C_DIRECT_MAX_LENGTH           255U
+#define I2C_ISR_ERRORS                  (I2C_ISR_NACKF | I2C_ISR_BERR | I2C_ISR_ARLO | I2C_ISR_TIMEOUT)
 
 I2C_HandleTypeDef hi2c2;
 
+static uint32_t timing = I2C_TIMING_100KHZ;
+static uint32_t speed = I2C_API_SPEED_STANDARD;
+static I2C_API_ErrorCounters_t error_counters;
+static I2C_API_AddressStats_t address_stats[I2C_API_STATS_SLOTS];
+/* Transfers come in runs to the same device, so the last slot is checked first */
+static I2C_API_AddressStats_t *last_stats = &address_stats[0];
+
+static const char* error_names[I2C_API_Error_Count] =
+{
+    "NACK",
+    "ARLO",
+    "BERR",
+    "Timeout",
+    "Other"
+};
+
 
 /** @defgroup I2C LOW LEVEL Private Function Prototypes
   * @{
@@ -12,7 +50,15 @@ static void I2Cx_DeInit(I2C_HandleTypeDef *i2c_handler);
 static HAL_StatusTypeDef I2Cx_ReadMultiple(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint16_t Reg, uint16_t MemAddSize, uint8_t *Buffer, uint16_t Length);
 static HAL_StatusTypeDef I2Cx_WriteMultiple(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint16_t Reg, uint16_t MemAddSize, uint8_t *Buffer, uint16_t Length);
 static HAL_StatusTypeDef I2Cx_IsDeviceReady(I2C_HandleTypeDef *i2c_handler, uint16_t DevAddress, uint32_t Trials);
-static void I2Cx_Error(I2C_HandleTypeDef *i2c_handler, uint8_t Addr);
+static HAL_StatusTypeDef I2Cx_ReadDirect(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length);
+static HAL_StatusTypeDef I2Cx_WriteDirect(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length);
+static bool I2Cx_Error(I2C_HandleTypeDef *i2c_handler, I2C_API_AddressStats_t *stats, HAL_StatusTypeDef status, uint8_t attempt);
+static I2C_API_AddressStats_t* I2Cx_GetStats(uint8_t Addr);
+static void I2Cx_UpdateStats(I2C_API_AddressStats_t *stats, uint16_t Length, uint32_t start);
+static void I2Cx_SetClockTimeout(I2C_HandleTypeDef *i2c_handler, uint32_t timeout_us);
+static void I2Cx_Reset(I2C_HandleTypeDef *i2c_handler);
+static bool I2Cx_BusClear(void);
+static void I2Cx_RecoverBus(I2C_HandleTypeDef *i2c_handler);
 /**
   * @}
   */
@@ -26,7 +72,7 @@ static void I2Cx_Error(I2C_HandleTypeDef *i2c_handler, uint8_t Addr);
 static void I2Cx_Init(I2C_HandleTypeDef *i2c_handler)
 {
   i2c_handler->Instance = I2C2;
-  i2c_handler->Init.Timing = 0x10909CEC;
+  i2c_handler->Init.Timing = timing;
   i2c_handler->Init.OwnAddress1 = 0;
   i2c_handler->Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
   i2c_handler->Init.DualAddressMode = I2C_DUALADDRESS_DISABLE;
@@ -50,6 +96,35 @@ static void I2Cx_Init(I2C_HandleTypeDef *i2c_handler)
   {
     Error_Handler();
   }
+
+  I2Cx_SetClockTimeout(i2c_handler, I2C_SCL_LOW_TIMEOUT_US);
+}
+
+
+/**
+  * @brief  Programs TIMEOUTR so a slave can't stretch SCL longer than the bound.
+  * @param  i2c_handler : I2C handler
+  * @param  timeout_us: maximum SCL low time
+  * @retval None
+  */
+static void I2Cx_SetClockTimeout(I2C_HandleTypeDef *i2c_handler, uint32_t timeout_us)
+{
+  /* tTIMEOUT = (TIMEOUTA + 1) x 2048 x tI2CCLK, I2C2 is clocked from PCLK1 */
+  uint32_t timeouta = (HAL_RCC_GetPCLK1Freq() / 1000000U) * timeout_us / 2048U;
+
+  if(timeouta > 0)
+  {
+    timeouta--;
+  }
+  if(timeouta > I2C_TIMEOUTR_TIMEOUTA_Msk)
+  {
+    timeouta = I2C_TIMEOUTR_TIMEOUTA_Msk;
+  }
+
+  /* TIMEOUTA can be changed only while the timeout is disabled, TIDLE = 0 selects SCL low detection */
+  CLEAR_BIT(i2c_handler->Instance->TIMEOUTR, I2C_TIMEOUTR_TIMOUTEN);
+  WRITE_REG(i2c_handler->Instance->TIMEOUTR, timeouta);
+  SET_BIT(i2c_handler->Instance->TIMEOUTR, I2C_TIMEOUTR_TIMOUTEN);
 }
 
 
@@ -78,15 +153,22 @@ static void I2Cx_DeInit(I2C_HandleTypeDef *i2c_handler)
 static HAL_StatusTypeDef I2Cx_ReadMultiple(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint16_t Reg, uint16_t MemAddress, uint8_t *Buffer, uint16_t Length)
 {
   HAL_StatusTypeDef status = HAL_OK;
+  uint8_t attempt = 0;
+  uint32_t start = CycleCounter_Get();
+  I2C_API_AddressStats_t *stats = I2Cx_GetStats(Addr);
 
-  status = HAL_I2C_Mem_Read(i2c_handler, Addr, (uint16_t)Reg, MemAddress, Buffer, Length, 1000);
+  do
+  {
+    status = HAL_I2C_Mem_Read(i2c_handler, Addr, (uint16_t)Reg, MemAddress, Buffer, Length, I2C_TIMEOUT_MS(Length));
+  }
+  while((status != HAL_OK) && I2Cx_Error(i2c_handler, stats, status, attempt++));
 
-  /* Check the communication status */
-  if(status != HAL_OK)
+  if(stats != NULL)
   {
-    /* I2C error occured */
-    I2Cx_Error(i2c_handler, Addr);
+    stats->reads++;
+    I2Cx_UpdateStats(stats, Length, start);
   }
+
   return status;
 }
 
@@ -104,15 +186,227 @@ static HAL_StatusTypeDef I2Cx_ReadMultiple(I2C_HandleTypeDef *i2c_handler, uint8
 static HAL_StatusTypeDef I2Cx_WriteMultiple(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint16_t Reg, uint16_t MemAddress, uint8_t *Buffer, uint16_t Length)
 {
   HAL_StatusTypeDef status = HAL_OK;
+  uint8_t attempt = 0;
+  uint32_t start = CycleCounter_Get();
+  I2C_API_AddressStats_t *stats = I2Cx_GetStats(Addr);
+
+  do
+  {
+    status = HAL_I2C_Mem_Write(i2c_handler, Addr, (uint16_t)Reg, MemAddress, Buffer, Length, I2C_TIMEOUT_MS(Length));
+  }
+  while((status != HAL_OK) && I2Cx_Error(i2c_handler, stats, status, attempt++));
+
+  if(stats != NULL)
+  {
+    stats->writes++;
+    I2Cx_UpdateStats(stats, Length, start);
+  }
+
+  return status;
+}
+
+
+/**
+  * @brief  Waits for a flag of a direct transfer. A failed transfer leaves the cause in
+  *         ErrorCode like the HAL does, so the error handling is shared with it.
+  * @param  i2c_handler : I2C handler
+  * @param  flag: ISR flag to wait for
+  * @param  start: cycle counter at the start of the transfer
+  * @param  timeout: cycles the whole transfer may take
+  * @retval HAL status
+  */
+static HAL_StatusTypeDef I2Cx_WaitDirect(I2C_HandleTypeDef *i2c_handler, uint32_t flag, uint32_t start, uint32_t timeout)
+{
+  I2C_TypeDef *i2c = i2c_handler->Instance;
+  uint32_t isr;
+
+  while(((isr = i2c->ISR) & flag) == 0)
+  {
+    if((isr & I2C_ISR_ERRORS) != 0)
+    {
+      break;
+    }
+    if((CycleCounter_Get() - start) > timeout)
+    {
+      i2c_handler->ErrorCode = HAL_I2C_ERROR_TIMEOUT;
+      return HAL_TIMEOUT;
+    }
+  }
+
+  if((isr & I2C_ISR_ERRORS) == 0)
+  {
+    return HAL_OK;
+  }
+
+  /* The clock timeout flag is left for I2Cx_ClassifyError() */
+  if((isr & I2C_ISR_NACKF) != 0)
+  {
+    /* The peripheral sends STOP after a NACK */
+    while(((i2c->ISR & I2C_ISR_STOPF) == 0) && ((CycleCounter_Get() - start) <= timeout))
+    {
+    }
+    __HAL_I2C_CLEAR_FLAG(i2c_handler, I2C_FLAG_AF | I2C_FLAG_STOPF);
+    i2c_handler->ErrorCode = HAL_I2C_ERROR_AF;
+  }
+  else if((isr & I2C_ISR_BERR) != 0)
+  {
+    __HAL_I2C_CLEAR_FLAG(i2c_handler, I2C_FLAG_BERR);
+    i2c_handler->ErrorCode = HAL_I2C_ERROR_BERR;
+  }
+  else if((isr & I2C_ISR_ARLO) != 0)
+  {
+    __HAL_I2C_CLEAR_FLAG(i2c_handler, I2C_FLAG_ARLO);
+    i2c_handler->ErrorCode = HAL_I2C_ERROR_ARLO;
+  }
+  return HAL_ERROR;
+}
+
 
-  status = HAL_I2C_Mem_Write(i2c_handler, Addr, (uint16_t)Reg, MemAddress, Buffer, Length, 1000);
+/**
+  * @brief  Register read by CR2/TXDR/RXDR: write of the register address, then repeated
+  *         START and read, without the HAL state machine and tick polling.
+  * @param  i2c_handler : I2C handler
+  * @param  Addr: I2C address
+  * @param  Reg: Reg address
+  * @param  Buffer: Pointer to data buffer
+  * @param  Length: Length of the data, up to I2C_DIRECT_MAX_LENGTH
+  * @retval HAL status
+  */
+static HAL_StatusTypeDef I2Cx_ReadDirectOnce(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length)
+{
+  I2C_TypeDef *i2c = i2c_handler->Instance;
+  uint32_t start = CycleCounter_Get();
+  uint32_t timeout = I2C_TIMEOUT_MS(Length) * (SystemCoreClock / 1000U);
+  HAL_StatusTypeDef status;
+
+  i2c_handler->ErrorCode = HAL_I2C_ERROR_NONE;
+  if((i2c->ISR & I2C_ISR_BUSY) != 0)
+  {
+    return HAL_BUSY;
+  }
 
-  /* Check the communication status */
+  /* Register address, no STOP: TC is set when it's out */
+  WRITE_REG(i2c->CR2, (Addr & I2C_CR2_SADD) | (1U << I2C_CR2_NBYTES_Pos) | I2C_CR2_START);
+  status = I2Cx_WaitDirect(i2c_handler, I2C_ISR_TXIS, start, timeout);
   if(status != HAL_OK)
   {
-    /* Re-Initiaize the I2C Bus */
-    I2Cx_Error(i2c_handler, Addr);
+    return status;
+  }
+  i2c->TXDR = Reg;
+  status = I2Cx_WaitDirect(i2c_handler, I2C_ISR_TC, start, timeout);
+  if(status != HAL_OK)
+  {
+    return status;
+  }
+
+  /* Repeated START, STOP after the last byte */
+  WRITE_REG(i2c->CR2, (Addr & I2C_CR2_SADD) | ((uint32_t)Length << I2C_CR2_NBYTES_Pos) | I2C_CR2_RD_WRN |
+                      I2C_CR2_AUTOEND | I2C_CR2_START);
+  for(uint16_t i = 0; i < Length; i++)
+  {
+    status = I2Cx_WaitDirect(i2c_handler, I2C_ISR_RXNE, start, timeout);
+    if(status != HAL_OK)
+    {
+      return status;
+    }
+    Buffer[i] = (uint8_t)i2c->RXDR;
+  }
+
+  status = I2Cx_WaitDirect(i2c_handler, I2C_ISR_STOPF, start, timeout);
+  __HAL_I2C_CLEAR_FLAG(i2c_handler, I2C_FLAG_STOPF);
+  return status;
+}
+
+
+/**
+  * @brief  Register write by CR2/TXDR: register address and data in one transfer.
+  * @param  i2c_handler : I2C handler
+  * @param  Addr: I2C address
+  * @param  Reg: Reg address
+  * @param  Buffer: Pointer to data buffer
+  * @param  Length: Length of the data, up to I2C_DIRECT_MAX_LENGTH - 1
+  * @retval HAL status
+  */
+static HAL_StatusTypeDef I2Cx_WriteDirectOnce(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length)
+{
+  I2C_TypeDef *i2c = i2c_handler->Instance;
+  uint32_t start = CycleCounter_Get();
+  uint32_t timeout = I2C_TIMEOUT_MS(Length) * (SystemCoreClock / 1000U);
+  HAL_StatusTypeDef status;
+
+  i2c_handler->ErrorCode = HAL_I2C_ERROR_NONE;
+  if((i2c->ISR & I2C_ISR_BUSY) != 0)
+  {
+    return HAL_BUSY;
+  }
+
+  WRITE_REG(i2c->CR2, (Addr & I2C_CR2_SADD) | ((uint32_t)(Length + 1) << I2C_CR2_NBYTES_Pos) | I2C_CR2_AUTOEND | I2C_CR2_START);
+  for(uint16_t i = 0; i <= Length; i++)
+  {
+    status = I2Cx_WaitDirect(i2c_handler, I2C_ISR_TXIS, start, timeout);
+    if(status != HAL_OK)
+    {
+      return status;
+    }
+    i2c->TXDR = (i == 0) ? Reg : Buffer[i - 1];
+  }
+
+  status = I2Cx_WaitDirect(i2c_handler, I2C_ISR_STOPF, start, timeout);
+  __HAL_I2C_CLEAR_FLAG(i2c_handler, I2C_FLAG_STOPF);
+  return status;
+}
+
+
+/**
+  * @brief  Direct register read with the retries, recovery and metrics of I2Cx_ReadMultiple().
+  * @retval HAL status
+  */
+static HAL_StatusTypeDef I2Cx_ReadDirect(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length)
+{
+  HAL_StatusTypeDef status = HAL_OK;
+  uint8_t attempt = 0;
+  uint32_t start = CycleCounter_Get();
+  I2C_API_AddressStats_t *stats = I2Cx_GetStats(Addr);
+
+  do
+  {
+    status = I2Cx_ReadDirectOnce(i2c_handler, Addr, Reg, Buffer, Length);
+  }
+  while((status != HAL_OK) && I2Cx_Error(i2c_handler, stats, status, attempt++));
+
+  if(stats != NULL)
+  {
+    stats->reads++;
+    I2Cx_UpdateStats(stats, Length, start);
+  }
+
+  return status;
+}
+
+
+/**
+  * @brief  Direct register write with the retries, recovery and metrics of I2Cx_WriteMultiple().
+  * @retval HAL status
+  */
+static HAL_StatusTypeDef I2Cx_WriteDirect(I2C_HandleTypeDef *i2c_handler, uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length)
+{
+  HAL_StatusTypeDef status = HAL_OK;
+  uint8_t attempt = 0;
+  uint32_t start = CycleCounter_Get();
+  I2C_API_AddressStats_t *stats = I2Cx_GetStats(Addr);
+
+  do
+  {
+    status = I2Cx_WriteDirectOnce(i2c_handler, Addr, Reg, Buffer, Length);
+  }
+  while((status != HAL_OK) && I2Cx_Error(i2c_handler, stats, status, attempt++));
+
+  if(stats != NULL)
+  {
+    stats->writes++;
+    I2Cx_UpdateStats(stats, Length, start);
   }
+
   return status;
 }
 
@@ -132,18 +426,298 @@ static HAL_StatusTypeDef I2Cx_IsDeviceReady(I2C_HandleTypeDef *i2c_handler, uint
 
 
 /**
-  * @brief  Manages error callback by re-initializing I2C.
+  * @brief  Classifies failed transfer by the HAL error code and the peripheral flags.
+  * @param  i2c_handler : I2C handler
+  * @param  status: HAL status of the transfer
+  * @retval error class
+  */
+static I2C_API_ErrorClass_t I2Cx_ClassifyError(I2C_HandleTypeDef *i2c_handler, HAL_StatusTypeDef status)
+{
+  uint32_t error = HAL_I2C_GetError(i2c_handler);
+
+  /* HAL doesn't handle the clock timeout flag in polling mode */
+  if(__HAL_I2C_GET_FLAG(i2c_handler, I2C_FLAG_TIMEOUT))
+  {
+    __HAL_I2C_CLEAR_FLAG(i2c_handler, I2C_FLAG_TIMEOUT);
+    return I2C_API_Error_Timeout;
+  }
+
+  if((error & HAL_I2C_ERROR_BERR) != 0)
+  {
+    return I2C_API_Error_BERR;
+  }
+
+  if((error & HAL_I2C_ERROR_ARLO) != 0)
+  {
+    return I2C_API_Error_ARLO;
+  }
+
+  if((error & HAL_I2C_ERROR_AF) != 0)
+  {
+    return I2C_API_Error_NACK;
+  }
+
+  /* HAL_BUSY is returned when the BUSY flag doesn't clear, i.e. the bus is stuck */
+  if(((error & HAL_I2C_ERROR_TIMEOUT) != 0) || (status == HAL_BUSY) || (status == HAL_TIMEOUT))
+  {
+    return I2C_API_Error_Timeout;
+  }
+
+  return I2C_API_Error_Other;
+}
+
+
+/**
+  * @brief  Software reset of the peripheral. Keeps configuration, GPIO and clocks.
   * @param  i2c_handler : I2C handler
-  * @param  Addr: I2C Address
   * @retval None
   */
-static void I2Cx_Error(I2C_HandleTypeDef *i2c_handler, uint8_t Addr)
+static void I2Cx_Reset(I2C_HandleTypeDef *i2c_handler)
 {
-  /* De-initialize the I2C communication bus */
-  HAL_I2C_DeInit(i2c_handler);
+  /* PE must be kept low during at least 3 APB clock cycles, reading it back provides the delay */
+  __HAL_I2C_DISABLE(i2c_handler);
+  while(READ_BIT(i2c_handler->Instance->CR1, I2C_CR1_PE) != 0)
+  {
+    __asm__("nop");
+  }
+  __HAL_I2C_ENABLE(i2c_handler);
+
+  i2c_handler->State = HAL_I2C_STATE_READY;
+  i2c_handler->ErrorCode = HAL_I2C_ERROR_NONE;
+  __HAL_UNLOCK(i2c_handler);
 
-  /* Re-Initialize the I2C communication bus */
-  I2Cx_Init(i2c_handler);
+  error_counters.resets++;
+}
+
+
+/**
+  * @brief  Busy wait in microseconds.
+  * @retval None
+  */
+static void I2Cx_DelayUs(uint32_t us)
+{
+  uint32_t start = CycleCounter_Get();
+  uint32_t cycles = us * (SystemCoreClock / 1000000U);
+
+  while((CycleCounter_Get() - start) < cycles)
+  {
+    __asm__("nop");
+  }
+}
+
+
+/**
+  * @brief  Releases a slave holding SDA low: up to 9 SCL pulses followed by STOP,
+  *         generated with the pins switched to GPIO open-drain outputs.
+  * @retval true if SDA is released
+  */
+static bool I2Cx_BusClear(void)
+{
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+  bool released;
+
+  HAL_GPIO_WritePin(I2C2_SCL_GPIO_Port, I2C2_SCL_Pin, GPIO_PIN_SET);
+  HAL_GPIO_WritePin(I2C2_SDA_GPIO_Port, I2C2_SDA_Pin, GPIO_PIN_SET);
+
+  GPIO_InitStruct.Pin = I2C2_SCL_Pin|I2C2_SDA_Pin;
+  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+  GPIO_InitStruct.Pull = GPIO_PULLUP;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+  HAL_GPIO_Init(I2C2_SCL_GPIO_Port, &GPIO_InitStruct);
+
+  /* Clock out the byte the slave is sending, it releases SDA on the ACK slot */
+  for(uint8_t i = 0; i < I2C_BUS_CLEAR_PULSES; i++)
+  {
+    if(HAL_GPIO_ReadPin(I2C2_SDA_GPIO_Port, I2C2_SDA_Pin) == GPIO_PIN_SET)
+    {
+      break;
+    }
+    HAL_GPIO_WritePin(I2C2_SCL_GPIO_Port, I2C2_SCL_Pin, GPIO_PIN_RESET);
+    I2Cx_DelayUs(I2C_BUS_CLEAR_HALF_PERIOD_US);
+    HAL_GPIO_WritePin(I2C2_SCL_GPIO_Port, I2C2_SCL_Pin, GPIO_PIN_SET);
+    I2Cx_DelayUs(I2C_BUS_CLEAR_HALF_PERIOD_US);
+  }
+
+  /* STOP: SDA rises while SCL is high */
+  HAL_GPIO_WritePin(I2C2_SCL_GPIO_Port, I2C2_SCL_Pin, GPIO_PIN_RESET);
+  I2Cx_DelayUs(I2C_BUS_CLEAR_HALF_PERIOD_US);
+  HAL_GPIO_WritePin(I2C2_SDA_GPIO_Port, I2C2_SDA_Pin, GPIO_PIN_RESET);
+  I2Cx_DelayUs(I2C_BUS_CLEAR_HALF_PERIOD_US);
+  HAL_GPIO_WritePin(I2C2_SCL_GPIO_Port, I2C2_SCL_Pin, GPIO_PIN_SET);
+  I2Cx_DelayUs(I2C_BUS_CLEAR_HALF_PERIOD_US);
+  HAL_GPIO_WritePin(I2C2_SDA_GPIO_Port, I2C2_SDA_Pin, GPIO_PIN_SET);
+  I2Cx_DelayUs(I2C_BUS_CLEAR_HALF_PERIOD_US);
+
+  released = (HAL_GPIO_ReadPin(I2C2_SDA_GPIO_Port, I2C2_SDA_Pin) == GPIO_PIN_SET) &&
+             (HAL_GPIO_ReadPin(I2C2_SCL_GPIO_Port, I2C2_SCL_Pin) == GPIO_PIN_SET);
+
+  /* Give the pins back to the peripheral */
+  GPIO_InitStruct.Mode = GPIO_MODE_AF_OD;
+  GPIO_InitStruct.Alternate = GPIO_AF4_I2C2;
+  HAL_GPIO_Init(I2C2_SCL_GPIO_Port, &GPIO_InitStruct);
+
+  error_counters.bus_clears++;
+
+  return released;
+}
+
+
+/**
+  * @brief  Recovers a stuck bus: bus clear if a line is held low, peripheral reset,
+  *         full re-initialization only if the bus can't be released.
+  * @param  i2c_handler : I2C handler
+  * @retval None
+  */
+static void I2Cx_RecoverBus(I2C_HandleTypeDef *i2c_handler)
+{
+  bool released = true;
+
+  if((HAL_GPIO_ReadPin(I2C2_SDA_GPIO_Port, I2C2_SDA_Pin) != GPIO_PIN_SET) ||
+     (HAL_GPIO_ReadPin(I2C2_SCL_GPIO_Port, I2C2_SCL_Pin) != GPIO_PIN_SET))
+  {
+    released = I2Cx_BusClear();
+  }
+
+  if(released)
+  {
+    I2Cx_Reset(i2c_handler);
+  }
+  else
+  {
+    /* Last resort */
+    HAL_I2C_DeInit(i2c_handler);
+    I2Cx_Init(i2c_handler);
+    error_counters.reinits++;
+  }
+}
+
+
+/**
+  * @brief  Manages failed transfer: counts the error, recovers the bus and decides on retry.
+  *         NACKs are retried with exponential backoff, other errors once the bus is recovered.
+  * @param  i2c_handler : I2C handler
+  * @param  stats: metrics of the target address, can be NULL
+  * @param  status: HAL status of the transfer
+  * @param  attempt: number of the failed attempt, starting from 0
+  * @retval true if the transfer should be repeated
+  */
+static bool I2Cx_Error(I2C_HandleTypeDef *i2c_handler, I2C_API_AddressStats_t *stats, HAL_StatusTypeDef status, uint8_t attempt)
+{
+  I2C_API_ErrorClass_t error = I2Cx_ClassifyError(i2c_handler, status);
+
+  error_counters.errors[error]++;
+  if(stats != NULL)
+  {
+    stats->errors[error]++;
+  }
+
+  switch(error)
+  {
+    case I2C_API_Error_NACK:
+      /* HAL has already generated STOP, the bus and the peripheral are fine */
+      break;
+
+    case I2C_API_Error_ARLO:
+    case I2C_API_Error_BERR:
+      I2Cx_Reset(i2c_handler);
+      break;
+
+    case I2C_API_Error_Timeout:
+    default:
+      I2Cx_RecoverBus(i2c_handler);
+      break;
+  }
+
+  if(attempt >= I2C_MAX_RETRIES)
+  {
+    error_counters.failures++;
+    if(stats != NULL)
+    {
+      stats->failures++;
+    }
+    return false;
+  }
+
+  if(error == I2C_API_Error_NACK)
+  {
+    HAL_Delay(1U << attempt);
+  }
+
+  error_counters.retries++;
+  if(stats != NULL)
+  {
+    stats->retries++;
+  }
+  return true;
+}
+
+
+/**
+  * @brief  Finds metrics slot of the target address, allocates a free one for a new address.
+  * @param  Addr: I2C address
+  * @retval pointer to the slot or NULL if the table is full
+  */
+static I2C_API_AddressStats_t* I2Cx_GetStats(uint8_t Addr)
+{
+  I2C_API_AddressStats_t *free_slot = NULL;
+
+  if(last_stats->address == Addr)
+  {
+    return last_stats;
+  }
+
+  for(uint8_t i = 0; i < I2C_API_STATS_SLOTS; i++)
+  {
+    if(address_stats[i].address == Addr)
+    {
+      last_stats = &address_stats[i];
+      return last_stats;
+    }
+    if((address_stats[i].address == 0) && (free_slot == NULL))
+    {
+      free_slot = &address_stats[i];
+    }
+  }
+
+  if(free_slot != NULL)
+  {
+    free_slot->address = Addr;
+    last_stats = free_slot;
+  }
+
+  return free_slot;
+}
+
+
+/**
+  * @brief  Accounts transfer size and latency.
+  * @param  stats: metrics of the target address
+  * @param  Length: transferred bytes
+  * @param  start: cycle counter at the start of the transfer
+  * @retval None
+  */
+static void I2Cx_UpdateStats(I2C_API_AddressStats_t *stats, uint16_t Length, uint32_t start)
+{
+  uint32_t latency_us = CYCLES_TO_US(CycleCounter_Get() - start);
+  uint32_t bucket = 0;
+
+  /* floor(log2(latency)) with a single CLZ instruction */
+  if(latency_us > 1)
+  {
+    bucket = 31U - __CLZ(latency_us);
+    if(bucket >= I2C_API_LATENCY_BUCKETS)
+    {
+      bucket = I2C_API_LATENCY_BUCKETS - 1;
+    }
+  }
+
+  stats->bytes += Length;
+  stats->latency_total_us += latency_us;
+  if(latency_us > stats->latency_max_us)
+  {
+    stats->latency_max_us = latency_us;
+  }
+  stats->latency_histogram[bucket]++;
 }
 
 
@@ -174,6 +748,25 @@ void I2C_API_DeInit(void)
 }
 
 
+void I2C_API_SetSpeed(uint32_t i2c_speed)
+{
+    timing = (i2c_speed >= I2C_API_SPEED_FAST) ? I2C_TIMING_400KHZ : I2C_TIMING_100KHZ;
+    speed = (i2c_speed >= I2C_API_SPEED_FAST) ? I2C_API_SPEED_FAST : I2C_API_SPEED_STANDARD;
+    hi2c2.Init.Timing = timing;
+
+    /* TIMINGR can be written only while the peripheral is disabled */
+    __HAL_I2C_DISABLE(&hi2c2);
+    WRITE_REG(hi2c2.Instance->TIMINGR, timing);
+    __HAL_I2C_ENABLE(&hi2c2);
+}
+
+
+uint32_t I2C_API_GetSpeed(void)
+{
+    return speed;
+}
+
+
 void I2C_API_Write(uint8_t Addr, uint8_t Reg, uint8_t Value)
 {
     I2Cx_WriteMultiple(&hi2c2, Addr, (uint16_t)Reg, I2C_MEMADD_SIZE_8BIT,(uint8_t*)&Value, 1);
@@ -204,8 +797,95 @@ bool I2C_API_WriteMultiple(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t
 }
 
 
+bool I2C_API_ReadDirect(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length)
+{
+    if(length > I2C_DIRECT_MAX_LENGTH)
+    {
+        return false;
+    }
+    return I2Cx_ReadDirect(&hi2c2, addr, reg, buffer, length) == HAL_OK;
+}
+
+
+bool I2C_API_WriteDirect(uint8_t addr, uint8_t reg, uint8_t *buffer, uint16_t length)
+{
+    if(length > I2C_DIRECT_MAX_LENGTH - 1)
+    {
+        return false;
+    }
+    return I2Cx_WriteDirect(&hi2c2, addr, reg, buffer, length) == HAL_OK;
+}
+
+
 HAL_StatusTypeDef I2C_API_IsDeviceReady(uint16_t dev_address, uint32_t trials)
 {
     return (I2Cx_IsDeviceReady(&hi2c2, dev_address, trials));
 }
 
+
+bool I2C_API_Probe(uint8_t addr)
+{
+    I2C_TypeDef *i2c = hi2c2.Instance;
+    uint32_t start = CycleCounter_Get();
+    uint32_t timeout = I2C_PROBE_TIMEOUT_US * (SystemCoreClock / 1000000U);
+    bool ack;
+
+    if(__HAL_I2C_GET_FLAG(&hi2c2, I2C_FLAG_BUSY))
+    {
+        I2Cx_RecoverBus(&hi2c2);
+    }
+
+    /* Write with NBYTES = 0: address phase only, STOP is generated by hardware */
+    WRITE_REG(i2c->CR2, (addr & I2C_CR2_SADD) | I2C_CR2_AUTOEND | I2C_CR2_START);
+
+    while(!__HAL_I2C_GET_FLAG(&hi2c2, I2C_FLAG_STOPF))
+    {
+        if((CycleCounter_Get() - start) > timeout)
+        {
+            error_counters.errors[I2C_API_Error_Timeout]++;
+            I2Cx_RecoverBus(&hi2c2);
+            return false;
+        }
+    }
+
+    ack = !__HAL_I2C_GET_FLAG(&hi2c2, I2C_FLAG_AF);
+    __HAL_I2C_CLEAR_FLAG(&hi2c2, I2C_FLAG_STOPF | I2C_FLAG_AF);
+
+    return ack;
+}
+
+
+void I2C_API_GetErrorCounters(I2C_API_ErrorCounters_t *counters)
+{
+    *counters = error_counters;
+}
+
+
+void I2C_API_ResetErrorCounters(void)
+{
+    memset(&error_counters, 0, sizeof(error_counters));
+}
+
+
+const I2C_API_AddressStats_t* I2C_API_GetStats(uint8_t item)
+{
+    if((item >= I2C_API_STATS_SLOTS) || (address_stats[item].address == 0))
+    {
+        return NULL;
+    }
+    return &address_stats[item];
+}
+
+
+void I2C_API_ResetStats(void)
+{
+    memset(address_stats, 0, sizeof(address_stats));
+    last_stats = &address_stats[0];
+}
+
+
+const char* I2C_API_GetErrorName(I2C_API_ErrorClass_t error)
+{
+    return error < I2C_API_Error_Count ? error_names[error] : "";
+}
+
@@ -0,0 +1,214 @@
+#include <stddef.h>
+
+#include "i2c_devmap.h"
+#include "i2c_api.h"
+#include "cycle_counter.h"
+#include "max6650.h"
+#include "hts221.h"
+#include "lsm6dsl.h"
+
+/* 7-bit addresses outside the reserved ranges */
+#define SCAN_FIRST_ADDRESS      0x08
+#define SCAN_LAST_ADDRESS       0x77
+
+#define ST_WHO_AM_I_REG         0x0F
+
+#define LPS22HB_I2C_ADDRESS_LOW     0xB8
+#define LPS22HB_I2C_ADDRESS_HIGH    0xBA
+#define LPS22HB_WHO_AM_I_VALUE      0xB1
+
+#define LSM6DSL_I2C_ADDRESS_HIGH    0xD6
+
+#define MAX6650_ALARM_ENABLE_REG    0x08
+#define MAX6650_COUNT_REG           0x16
+
+/* 8-bit addresses of the known parts */
+static const uint8_t known_addresses[] =
+{
+    MAX6650_I2C_ADDRESS_GND,
+    MAX6650_I2C_ADDRESS_VCC,
+    MAX6650_I2C_ADDRESS_NOT_CONNECTED,
+    MAX6650_I2C_ADDRESS_RES10K,
+    HTS221_I2C_ADDRESS,
+    LSM6DSL_I2C_ADDRESS,
+    LSM6DSL_I2C_ADDRESS_HIGH,
+    LPS22HB_I2C_ADDRESS_LOW,
+    LPS22HB_I2C_ADDRESS_HIGH
+};
+
+static I2C_DevMap_Entry_t devices[I2C_DEVMAP_MAX_ENTRIES];
+static uint8_t devices_count;
+static uint32_t scan_time_us;
+
+static const char* device_names[I2C_Device_Count] =
+{
+    "Unknown",
+    "MAX6650",
+    "HTS221",
+    "LSM6DSL",
+    "LPS22HB"
+};
+
+
+static bool check_who_am_i(uint8_t address, uint8_t expected)
+{
+    uint8_t value;
+
+    return (I2C_API_ReadMultiple(address, ST_WHO_AM_I_REG, &value, 1) == true) && (value == expected);
+}
+
+
+static bool check_max6650(uint8_t address)
+{
+    uint8_t value;
+
+    /* No ID register: unused bits of alarm enable and count time registers read as zero */
+    if((I2C_API_ReadMultiple(address, MAX6650_ALARM_ENABLE_REG, &value, 1) != true) || ((value & 0xE0) != 0))
+    {
+        return false;
+    }
+
+    return (I2C_API_ReadMultiple(address, MAX6650_COUNT_REG, &value, 1) == true) && ((value & 0xFC) == 0);
+}
+
+
+/**
+ * @brief Identify acknowledged address. Only the parts that may sit at this address are checked
+ */
+static I2C_DeviceType_t identify(uint8_t address)
+{
+    switch(address)
+    {
+        case MAX6650_I2C_ADDRESS_GND:
+        case MAX6650_I2C_ADDRESS_VCC:
+        case MAX6650_I2C_ADDRESS_NOT_CONNECTED:
+        case MAX6650_I2C_ADDRESS_RES10K:
+            if(check_max6650(address))
+            {
+                return I2C_Device_MAX6650;
+            }
+            break;
+
+        case HTS221_I2C_ADDRESS:
+            if(check_who_am_i(address, HTS221_WHO_AM_I_VALUE))
+            {
+                return I2C_Device_HTS221;
+            }
+            break;
+
+        case LSM6DSL_I2C_ADDRESS:
+        case LSM6DSL_I2C_ADDRESS_HIGH:
+            if(check_who_am_i(address, LSM6DSL_WHO_AM_I_VALUE))
+            {
+                return I2C_Device_LSM6DSL;
+            }
+            break;
+
+        case LPS22HB_I2C_ADDRESS_LOW:
+        case LPS22HB_I2C_ADDRESS_HIGH:
+            if(check_who_am_i(address, LPS22HB_WHO_AM_I_VALUE))
+            {
+                return I2C_Device_LPS22HB;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return I2C_Device_Unknown;
+}
+
+
+static void probe(uint8_t address, bool known_only)
+{
+    I2C_DeviceType_t type;
+
+    if((I2C_API_Probe(address) != true) || (devices_count >= I2C_DEVMAP_MAX_ENTRIES))
+    {
+        return;
+    }
+
+    type = identify(address);
+    if(known_only && (type == I2C_Device_Unknown))
+    {
+        return;
+    }
+
+    devices[devices_count].address = address;
+    devices[devices_count].type = type;
+    devices_count++;
+}
+
+
+uint8_t I2C_DevMap_Scan(void)
+{
+    uint32_t start = CycleCounter_Get();
+
+    devices_count = 0;
+
+    for(uint8_t addr7 = SCAN_FIRST_ADDRESS; addr7 <= SCAN_LAST_ADDRESS; addr7++)
+    {
+        probe(addr7 << 1, false);
+    }
+
+    scan_time_us = CYCLES_TO_US(CycleCounter_Get() - start);
+
+    return devices_count;
+}
+
+
+uint8_t I2C_DevMap_ScanKnown(void)
+{
+    uint32_t start = CycleCounter_Get();
+
+    devices_count = 0;
+
+    for(uint8_t i = 0; i < sizeof(known_addresses); i++)
+    {
+        probe(known_addresses[i], true);
+    }
+
+    scan_time_us = CYCLES_TO_US(CycleCounter_Get() - start);
+
+    return devices_count;
+}
+
+
+uint8_t I2C_DevMap_GetCount(void)
+{
+    return devices_count;
+}
+
+
+const I2C_DevMap_Entry_t* I2C_DevMap_GetEntry(uint8_t item)
+{
+    return item < devices_count ? &devices[item] : NULL;
+}
+
+
+bool I2C_DevMap_Find(I2C_DeviceType_t type, uint8_t *address)
+{
+    for(uint8_t i = 0; i < devices_count; i++)
+    {
+        if(devices[i].type == type)
+        {
+            *address = devices[i].address;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+uint32_t I2C_DevMap_GetScanTime(void)
+{
+    return scan_time_us;
+}
+
+
+const char* I2C_DevMap_GetName(I2C_DeviceType_t type)
+{
+    return type < I2C_Device_Count ? device_names[type] : "";
+}
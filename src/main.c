@@ -3,6 +3,10 @@
 #include "uart_api.h"
 #include "user_functions.h"
 #include "error.h"
+#include "crc.h"
+#include "boot.h"
+#include "timebase.h"
+#include "tach.h"
 
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
@@ -15,20 +19,34 @@ int main(void)
 {
     bool i2c_fast_speed = false;
 
+  Boot_Mark(Boot_Phase_Startup);
+
   /* Reset of all peripherals, Initializes the Flash interface and the Systick. */
   HAL_Init();
+  Boot_Mark(Boot_Phase_HAL);
 
   /* Configure the system clock */
   SystemClock_Config();
+  Boot_Mark(Boot_Phase_Clock);
+
+  /* Frame and record checksums */
+  Crc_Init();
+
+  /* Microsecond clock and timer events */
+  Timebase_Init();
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
 
+  /* Fan tach capture, with TACH_CAPTURE */
+  Tach_Init();
+
   I2C_API_Init(i2c_fast_speed);
   UartAPI_Init();
 
   /* Don't use buffer for stdin */
   setbuf(stdin, NULL);
+  Boot_Mark(Boot_Phase_Peripherals);
 
   /* Clear terminal window */
   printf(TC_CLS);
@@ -39,9 +57,16 @@ int main(void)
       printf(TC_RED"ERROR: Can't initialize..\r\n");
       //Error_Handler();
   }
+  Boot_Mark(Boot_Phase_Devices);
 
+#if FAST_BOOT
+  /* The full menu takes ~100 ms at 115200 */
+  printf(TC_MAGENTA"UART<->I2C Controller, type \"help\" for commands\r\n");
+#else
   printf(TC_MAGENTA"---------------- UART<->I2C Controller ---------------");
   UartAPI_PrintMenu();
+#endif
+  Boot_Mark(Boot_Phase_Console);
 
   /* Infinite loop */
   while (1)
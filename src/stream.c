@@ -0,0 +1,247 @@
+#include <string.h>
+
+#include "stm32l4xx_hal.h"
+#include "stream.h"
+#include "uart_api.h"
+#include "usart_ll.h"
+#include "cycle_counter.h"
+#include "thermal.h"
+#include "max6650.h"
+
+/* Power of 2, about 90 ms of the UART bandwidth */
+#define STREAM_TX_RING_SIZE     1024
+#define STREAM_TX_RING_MASK     (STREAM_TX_RING_SIZE - 1)
+
+/* sync, seq, flags, 5 bytes per varint, sum */
+#define STREAM_FRAME_MAX        (3 + 5 * Stream_Field_Count + 1)
+
+static uint8_t tx_ring[STREAM_TX_RING_SIZE];
+static uint32_t tx_head;
+static uint32_t tx_tail;
+
+/* Values of the last frame sent, reference for the deltas */
+static uint32_t reference[Stream_Field_Count];
+static uint8_t frames_since_keyframe;
+
+static Stream_Stats_t stats;
+
+
+static uint8_t put_varint(uint8_t *buffer, uint32_t value)
+{
+    uint8_t len = 0;
+
+    while(value >= 0x80)
+    {
+        buffer[len++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    buffer[len++] = (uint8_t)value;
+
+    return len;
+}
+
+
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+
+/**
+ * @brief Encode a frame against the reference values
+ * @retval frame length
+ */
+static uint8_t encode_frame(uint8_t seq, const uint32_t *values, uint8_t *frame)
+{
+    bool keyframe = (frames_since_keyframe == 0);
+    uint8_t flags = keyframe ? STREAM_FLAG_KEYFRAME : 0;
+    uint8_t len = 3;
+    uint8_t sum = 0;
+    int32_t delta;
+
+    for(uint8_t i = 0; i < Stream_Field_Count; i++)
+    {
+        if(keyframe)
+        {
+            len += put_varint(&frame[len], values[i]);
+        }
+        else
+        {
+            delta = (int32_t)(values[i] - reference[i]);
+            if(i == Stream_Field_Timestamp)
+            {
+                len += put_varint(&frame[len], (uint32_t)delta);
+            }
+            else if(delta != 0)
+            {
+                len += put_varint(&frame[len], zigzag(delta));
+            }
+            else
+            {
+                continue;
+            }
+        }
+        flags |= 1 << i;
+    }
+
+    frame[0] = STREAM_SYNC;
+    frame[1] = seq;
+    frame[2] = flags;
+
+    for(uint8_t i = 1; i < len; i++)
+    {
+        sum += frame[i];
+    }
+    frame[len++] = sum;
+
+    return len;
+}
+
+
+static bool queue_frame(const uint8_t *frame, uint8_t len)
+{
+    if((STREAM_TX_RING_SIZE - (tx_head - tx_tail)) < len)
+    {
+        return false;
+    }
+
+    for(uint8_t i = 0; i < len; i++)
+    {
+        tx_ring[tx_head++ & STREAM_TX_RING_MASK] = frame[i];
+    }
+
+    return true;
+}
+
+
+static void drain(void)
+{
+    while((tx_tail != tx_head) && UsartLL_TryPutChar(USART1, tx_ring[tx_tail & STREAM_TX_RING_MASK]))
+    {
+        tx_tail++;
+    }
+}
+
+
+/**
+ * @brief Refresh sampled values. Only one register is read per sample to bound the
+ *        I2C time, the tachometer count changes once per count time anyway
+ */
+static void sample(uint32_t *values, uint32_t slot, uint32_t timestamp)
+{
+    uint16_t rpm;
+    uint8_t value;
+
+    values[Stream_Field_Timestamp] = timestamp;
+    values[Stream_Field_TargetSpeed] = MAX6650_GetTargetSpeed();
+
+    switch(slot % 3)
+    {
+        case 0:
+            if(MAX6650_GetRPM(&rpm, MAX6650_MAX_AGE_GATE, NULL))
+            {
+                values[Stream_Field_RPM] = rpm;
+            }
+            break;
+
+        case 1:
+            if(MAX6650_GetKTach(&value, MAX6650_MAX_AGE_GATE, NULL))
+            {
+                values[Stream_Field_KTach] = value;
+            }
+            break;
+
+        default:
+            if(MAX6650_GetAlarm(&value))
+            {
+                values[Stream_Field_Alarm] = value;
+            }
+            break;
+    }
+}
+
+
+bool Stream_Run(uint16_t rate_hz)
+{
+    uint32_t values[Stream_Field_Count] = {0};
+    uint8_t frame[STREAM_FRAME_MAX];
+    uint32_t period;
+    uint32_t next;
+    uint32_t start_tick;
+    uint8_t len;
+    uint8_t c;
+
+    if((rate_hz == 0) || (rate_hz > STREAM_MAX_RATE_HZ))
+    {
+        return false;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    stats.rate_hz = rate_hz;
+    tx_head = 0;
+    tx_tail = 0;
+    frames_since_keyframe = 0;
+
+    period = SystemCoreClock / rate_hz;
+    start_tick = HAL_GetTick();
+    next = CycleCounter_Get();
+
+    while(1)
+    {
+        if(UsartLL_TryGetChar(USART1, &c) && (c == STREAM_STOP_CHAR))
+        {
+            break;
+        }
+
+        drain();
+
+        if((int32_t)(CycleCounter_Get() - next) < 0)
+        {
+            continue;
+        }
+
+        next += period;
+        if((int32_t)(CycleCounter_Get() - next) >= 0)
+        {
+            /* Fell behind by a whole period: skip the slot instead of bursting */
+            stats.overruns++;
+            next = CycleCounter_Get() + period;
+        }
+
+        sample(values, stats.samples, HAL_GetTick() - start_tick);
+
+        len = encode_frame((uint8_t)stats.samples, values, frame);
+        stats.samples++;
+
+        /* The host is too slow: drop the frame, the sequence gap reports it */
+        if(queue_frame(frame, len))
+        {
+            memcpy(reference, values, sizeof(reference));
+            frames_since_keyframe = (frames_since_keyframe + 1) % STREAM_KEYFRAME_INTERVAL;
+            stats.frames++;
+            stats.bytes += len;
+        }
+        else
+        {
+            stats.dropped++;
+        }
+
+        /* Keep the fan under control while the console is busy */
+        Thermal_Process();
+    }
+
+    while(tx_tail != tx_head)
+    {
+        drain();
+    }
+
+    stats.duration_ms = HAL_GetTick() - start_tick;
+
+    return true;
+}
+
+
+void Stream_GetStats(Stream_Stats_t *stream_stats)
+{
+    *stream_stats = stats;
+}
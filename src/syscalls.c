@@ -37,6 +37,7 @@
 extern int errno;
 extern int __io_putchar(int ch) __attribute__((weak));
 extern int __io_getchar(void) __attribute__((weak));
+extern int __io_write(const char *ptr, int len) __attribute__((weak));
 
 register char * stack_ptr asm("sp");
 
@@ -82,6 +83,12 @@ __attribute__((weak)) int _write(int file, char *ptr, int len)
 {
 	int DataIdx;
 
+	/* Whole block at once when the application has a block writer */
+	if (__io_write != NULL)
+	{
+		return __io_write(ptr, len);
+	}
+
 	for (DataIdx = 0; DataIdx < len; DataIdx++)
 	{
 		__io_putchar(*ptr++);
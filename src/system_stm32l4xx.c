@@ -90,6 +90,7 @@
   */
 
 #include "stm32l4xx.h"
+#include "cycle_counter.h"
 
 #if !defined  (HSE_VALUE)
   #define HSE_VALUE    8000000U  /*!< Value of the External oscillator in Hz */
@@ -179,6 +180,9 @@
 
 void SystemInit(void)
 {
+  /* Boot phases are timed from here, see boot.h */
+  CycleCounter_Init();
+
   /* FPU settings ------------------------------------------------------------*/
   #if (__FPU_PRESENT == 1) && (__FPU_USED == 1)
     SCB->CPACR |= ((3UL << 10*2)|(3UL << 11*2));  /* set CP10 and CP11 Full Access */
@@ -0,0 +1,223 @@
+#include <string.h>
+
+#include "stm32l4xx_hal.h"
+#include "timebase.h"
+#include "tach.h"
+
+#if TACH_CAPTURE
+
+#define TACH_GPIO_PORT          GPIOA
+#define TACH_GPIO_PIN           GPIO_PIN_1
+#define TACH_DMA_CHANNEL        DMA1_Channel7
+/* TIM2_CH2 request of DMA1 channel 7 */
+#define TACH_DMA_REQUEST        4U
+/* 8 samples at fDTS / 32: an edge has to stay for 3.2 us at 80 MHz */
+#define TACH_INPUT_FILTER       0xFU
+/* Edges in flight: 180 ms at 10500 rpm, taken every 10 ms */
+#define TACH_RING               64
+#define TACH_POLL_US            10000
+/* Revolution periods the speed is the median of */
+#define TACH_MEDIAN             7
+#define TACH_STALL_REVS         2
+#define TACH_STALL_MAX_US       500000U
+#define US_PER_MINUTE           60000000U
+
+/* Low words of the timebase at the edges, written by the DMA */
+static volatile uint32_t ring[TACH_RING];
+static uint16_t ring_read;
+static Timebase_Event_t poll_event;
+
+/* Since the fan has started, cleared on a stall */
+static struct
+{
+    uint32_t edges;
+    uint32_t pulse_us[TACH_PULSES_PER_REV];     /* last edge of each pulse of the revolution */
+    uint32_t periods_us[TACH_MEDIAN];
+    uint8_t periods;
+    uint8_t next_period;
+} run;
+
+/* Written by the poll in the TIM2 interrupt */
+static Tach_Info_t state;
+static uint32_t last_edge_us;
+
+
+/**
+ * @brief Take an edge: the time since the same pulse of the previous revolution is a revolution
+ *        period, the pulses of a revolution needn't be evenly spaced
+ */
+static void edge(uint32_t time_us)
+{
+    uint8_t pulse = run.edges % TACH_PULSES_PER_REV;
+
+    /* Within a quarter of a pulse interval of the previous edge: ringing, it would put the pulses
+       out of step. The fan can't speed up that much between two polls */
+    if((state.period_us != 0) && ((time_us - last_edge_us) < state.period_us / (4 * TACH_PULSES_PER_REV)))
+    {
+        state.rejected++;
+        return;
+    }
+
+    if(run.edges >= TACH_PULSES_PER_REV)
+    {
+        run.periods_us[run.next_period] = time_us - run.pulse_us[pulse];
+        run.next_period = (run.next_period + 1) % TACH_MEDIAN;
+        if(run.periods < TACH_MEDIAN)
+        {
+            run.periods++;
+        }
+    }
+    run.pulse_us[pulse] = time_us;
+    run.edges++;
+
+    last_edge_us = time_us;
+    state.edges++;
+}
+
+/**
+ * @brief Median of the last revolution periods
+ */
+static uint32_t median(void)
+{
+    uint32_t sorted[TACH_MEDIAN];
+    uint32_t value;
+    uint8_t i, j;
+
+    for(i = 0; i < run.periods; i++)
+    {
+        value = run.periods_us[i];
+        for(j = i; (j > 0) && (sorted[j - 1] > value); j--)
+        {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+    }
+
+    return sorted[run.periods / 2];
+}
+
+/**
+ * @brief Timebase event: take the edges the DMA has stored, check for a stall
+ */
+static void poll(void *context)
+{
+    uint16_t write = (TACH_RING - TACH_DMA_CHANNEL->CNDTR) % TACH_RING;
+    uint32_t now = (uint32_t)Timebase_NowUs();
+    uint32_t timeout;
+
+    (void)context;
+
+    while(ring_read != write)
+    {
+        edge(ring[ring_read]);
+        ring_read = (ring_read + 1) % TACH_RING;
+    }
+
+    if(run.periods != 0)
+    {
+        state.period_us = median();
+        state.stalled = false;
+    }
+
+    timeout = state.stalled ? TACH_STALL_MAX_US : state.period_us * TACH_STALL_REVS;
+    if((run.edges != 0) && ((now - last_edge_us) > ((timeout < TACH_STALL_MAX_US) ? timeout : TACH_STALL_MAX_US)))
+    {
+        if(!state.stalled)
+        {
+            state.stalls++;
+        }
+        memset(&run, 0, sizeof(run));
+        state.period_us = 0;
+        state.stalled = true;
+    }
+}
+
+
+void Tach_Init(void)
+{
+    GPIO_InitTypeDef gpio = {0};
+
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    gpio.Pin = TACH_GPIO_PIN;
+    gpio.Mode = GPIO_MODE_AF_PP;
+    gpio.Pull = GPIO_PULLUP;
+    gpio.Speed = GPIO_SPEED_FREQ_LOW;
+    gpio.Alternate = GPIO_AF1_TIM2;
+    HAL_GPIO_Init(TACH_GPIO_PORT, &gpio);
+
+    /* CCR2 to the ring, 32-bit words, circular */
+    MODIFY_REG(DMA1_CSELR->CSELR, DMA_CSELR_C7S, TACH_DMA_REQUEST << DMA_CSELR_C7S_Pos);
+    TACH_DMA_CHANNEL->CCR = 0;
+    TACH_DMA_CHANNEL->CPAR = (uintptr_t)&TIM2->CCR2;
+    TACH_DMA_CHANNEL->CMAR = (uintptr_t)ring;
+    TACH_DMA_CHANNEL->CNDTR = TACH_RING;
+    TACH_DMA_CHANNEL->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_PSIZE_1 | DMA_CCR_MSIZE_1;
+    SET_BIT(TACH_DMA_CHANNEL->CCR, DMA_CCR_EN);
+    ring_read = 0;
+    memset(&run, 0, sizeof(run));
+    memset(&state, 0, sizeof(state));
+    state.stalled = true;
+
+    /* TI2 on channel 2, every falling edge: the tach output pulls the line low */
+    MODIFY_REG(TIM2->CCMR1, TIM_CCMR1_CC2S | TIM_CCMR1_IC2PSC | TIM_CCMR1_IC2F,
+               TIM_CCMR1_CC2S_0 | (TACH_INPUT_FILTER << TIM_CCMR1_IC2F_Pos));
+    MODIFY_REG(TIM2->CCER, TIM_CCER_CC2P | TIM_CCER_CC2NP, TIM_CCER_CC2P);
+    SET_BIT(TIM2->DIER, TIM_DIER_CC2DE);
+    SET_BIT(TIM2->CCER, TIM_CCER_CC2E);
+
+    Timebase_Start(&poll_event, TACH_POLL_US, TACH_POLL_US, poll, NULL);
+}
+
+
+bool Tach_GetRPM(uint16_t *rpm, Tach_Info_t *info)
+{
+    Tach_Info_t copy;
+    uint32_t primask;
+    uint32_t value;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    copy = state;
+    copy.age_us = (uint32_t)Timebase_NowUs() - last_edge_us;
+    __set_PRIMASK(primask);
+
+    if(copy.stalled)
+    {
+        *rpm = 0;
+    }
+    else
+    {
+        value = (US_PER_MINUTE + copy.period_us / 2) / copy.period_us;
+        *rpm = (value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value;
+    }
+
+    if(info != NULL)
+    {
+        *info = copy;
+    }
+
+    return !copy.stalled;
+}
+
+#else
+
+void Tach_Init(void)
+{
+}
+
+
+bool Tach_GetRPM(uint16_t *rpm, Tach_Info_t *info)
+{
+    *rpm = 0;
+    if(info != NULL)
+    {
+        memset(info, 0, sizeof(*info));
+        info->stalled = true;
+    }
+
+    return false;
+}
+
+#endif /* TACH_CAPTURE */
@@ -0,0 +1,185 @@
+#include <stddef.h>
+
+#include "stm32l4xx_hal.h"
+#include "thermal.h"
+#include "hts221.h"
+#include "max6650.h"
+
+static const Thermal_Config_t *config = NULL;
+static Thermal_Status_t status;
+
+static uint32_t last_update_tick;
+/* Temperature that produced the speed currently applied to the fan */
+static int16_t applied_temperature;
+static bool applied;
+
+
+/**
+ * @brief Check the curve: ascending temperatures, and speeds the fan controller can set.
+ *        Between 0 and the lowest regulated speed there are none
+ */
+static bool curve_valid(const Thermal_Config_t *thermal_config)
+{
+    const Thermal_CurvePoint_t *point;
+    uint8_t speed_min = MAX6650_GetMinSpeed();
+
+    for(uint8_t i = 0; i < thermal_config->curve_points; i++)
+    {
+        point = &thermal_config->curve[i];
+        if((point->speed > 100) || ((point->speed != 0) && (point->speed < speed_min)))
+        {
+            return false;
+        }
+        if((i != 0) && (point->temperature <= point[-1].temperature))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool Thermal_Init(const Thermal_Config_t *thermal_config)
+{
+    if((thermal_config == NULL) || (thermal_config->curve == NULL) || (thermal_config->curve_points == 0) ||
+       (curve_valid(thermal_config) != true))
+    {
+        return false;
+    }
+
+    config = thermal_config;
+    status.enabled = false;
+    status.valid = false;
+    status.update_period_ms = config->update_period_ms;
+
+    /* The first conversion runs while the rest of the system starts */
+    return HTS221_StartConversion();
+}
+
+
+void Thermal_SetUpdatePeriod(uint32_t period_ms)
+{
+    if(config == NULL)
+    {
+        return;
+    }
+
+    status.enabled = period_ms != 0;
+    if(status.enabled)
+    {
+        status.update_period_ms = period_ms;
+        /* Force the fan to be updated on the next measurement */
+        applied = false;
+        last_update_tick = HAL_GetTick() - period_ms;
+    }
+}
+
+
+void Thermal_Enable(void)
+{
+    if(config != NULL)
+    {
+        Thermal_SetUpdatePeriod(config->update_period_ms);
+    }
+}
+
+
+uint8_t Thermal_CurveLookup(int16_t temperature)
+{
+    const Thermal_CurvePoint_t *lo;
+    const Thermal_CurvePoint_t *hi;
+    uint8_t i;
+
+    if(temperature <= config->curve[0].temperature)
+    {
+        return config->curve[0].speed;
+    }
+
+    for(i = 1; i < config->curve_points; i++)
+    {
+        hi = &config->curve[i];
+        if(temperature < hi->temperature)
+        {
+            lo = hi - 1;
+            return lo->speed + (int32_t)(temperature - lo->temperature) * (hi->speed - lo->speed) /
+                                (hi->temperature - lo->temperature);
+        }
+    }
+
+    return config->curve[config->curve_points - 1].speed;
+}
+
+
+void Thermal_GetStatus(Thermal_Status_t *thermal_status)
+{
+    *thermal_status = status;
+}
+
+
+void Thermal_Process(void)
+{
+    HTS221_Data_t data;
+    bool ready;
+    uint8_t speed;
+    uint8_t speed_actual;
+
+    if((config == NULL) || (status.enabled != true))
+    {
+        return;
+    }
+
+    if((HAL_GetTick() - last_update_tick) < status.update_period_ms)
+    {
+        return;
+    }
+    last_update_tick = HAL_GetTick();
+
+    /* Pick up the conversion started on the previous step */
+    if(HTS221_Read(&data, &ready) != true)
+    {
+        return;
+    }
+
+    /* Restart the sensor before talking to the fan controller, so the conversion time
+     * overlaps with the MAX6650 transfer instead of being waited for */
+    HTS221_StartConversion();
+
+    if(ready != true)
+    {
+        return;
+    }
+
+    status.humidity = data.humidity;
+    status.temperature = data.temperature;
+    status.valid = true;
+
+    /* Follow rising temperature immediately, falling one only after the hysteresis band */
+    if((applied == true) &&
+       (data.temperature <= applied_temperature) &&
+       (data.temperature > applied_temperature - config->hysteresis))
+    {
+        return;
+    }
+
+    speed = Thermal_CurveLookup(data.temperature);
+    applied_temperature = data.temperature;
+
+    /* Between a 0 point and the next one the line passes speeds that can't be regulated */
+    if((speed != 0) && (speed < MAX6650_GetMinSpeed()))
+    {
+        speed = MAX6650_GetMinSpeed();
+    }
+
+    /* Don't touch the bus if the fan is already at the required speed */
+    if((applied == true) && (speed == status.speed))
+    {
+        return;
+    }
+
+    if(MAX6650_SetSpeed(speed, &speed_actual) == true)
+    {
+        status.speed = speed;
+        applied = true;
+    }
+}
@@ -0,0 +1,223 @@
+#include "stm32l4xx_hal.h"
+#include "timebase.h"
+
+#define TIMEBASE_HZ             1000000U
+/* A counter value in the lower half has wrapped recently */
+#define TIMEBASE_HALF           0x80000000U
+/* Under the USART1 receive interrupt, which must not lose update chunks */
+#define TIMEBASE_IRQ_PRIORITY   1
+
+/* Upper word of the time, written by the update interrupt only */
+static volatile uint32_t wraps;
+/* Started events by deadline */
+static Timebase_Event_t *head;
+
+
+/**
+ * @brief Load the first deadline into the compare channel. The interrupt is
+ *        raised at once if the deadline has passed meanwhile
+ */
+static void arm(void)
+{
+    if(head == NULL)
+    {
+        return;
+    }
+
+    /* A deadline more than a wrap away matches early, it's checked in the interrupt */
+    TIM2->CCR1 = (uint32_t)head->deadline_us;
+    if(Timebase_NowUs() >= head->deadline_us)
+    {
+        TIM2->EGR = TIM_EGR_CC1G;
+    }
+}
+
+/**
+ * @brief Put an event into the list by its deadline, after the events with the same one
+ */
+static void list_insert(Timebase_Event_t *event)
+{
+    Timebase_Event_t **link = &head;
+
+    while((*link != NULL) && ((*link)->deadline_us <= event->deadline_us))
+    {
+        link = &(*link)->next;
+    }
+    event->next = *link;
+    *link = event;
+    event->active = true;
+}
+
+/**
+ * @brief Take an event out of the list
+ */
+static void list_remove(Timebase_Event_t *event)
+{
+    Timebase_Event_t **link = &head;
+
+    while((*link != NULL) && (*link != event))
+    {
+        link = &(*link)->next;
+    }
+    if(*link != NULL)
+    {
+        *link = event->next;
+    }
+    event->next = NULL;
+    event->active = false;
+}
+
+/**
+ * @brief Call the events that are due
+ */
+static void run_due(void)
+{
+    Timebase_Event_t *event;
+    uint64_t now = Timebase_NowUs();
+    uint64_t late;
+    uint32_t missed;
+
+    while((head != NULL) && (head->deadline_us <= now))
+    {
+        event = head;
+        head = event->next;
+        event->next = NULL;
+        event->active = false;
+
+        late = now - event->deadline_us;
+        if((event->calls == 0) || (late < event->late_min_us))
+        {
+            event->late_min_us = (uint32_t)late;
+        }
+        if(late > event->late_max_us)
+        {
+            event->late_max_us = (uint32_t)late;
+        }
+        event->late_total_us += late;
+        event->calls++;
+
+        /* Rescheduled before the call, the callback may stop or restart it */
+        if(event->period_us != 0)
+        {
+            event->deadline_us += event->period_us;
+            if(event->deadline_us <= now)
+            {
+                missed = (uint32_t)((now - event->deadline_us) / event->period_us) + 1;
+                event->deadline_us += (uint64_t)missed * event->period_us;
+                event->overruns += missed;
+            }
+            list_insert(event);
+        }
+
+        event->callback(event->context);
+        now = Timebase_NowUs();
+    }
+
+    arm();
+}
+
+
+void Timebase_Init(void)
+{
+    uint32_t clock = HAL_RCC_GetPCLK1Freq();
+
+    /* Timers run at twice the APB1 clock when it's divided */
+    if((RCC->CFGR & RCC_CFGR_PPRE1) >= RCC_CFGR_PPRE1_2)
+    {
+        clock *= 2;
+    }
+
+    __HAL_RCC_TIM2_CLK_ENABLE();
+
+    TIM2->CR1 = 0;
+    TIM2->PSC = clock / TIMEBASE_HZ - 1;
+    TIM2->ARR = 0xFFFFFFFFU;
+    /* The prescaler is loaded on an update event */
+    TIM2->EGR = TIM_EGR_UG;
+    TIM2->CNT = 0;
+    TIM2->SR = 0;
+    wraps = 0;
+
+    TIM2->DIER = TIM_DIER_UIE | TIM_DIER_CC1IE;
+    HAL_NVIC_SetPriority(TIM2_IRQn, TIMEBASE_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(TIM2_IRQn);
+    TIM2->CR1 = TIM_CR1_CEN;
+}
+
+
+uint64_t Timebase_NowUs(void)
+{
+    uint32_t high, low;
+    bool pending;
+
+    /* Read again if the update interrupt has run in between */
+    do
+    {
+        high = wraps;
+        low = TIM2->CNT;
+        /* Wrapped, but the interrupt hasn't run: called with it held up */
+        pending = (TIM2->SR & TIM_SR_UIF) && (low < TIMEBASE_HALF);
+    }
+    while(high != wraps);
+
+    return ((uint64_t)(high + (pending ? 1 : 0)) << 32) | low;
+}
+
+
+void Timebase_Start(Timebase_Event_t *event, uint32_t delay_us, uint32_t period_us,
+                    Timebase_Callback_t callback, void *context)
+{
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    if(event->active)
+    {
+        list_remove(event);
+    }
+    event->callback = callback;
+    event->context = context;
+    event->period_us = period_us;
+    event->deadline_us = Timebase_NowUs() + delay_us;
+    list_insert(event);
+    arm();
+
+    __set_PRIMASK(primask);
+}
+
+
+void Timebase_Stop(Timebase_Event_t *event)
+{
+    uint32_t primask;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    if(event->active)
+    {
+        list_remove(event);
+        arm();
+    }
+
+    __set_PRIMASK(primask);
+}
+
+
+void Timebase_IRQHandler(void)
+{
+    uint32_t sr = TIM2->SR;
+
+    /* rc_w0 flags: writing 1 to the others leaves them alone */
+    if(sr & TIM_SR_UIF)
+    {
+        TIM2->SR = (uint32_t)~TIM_SR_UIF;
+        wraps++;
+    }
+
+    if(sr & TIM_SR_CC1IF)
+    {
+        TIM2->SR = (uint32_t)~TIM_SR_CC1IF;
+        run_due();
+    }
+}
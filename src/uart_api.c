@@ -1,28 +1,259 @@
 #include <stdlib.h>
+#include <ctype.h>
+#include <stdarg.h>
 #include <string.h>
 #include <stdbool.h>
 
 #include "stm32l4xx_hal.h"
 #include "user_functions.h"
 #include "uart_api.h"
+#include "usart_ll.h"
 #include "error.h"
+#include "dlog.h"
 
-#define INCOMING_BUFF_LENGTH    64
+/* Holds a batch of 32 commands, a longer line is refused */
+#define INCOMING_LINE_MAX       511
+#define INCOMING_BUFF_LENGTH    (INCOMING_LINE_MAX + 1)
+/* scanf() field width of a line */
+#define STR(x)                  #x
+#define XSTR(x)                 STR(x)
+/* Reply of a command batch, sent when full or when the batch is done */
+#define REPLY_BUFFER_LENGTH     1024
+/* Background work while waiting for a character, as often as the old HAL_UART_Receive() timeout */
+#define RX_IDLE_PERIOD_MS       16
+
+#ifndef CONSOLE_BAUD
+#define CONSOLE_BAUD            115200
+#endif
+/* The first character after reset may set the rate, see UartAPI_SwitchBaudRate() */
+#ifndef CONSOLE_AUTOBAUD
+#define CONSOLE_AUTOBAUD        1
+#endif
+
+/* Auto baud rate detection measures this character */
+#define AUTOBAUD_SYNC_CHAR      0x55
+/* A switched rate is undone unless the client confirms it in time */
+#define BAUD_CONFIRM_TIMEOUT_MS 1000
+/* BRR range with 16x oversampling */
+#define BRR_MIN                 16U
+#define BRR_MAX                 0xFFFFU
+/* Rate error the receivers tolerate, 1/1000 */
+#define BAUD_MAX_ERROR_PERMILLE 20
+
+/* USART1_TX is request 2 of DMA1 channel 4 */
+#define TX_DMA_CHANNEL          DMA1_Channel4
+#define TX_DMA_REQUEST          2U
+#define TX_DMA_TC_FLAG          DMA_ISR_TCIF4
+#define TX_DMA_CLEAR_FLAGS      DMA_IFCR_CGIF4
+/* A chain that moves no character for this long is stopped, 10 characters at 1200 baud */
+#define TX_DMA_STALL_MS         100
+
+/* Menu: header, up to 3 segments per command, footer */
+#define MENU_COMMANDS_MAX       32
+#define MENU_SEGMENTS_MAX       (2 + 3 * MENU_COMMANDS_MAX)
+/* Power of 2. Holds 16 update chunks, enough for a page erase at 115200 */
+#define RX_BUFFER_SIZE          4096
 
 UART_HandleTypeDef huart1;
 
+static volatile uint8_t rx_buffer[RX_BUFFER_SIZE];
+static volatile uint16_t rx_head;
+static volatile uint16_t rx_tail;
+static volatile uint32_t rx_overflows;
+
+static char reply_buffer[REPLY_BUFFER_LENGTH];
+static uint16_t reply_length;
+static bool reply_buffered;
+static bool quiet;
+/* Auto baud rate detection is armed, the next character is measured */
+static bool autobaud;
+
+static UartAPI_Segment_t menu_segments[MENU_SEGMENTS_MAX];
+static uint16_t menu_segments_count;
+
+/* DMA chain in flight, advanced by the transfer complete interrupt */
+static const UartAPI_Segment_t *volatile tx_segments;
+static volatile uint16_t tx_segments_left;
+static volatile bool tx_dma_busy;
+
+
+/**
+ * @brief Load the next non-empty segment of the chain, stop the channel after the last one
+ */
+static void tx_dma_next(void)
+{
+    CLEAR_BIT(TX_DMA_CHANNEL->CCR, DMA_CCR_EN);
+    DMA1->IFCR = TX_DMA_CLEAR_FLAGS;
+
+    while((tx_segments_left != 0) && (tx_segments->length == 0))
+    {
+        tx_segments++;
+        tx_segments_left--;
+    }
+
+    if(tx_segments_left == 0)
+    {
+        CLEAR_BIT(TX_DMA_CHANNEL->CCR, DMA_CCR_TCIE);
+        tx_dma_busy = false;
+        return;
+    }
+
+    TX_DMA_CHANNEL->CMAR = (uintptr_t)tx_segments->data;
+    TX_DMA_CHANNEL->CNDTR = tx_segments->length;
+    tx_segments++;
+    tx_segments_left--;
+    SET_BIT(TX_DMA_CHANNEL->CCR, DMA_CCR_TCIE | DMA_CCR_EN);
+}
+
+/**
+ * @brief Wait until the DMA chain is out of memory, the CPU writes to TDR after it. The chain
+ *        is advanced from here too when the caller masks interrupts. A channel which moves
+ *        nothing for TX_DMA_STALL_MS is stopped and the rest of the chain dropped
+ */
+static void tx_dma_wait(void)
+{
+    uint32_t primask, progress, last = UINT32_MAX, since = 0;
+
+    while(tx_dma_busy)
+    {
+        progress = ((uint32_t)tx_segments_left << 16) | TX_DMA_CHANNEL->CNDTR;
+        if(progress != last)
+        {
+            last = progress;
+            since = HAL_GetTick();
+        }
+
+        primask = __get_PRIMASK();
+        __disable_irq();
+        if(tx_dma_busy && (DMA1->ISR & TX_DMA_TC_FLAG))
+        {
+            tx_dma_next();
+        }
+        else if(tx_dma_busy && (HAL_GetTick() - since >= TX_DMA_STALL_MS))
+        {
+            tx_segments_left = 0;
+            tx_dma_next();
+        }
+        __set_PRIMASK(primask);
+    }
+}
+
+
+static void send_reply(void)
+{
+    tx_dma_wait();
+    if(reply_length != 0)
+    {
+        UsartLL_Write(USART1, (const uint8_t *)reply_buffer, reply_length);
+        reply_length = 0;
+    }
+}
+
+/**
+ * @brief Reprogram the USART without HAL_UART_Init(): CR3 (the TX DMA request) and the interrupt
+ *        enables are kept. Waits until the line is idle
+ * @param[in] brr rate divider
+ * @param[in] detect arm auto baud rate detection on the next character
+ */
+static void usart_configure(uint32_t brr, bool detect)
+{
+    tx_dma_wait();
+    UsartLL_WaitIdle(USART1);
+
+    /* BRR and ABREN are written with the USART disabled */
+    CLEAR_BIT(USART1->CR1, USART_CR1_UE);
+    USART1->BRR = brr;
+    if(detect)
+    {
+        SET_BIT(USART1->CR2, USART_CR2_ABREN);
+    }
+    else
+    {
+        CLEAR_BIT(USART1->CR2, USART_CR2_ABREN);
+    }
+    SET_BIT(USART1->CR1, USART_CR1_UE);
+
+    autobaud = detect;
+}
+
+/**
+ * @brief BRR of a rate with 16x oversampling, rounded
+ */
+static uint32_t brr_for(uint32_t baud)
+{
+    return (HAL_RCC_GetPCLK2Freq() + baud / 2) / baud;
+}
+
+/**
+ * @brief Finish auto baud rate detection on the first character received. The measured rate is
+ *        kept if the character was the sync frame, the configured one otherwise. The character
+ *        is not passed to the console either way: another one was sampled while the rate was
+ *        being measured and may not be what the client sent
+ */
+static void autobaud_complete(uint8_t ch)
+{
+    bool detected = ((USART1->ISR & (USART_ISR_ABRF | USART_ISR_ABRE)) == USART_ISR_ABRF) &&
+                    (ch == AUTOBAUD_SYNC_CHAR);
+
+    if(detected)
+    {
+        huart1.Init.BaudRate = HAL_RCC_GetPCLK2Freq() / USART1->BRR;
+    }
+    usart_configure(brr_for(huart1.Init.BaudRate), false);
+}
+
 /**
  * @brief Custom implementation of WEAK __io_putchar() function from syscallc.c
  */
 int __io_putchar(int ch)
 {
-    if(HAL_UART_Transmit(&huart1, (uint8_t *)&ch, 1, 100) != HAL_OK)
+    /* A batch reply goes out in one transfer instead of one per character */
+    if(reply_buffered)
     {
-        return -1;
+        if(reply_length == REPLY_BUFFER_LENGTH)
+        {
+            send_reply();
+        }
+        reply_buffer[reply_length++] = (char)ch;
+        return ch;
     }
+
+    tx_dma_wait();
+    UsartLL_PutChar(USART1, (uint8_t)ch);
     return ch;
 }
 
+/**
+ * @brief Block version of __io_putchar() for _write() in syscalls.c
+ */
+int __io_write(const char *ptr, int len)
+{
+    uint16_t chunk;
+
+    if(reply_buffered != true)
+    {
+        tx_dma_wait();
+        UsartLL_Write(USART1, (const uint8_t *)ptr, len);
+        return len;
+    }
+
+    for(int done = 0; done < len; done += chunk)
+    {
+        if(reply_length == REPLY_BUFFER_LENGTH)
+        {
+            send_reply();
+        }
+        chunk = REPLY_BUFFER_LENGTH - reply_length;
+        if(chunk > len - done)
+        {
+            chunk = len - done;
+        }
+        memcpy(&reply_buffer[reply_length], &ptr[done], chunk);
+        reply_length += chunk;
+    }
+    return len;
+}
+
 /**
  * @brief Custom implementation of WEAK __io_getchar() function from syscallc.c
  */
@@ -30,11 +261,27 @@ int __io_getchar(void)
 {
     char data[4];
     uint8_t ch, len = 1;
+    uint32_t idle_start = HAL_GetTick();
+    bool measured;
 
-    while(HAL_UART_Receive(&huart1, &ch, 1, 0x10) != HAL_OK)
+    do
     {
-        __asm__("nop");
+        while(UsartLL_TryGetChar(USART1, &ch) != true)
+        {
+            if(HAL_GetTick() - idle_start >= RX_IDLE_PERIOD_MS)
+            {
+                UserFunctions_Process();
+                idle_start = HAL_GetTick();
+            }
+        }
+
+        measured = autobaud;
+        if(measured)
+        {
+            autobaud_complete(ch);
+        }
     }
+    while(measured);
 
     memset(data, 0x00, 4);
     switch(ch)
@@ -56,7 +303,11 @@ int __io_getchar(void)
             break;
     }
 
-    HAL_UART_Transmit(&huart1, (uint8_t *)&data, len, 100);
+    if(quiet != true)
+    {
+        tx_dma_wait();
+        UsartLL_Write(USART1, (const uint8_t *)data, len);
+    }
     return ch;
 }
 
@@ -64,7 +315,7 @@ int __io_getchar(void)
 void UartAPI_Init(void)
 {
   huart1.Instance = USART1;
-  huart1.Init.BaudRate = 115200;
+  huart1.Init.BaudRate = CONSOLE_BAUD;
   huart1.Init.WordLength = UART_WORDLENGTH_8B;
   huart1.Init.StopBits = UART_STOPBITS_1;
   huart1.Init.Parity = UART_PARITY_NONE;
@@ -72,11 +323,28 @@ void UartAPI_Init(void)
   huart1.Init.HwFlowCtl = UART_HWCONTROL_NONE;
   huart1.Init.OverSampling = UART_OVERSAMPLING_16;
   huart1.Init.OneBitSampling = UART_ONE_BIT_SAMPLE_DISABLE;
+#if CONSOLE_AUTOBAUD
+  huart1.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_AUTOBAUDRATE_INIT;
+  huart1.AdvancedInit.AutoBaudRateEnable = UART_ADVFEATURE_AUTOBAUDRATE_ENABLE;
+  huart1.AdvancedInit.AutoBaudRateMode = UART_ADVFEATURE_AUTOBAUDRATE_ON0X55FRAME;
+  autobaud = true;
+#else
   huart1.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
+#endif
   if (HAL_UART_Init(&huart1) != HAL_OK)
   {
     Error_Handler();
   }
+
+  /* TX DMA for UartAPI_SendSegments(): 8-bit memory to TDR, the channel is enabled per segment
+     and reloaded from the transfer complete interrupt */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  MODIFY_REG(DMA1_CSELR->CSELR, DMA_CSELR_C4S, TX_DMA_REQUEST << DMA_CSELR_C4S_Pos);
+  TX_DMA_CHANNEL->CCR = DMA_CCR_MINC | DMA_CCR_DIR;
+  TX_DMA_CHANNEL->CPAR = (uintptr_t)&USART1->TDR;
+  SET_BIT(USART1->CR3, USART_CR3_DMAT);
+  HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
 }
 
 
@@ -115,62 +383,503 @@ __RAM_FUNC void UartAPI_SendString(char *c, int len)
 }
 
 
+void UartAPI_SendRaw(UartAPI_TxPath_t path, const char *data, uint32_t len)
+{
+    tx_dma_wait();
+    switch(path)
+    {
+        case UartAPI_TxPath_HAL:
+            for(uint32_t i = 0; i < len; i++)
+            {
+                HAL_UART_Transmit(&huart1, (uint8_t *)&data[i], 1, 100);
+            }
+            break;
+
+        case UartAPI_TxPath_WaitTC:
+            UartAPI_SendString((char *)data, len);
+            break;
+
+        default:
+            UsartLL_Write(USART1, (const uint8_t *)data, len);
+            break;
+    }
+
+    UsartLL_WaitIdle(USART1);
+}
+
+
+uint32_t UartAPI_GetBaudRate(void)
+{
+    return huart1.Init.BaudRate;
+}
+
+
+bool UartAPI_SwitchBaudRate(uint32_t baud)
+{
+    uint32_t pclk = HAL_RCC_GetPCLK2Freq();
+    uint32_t old_baud = huart1.Init.BaudRate;
+    uint32_t brr, actual, start;
+    char line[12];
+    char *end;
+    uint8_t len = 0;
+    uint8_t ch;
+
+    if(baud == 0)
+    {
+        printf(TC_RESET"Send 'U' at the new rate, it sets the rate and is not taken as input\r\n");
+        UartAPI_FlushReply();
+        usart_configure(brr_for(old_baud), true);
+        return true;
+    }
+
+    brr = (pclk + baud / 2) / baud;
+    if((brr < BRR_MIN) || (brr > BRR_MAX))
+    {
+        printf(TC_RED"Baud rate should be in range: %lu..%lu\r\n", pclk / BRR_MAX + 1, pclk / BRR_MIN);
+        return false;
+    }
+
+    actual = pclk / brr;
+    if((actual > baud ? actual - baud : baud - actual) * 1000ULL / baud > BAUD_MAX_ERROR_PERMILLE)
+    {
+        printf(TC_RED"%lu baud can't be made from %lu Hz, nearest %lu\r\n", baud, pclk, actual);
+        return false;
+    }
+
+    printf(TC_RESET"Switching to %lu baud, send \"%lu\" and Enter at the new rate within %u ms\r\n",
+            baud, baud, BAUD_CONFIRM_TIMEOUT_MS);
+    UartAPI_FlushReply();
+    usart_configure(brr, false);
+    huart1.Init.BaudRate = baud;
+
+    /* Anything but the rate, noise of a client still at the old rate included, doesn't confirm */
+    start = HAL_GetTick();
+    while(HAL_GetTick() - start < BAUD_CONFIRM_TIMEOUT_MS)
+    {
+        if(UsartLL_TryGetChar(USART1, &ch) != true)
+        {
+            continue;
+        }
+
+        if((ch == '\r') || (ch == '\n'))
+        {
+            line[len] = '\0';
+            if((len != 0) && (strtoul(line, &end, 10) == baud) && (*end == '\0'))
+            {
+                printf(TC_RESET"Baud rate: %lu\r\n", baud);
+                return true;
+            }
+            len = 0;
+        }
+        else if(len < sizeof(line) - 1)
+        {
+            line[len++] = (char)ch;
+        }
+    }
+
+    usart_configure(brr_for(old_baud), false);
+    huart1.Init.BaudRate = old_baud;
+    printf(TC_RED"Not confirmed, back to %lu baud\r\n", old_baud);
+    return false;
+}
+
+
+void UartAPI_RxBufferStart(void)
+{
+    rx_head = 0;
+    rx_tail = 0;
+    rx_overflows = 0;
+
+    USART1->ICR = USART_ICR_ORECF;
+    (void)USART1->RDR;
+    SET_BIT(USART1->CR1, USART_CR1_RXNEIE);
+    HAL_NVIC_SetPriority(USART1_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(USART1_IRQn);
+}
+
+
+void UartAPI_RxBufferStop(void)
+{
+    CLEAR_BIT(USART1->CR1, USART_CR1_RXNEIE);
+    HAL_NVIC_DisableIRQ(USART1_IRQn);
+    rx_tail = rx_head;
+}
+
+
+bool UartAPI_RxBufferGet(char *c)
+{
+    uint16_t tail = rx_tail;
+
+    if(tail == rx_head)
+    {
+        return false;
+    }
+    *c = (char)rx_buffer[tail];
+    rx_tail = (tail + 1) & (RX_BUFFER_SIZE - 1);
+    return true;
+}
+
+
+uint32_t UartAPI_RxBufferOverflows(void)
+{
+    return rx_overflows;
+}
+
+
+void UartAPI_IRQHandler(void)
+{
+    uint32_t isr = USART1->ISR;
+    uint16_t next;
+
+    if(isr & USART_ISR_ORE_Msk)
+    {
+        USART1->ICR = USART_ICR_ORECF;
+        rx_overflows++;
+    }
+
+    if(isr & USART_ISR_RXNE_Msk)
+    {
+        /* Reading RDR clears RXNE */
+        uint8_t data = (uint8_t)USART1->RDR;
+
+        next = (rx_head + 1) & (RX_BUFFER_SIZE - 1);
+        if(next != rx_tail)
+        {
+            rx_buffer[rx_head] = data;
+            rx_head = next;
+        }
+        else
+        {
+            rx_overflows++;
+        }
+    }
+}
+
+
+/**
+ * @brief Parse the arguments of a command into its argument struct, one pass over the line
+ * @param[in] func command with the argument schema
+ * @param[in] p the line after the command name
+ * @param[out] args argument struct of the command
+ * @retval true if the arguments match the schema, the reason is printed otherwise
+ */
+static bool parse_args(const Command_t *func, const char *p, void *args)
+{
+    for(uint8_t i = 0; i < func->args_count; i++)
+    {
+        const Command_Arg_t *arg = &func->args[i];
+        void *field = (uint8_t *)args + arg->offset;
+        int64_t value = arg->def;
+        bool negative;
+
+        if(*p == ',')
+        {
+            p++;
+        }
+
+        if((*p == ',') || (*p == '\0'))
+        {
+            if(arg->optional != true)
+            {
+                printf(TC_RED"Argument \"%s\" is required\r\n", arg->name);
+                return false;
+            }
+        }
+        else
+        {
+            negative = (*p == '-');
+            if(negative)
+            {
+                p++;
+            }
+            if((*p < '0') || (*p > '9'))
+            {
+                printf(TC_RED"Argument \"%s\" should be a number\r\n", arg->name);
+                return false;
+            }
+
+            /* Saturates, anything that long is out of range */
+            for(value = 0; (*p >= '0') && (*p <= '9'); p++)
+            {
+                if(value <= INT32_MAX)
+                {
+                    value = value * 10 + (*p - '0');
+                }
+            }
+            value = negative ? -value : value;
+
+            if(((*p != ',') && (*p != '\0')) || (value < arg->min) || (value > arg->max))
+            {
+                printf(TC_RED"Argument \"%s\" should be in range: %ld..%ld\r\n", arg->name, arg->min, arg->max);
+                return false;
+            }
+        }
+
+        switch(arg->type)
+        {
+            case Command_ArgType_U8:    *(uint8_t *)field = (uint8_t)value; break;
+            case Command_ArgType_U16:   *(uint16_t *)field = (uint16_t)value; break;
+            case Command_ArgType_U32:   *(uint32_t *)field = (uint32_t)value; break;
+            case Command_ArgType_I32:   *(int32_t *)field = (int32_t)value; break;
+            default: break;
+        }
+    }
+
+    if(*p != '\0')
+    {
+        printf(TC_RED"Too many arguments, \"%s\" takes %u\r\n", func->command_name, func->args_count);
+        return false;
+    }
+
+    return true;
+}
+
+
+void UartAPI_SendSegments(const UartAPI_Segment_t *segments, uint16_t count)
+{
+    /* The previous chain and the text printed before go first */
+    UartAPI_FlushReply();
+
+    tx_segments = segments;
+    tx_segments_left = count;
+    tx_dma_busy = true;
+    tx_dma_next();
+}
+
+
+void UartAPI_TxDMA_IRQHandler(void)
+{
+    /* The channel is reloaded as soon as the previous block is in the USART, the line doesn't go idle */
+    if(DMA1->ISR & TX_DMA_TC_FLAG)
+    {
+        tx_dma_next();
+    }
+}
+
+
+void UartAPI_OutputInit(UartAPI_Output_t *out, UartAPI_Segment_t *segments, uint16_t capacity,
+                        char *scratch, uint16_t scratch_size)
+{
+    out->segments = segments;
+    out->capacity = capacity;
+    out->count = 0;
+    out->scratch = scratch;
+    out->scratch_size = scratch_size;
+    out->scratch_used = 0;
+    out->overflow = false;
+}
+
+
+void UartAPI_OutputText(UartAPI_Output_t *out, const char *text)
+{
+    uint16_t len = strlen(text);
+
+    if(len == 0)
+    {
+        return;
+    }
+    if(out->count == out->capacity)
+    {
+        out->overflow = true;
+        return;
+    }
+
+    out->segments[out->count].data = text;
+    out->segments[out->count].length = len;
+    out->count++;
+}
+
+
+void UartAPI_OutputFormat(UartAPI_Output_t *out, const char *format, ...)
+{
+    char *field = &out->scratch[out->scratch_used];
+    uint16_t room = out->scratch_size - out->scratch_used;
+    UartAPI_Segment_t *last = (out->count != 0) ? &out->segments[out->count - 1] : NULL;
+    va_list args;
+    int len;
+
+    va_start(args, format);
+    len = vsnprintf(field, room, format, args);
+    va_end(args);
+
+    if((len < 0) || (len >= room))
+    {
+        out->overflow = true;
+        return;
+    }
+
+    /* Fields formatted one after another are one segment */
+    if((last != NULL) && (last->data + last->length == field))
+    {
+        last->length += len;
+    }
+    else if(out->count < out->capacity)
+    {
+        out->segments[out->count].data = field;
+        out->segments[out->count].length = len;
+        out->count++;
+    }
+    else
+    {
+        out->overflow = true;
+        return;
+    }
+
+    out->scratch_used += len;
+}
+
+
+void UartAPI_OutputSend(const UartAPI_Output_t *out)
+{
+    UartAPI_SendSegments(out->segments, out->count);
+    /* The scratch buffer is the caller's */
+    tx_dma_wait();
+}
+
+
+void UartAPI_FlushReply(void)
+{
+    /* Text buffered by stdio comes through __io_write() */
+    fflush(stdout);
+    send_reply();
+    tx_dma_wait();
+    UsartLL_WaitIdle(USART1);
+}
+
+
+void UartAPI_SetQuiet(bool enable)
+{
+    quiet = enable;
+}
+
+
 void UartAPI_PrintMenu(void)
 {
+    UartAPI_Output_t out;
     Command_t *func;
-    printf(TC_YELLOW"\r\n\r\nUse next commands to control peripheral devices:\r\n");
-    for(uint8_t i = 0; i < UserFunctions_GetFuncCount(); i++)
+
+    /* The command list is constant, the menu is only referenced text */
+    if(menu_segments_count == 0)
     {
-        func = UserFunctions_GetFunc(i);
-        printf(TC_YELLOW"- %s%s\r\n", func->command_name, func->command_param);
+        UartAPI_OutputInit(&out, menu_segments, MENU_SEGMENTS_MAX, NULL, 0);
+        UartAPI_OutputText(&out, TC_YELLOW"\r\n\r\nUse next commands to control peripheral devices:\r\n");
+        for(uint8_t i = 0; i < UserFunctions_GetFuncCount(); i++)
+        {
+            func = UserFunctions_GetFunc(i);
+            UartAPI_OutputText(&out, (i == 0) ? TC_YELLOW"- " : "\r\n"TC_YELLOW"- ");
+            UartAPI_OutputText(&out, func->command_name);
+            UartAPI_OutputText(&out, func->command_param);
+        }
+        UartAPI_OutputText(&out, "\r\n\r\n");
+        menu_segments_count = out.count;
     }
-    printf("\r\n");
+
+    UartAPI_SendSegments(menu_segments, menu_segments_count);
 }
 
 
-void UartAPI_WaitForCommandAndExecute(void)
+/**
+ * @brief Find and run a command
+ * @param[in] line command name with its arguments
+ * @param[in] batch part of a batch, the deferred log is sent at the end of the batch
+ */
+static void execute_command(const char *line, bool batch)
 {
-    char incom[INCOMING_BUFF_LENGTH];
-    int value = -1;
+    /* Argument struct of the command, word aligned for any field type */
+    uint32_t args[COMMAND_ARGS_MAX_SIZE / sizeof(uint32_t)];
+    size_t name_len;
     bool res;
-    char *p;
-    bool command_found = false;
     Command_t *func;
 
-    printf(TC_RESET"\r\nWaiting for commands..\r\n\r\n");
-
-    memset(incom, 0 ,INCOMING_BUFF_LENGTH);
-    scanf("%s", incom);
+    /* Command name is everything up to the first comma */
+    name_len = strcspn(line, ",");
 
     for(uint8_t i = 0; i < UserFunctions_GetFuncCount(); i++)
     {
         func = UserFunctions_GetFunc(i);
-        p = strstr(incom, func->command_name);
 
         /* Command found */
-        if( p != NULL )
+        if((strncmp(line, func->command_name, name_len) == 0) && (func->command_name[name_len] == '\0'))
         {
-            command_found = true;
-            p = strstr(incom,",");
-
-            /* Value found */
-            if( p != NULL )
+            if(parse_args(func, &line[name_len], args) != true)
             {
-                value = atoi(p+1);
+                printf(TC_RESET"Status: ERROR\r\n");
+                return;
             }
-            res = func->run(value);
+
+            UserFunctions_CompleteInit();
+            res = func->run((func->args_count != 0) ? args : NULL);
             if(res != true)
             {
-                printf(TC_RED"Function %s failed\r\n"TC_RESET, func->command_name);
+                DLOG(TC_RED"Function %s failed\r\n"TC_RESET, func->command_name);
             }
-            break;
+            /* The ring doesn't hold the records of a long batch */
+            if((batch != true) || DLog_IsHalfFull())
+            {
+                DLog_Flush();
+            }
+            return;
         }
     }
 
-    if(!command_found)
+    printf(TC_YELLOW"\r\nCommand \"%s\" is not found..\r\n", line);
+}
+
+
+void UartAPI_WaitForCommandAndExecute(void)
+{
+    /* Static, the line is as long as a batch */
+    static char incom[INCOMING_BUFF_LENGTH];
+    char *line;
+    int c;
+    char *next;
+    bool batch;
+
+    if(quiet != true)
     {
-        printf(TC_YELLOW"\r\nCommand \"%s\" is not found..\r\n", incom);
+        printf(TC_RESET"\r\nWaiting for commands..\r\n\r\n");
+    }
+
+    memset(incom, 0 ,INCOMING_BUFF_LENGTH);
+    scanf("%" XSTR(INCOMING_LINE_MAX) "s", incom);
+
+    /* The width stops scanf() at a full buffer, the rest of a longer line is still waiting */
+    if(strlen(incom) == INCOMING_LINE_MAX)
+    {
+        c = getchar();
+        if((c != EOF) && (isspace(c) == 0))
+        {
+            while((c != EOF) && (isspace(c) == 0))
+            {
+                c = getchar();
+            }
+            printf(TC_RED"Line is longer than %u characters, ignored\r\n"TC_RESET, INCOMING_LINE_MAX);
+            printf(TC_RESET"Status: ERROR\r\n");
+            return;
+        }
     }
-}
 
+    batch = (strchr(incom, ';') != NULL);
+    reply_buffered = batch;
 
+    for(line = incom; line != NULL; line = next)
+    {
+        next = strchr(line, ';');
+        if(next != NULL)
+        {
+            *next++ = '\0';
+        }
+
+        if(*line != '\0')
+        {
+            execute_command(line, batch);
+        }
+    }
+
+    if(batch)
+    {
+        DLog_Flush();
+        UartAPI_FlushReply();
+        reply_buffered = false;
+    }
+}
@@ -0,0 +1,282 @@
+#include <string.h>
+
+#include "stm32l4xx_hal.h"
+#include "update.h"
+#include "flash_api.h"
+#include "uart_api.h"
+#include "thermal.h"
+#include "crc.h"
+
+/* The inactive bank is always mapped here */
+#define UPDATE_SLOT_ADDR            (FLASH_BASE + FLASH_BANK_SIZE)
+
+/* type, chunk number, chunk, crc16 */
+#define UPDATE_FRAME_MAX            (1 + 2 + UPDATE_CHUNK_SIZE + 2)
+
+typedef enum
+{
+    Frame_OK = 0,
+    Frame_Bad,
+    Frame_Timeout
+} Frame_Result_t;
+
+static Update_Stats_t stats;
+
+
+static uint16_t get_u16(const uint8_t *data)
+{
+    return data[0] | (uint16_t)data[1] << 8;
+}
+
+
+static uint32_t get_u32(const uint8_t *data)
+{
+    return get_u16(data) | (uint32_t)get_u16(data + 2) << 16;
+}
+
+
+/**
+ * @brief Payload length of the frame type
+ * @retval -1 for unknown type
+ */
+static int payload_length(uint8_t type)
+{
+    switch(type)
+    {
+        case UPDATE_FRAME_START:
+            return 2 * sizeof(uint32_t);
+
+        case UPDATE_FRAME_DATA:
+            return sizeof(uint16_t) + UPDATE_CHUNK_SIZE;
+
+        case UPDATE_FRAME_DONE:
+        case UPDATE_FRAME_ABORT:
+            return 0;
+
+        default:
+            return -1;
+    }
+}
+
+
+/**
+ * @brief Wait for the next frame
+ * @param[out] frame type, payload and crc16
+ */
+static Frame_Result_t receive_frame(uint8_t *frame)
+{
+    uint32_t start_tick = HAL_GetTick();
+    bool synced = false;
+    uint16_t pos = 0;
+    uint16_t total = 0;
+    int len;
+    char c;
+
+    while(1)
+    {
+        if(UartAPI_RxBufferGet(&c) != true)
+        {
+            if((HAL_GetTick() - start_tick) >= UPDATE_TIMEOUT_MS)
+            {
+                return Frame_Timeout;
+            }
+            /* Keep the fan under control while the console is busy */
+            Thermal_Process();
+            continue;
+        }
+
+        if(synced != true)
+        {
+            synced = ((uint8_t)c == UPDATE_SYNC_HOST);
+            continue;
+        }
+
+        frame[pos++] = (uint8_t)c;
+        if(pos == 1)
+        {
+            len = payload_length(frame[0]);
+            if(len < 0)
+            {
+                return Frame_Bad;
+            }
+            total = 1 + len + sizeof(uint16_t);
+        }
+        else if(pos == total)
+        {
+            return (Crc_Compute(Crc_Type_CCITT16, frame, total - 2) == get_u16(&frame[total - 2])) ? Frame_OK : Frame_Bad;
+        }
+    }
+}
+
+
+static void reply(Update_Status_t status, uint16_t seq)
+{
+    UartAPI_SendChar(UPDATE_SYNC_DEVICE);
+    UartAPI_SendChar(status);
+    UartAPI_SendChar(seq & 0xFF);
+    UartAPI_SendChar(seq >> 8);
+}
+
+
+bool Update_Run(void)
+{
+    uint8_t frame[UPDATE_FRAME_MAX];
+    uint32_t image_crc = 0;
+    uint32_t start_tick = 0;
+    uint16_t chunks_total = 0;
+    uint16_t expected = 0;
+    uint16_t seq;
+    bool started = false;
+    bool nak_sent = false;
+    bool running = true;
+    Frame_Result_t res;
+
+    memset(&stats, 0, sizeof(stats));
+    stats.status = Update_Status_Timeout;
+
+    UartAPI_RxBufferStart();
+
+    while(running)
+    {
+        res = receive_frame(frame);
+        if(res == Frame_Timeout)
+        {
+            stats.status = Update_Status_Timeout;
+            break;
+        }
+
+        if(res == Frame_Bad)
+        {
+            /* The host goes back on the first NAK, the frames already in flight are ignored */
+            if(nak_sent != true)
+            {
+                reply(Update_Status_BadFrame, expected);
+                nak_sent = true;
+                stats.naks++;
+            }
+            continue;
+        }
+
+        switch(frame[0])
+        {
+            case UPDATE_FRAME_START:
+                stats.length = get_u32(&frame[1]);
+                image_crc = get_u32(&frame[5]);
+                if((stats.length == 0) || (stats.length > UPDATE_MAX_IMAGE_SIZE))
+                {
+                    stats.status = Update_Status_BadLength;
+                    running = false;
+                    break;
+                }
+
+                start_tick = HAL_GetTick();
+                if(FlashAPI_Erase(UPDATE_SLOT_ADDR, (stats.length + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE) != true)
+                {
+                    stats.status = Update_Status_FlashError;
+                    running = false;
+                    break;
+                }
+                stats.erase_ms = HAL_GetTick() - start_tick;
+
+                chunks_total = (stats.length + UPDATE_CHUNK_SIZE - 1) / UPDATE_CHUNK_SIZE;
+                expected = 0;
+                started = true;
+                nak_sent = false;
+                reply(Update_Status_OK, expected);
+                break;
+
+            case UPDATE_FRAME_DATA:
+                seq = get_u16(&frame[1]);
+                if(started && (seq < expected))
+                {
+                    /* Sent again after a lost acknowledgement */
+                    stats.duplicates++;
+                    reply(Update_Status_OK, expected);
+                    break;
+                }
+
+                if((started != true) || (seq != expected) || (seq >= chunks_total))
+                {
+                    if(nak_sent != true)
+                    {
+                        reply(Update_Status_BadSeq, expected);
+                        nak_sent = true;
+                        stats.naks++;
+                    }
+                    break;
+                }
+
+                if(FlashAPI_Program(UPDATE_SLOT_ADDR + (uint32_t)seq * UPDATE_CHUNK_SIZE, &frame[3], UPDATE_CHUNK_SIZE) != true)
+                {
+                    stats.status = Update_Status_FlashError;
+                    running = false;
+                    break;
+                }
+
+                expected++;
+                stats.chunks++;
+                nak_sent = false;
+                reply(Update_Status_OK, expected);
+                break;
+
+            case UPDATE_FRAME_DONE:
+                if((started != true) || (expected != chunks_total))
+                {
+                    stats.status = Update_Status_BadLength;
+                }
+                else if(Crc_Compute(Crc_Type_CRC32, (const void *)UPDATE_SLOT_ADDR, stats.length) != image_crc)
+                {
+                    stats.status = Update_Status_BadCRC;
+                }
+                else
+                {
+                    stats.status = Update_Status_OK;
+                }
+                running = false;
+                break;
+
+            case UPDATE_FRAME_ABORT:
+            default:
+                stats.status = Update_Status_Aborted;
+                running = false;
+                break;
+        }
+    }
+
+    stats.duration_ms = started ? HAL_GetTick() - start_tick : 0;
+    stats.rx_overflows = UartAPI_RxBufferOverflows();
+
+    UartAPI_RxBufferStop();
+
+    /* Final status, the host doesn't wait for it after a timeout */
+    if(stats.status != Update_Status_Timeout)
+    {
+        reply(stats.status, UPDATE_SEQ_FINAL);
+    }
+
+    return stats.status == Update_Status_OK;
+}
+
+
+void Update_GetStats(Update_Stats_t *update_stats)
+{
+    *update_stats = stats;
+}
+
+
+bool Update_IsOtherBankValid(void)
+{
+    const uint32_t *vectors = (const uint32_t *)UPDATE_SLOT_ADDR;
+    uint32_t sp = vectors[0];
+    uint32_t reset = vectors[1] & ~1U;
+
+    /* The image is linked at FLASH_BASE and runs from there after the swap */
+    return (sp > SRAM1_BASE) && (sp <= SRAM1_BASE + SRAM1_SIZE_MAX) &&
+           (reset >= FLASH_BASE) && (reset < FLASH_BASE + UPDATE_MAX_IMAGE_SIZE);
+}
+
+
+bool Update_SwapBank(void)
+{
+    return FlashAPI_SetBootBank(FlashAPI_IsBankSwapped() != true);
+}
@@ -8,35 +8,338 @@
 #include "stm32l4xx_hal.h"
 
 #include "max6650.h"
+#include "hts221.h"
+#include "thermal.h"
+#include "lsm6dsl.h"
+#include "vibration.h"
+#include "i2c_devmap.h"
+#include "dlog.h"
+#include "stream.h"
+#include "archive.h"
+#include "update.h"
+#include "flash_api.h"
+#include "crc.h"
+#include "cycle_counter.h"
+#include "boot.h"
+#include "timebase.h"
+#include "tach.h"
 
-#define COMMANDS_COUNT          4
+#define COMMANDS_COUNT          23
+
+/* One MAX6650 on the board */
+#define FAN_COUNT               1
+/* set_fan_speed ramp: longest ramp and speed update period */
+#define FAN_RAMP_MAX_MS         60000
+#define FAN_RAMP_STEP_MS        100
+
+#define HTS221_CONVERSION_TIMEOUT_MS    100
+
+/* Benchmark input sizes: 64 B..1 MB, x4 */
+#define CRC_BENCH_MIN_SIZE              64
+#define CRC_BENCH_MAX_SIZE              (1024 * 1024)
+
+/* uart_bench block, sent as lines of this pattern */
+#define UART_BENCH_LINE                 "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ\r\n"
+#define UART_BENCH_LINE_LENGTH          (sizeof(UART_BENCH_LINE) - 1)
+#define UART_BENCH_MAX_SIZE             4096
+
+/* i2c_bench: MAX6650 count time register, reading it has no side effects */
+#define I2C_BENCH_REG                   0x16
+#define I2C_BENCH_MAX_COUNT             1000
+/* START, address, register, repeated START, address, data, acknowledges and STOP */
+#define I2C_BENCH_READ_BITS             38
+
+/* timer_bench: a period leaves time for the callback and the wait loop */
+#define TIMER_BENCH_MIN_PERIOD_US       20
+#define TIMER_BENCH_MAX_PERIOD_US       10000
+#define TIMER_BENCH_MAX_COUNT           10000
+#define TIMER_BENCH_NOW_CALLS           1000
+
+/* Console rate limit: 80 MHz USART1 clock, 16x oversampling */
+#define BAUD_MAX                        5000000
+
+/**
+ * @brief Device init step
+ */
+typedef struct
+{
+    bool (*run)(void);
+    const char *name;
+    bool res;
+    uint32_t time_us;
+} Init_Task_t;
+
+/**
+ * @brief Speed ramp started by set_fan_speed, stepped from the idle loop
+ */
+typedef struct
+{
+    bool active;
+    uint8_t from;
+    uint8_t to;
+    uint32_t start_tick;
+    uint32_t duration_ms;
+    uint32_t step_tick;
+} Fan_Ramp_t;
+
+/* Argument structs of the console commands */
+typedef struct
+{
+    uint8_t speed;
+    uint8_t fan;
+    uint16_t ramp_ms;
+} Args_SetFanSpeed_t;
+
+typedef struct
+{
+    int32_t max_age_ms;
+} Args_GetFanSpeed_t;
+
+typedef struct
+{
+    uint16_t rate_hz;
+} Args_Stream_t;
+
+typedef struct
+{
+    int32_t from_s;
+    int32_t to_s;
+} Args_History_t;
+
+typedef struct
+{
+    int32_t period_ms;
+} Args_Thermal_t;
+
+typedef struct
+{
+    uint8_t enable;
+} Args_Quiet_t;
+
+typedef struct
+{
+    uint16_t bytes;
+} Args_UartBench_t;
+
+typedef struct
+{
+    uint32_t rate;
+} Args_Baud_t;
+
+typedef struct
+{
+    uint16_t count;
+} Args_I2CBench_t;
+
+typedef struct
+{
+    uint32_t period_us;
+    uint16_t count;
+} Args_TimerBench_t;
+
+/**
+ * @brief timer_bench run: intervals between the callbacks measured with the cycle counter
+ */
+typedef struct
+{
+    Timebase_Event_t event;
+    uint32_t period_us;
+    uint16_t count;
+    bool one_shot;                      /* restarted from the callback instead of periodic */
+    uint32_t last_cycles;
+    int32_t deviation_min;              /* interval - period, cycles */
+    int32_t deviation_max;
+    volatile uint16_t calls;
+} Timer_Bench_t;
 
 static MAX6650_Config_t *max6650_config = NULL;
+static Fan_Ramp_t fan_ramp;
+
+static HTS221_Config_t hts221_config =
+{
+    .i2c_address = HTS221_I2C_ADDRESS,
+    .mode = HTS221_Mode_OneShot
+};
+
+/* Fan speed vs board temperature. The MAX6650 regulates down to 36% with KScale_16 */
+static const Thermal_CurvePoint_t thermal_curve[] =
+{
+    {250,   40},
+    {350,   60},
+    {450,   100}
+};
+
+static const Thermal_Config_t thermal_config =
+{
+    .curve = thermal_curve,
+    .curve_points = sizeof(thermal_curve) / sizeof(thermal_curve[0]),
+    .hysteresis = 15,
+    .update_period_ms = 1000
+};
+
+static LSM6DSL_Config_t lsm6dsl_config =
+{
+    .i2c_address = LSM6DSL_I2C_ADDRESS,
+    .odr = LSM6DSL_ODR_1660Hz
+};
+
+static const Archive_Config_t archive_config =
+{
+    .period_s = 10
+};
+
+static const Vibration_Config_t vibration_config =
+{
+    .axis = Vibration_Axis_Z,
+    .block_period_ms = 1000
+};
 
 /* MAX6650 I2C external interface configuration */
 static const struct MAX6650_I2C_ExtInterface max6650_i2c_ext_interface =
 {
     .i2c_setup = I2C_API_Init,
+    .i2c_read = I2C_API_ReadDirect,
+    .i2c_write = I2C_API_WriteDirect,
+    .get_tick_ms = HAL_GetTick
+};
+
+/* HTS221 I2C external interface configuration */
+static const struct HTS221_I2C_ExtInterface hts221_i2c_ext_interface =
+{
+    .i2c_read = I2C_API_ReadMultiple,
+    .i2c_write = I2C_API_WriteMultiple
+};
+
+/* LSM6DSL I2C external interface configuration */
+static const struct LSM6DSL_I2C_ExtInterface lsm6dsl_i2c_ext_interface =
+{
     .i2c_read = I2C_API_ReadMultiple,
     .i2c_write = I2C_API_WriteMultiple
 };
 
 
 /* Prototypes for console commands */
-static bool set_fan_speed(int var);
-static bool get_fan_speed(int var);
-static bool self_erase(int var);
-static bool help(int var);
+static bool set_fan_speed(const void *args);
+static bool get_fan_speed(const void *args);
+static bool stream(const void *args);
+static bool history(const void *args);
+static bool get_temperature(const void *args);
+static bool thermal(const void *args);
+static bool get_vibration(const void *args);
+static bool i2c_errors(const void *args);
+static bool scan(const void *args);
+static bool i2c_stats(const void *args);
+static bool i2c_reset_stats(const void *args);
+static bool dlog_stats(const void *args);
+static bool boot_times(const void *args);
+static bool crc_bench(const void *args);
+static bool uart_bench(const void *args);
+static bool i2c_bench(const void *args);
+static bool timer_bench(const void *args);
+static bool update(const void *args);
+static bool rollback(const void *args);
+static bool self_erase(const void *args);
+static bool quiet(const void *args);
+static bool baud(const void *args);
+static bool help(const void *args);
+
+
+/* Device init, deferred to the idle loop with FAST_BOOT */
+static bool devmap_init(void);
+static bool max6650_init(void);
+static bool hts221_init(void);
+static bool lsm6dsl_init(void);
+static bool archive_init(void);
+
+static void fan_ramp_process(void);
+
+static Init_Task_t init_tasks[] = {
+    {devmap_init,       "I2C scan"},
+    {max6650_init,      "MAX6650"},
+    {hts221_init,       "HTS221"},
+    {lsm6dsl_init,      "LSM6DSL"},
+    {archive_init,      "Archive"}
+};
+
+#define INIT_TASKS_COUNT        (sizeof(init_tasks) / sizeof(init_tasks[0]))
+
+static uint8_t init_next = 0;
+
+
+/**
+ * Argument schemas of the commands
+ */
+static const Command_Arg_t set_fan_speed_args[] = {
+    COMMAND_ARG(Args_SetFanSpeed_t, speed,      Command_ArgType_U8,     false,  0,  100,                0),
+    COMMAND_ARG(Args_SetFanSpeed_t, ramp_ms,    Command_ArgType_U16,    true,   0,  FAN_RAMP_MAX_MS,    0),
+    COMMAND_ARG(Args_SetFanSpeed_t, fan,        Command_ArgType_U8,     true,   0,  FAN_COUNT - 1,      0)
+};
+
+static const Command_Arg_t get_fan_speed_args[] = {
+    COMMAND_ARG(Args_GetFanSpeed_t, max_age_ms, Command_ArgType_I32,    true,   0,  INT32_MAX,          -1)
+};
 
+static const Command_Arg_t stream_args[] = {
+    COMMAND_ARG(Args_Stream_t,      rate_hz,    Command_ArgType_U16,    true,   1,  STREAM_MAX_RATE_HZ, STREAM_DEFAULT_RATE_HZ)
+};
+
+static const Command_Arg_t history_args[] = {
+    COMMAND_ARG(Args_History_t,     from_s,     Command_ArgType_I32,    true,   0,  INT32_MAX,          -1),
+    COMMAND_ARG(Args_History_t,     to_s,       Command_ArgType_I32,    true,   0,  INT32_MAX,          -1)
+};
+
+static const Command_Arg_t thermal_args[] = {
+    COMMAND_ARG(Args_Thermal_t,     period_ms,  Command_ArgType_I32,    true,   0,  INT32_MAX,          -1)
+};
+
+static const Command_Arg_t uart_bench_args[] = {
+    COMMAND_ARG(Args_UartBench_t,   bytes,      Command_ArgType_U16,    true,   UART_BENCH_LINE_LENGTH, UART_BENCH_MAX_SIZE, 1024)
+};
+
+static const Command_Arg_t i2c_bench_args[] = {
+    COMMAND_ARG(Args_I2CBench_t,    count,      Command_ArgType_U16,    true,   1,  I2C_BENCH_MAX_COUNT, 100)
+};
+
+static const Command_Arg_t timer_bench_args[] = {
+    COMMAND_ARG(Args_TimerBench_t,  period_us,  Command_ArgType_U32,    true,   TIMER_BENCH_MIN_PERIOD_US, TIMER_BENCH_MAX_PERIOD_US, 1000),
+    COMMAND_ARG(Args_TimerBench_t,  count,      Command_ArgType_U16,    true,   10, TIMER_BENCH_MAX_COUNT, 1000)
+};
+
+static const Command_Arg_t quiet_args[] = {
+    COMMAND_ARG(Args_Quiet_t,       enable,     Command_ArgType_U8,     true,   0,  1,                  1)
+};
+
+static const Command_Arg_t baud_args[] = {
+    COMMAND_ARG(Args_Baud_t,        rate,       Command_ArgType_U32,    false,  0,  BAUD_MAX,           0)
+};
 
 /**
  * List of commands with their names
  */
 static Command_t commands_list[COMMANDS_COUNT] = {
-    {set_fan_speed,     "set_fan_speed",    ",speed<0..100>"},
-    {get_fan_speed,     "get_fan_speed",    ""},
-    {self_erase,        "self_erase",       " "TC_RED"*Warning: this operation is irreversible"TC_RESET},
-    {help,              "help",             ""}
+    {set_fan_speed,     "set_fan_speed",    ",speed<0..100>,ramp_ms<0..60000, empty - 0>,fan<0, empty - 0>",    COMMAND_ARGS(set_fan_speed_args)},
+    {get_fan_speed,     "get_fan_speed",    ",max_age_ms<0 - fresh, empty - current gate>",                     COMMAND_ARGS(get_fan_speed_args)},
+    {stream,            "stream",           ",rate_hz<1..1000, empty - 100>, Ctrl+C to stop",                   COMMAND_ARGS(stream_args)},
+    {history,           "history",          ",from_s,to_s<empty - archive state>",                              COMMAND_ARGS(history_args)},
+    {get_temperature,   "get_temperature",  "",                                                                 COMMAND_NO_ARGS},
+    {thermal,           "thermal",          ",period_ms<0 - off, empty - default>",                             COMMAND_ARGS(thermal_args)},
+    {get_vibration,     "get_vibration",    "",                                                                 COMMAND_NO_ARGS},
+    {i2c_errors,        "i2c_errors",       "",                                                                 COMMAND_NO_ARGS},
+    {scan,              "scan",             "",                                                                 COMMAND_NO_ARGS},
+    {i2c_stats,         "i2c_stats",        "",                                                                 COMMAND_NO_ARGS},
+    {i2c_reset_stats,   "i2c_reset_stats",  "",                                                                 COMMAND_NO_ARGS},
+    {dlog_stats,        "dlog_stats",       "",                                                                 COMMAND_NO_ARGS},
+    {boot_times,        "boot_times",       "",                                                                 COMMAND_NO_ARGS},
+    {crc_bench,         "crc_bench",        "",                                                                 COMMAND_NO_ARGS},
+    {uart_bench,        "uart_bench",       ",bytes<64..4096, empty - 1024>",                                  COMMAND_ARGS(uart_bench_args)},
+    {i2c_bench,         "i2c_bench",        ",count<1..1000, empty - 100>",                                     COMMAND_ARGS(i2c_bench_args)},
+    {timer_bench,       "timer_bench",      ",period_us<20..10000, empty - 1000>,count<10..10000, empty - 1000>", COMMAND_ARGS(timer_bench_args)},
+    {update,            "update",           " - receive firmware from host/uploader into the other bank and boot it", COMMAND_NO_ARGS},
+    {rollback,          "rollback",         " - boot the firmware of the other bank",                           COMMAND_NO_ARGS},
+    {self_erase,        "self_erase",       " "TC_RED"*Warning: this operation is irreversible"TC_RESET,        COMMAND_NO_ARGS},
+    {quiet,             "quiet",            ",enable<0..1, empty - 1> - no banner and echo, for scripts",      COMMAND_ARGS(quiet_args)},
+    {baud,              "baud",             ",rate<1221..5000000, 0 - auto detect>",                           COMMAND_ARGS(baud_args)},
+    {help,              "help",             "",                                                                 COMMAND_NO_ARGS}
 };
 
 
@@ -117,22 +420,91 @@ static __RAM_FUNC void mass_erase_from_ram(void)
     }
 }
 
+/**
+ * @brief Step the set_fan_speed ramp, the speed follows a straight line from start to target
+ */
+static void fan_ramp_process(void)
+{
+    uint32_t elapsed;
+    uint8_t speed;
+    uint8_t speed_actual;
+
+    if((fan_ramp.active != true) || ((HAL_GetTick() - fan_ramp.step_tick) < FAN_RAMP_STEP_MS))
+    {
+        return;
+    }
+    fan_ramp.step_tick = HAL_GetTick();
+
+    elapsed = fan_ramp.step_tick - fan_ramp.start_tick;
+    if(elapsed >= fan_ramp.duration_ms)
+    {
+        speed = fan_ramp.to;
+        fan_ramp.active = false;
+    }
+    else
+    {
+        speed = fan_ramp.from + (int32_t)(fan_ramp.to - fan_ramp.from) * (int32_t)elapsed / (int32_t)fan_ramp.duration_ms;
+        /* The line to or from 0% passes speeds that can't be regulated */
+        if((speed != 0) && (speed < MAX6650_GetMinSpeed()))
+        {
+            speed = MAX6650_GetMinSpeed();
+        }
+    }
+
+    MAX6650_SetSpeed(speed, &speed_actual);
+}
+
 /**
  * @brief Handler for "set_fan_speed" command
- * @param[in] desired speed <0..100%>
+ * @param[in] Args_SetFanSpeed_t: desired speed <0..100%>, ramp time, fan
  */
-static bool set_fan_speed(int set_speed)
+static bool set_fan_speed(const void *args)
 {
+    const Args_SetFanSpeed_t *set = args;
     uint8_t speed_actual = 0;
     bool res;
+    Thermal_Status_t thermal_status;
 
-    res = MAX6650_SetSpeed(set_speed, &speed_actual);
-    printf(TC_RESET"Status: %s\r\n", get_status(res));
+    /* KTACH can't encode the speeds between 0 and the lowest regulated one */
+    if((set->speed != 0) && (set->speed < MAX6650_GetMinSpeed()))
+    {
+        DLOG(TC_RED"Speed 1..%u%% can't be regulated, use 0 to stop the fan\r\n"TC_RESET, MAX6650_GetMinSpeed() - 1);
+        return false;
+    }
+
+    /* Manual speed overrides the thermal control loop */
+    Thermal_GetStatus(&thermal_status);
+    if(thermal_status.enabled)
+    {
+        Thermal_SetUpdatePeriod(0);
+        DLOG(TC_YELLOW"Thermal control disabled\r\n");
+    }
+
+    /* The ramp starts now and goes on in background, the reply shows the speed it starts from */
+    fan_ramp.active = (set->ramp_ms != 0);
+    if(fan_ramp.active)
+    {
+        fan_ramp.from = MAX6650_GetTargetSpeed();
+        fan_ramp.to = set->speed;
+        fan_ramp.start_tick = HAL_GetTick();
+        fan_ramp.step_tick = fan_ramp.start_tick;
+        fan_ramp.duration_ms = set->ramp_ms;
+        res = MAX6650_GetSpeed(&speed_actual, MAX6650_MAX_AGE_FRESH, NULL);
+    }
+    else
+    {
+        res = MAX6650_SetSpeed(set->speed, &speed_actual);
+    }
+    DLOG(TC_RESET"Status: %s\r\n", get_status(res));
 
     if(res!=false)
     {
-        printf(TC_RESET"Set    speed: %d%%\r\n", set_speed);
-        printf(TC_RESET"Actual speed: %d%%\r\n", speed_actual);
+        DLOG(TC_RESET"Set    speed: %d%%\r\n", set->speed);
+        if(fan_ramp.active)
+        {
+            DLOG(TC_RESET"Ramp:         %u ms\r\n", set->ramp_ms);
+        }
+        DLOG(TC_RESET"Actual speed: %d%%\r\n", speed_actual);
     }
 
     return res;
@@ -140,19 +512,52 @@ static bool set_fan_speed(int set_speed)
 
 /**
  * @brief Handler for "get_fan_speed" command
- * @param[in] not used
+ * @param[in] Args_GetFanSpeed_t: oldest cached reading accepted in ms, -1 (no value) accepts any from the current gate
  */
-static bool get_fan_speed(int var)
+static bool get_fan_speed(const void *args)
 {
+    int32_t max_age_ms = ((const Args_GetFanSpeed_t *)args)->max_age_ms;
     uint8_t speed_actual = 0;
+    uint16_t rpm = 0;
+    MAX6650_ReadInfo_t info;
+#if TACH_CAPTURE
+    uint16_t tach_rpm;
+    Tach_Info_t tach;
+#endif
     bool res;
 
-    res = MAX6650_GetSpeed(&speed_actual);
-    printf(TC_RESET"Status: %s\r\n", get_status(res));
+    res = MAX6650_GetSpeed(&speed_actual, (max_age_ms < 0) ? MAX6650_MAX_AGE_GATE : (uint32_t)max_age_ms, &info);
+    if(res!=false)
+    {
+        /* Same tach count, the cache has it now */
+        res = MAX6650_GetRPM(&rpm, MAX6650_MAX_AGE_GATE, NULL);
+    }
+    DLOG(TC_RESET"Status: %s\r\n", get_status(res));
 
     if(res!=false)
     {
-        printf(TC_RESET"Actual speed: %d%%\r\n", speed_actual);
+        if(info.cached)
+        {
+            DLOG(TC_RESET"Source:       cache, %lu ms old\r\n", info.age_ms);
+        }
+        else
+        {
+            DLOG(TC_RESET"Source:       I2C\r\n");
+        }
+        /* "Actual speed" goes last, host/fleet takes it as the end of the reply */
+        DLOG(TC_RESET"Fan RPM:      %u\r\n", rpm);
+#if TACH_CAPTURE
+        /* One reading per revolution from the tach edges, next to the MAX6650 count per gate */
+        if(Tach_GetRPM(&tach_rpm, &tach) != false)
+        {
+            DLOG(TC_RESET"Tach RPM:     %u, %lu us per revolution\r\n", tach_rpm, tach.period_us);
+        }
+        else
+        {
+            DLOG(TC_RESET"Tach RPM:     0, stalled %lu ms\r\n", tach.age_us / 1000);
+        }
+#endif
+        DLOG(TC_RESET"Actual speed: %d%%\r\n", speed_actual);
     }
 
     return res;
@@ -160,99 +565,914 @@ static bool get_fan_speed(int var)
 
 
 /**
- * @brief Handler for "self_erase" command
- * @param[in] not used
+ * @brief Handler for "stream" command
+ * @param[in] Args_Stream_t: sample rate in Hz
  */
-static bool self_erase(int var)
+static bool stream(const void *args)
 {
-    char value;
-    bool wait_for_op = true;
+    uint16_t rate_hz = ((const Args_Stream_t *)args)->rate_hz;
+    Stream_Stats_t stats;
 
-    printf(TC_RED"*WARNING: this operation is irreversible!\r\n");
+    DLOG(TC_RESET"Streaming at %d Hz, press Ctrl+C to stop\r\n", rate_hz);
+    /* Text must be out before the binary frames */
+    DLog_Flush();
+    UartAPI_FlushReply();
 
+    Stream_Run(rate_hz);
+    Stream_GetStats(&stats);
 
-    while(wait_for_op)
+    DLOG(TC_RESET"\r\nSamples: %lu, dropped: %lu, overruns: %lu\r\n", stats.samples, stats.dropped, stats.overruns);
+    DLOG(TC_RESET"Sent %lu bytes in %lu ms\r\n", stats.bytes, stats.duration_ms);
+
+    return true;
+}
+
+
+static void print_archive_sample(const Archive_Sample_t *sample)
+{
+    if(sample->temperature == ARCHIVE_NO_TEMPERATURE)
     {
-        printf(TC_YELLOW"\r\nPlease, type [Y] to confirm or [N] to reject the ERASE operation: "TC_RESET);
-        fflush(stdout);
-        fflush(stdin);
-        scanf("%c", &value);
-        switch(value)
-        {
-            case 'y':
-            case 'Y':
-                printf(TC_YELLOW"\r\nOperation accepted\r\n");
-                __disable_irq();
-                mass_erase_from_ram();
-                break;
+        printf("%lu,%u,%u,-\r\n", sample->time, sample->rpm, sample->speed);
+    }
+    else
+    {
+        printf("%lu,%u,%u,%s%d.%d\r\n", sample->time, sample->rpm, sample->speed, (sample->temperature < 0) ? "-" : "",
+                abs(sample->temperature) / 10, abs(sample->temperature) % 10);
+    }
+}
 
-            case 'n':
-            case 'N':
-                printf(TC_YELLOW"\r\nOperation declined\r\n");
-                wait_for_op = false;
-                break;
+/**
+ * @brief Handler for "history" command
+ * @param[in] Args_History_t: time range in seconds, -1 (no value) for the start prints the archive state,
+ *            for the end selects now. An end before the start is refused
+ */
+static bool history(const void *args)
+{
+    const Args_History_t *range = args;
+    Archive_Status_t status;
+    Archive_QueryResult_t result;
+    int32_t from = range->from_s;
+    int32_t to = range->to_s;
 
-            default:
-                wait_for_op = true;
-                break;
-        }
+    Archive_GetStatus(&status);
+
+    if(from < 0)
+    {
+        printf(TC_RESET"Archive time: %lu s\r\n", status.now);
+        printf(TC_RESET"Oldest:       %lu s\r\n", status.oldest_time);
+        printf(TC_RESET"Pages:        %u/%u\r\n", status.pages_used, status.pages_total);
+        printf(TC_RESET"Pending:      %u samples\r\n", status.pending_samples);
+        printf(TC_RESET"Write errors: %lu\r\n", status.write_errors);
+        printf(TC_RESET"Read errors:  %lu\r\n", status.read_errors);
+        printf(TC_RESET"Boot scan:    %lu us\r\n", status.recovery_us);
+        return true;
+    }
+
+    if(to < 0)
+    {
+        to = status.now;
+    }
+    else if(to < from)
+    {
+        printf(TC_RED"The range ends at %ld s, before its start at %ld s\r\n"TC_RESET, to, from);
+        return false;
     }
 
+    printf(TC_RESET"time_s,rpm,speed,temperature\r\n");
+    Archive_Query(from, to, print_archive_sample, &result);
+    printf(TC_RESET"Samples: %lu, pages: %u, blocks decoded: %u, skipped: %u\r\n",
+            result.samples, result.pages_visited, result.blocks_decoded, result.blocks_skipped);
+
     return true;
 }
 
-static bool help(int var)
+
+/**
+ * @brief Handler for "get_temperature" command
+ * @param[in] not used
+ */
+static bool get_temperature(const void *args)
 {
-    UartAPI_PrintMenu();
-    return true;
+    HTS221_Data_t data;
+    bool ready = false;
+    bool res;
+    uint32_t start = HAL_GetTick();
+
+    res = HTS221_StartConversion();
+    while((res == true) && (ready != true) && ((HAL_GetTick() - start) < HTS221_CONVERSION_TIMEOUT_MS))
+    {
+        res = HTS221_Read(&data, &ready);
+    }
+    res = res && ready;
+
+    DLOG(TC_RESET"Status: %s\r\n", get_status(res));
+
+    if(res!=false)
+    {
+        DLOG(TC_RESET"Temperature: %s%d.%d C\r\n", (data.temperature < 0) ? "-" : "",
+             abs(data.temperature) / 10, abs(data.temperature) % 10);
+        DLOG(TC_RESET"Humidity:    %d.%d %%\r\n", data.humidity / 10, data.humidity % 10);
+    }
+
+    return res;
 }
 
-static bool max6650_init()
+/**
+ * @brief Handler for "thermal" command
+ * @param[in] Args_Thermal_t: update period in ms, 0 disables the loop, -1 (no value) enables it with the default period
+ */
+static bool thermal(const void *args)
 {
-    bool res;
+    int32_t period_ms = ((const Args_Thermal_t *)args)->period_ms;
+    Thermal_Status_t thermal_status;
 
-    max6650_config = (MAX6650_Config_t *) malloc(sizeof(MAX6650_Config_t));
-    if(max6650_config == NULL)
+    /* The loop takes over the fan */
+    if(period_ms != 0)
     {
-        printf(TC_RED"MAX6650 config: no memory\r\n");
-        return false;
+        fan_ramp.active = false;
     }
 
-    /* MAX6650/fan configuration */
-    max6650_config->add_line_connection = ADD_Line_GND;
-    max6650_config->rpm_max = 10500U;
-    max6650_config->fan_lovtage = FanVoltage_12V;
-    max6650_config->operating_mode = OperatingMode_Closed_Loop;
-    /* Select the KScale value so the fan’s full speed is achieved with a speed register value of approximately 64
-     * Fan-Speed Register value (KTACH) may be calculated as:
-     * tTACH = 1 / (2 x Fan Speed[RPS])
-     * KTACH = [tTACH x KSCALE x (fCLK / 128)] - 1
-     *
-     * KSCALE=11.5 for 10500 RPM, so choosing scale=KScale_16, in this case KTACH=90 at max speed (should be less than 128)*/
-    max6650_config->k_scale = KScale_16;
+    if(period_ms < 0)
+    {
+        Thermal_Enable();
+    }
+    else
+    {
+        Thermal_SetUpdatePeriod((uint32_t)period_ms);
+    }
 
-    res = MAX6650_Init(max6650_config, &max6650_i2c_ext_interface);
+    Thermal_GetStatus(&thermal_status);
+    DLOG(TC_RESET"Thermal control: %s\r\n", thermal_status.enabled ? "ON" : "OFF");
 
-    if(res != true)
+    if(thermal_status.enabled)
     {
-        printf(TC_RED"MAX6650 initialization error!\r\n");
-        return false;
+        DLOG(TC_RESET"Update period: %lu ms\r\n", thermal_status.update_period_ms);
+    }
+
+    if(thermal_status.valid)
+    {
+        DLOG(TC_RESET"Temperature: %s%d.%d C\r\n", (thermal_status.temperature < 0) ? "-" : "",
+             abs(thermal_status.temperature) / 10, abs(thermal_status.temperature) % 10);
+        DLOG(TC_RESET"Fan speed:   %d%%\r\n", thermal_status.speed);
     }
 
     return true;
 }
 
 
-bool UserFunctions_Init(void)
+/**
+ * @brief Handler for "get_vibration" command
+ * @param[in] not used
+ */
+static bool get_vibration(const void *args)
 {
+    Vibration_Status_t vibration_status;
     bool res;
 
-    res = max6650_init();
+    Vibration_GetStatus(&vibration_status);
+    res = vibration_status.valid;
+    DLOG(TC_RESET"Status: %s\r\n", get_status(res));
+
+    if(res!=false)
+    {
+        DLOG(TC_RESET"Fan speed:      %u rpm\r\n", vibration_status.fan_rpm);
+        DLOG(TC_RESET"Rotation peak:  %u mg @ %u.%u Hz\r\n", vibration_status.rotation_amplitude,
+                vibration_status.rotation_freq / 10, vibration_status.rotation_freq % 10);
+        DLOG(TC_RESET"Spectrum peak:  %u mg @ %u.%u Hz\r\n", vibration_status.peak_amplitude,
+                vibration_status.peak_freq / 10, vibration_status.peak_freq % 10);
+        DLOG(TC_RESET"RMS:            %u mg\r\n", vibration_status.rms);
+        DLOG(TC_RESET"Blocks:         %lu (%u samples @ %u Hz)\r\n", vibration_status.blocks,
+                VIBRATION_FFT_LENGTH, vibration_status.sample_rate);
+        DLOG(TC_RESET"FFT cycles:     %lu\r\n", vibration_status.fft_cycles);
+        DLOG(TC_RESET"Block cycles:   %lu\r\n", vibration_status.analysis_cycles);
+    }
 
     return res;
 }
 
 
+/**
+ * @brief Handler for "i2c_errors" command
+ * @param[in] not used
+ */
+static bool i2c_errors(const void *args)
+{
+    I2C_API_ErrorCounters_t counters;
+
+    I2C_API_GetErrorCounters(&counters);
+
+    for(uint8_t i = 0; i < I2C_API_Error_Count; i++)
+    {
+        DLOG(TC_RESET"%-12s %lu\r\n", I2C_API_GetErrorName(i), counters.errors[i]);
+    }
+    DLOG(TC_RESET"Retries:     %lu\r\n", counters.retries);
+    DLOG(TC_RESET"Failures:    %lu\r\n", counters.failures);
+    DLOG(TC_RESET"Resets:      %lu\r\n", counters.resets);
+    DLOG(TC_RESET"Bus clears:  %lu\r\n", counters.bus_clears);
+    DLOG(TC_RESET"Re-inits:    %lu\r\n", counters.reinits);
+
+    return true;
+}
+
+
+/**
+ * @brief Handler for "scan" command
+ * @param[in] not used
+ */
+static bool scan(const void *args)
+{
+    const I2C_DevMap_Entry_t *entry;
+    uint8_t count;
+
+    count = I2C_DevMap_Scan();
+
+    for(uint8_t i = 0; i < count; i++)
+    {
+        entry = I2C_DevMap_GetEntry(i);
+        DLOG(TC_RESET"0x%02X (7-bit 0x%02X): %s\r\n", entry->address, entry->address >> 1, I2C_DevMap_GetName(entry->type));
+    }
+    DLOG(TC_RESET"Devices found: %d\r\n", count);
+    DLOG(TC_RESET"Scan time: %lu us\r\n", I2C_DevMap_GetScanTime());
+
+    return true;
+}
+
+
+/**
+ * @brief Handler for "i2c_stats" command
+ * @param[in] not used
+ */
+static bool i2c_stats(const void *args)
+{
+    const I2C_API_AddressStats_t *stats;
+    uint32_t transfers;
+    uint8_t last_bucket;
+
+    for(uint8_t i = 0; i < I2C_API_STATS_SLOTS; i++)
+    {
+        stats = I2C_API_GetStats(i);
+        if(stats == NULL)
+        {
+            continue;
+        }
+
+        transfers = stats->reads + stats->writes;
+        DLOG(TC_CYAN"Address 0x%02X\r\n"TC_RESET, stats->address);
+        DLOG("  Reads/writes: %lu/%lu, bytes: %lu\r\n", stats->reads, stats->writes, stats->bytes);
+        DLOG("  Latency avg/max: %lu/%lu us\r\n", transfers ? stats->latency_total_us / transfers : 0, stats->latency_max_us);
+        DLOG("  Retries: %lu, failures: %lu\r\n", stats->retries, stats->failures);
+        DLOG("  Errors:");
+        for(uint8_t e = 0; e < I2C_API_Error_Count; e++)
+        {
+            DLOG(" %s %lu", I2C_API_GetErrorName(e), stats->errors[e]);
+        }
+        DLOG("\r\n  Latency histogram (us):");
+
+        last_bucket = 0;
+        for(uint8_t b = 0; b < I2C_API_LATENCY_BUCKETS; b++)
+        {
+            if(stats->latency_histogram[b] != 0)
+            {
+                last_bucket = b;
+            }
+        }
+        for(uint8_t b = 0; b <= last_bucket; b++)
+        {
+            DLOG(" <%lu:%lu", 2UL << b, stats->latency_histogram[b]);
+        }
+        DLOG("\r\n");
+    }
+
+    return true;
+}
+
+/**
+ * @brief Handler for "i2c_reset_stats" command
+ * @param[in] not used
+ */
+static bool i2c_reset_stats(const void *args)
+{
+    I2C_API_ResetStats();
+    I2C_API_ResetErrorCounters();
+    DLOG(TC_RESET"I2C metrics are reset\r\n");
+
+    return true;
+}
+
+
+/**
+ * @brief Handler for "dlog_stats" command
+ * @param[in] not used
+ */
+static bool dlog_stats(const void *args)
+{
+    DLog_Stats_t stats;
+
+    DLog_GetStats(&stats);
+
+    printf(TC_RESET"Deferred logging: %s\r\n", DLOG_ENABLED ? "ON" : "OFF");
+    printf(TC_RESET"Records:    %lu\r\n", stats.records);
+    printf(TC_RESET"Dropped:    %lu\r\n", stats.dropped);
+    printf(TC_RESET"Cycles avg: %lu\r\n", stats.records ? stats.cycles_total / stats.records : 0);
+    printf(TC_RESET"Cycles max: %lu\r\n", stats.cycles_max);
+
+    return true;
+}
+
+
+/**
+ * @brief Handler for "boot_times" command
+ * @param[in] not used
+ */
+static bool boot_times(const void *args)
+{
+    uint32_t time_us;
+    uint32_t prev_us = 0;
+
+    printf(TC_RESET"Fast boot: %s\r\n", FAST_BOOT ? "ON" : "OFF");
+    printf(TC_RESET"%-14s %10s %10s\r\n", "Phase", "End, us", "Took, us");
+    for(uint8_t phase = 0; phase < Boot_Phase_Count; phase++)
+    {
+        if(Boot_GetTime(phase, &time_us) != true)
+        {
+            printf(TC_RESET"%-14s %10s\r\n", Boot_GetPhaseName(phase), "-");
+            continue;
+        }
+        printf(TC_RESET"%-14s %10lu %10lu\r\n", Boot_GetPhaseName(phase), time_us, time_us - prev_us);
+        prev_us = time_us;
+    }
+
+    printf(TC_RESET"\r\nDevice init tasks:\r\n");
+    for(uint8_t i = 0; i < init_next; i++)
+    {
+        printf(TC_RESET"%-14s %10lu us %s\r\n", init_tasks[i].name, init_tasks[i].time_us, get_status(init_tasks[i].res));
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Run one CRC computation
+ * @param[out] cycles CPU cycles spent
+ */
+static uint32_t crc_bench_run(Crc_Type_t type, Crc_Backend_t backend, uint32_t len, uint32_t *cycles)
+{
+    Crc_Context_t ctx;
+    uint32_t start = CycleCounter_Get();
+
+    Crc_Start(&ctx, type, backend);
+    Crc_Update(&ctx, (const void *)FLASH_BASE, len);
+    *cycles = CycleCounter_Get() - start;
+
+    return Crc_Finish(&ctx);
+}
+
+
+/**
+ * @brief Handler for "crc_bench" command
+ * @param[in] not used
+ */
+static bool crc_bench(const void *args)
+{
+    static const char *type_names[Crc_Type_Count] = {"CCITT16", "CRC32"};
+    uint32_t crc[Crc_Backend_Count];
+    uint32_t cycles[Crc_Backend_Count];
+    uint32_t mb_s_x10[Crc_Backend_Count];
+    bool res = true;
+
+    /* The input is the flash contents, up to both banks */
+    printf(TC_RESET"%-8s %-8s %10s %7s %10s %7s %s\r\n", "Size", "Type", "HW cycles", "HW MB/s", "SW cycles", "SW MB/s", "Match");
+
+    for(uint32_t len = CRC_BENCH_MIN_SIZE; len <= CRC_BENCH_MAX_SIZE; len *= 4)
+    {
+        for(uint8_t type = 0; type < Crc_Type_Count; type++)
+        {
+            for(uint8_t backend = 0; backend < Crc_Backend_Count; backend++)
+            {
+                crc[backend] = crc_bench_run(type, backend, len, &cycles[backend]);
+                mb_s_x10[backend] = (uint64_t)len * (SystemCoreClock / 100000U) / (cycles[backend] ? cycles[backend] : 1);
+            }
+
+            printf(TC_RESET"%-8lu %-8s %10lu %5lu.%lu %10lu %5lu.%lu %s\r\n", len, type_names[type],
+                    cycles[Crc_Backend_Hardware], mb_s_x10[Crc_Backend_Hardware] / 10, mb_s_x10[Crc_Backend_Hardware] % 10,
+                    cycles[Crc_Backend_Software], mb_s_x10[Crc_Backend_Software] / 10, mb_s_x10[Crc_Backend_Software] % 10,
+                    get_status(crc[Crc_Backend_Hardware] == crc[Crc_Backend_Software]));
+            res = res && (crc[Crc_Backend_Hardware] == crc[Crc_Backend_Software]);
+        }
+    }
+
+    return res;
+}
+
+
+/**
+ * @brief Handler for "uart_bench" command
+ * @param[in] Args_UartBench_t: block size, rounded up to whole pattern lines
+ */
+static bool uart_bench(const void *args)
+{
+    static const char *path_names[UartAPI_TxPath_Count] = {"HAL", "TC", "TXE"};
+    const Args_UartBench_t *a = args;
+    uint32_t lines = (a->bytes + UART_BENCH_LINE_LENGTH - 1) / UART_BENCH_LINE_LENGTH;
+    uint32_t len = lines * UART_BENCH_LINE_LENGTH;
+    uint32_t baud = UartAPI_GetBaudRate();
+    uint32_t cycles[UartAPI_TxPath_Count];
+    uint32_t start;
+
+    /* The blocks go straight to the USART, what was printed before goes first */
+    UartAPI_FlushReply();
+
+    for(uint8_t path = 0; path < UartAPI_TxPath_Count; path++)
+    {
+        start = CycleCounter_Get();
+        for(uint32_t i = 0; i < lines; i++)
+        {
+            UartAPI_SendRaw(path, UART_BENCH_LINE, UART_BENCH_LINE_LENGTH);
+        }
+        cycles[path] = CycleCounter_Get() - start;
+    }
+
+    /* 8N1: 10 bits per byte on the line */
+    printf(TC_RESET"\r\nBaud rate: %lu, %lu bytes, line limit %lu B/s, %lu cycles/B\r\n", baud, len, baud / 10,
+            (uint32_t)((uint64_t)SystemCoreClock * 10 / baud));
+    printf(TC_RESET"%-6s %10s %10s %10s\r\n", "Path", "Cycles", "Cycles/B", "B/s");
+    for(uint8_t path = 0; path < UartAPI_TxPath_Count; path++)
+    {
+        printf(TC_RESET"%-6s %10lu %10lu %10lu\r\n", path_names[path], cycles[path], cycles[path] / len,
+                (uint32_t)((uint64_t)len * SystemCoreClock / (cycles[path] ? cycles[path] : 1)));
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Handler for "i2c_bench" command
+ * @param[in] Args_I2CBench_t: register reads per path and bus speed
+ */
+static bool i2c_bench(const void *args)
+{
+    static const uint32_t speeds[] = {I2C_API_SPEED_STANDARD, I2C_API_SPEED_FAST};
+    static const char *path_names[] = {"HAL", "Direct"};
+    bool (*const paths[])(uint8_t, uint8_t, uint8_t *, uint16_t) = {I2C_API_ReadMultiple, I2C_API_ReadDirect};
+    const Args_I2CBench_t *a = args;
+    uint32_t saved_speed = I2C_API_GetSpeed();
+    uint32_t bus_cycles, cycles, start;
+    uint8_t address, value;
+    bool res = true;
+
+    if(I2C_DevMap_Find(I2C_Device_MAX6650, &address) != true)
+    {
+        printf(TC_RED"MAX6650 is not found on the bus\r\n"TC_RESET);
+        return false;
+    }
+
+    /* Overhead: CPU time of a 1-byte register read beyond its bit times on the bus */
+    printf(TC_RESET"%-6s %-6s %10s %10s %14s\r\n", "kHz", "Path", "us/read", "Cycles", "Overhead cyc");
+    for(uint8_t s = 0; s < sizeof(speeds) / sizeof(speeds[0]); s++)
+    {
+        I2C_API_SetSpeed(speeds[s]);
+        bus_cycles = (uint32_t)((uint64_t)I2C_BENCH_READ_BITS * SystemCoreClock / speeds[s]);
+
+        for(uint8_t p = 0; p < sizeof(paths) / sizeof(paths[0]); p++)
+        {
+            start = CycleCounter_Get();
+            for(uint16_t i = 0; i < a->count; i++)
+            {
+                res = paths[p](address, I2C_BENCH_REG, &value, 1) && res;
+            }
+            cycles = (CycleCounter_Get() - start) / a->count;
+
+            printf(TC_RESET"%-6lu %-6s %10lu %10lu %14ld\r\n", speeds[s] / 1000, path_names[p], CYCLES_TO_US(cycles),
+                    cycles, (int32_t)(cycles - bus_cycles));
+        }
+    }
+    I2C_API_SetSpeed(saved_speed);
+
+    printf(TC_RESET"Status: %s\r\n", get_status(res));
+    return res;
+}
+
+
+/**
+ * @brief Callback of the timer_bench event, runs in the TIM2 interrupt
+ */
+static void timer_bench_callback(void *context)
+{
+    Timer_Bench_t *bench = context;
+    uint32_t cycles = CycleCounter_Get();
+    int32_t deviation;
+
+    if(bench->calls != 0)
+    {
+        deviation = (int32_t)(cycles - bench->last_cycles - bench->period_us * (SystemCoreClock / 1000000U));
+        if((bench->calls == 1) || (deviation < bench->deviation_min))
+        {
+            bench->deviation_min = deviation;
+        }
+        if((bench->calls == 1) || (deviation > bench->deviation_max))
+        {
+            bench->deviation_max = deviation;
+        }
+    }
+    bench->last_cycles = cycles;
+    bench->calls++;
+
+    if(bench->calls >= bench->count)
+    {
+        Timebase_Stop(&bench->event);
+    }
+    else if(bench->one_shot)
+    {
+        Timebase_Start(&bench->event, bench->period_us, 0, timer_bench_callback, bench);
+    }
+}
+
+/**
+ * @brief Handler for "timer_bench" command
+ * @param[in] Args_TimerBench_t: event period and number of calls
+ */
+static bool timer_bench(const void *args)
+{
+    static const char *mode_names[] = {"Periodic", "One-shot"};
+    static Timer_Bench_t bench;
+    const Args_TimerBench_t *a = args;
+    uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+    uint32_t start, cycles, min_cycles = UINT32_MAX, max_cycles = 0;
+    uint32_t late_avg;
+    uint64_t deadline;
+    bool res = true;
+
+    for(uint16_t i = 0; i < TIMER_BENCH_NOW_CALLS; i++)
+    {
+        start = CycleCounter_Get();
+        (void)Timebase_NowUs();
+        cycles = CycleCounter_Get() - start;
+        min_cycles = (cycles < min_cycles) ? cycles : min_cycles;
+        max_cycles = (cycles > max_cycles) ? cycles : max_cycles;
+    }
+    printf(TC_RESET"Timebase_NowUs: %lu..%lu cycles, uptime %lu ms\r\n", min_cycles, max_cycles,
+            (uint32_t)(Timebase_NowUs() / 1000));
+
+    /* Late: deadline to call, 1 us resolution. Jitter: interval between calls - period */
+    printf(TC_RESET"%-9s %6s %9s %9s %9s %11s %11s %9s\r\n", "Mode", "Calls", "Late min", "Late avg", "Late max",
+            "Jitter- ns", "Jitter+ ns", "Overruns");
+    for(uint8_t mode = 0; mode < sizeof(mode_names) / sizeof(mode_names[0]); mode++)
+    {
+        memset(&bench, 0, sizeof(bench));
+        bench.period_us = a->period_us;
+        bench.count = a->count;
+        bench.one_shot = (mode == 1);
+
+        Timebase_Start(&bench.event, a->period_us, bench.one_shot ? 0 : a->period_us, timer_bench_callback, &bench);
+        /* Twice the run time before giving up */
+        deadline = Timebase_NowUs() + 2ULL * a->count * a->period_us;
+        while((bench.calls < a->count) && (Timebase_NowUs() < deadline))
+        {
+        }
+        Timebase_Stop(&bench.event);
+        res = res && (bench.calls >= a->count);
+
+        late_avg = (bench.event.calls != 0) ? (uint32_t)(bench.event.late_total_us / bench.event.calls) : 0;
+        printf(TC_RESET"%-9s %6u %9lu %9lu %9lu %11ld %11ld %9lu\r\n", mode_names[mode], bench.calls,
+                bench.event.late_min_us, late_avg, bench.event.late_max_us,
+                (long)((int64_t)bench.deviation_min * 1000 / (int32_t)cycles_per_us),
+                (long)((int64_t)bench.deviation_max * 1000 / (int32_t)cycles_per_us),
+                bench.event.overruns);
+    }
+
+    printf(TC_RESET"Status: %s\r\n", get_status(res));
+    return res;
+}
+
+
+/**
+ * @brief Handler for "update" command
+ * @param[in] not used
+ */
+static bool update(const void *args)
+{
+    Update_Stats_t stats;
+
+    printf(TC_RESET"Running from bank %d, waiting for the image..\r\n", FlashAPI_IsBankSwapped() ? 2 : 1);
+    /* Text must be out before the binary replies */
+    DLog_Flush();
+    UartAPI_FlushReply();
+
+    Update_Run();
+    Update_GetStats(&stats);
+
+    printf(TC_RESET"\r\nStatus: %d, %lu bytes, %lu chunks in %lu ms (erase %lu ms)\r\n",
+            stats.status, stats.length, stats.chunks, stats.duration_ms, stats.erase_ms);
+    printf(TC_RESET"Duplicates: %lu, NAKs: %lu, RX overflows: %lu\r\n", stats.duplicates, stats.naks, stats.rx_overflows);
+
+    if(stats.status != Update_Status_OK)
+    {
+        return false;
+    }
+
+    printf(TC_YELLOW"Rebooting from bank %d\r\n"TC_RESET, FlashAPI_IsBankSwapped() ? 1 : 2);
+    UartAPI_FlushReply();
+    return Update_SwapBank();
+}
+
+
+/**
+ * @brief Handler for "rollback" command
+ * @param[in] not used
+ */
+static bool rollback(const void *args)
+{
+    if(Update_IsOtherBankValid() != true)
+    {
+        printf(TC_RED"No valid firmware in the other bank\r\n"TC_RESET);
+        return false;
+    }
+
+    printf(TC_YELLOW"Rebooting from bank %d\r\n"TC_RESET, FlashAPI_IsBankSwapped() ? 1 : 2);
+    UartAPI_FlushReply();
+    return Update_SwapBank();
+}
+
+
+/**
+ * @brief Handler for "self_erase" command
+ * @param[in] not used
+ */
+static bool self_erase(const void *args)
+{
+    char value;
+    bool wait_for_op = true;
+
+    printf(TC_RED"*WARNING: this operation is irreversible!\r\n");
+
+
+    while(wait_for_op)
+    {
+        printf(TC_YELLOW"\r\nPlease, type [Y] to confirm or [N] to reject the ERASE operation: "TC_RESET);
+        UartAPI_FlushReply();
+        fflush(stdin);
+        scanf("%c", &value);
+        switch(value)
+        {
+            case 'y':
+            case 'Y':
+                printf(TC_YELLOW"\r\nOperation accepted\r\n");
+                __disable_irq();
+                mass_erase_from_ram();
+                break;
+
+            case 'n':
+            case 'N':
+                printf(TC_YELLOW"\r\nOperation declined\r\n");
+                wait_for_op = false;
+                break;
+
+            default:
+                wait_for_op = true;
+                break;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Handler for "quiet" command
+ * @param[in] Args_Quiet_t: 1 suppresses the banner and the echo, 0 brings them back
+ */
+static bool quiet(const void *args)
+{
+    UartAPI_SetQuiet(((const Args_Quiet_t *)args)->enable != 0);
+    DLOG(TC_RESET"Status: %s\r\n", get_status(true));
+    return true;
+}
+
+/**
+ * @brief Handler for "baud" command
+ * @param[in] Args_Baud_t: new console rate, 0 arms auto baud rate detection
+ */
+static bool baud(const void *args)
+{
+    bool res = UartAPI_SwitchBaudRate(((const Args_Baud_t *)args)->rate);
+
+    DLOG(TC_RESET"Status: %s\r\n", get_status(res));
+    return res;
+}
+
+static bool help(const void *args)
+{
+    UartAPI_PrintMenu();
+    return true;
+}
+
+/**
+ * @brief Get ADD line connection from the MAX6650 address found on the bus
+ */
+static bool max6650_get_add_line(MAX6650_ADDLineConn_t *add_line)
+{
+    uint8_t address;
+
+    if(I2C_DevMap_Find(I2C_Device_MAX6650, &address) != true)
+    {
+        return false;
+    }
+
+    switch(address)
+    {
+        case MAX6650_I2C_ADDRESS_GND: *add_line = ADD_Line_GND; break;
+        case MAX6650_I2C_ADDRESS_VCC: *add_line = ADD_Line_Vcc; break;
+        case MAX6650_I2C_ADDRESS_NOT_CONNECTED: *add_line = ADD_Line_NotConnected; break;
+        case MAX6650_I2C_ADDRESS_RES10K: *add_line = ADD_Line_Res10K; break;
+        default: return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Drivers take addresses from the device map instead of probing
+ */
+static bool devmap_init(void)
+{
+#if FAST_BOOT
+    /* A few probes instead of the whole address range */
+    I2C_DevMap_ScanKnown();
+#else
+    I2C_DevMap_Scan();
+#endif
+
+    return true;
+}
+
+
+static bool max6650_init()
+{
+    bool res;
+    MAX6650_ADDLineConn_t add_line;
+
+    if(max6650_get_add_line(&add_line) != true)
+    {
+        DLOG(TC_RED"MAX6650 is not found on the bus!\r\n");
+        return false;
+    }
+
+    max6650_config = (MAX6650_Config_t *) malloc(sizeof(MAX6650_Config_t));
+    if(max6650_config == NULL)
+    {
+        DLOG(TC_RED"MAX6650 config: no memory\r\n");
+        return false;
+    }
+
+    /* MAX6650/fan configuration */
+    max6650_config->add_line_connection = add_line;
+    max6650_config->rpm_max = 10500U;
+    max6650_config->fan_lovtage = FanVoltage_12V;
+    max6650_config->operating_mode = OperatingMode_Closed_Loop;
+    /* Select the KScale value so the fan’s full speed is achieved with a speed register value of approximately 64
+     * Fan-Speed Register value (KTACH) may be calculated as:
+     * tTACH = 1 / (2 x Fan Speed[RPS])
+     * KTACH = [tTACH x KSCALE x (fCLK / 128)] - 1
+     *
+     * KSCALE=11.5 for 10500 RPM, so choosing scale=KScale_16, in this case KTACH=90 at max speed (should be less than 128)*/
+    max6650_config->k_scale = KScale_16;
+
+    res = MAX6650_Init(max6650_config, &max6650_i2c_ext_interface);
+
+    if(res != true)
+    {
+        DLOG(TC_RED"MAX6650 initialization error!\r\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool hts221_init()
+{
+    bool res;
+
+    if(I2C_DevMap_Find(I2C_Device_HTS221, &hts221_config.i2c_address) != true)
+    {
+        DLOG(TC_RED"HTS221 is not found on the bus!\r\n");
+        return false;
+    }
+
+    res = HTS221_Init(&hts221_config, &hts221_i2c_ext_interface);
+
+    if(res != true)
+    {
+        DLOG(TC_RED"HTS221 initialization error!\r\n");
+        return false;
+    }
+
+    res = Thermal_Init(&thermal_config);
+
+    if(res != true)
+    {
+        DLOG(TC_RED"Thermal control initialization error!\r\n");
+    }
+
+    return res;
+}
+
+
+static bool lsm6dsl_init()
+{
+    bool res;
+
+    if(I2C_DevMap_Find(I2C_Device_LSM6DSL, &lsm6dsl_config.i2c_address) != true)
+    {
+        DLOG(TC_RED"LSM6DSL is not found on the bus!\r\n");
+        return false;
+    }
+
+    res = LSM6DSL_Init(&lsm6dsl_config, &lsm6dsl_i2c_ext_interface);
+
+    if(res != true)
+    {
+        DLOG(TC_RED"LSM6DSL initialization error!\r\n");
+        return false;
+    }
+
+    return Vibration_Init(&vibration_config);
+}
+
+
+static bool archive_init(void)
+{
+    return Archive_Init(&archive_config);
+}
+
+
+/**
+ * @brief Run the next device init task
+ * @retval result of the task
+ */
+static bool run_init_task(void)
+{
+    Init_Task_t *task = &init_tasks[init_next++];
+    uint32_t start = CycleCounter_Get();
+
+    task->res = task->run();
+    task->time_us = CYCLES_TO_US(CycleCounter_Get() - start);
+
+    if(init_next == INIT_TASKS_COUNT)
+    {
+        Boot_Mark(Boot_Phase_Deferred);
+    }
+
+    return task->res;
+}
+
+
+bool UserFunctions_Init(void)
+{
+    bool res = true;
+
+#if !FAST_BOOT
+    while(init_next < INIT_TASKS_COUNT)
+    {
+        res = run_init_task() && res;
+    }
+#endif
+
+    DLog_Flush();
+
+    return res;
+}
+
+
+void UserFunctions_CompleteInit(void)
+{
+    while(init_next < INIT_TASKS_COUNT)
+    {
+        run_init_task();
+    }
+}
+
+
+void UserFunctions_Process(void)
+{
+    /* One init task per call, the console stays responsive */
+    if(init_next < INIT_TASKS_COUNT)
+    {
+        run_init_task();
+        DLog_Flush();
+        return;
+    }
+
+    fan_ramp_process();
+    Thermal_Process();
+    Vibration_Process();
+    Archive_Process();
+    DLog_Flush();
+}
+
+
 inline uint8_t UserFunctions_GetFuncCount()
 {
     return COMMANDS_COUNT;
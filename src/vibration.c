@@ -0,0 +1,230 @@
+#include <stddef.h>
+#include <math.h>
+
+#include "stm32l4xx_hal.h"
+#include "vibration.h"
+#include "fft_q15.h"
+#include "cycle_counter.h"
+#include "lsm6dsl.h"
+#include "max6650.h"
+
+/* Samples drained from the FIFO per idle loop call, keeps the console responsive */
+#define DRAIN_CHUNK_SAMPLES     16
+
+/* Hann window coherent gain (1/2), one-sided spectrum (1/2) and input prescale (1/2) */
+#define AMPLITUDE_GAIN          8
+
+typedef enum
+{
+    State_Idle = 0,
+    State_Capture,
+    State_Drain
+} Vibration_State_t;
+
+static const Vibration_Config_t *config = NULL;
+static Vibration_Status_t status;
+static Vibration_State_t state = State_Idle;
+
+static uint32_t block_start_tick;
+static uint32_t capture_time_ms;
+static uint16_t drained;
+
+static int16_t samples[VIBRATION_FFT_LENGTH];
+static int16_t window[VIBRATION_FFT_LENGTH];
+static uint32_t spectrum[VIBRATION_FFT_LENGTH];
+
+
+static uint16_t to_mg(float amplitude_lsb)
+{
+    return (uint16_t)(amplitude_lsb * LSM6DSL_SENSITIVITY_2G_UG / 1000.0f);
+}
+
+
+static uint16_t bin_to_freq(uint16_t bin)
+{
+    return (uint32_t)bin * status.sample_rate * 10 / VIBRATION_FFT_LENGTH;
+}
+
+
+static void analyze_block(void)
+{
+    int32_t mean = 0;
+    int32_t x;
+    uint64_t power = 0;
+    uint32_t magnitude;
+    uint32_t peak = 0;
+    uint32_t rotation_peak = 0;
+    uint16_t peak_bin = 0;
+    uint16_t rotation_bin = 0;
+    uint16_t fan_rpm = 0;
+    uint32_t start;
+    uint32_t fft_start;
+
+    /* Fan speed is read before the analysis to keep the bus transfer out of the cycle count */
+    if(MAX6650_GetRPM(&fan_rpm, MAX6650_MAX_AGE_FRESH, NULL) != true)
+    {
+        fan_rpm = 0;
+    }
+
+    start = CycleCounter_Get();
+
+    for(uint16_t i = 0; i < VIBRATION_FFT_LENGTH; i++)
+    {
+        mean += samples[i];
+    }
+    mean /= VIBRATION_FFT_LENGTH;
+
+    /* Remove DC (gravity), apply window and prescale by 1/2 for headroom */
+    for(uint16_t i = 0; i < VIBRATION_FFT_LENGTH; i++)
+    {
+        x = samples[i] - mean;
+        power += (uint64_t)((int64_t)x * x);
+        spectrum[i] = FFT_Q15_PACK((x * window[i]) >> 16, 0);
+    }
+
+    fft_start = CycleCounter_Get();
+    FFT_Q15_Run(spectrum, VIBRATION_FFT_LENGTH);
+    status.fft_cycles = CycleCounter_Get() - fft_start;
+
+    if(fan_rpm != 0)
+    {
+        rotation_bin = ((uint32_t)fan_rpm * VIBRATION_FFT_LENGTH + 30 * status.sample_rate) / (60 * status.sample_rate);
+    }
+
+    /* Skip DC bin, real input gives a symmetric spectrum */
+    for(uint16_t k = 1; k < VIBRATION_FFT_LENGTH / 2; k++)
+    {
+        magnitude = __SMUAD(spectrum[k], spectrum[k]);
+
+        if(magnitude > peak)
+        {
+            peak = magnitude;
+            peak_bin = k;
+        }
+
+        if((rotation_bin != 0) && (k + 1 >= rotation_bin) && (k <= rotation_bin + 1) && (magnitude > rotation_peak))
+        {
+            rotation_peak = magnitude;
+        }
+    }
+
+    status.analysis_cycles = CycleCounter_Get() - start;
+
+    status.fan_rpm = fan_rpm;
+    status.rotation_freq = fan_rpm / 6;
+    status.rotation_amplitude = to_mg(sqrtf((float)rotation_peak) * AMPLITUDE_GAIN);
+    status.peak_freq = bin_to_freq(peak_bin);
+    status.peak_amplitude = to_mg(sqrtf((float)peak) * AMPLITUDE_GAIN);
+    status.rms = to_mg(sqrtf((float)power / VIBRATION_FFT_LENGTH));
+    status.blocks++;
+    status.valid = true;
+}
+
+
+bool Vibration_Init(const Vibration_Config_t *vibration_config)
+{
+    if(vibration_config == NULL)
+    {
+        return false;
+    }
+
+    config = vibration_config;
+    status.sample_rate = LSM6DSL_GetSampleRate();
+    if(status.sample_rate == 0)
+    {
+        return false;
+    }
+
+    /* Time to collect one block, plus a margin for the ODR tolerance */
+    capture_time_ms = (uint32_t)VIBRATION_FFT_LENGTH * 1000 / status.sample_rate + 2;
+
+    for(uint16_t i = 0; i < VIBRATION_FFT_LENGTH; i++)
+    {
+        window[i] = (int16_t)(32767.0f * 0.5f * (1.0f - cosf(2.0f * (float)M_PI * i / (VIBRATION_FFT_LENGTH - 1))));
+    }
+
+    FFT_Q15_Init();
+
+    block_start_tick = HAL_GetTick() - config->block_period_ms;
+    state = State_Idle;
+
+    return true;
+}
+
+
+void Vibration_GetStatus(Vibration_Status_t *vibration_status)
+{
+    *vibration_status = status;
+}
+
+
+void Vibration_Process(void)
+{
+    LSM6DSL_Sample_t chunk[DRAIN_CHUNK_SAMPLES];
+    uint16_t count;
+
+    if(config == NULL)
+    {
+        return;
+    }
+
+    switch(state)
+    {
+        case State_Idle:
+            if((HAL_GetTick() - block_start_tick) >= config->block_period_ms)
+            {
+                block_start_tick = HAL_GetTick();
+                if(LSM6DSL_FIFO_Restart() == true)
+                {
+                    state = State_Capture;
+                }
+            }
+            break;
+
+        case State_Capture:
+            /* Don't poll FIFO status before the block can be complete */
+            if((HAL_GetTick() - block_start_tick) < capture_time_ms)
+            {
+                break;
+            }
+            if(LSM6DSL_FIFO_GetCount(&count) != true)
+            {
+                state = State_Idle;
+            }
+            else if(count >= VIBRATION_FFT_LENGTH)
+            {
+                drained = 0;
+                state = State_Drain;
+            }
+            break;
+
+        case State_Drain:
+            count = VIBRATION_FFT_LENGTH - drained;
+            if(count > DRAIN_CHUNK_SAMPLES)
+            {
+                count = DRAIN_CHUNK_SAMPLES;
+            }
+
+            if(LSM6DSL_FIFO_Read(chunk, count) != true)
+            {
+                state = State_Idle;
+                break;
+            }
+
+            for(uint16_t i = 0; i < count; i++)
+            {
+                samples[drained++] = ((int16_t *)&chunk[i])[config->axis];
+            }
+
+            if(drained == VIBRATION_FFT_LENGTH)
+            {
+                analyze_block();
+                state = State_Idle;
+            }
+            break;
+
+        default:
+            state = State_Idle;
+            break;
+    }
+}